@@ -0,0 +1,64 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "arena.h"
+
+Arena::Arena(): m_next(nullptr), m_end(nullptr), m_bytes_used(0) {}
+
+Arena::~Arena() {
+	for (const auto block : m_blocks) std::free(block);
+	for (const auto block : m_spare_blocks) std::free(block);
+	for (const auto block : m_large_blocks) std::free(block);
+}
+
+void* Arena::allocate(size_t size, size_t align) {
+	uintptr_t start = (uintptr_t(m_next) + align - 1) & ~uintptr_t(align - 1);
+	if (!m_next || start + size > uintptr_t(m_end)) {
+		// a large request gets a block of its own, so that the rest of the
+		// current block isn't wasted
+		if (size + align > BLOCK_SIZE / 4) {
+			const auto block = static_cast<char*>(std::malloc(size + align));
+			if (!block) throw std::bad_alloc();
+			m_large_blocks.push_back(block);
+			m_bytes_used += size;
+			return reinterpret_cast<void*>((uintptr_t(block) + align - 1) & ~uintptr_t(align - 1));
+		}
+		m_next = new_block();
+		m_end = m_next + BLOCK_SIZE;
+		start = (uintptr_t(m_next) + align - 1) & ~uintptr_t(align - 1);
+	}
+	m_next = reinterpret_cast<char*>(start + size);
+	m_bytes_used += size;
+	return reinterpret_cast<void*>(start);
+}
+
+const char* Arena::copy_str(const char* str, size_t len) {
+	char* copy = allocate_array<char>(len + 1);
+	std::memcpy(copy, str, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+void Arena::reset() {
+	for (const auto block : m_large_blocks) std::free(block);
+	m_large_blocks.clear();
+	m_spare_blocks.insert(m_spare_blocks.end(), m_blocks.begin(), m_blocks.end());
+	m_blocks.clear();
+	m_next = m_end = nullptr;
+	m_bytes_used = 0;
+}
+
+char* Arena::new_block() {
+	char* block;
+	if (!m_spare_blocks.empty()) {
+		block = m_spare_blocks.back();
+		m_spare_blocks.pop_back();
+	}
+	else {
+		block = static_cast<char*>(std::malloc(BLOCK_SIZE));
+		if (!block) throw std::bad_alloc();
+	}
+	m_blocks.push_back(block);
+	return block;
+}
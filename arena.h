@@ -0,0 +1,53 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+// A bump allocator.  Allocations are carved out of large blocks and can't
+// be freed individually; all of them are released in one shot when the
+// Arena is destroyed or reset, without running any destructors.  Only
+// objects which don't own other heap memory should be put in an Arena.
+struct Arena {
+private:
+	static const size_t BLOCK_SIZE = 256 * 1024;
+
+	std::vector<char*> m_blocks;       // BLOCK_SIZE blocks in use
+	std::vector<char*> m_spare_blocks; // BLOCK_SIZE blocks released by reset
+	std::vector<char*> m_large_blocks; // blocks of their own for large requests
+	char* m_next;
+	char* m_end;
+	size_t m_bytes_used;
+
+	// copy ctor and assignment operator disallowed
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+public:
+	Arena();
+	~Arena();
+
+	void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+	template<typename T>
+	T* allocate_array(size_t count) {
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+	}
+
+	// NUL-terminated copy of the first len characters of str
+	const char* copy_str(const char* str, size_t len);
+
+	// total size of the allocations made so far
+	size_t get_bytes_used() const { return m_bytes_used; }
+
+	// Release all of the allocations, but keep the standard-size blocks to
+	// carve later allocations out of, so a long-lived Arena reused for one
+	// job after another stops calling malloc once it has grown to the size
+	// of the largest job.
+	void reset();
+
+private:
+	char* new_block();
+};
+
+#endif // ARENA_H
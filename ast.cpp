@@ -57,6 +57,28 @@ const char *ast_get_tag_name(int ast_tag) {
   }
 }
 
+int ast_is_compound_expression(int ast_tag) {
+  switch (ast_tag) {
+  case AST_ADD:
+  case AST_SUBTRACT:
+  case AST_MULTIPLY:
+  case AST_DIVIDE:
+  case AST_MODULUS:
+  case AST_NEGATE:
+  case AST_COMPARE_EQ:
+  case AST_COMPARE_NEQ:
+  case AST_COMPARE_LT:
+  case AST_COMPARE_LTE:
+  case AST_COMPARE_GT:
+  case AST_COMPARE_GTE:
+  case AST_ARRAY_ELEMENT_REF:
+  case AST_FIELD_REF:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
 class ASTGraphPrinter {
 private:
   std::map<std::string, int> m_node_levels;
@@ -105,32 +127,46 @@ void ASTGraphPrinter::print() {
   printf("}\n");
 }
 
-int ASTGraphPrinter::visit(struct Node *n, const std::string &parent_name, int level) {
-  int tag = node_get_tag(n);
-  std::map<int, int>::iterator i = m_node_type_count.find(tag);
-  int count = (i == m_node_type_count.end()) ? 0 : i->second;
-  m_node_type_count[tag] = count + 1;
-  std::string tag_name = ast_get_tag_name(tag);
-  if (tag_name == "TOK_IDENT") {
-    tag_name = "identifier";
-  }
-  std::string node_name = cpputil::format("%s_%d", tag_name.c_str(), count);
-  const char *strval = node_get_str(n);
-  if (strval) {
-    node_name += "\\n[";
-    node_name += strval;
-    node_name += "]";
-  }
-  m_node_levels[node_name] = level;
-  if (!parent_name.empty()) {
-    m_edges[parent_name].push_back(node_name);
-  }
-  int num_kids = node_get_num_kids(n);
-  int max_level = level;
-  for (int j = 0; j < num_kids; j++) {
-    int subtree_level = visit(node_get_kid(n, j), node_name, level + 1);
-    if (subtree_level > max_level) {
-      max_level = subtree_level;
+int ASTGraphPrinter::visit(struct Node *root, const std::string &root_parent_name, int root_level) {
+  // preorder traversal with an explicit stack, so deep trees are fine
+  struct Item {
+    struct Node *n;
+    std::string parent_name;
+    int level;
+  };
+  std::vector<Item> stack;
+  stack.push_back({root, root_parent_name, root_level});
+  int max_level = root_level;
+  while (!stack.empty()) {
+    Item item = stack.back();
+    stack.pop_back();
+    struct Node *n = item.n;
+    int level = item.level;
+    int tag = node_get_tag(n);
+    std::map<int, int>::iterator i = m_node_type_count.find(tag);
+    int count = (i == m_node_type_count.end()) ? 0 : i->second;
+    m_node_type_count[tag] = count + 1;
+    std::string tag_name = ast_get_tag_name(tag);
+    if (tag_name == "TOK_IDENT") {
+      tag_name = "identifier";
+    }
+    std::string node_name = cpputil::format("%s_%d", tag_name.c_str(), count);
+    const char *strval = node_get_str(n);
+    if (strval) {
+      node_name += "\\n[";
+      node_name += strval;
+      node_name += "]";
+    }
+    m_node_levels[node_name] = level;
+    if (!item.parent_name.empty()) {
+      m_edges[item.parent_name].push_back(node_name);
+    }
+    if (level > max_level) {
+      max_level = level;
+    }
+    // push the kids in reverse so they are visited in order
+    for (int j = node_get_num_kids(n) - 1; j >= 0; j--) {
+      stack.push_back({node_get_kid(n, j), node_name, level + 1});
     }
   }
   return max_level;
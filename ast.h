@@ -53,6 +53,11 @@ enum ASTKind {
 
 const char *ast_get_tag_name(int ast_tag);
 
+// Whether a node with the tag is an operator, a comparison or a designator
+// with an index or a field: its kids are expressions, so a tree of them is
+// as deep as the expression is long.
+int ast_is_compound_expression(int ast_tag);
+
 struct Node;
 
 void ast_print_graph(struct Node *ast);
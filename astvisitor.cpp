@@ -4,56 +4,105 @@
 #include "ast.h"
 #include "astvisitor.h"
 #include "type.h"
+#include <cstdarg>
 #include <iostream>
-#include "util.h"
+#include <utility>
+#include <vector>
+#include "cpputil.h"
+
+// throws a SemanticError with a printf-style message
+[[noreturn]] void semantic_error(const char* fmt, ...)
+#ifdef __GNUC__
+	__attribute__((format(printf, 1, 2)))
+#endif
+	;
+
+void semantic_error(const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	std::string msg = cpputil::vformat(fmt, args);
+	va_end(args);
+	throw SemanticError(msg);
+}
 
 // returns true if given operand_ast is integral (INTEGER or CHAR), false otherwise
-bool check_integral(const SymbolTable* symtab, struct Node* operand_ast) {
-	const auto operand_type = operand_ast->get_type();
-	const auto int_type = symtab->lookup("INTEGER")->get_type();
-	const auto char_type = symtab->lookup("CHAR")->get_type();
+bool check_integral(const SymbolTable* symtab, const SemanticInfo* info, struct Node* operand_ast) {
+	const auto operand_type = info->get_type(operand_ast);
+	const auto int_type = symtab->get_int_type();
+	const auto char_type = symtab->get_char_type();
 	return operand_type != int_type && operand_type != char_type ? false : true;
 }
 
 // returns Type* to either INTEGER or CHAR depending on operand types, errors otherwise
-Type* check_operand_types(const SymbolTable* symtab, struct Node* left_ast, struct Node* right_ast) {
-	if (!check_integral(symtab, left_ast)) {
-		const struct SourceInfo err = left_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Using a non-integral value '%s' as an operand to a binary operator\n", err.filename,
+Type* check_operand_types(const SymbolTable* symtab, const SemanticInfo* info, const SourceMap* source_map,
+                          struct Node* left_ast, struct Node* right_ast) {
+	if (!check_integral(symtab, info, left_ast)) {
+		const struct SourceInfo err = source_map->get_info(left_ast->get_source_loc());
+		semantic_error("%s:%d:%d: Error: Using a non-integral value '%s' as an operand to a binary operator", err.filename,
 		          err.line, err.col, left_ast->get_str().c_str());
 		return nullptr;
 	}
-	if (!check_integral(symtab, right_ast)) {
-		const struct SourceInfo err = right_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Using a non-integral value '%s' as an operand to a binary operator\n", err.filename,
+	if (!check_integral(symtab, info, right_ast)) {
+		const struct SourceInfo err = source_map->get_info(right_ast->get_source_loc());
+		semantic_error("%s:%d:%d: Error: Using a non-integral value '%s' as an operand to a binary operator", err.filename,
 		          err.line, err.col, right_ast->get_str().c_str());
 		return nullptr;
 	}
-	const auto int_type = symtab->lookup("INTEGER")->get_type();
-	return left_ast->get_type() == right_ast->get_type() ? left_ast->get_type() : int_type;
+	const auto int_type = symtab->get_int_type();
+	return info->get_type(left_ast) == info->get_type(right_ast) ? info->get_type(left_ast) : int_type;
 }
 
 // returns true if the given node is an integer literal or defined as a constant expression, false otherwise
-bool check_const(const SymbolTable* symtab, struct Node* operand_ast) {
+bool check_const(const SymbolTable* symtab, const SemanticInfo* info, struct Node* operand_ast) {
 	if (operand_ast->get_tag() == AST_INT_LITERAL) return true;
-	return operand_ast->get_tag() == AST_VAR_REF && symtab->lookup(operand_ast->get_str())->get_kind() == CONST
+	return operand_ast->get_tag() == AST_VAR_REF && symtab->lookup(operand_ast->get_name())->get_kind() == CONST
 		       ? true
 		       : false;
 }
 
 // traverses a list of identifiers and stores them in the provided vector
-void collate_identifiers(struct Node* ast, std::vector<std::string>& ids) {
-	ids.push_back(ast->get_kid(0)->get_str());
-	if (ast->get_num_kids() == 2) collate_identifiers(ast->get_kid(1), ids);
+void collate_identifiers(struct Node* ast, std::vector<Name>& ids) {
+	ids.reserve(ids.size() + ast->get_num_kids());
+	for (const auto identifier_ast : *ast) ids.push_back(identifier_ast->get_name());
 }
 
-ASTVisitor::ASTVisitor(SymbolTable* symtab) {
+ASTVisitor::ASTVisitor(SymbolTable* symtab, SemanticInfo* info, const SourceMap* source_map) {
 	this->symtab = symtab;
+	this->info = info;
+	this->source_map = source_map;
 }
 
 ASTVisitor::~ASTVisitor() {}
 
+SourceInfo ASTVisitor::get_source_info(const struct Node* ast) const {
+	return source_map->get_info(ast->get_source_loc());
+}
+
 void ASTVisitor::visit(struct Node* ast) {
+	if (ast_is_compound_expression(node_get_tag(ast))) visit_expression(ast);
+	else dispatch(ast);
+}
+
+// Visit an expression in postorder with an explicit stack, calling each
+// operator's visit_* method once its operands have been visited.  A long
+// sum is a tree as deep as it is long, so recursing on it would overflow
+// the stack.
+void ASTVisitor::visit_expression(struct Node* ast) {
+	std::vector<std::pair<struct Node*, int>> stack; // a node and the next kid to visit
+	stack.emplace_back(ast, 0);
+	while (!stack.empty()) {
+		struct Node* const node = stack.back().first;
+		const int kid = stack.back().second++;
+		if (kid == node->get_num_kids()) {
+			stack.pop_back();
+			dispatch(node);
+		}
+		else if (ast_is_compound_expression(node_get_tag(node->get_kid(kid)))) stack.emplace_back(node->get_kid(kid), 0);
+		else visit(node->get_kid(kid));
+	}
+}
+
+void ASTVisitor::dispatch(struct Node* ast) {
 	int tag = node_get_tag(ast);
 	switch (tag) {
 	case AST_PROGRAM:
@@ -192,18 +241,19 @@ void ASTVisitor::visit_constant_def(struct Node* ast) {
 	const auto identifier_ast = ast->get_kid(0);
 	const auto value_ast = ast->get_kid(1);
 	// if the value_ast has a string, at least one of its children is a non-constant
-	if (value_ast->get_str().length()) {
-		const struct SourceInfo err = value_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Using a non-constant value '%s' in a constant expression\n", err.filename, err.line,
+	if (!value_ast->get_name().empty()) {
+		const struct SourceInfo err = get_source_info(value_ast);
+		semantic_error("%s:%d:%d: Error: Using a non-constant value '%s' in a constant expression", err.filename, err.line,
 		          err.col, value_ast->get_str().c_str());
 		return;
 	}
-	const auto sym = new Symbol(identifier_ast->get_str(), value_ast->get_type(), CONST);
-	sym->set_ival(value_ast->get_ival());
+	const auto sym = new Symbol(identifier_ast->get_name(), info->get_type(value_ast), CONST);
+	sym->set_ival(info->get_ival(value_ast));
 	if (!symtab->define(sym)) {
-		const struct SourceInfo err = identifier_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Name '%s' is already defined\n", err.filename, err.line, err.col,
-		          sym->get_name().c_str());
+		delete sym;
+		const struct SourceInfo err = get_source_info(identifier_ast);
+		semantic_error("%s:%d:%d: Error: Name '%s' is already defined", err.filename, err.line, err.col,
+		          identifier_ast->get_name().c_str());
 	}
 }
 
@@ -215,39 +265,39 @@ void ASTVisitor::visit_type_def(struct Node* ast) {
 	recur_on_children(ast);
 	const auto identifier_ast = ast->get_kid(0);
 	const auto type_ast = ast->get_kid(1);
-	const auto sym = new Symbol(identifier_ast->get_str(), type_ast->get_type(), TYPE);
+	const auto sym = new Symbol(identifier_ast->get_name(), info->get_type(type_ast), TYPE);
 	if (!symtab->define(sym)) {
-		const struct SourceInfo err = identifier_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Name '%s' is already defined\n", err.filename, err.line, err.col,
-		          sym->get_name().c_str());
+		delete sym;
+		const struct SourceInfo err = get_source_info(identifier_ast);
+		semantic_error("%s:%d:%d: Error: Name '%s' is already defined", err.filename, err.line, err.col,
+		          identifier_ast->get_name().c_str());
 	}
 }
 
 void ASTVisitor::visit_named_type(struct Node* ast) {
 	const struct Node* tok_identifier = ast->get_kid(0);
-	const auto sym = symtab->lookup(tok_identifier->get_str());
+	const auto sym = symtab->lookup(tok_identifier->get_name());
 	if (!sym) {
-		const struct SourceInfo err = tok_identifier->get_source_info();
-		err_fatal("%s:%d:%d: Error: Use of a named type '%s' that is not defined\n", err.filename, err.line, err.col,
+		const struct SourceInfo err = get_source_info(tok_identifier);
+		semantic_error("%s:%d:%d: Error: Use of a named type '%s' that is not defined", err.filename, err.line, err.col,
 		          tok_identifier->get_str().c_str());
 		return;
 	}
-	ast->set_source_info(tok_identifier->get_source_info());
-	ast->set_str(tok_identifier->get_str());
-	ast->set_type(sym->get_type());
+	ast->set_source_loc(tok_identifier->get_source_loc());
+	ast->set_name(tok_identifier->get_name());
+	info->set_type(ast, sym->get_type());
 }
 
 void ASTVisitor::visit_array_type(struct Node* ast) {
 	recur_on_children(ast);
 	const auto size_ast = ast->get_kid(0);
-	if (size_ast->get_type() != symtab->lookup("INTEGER")->get_type()) {
-		const struct SourceInfo err = size_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Array size not an integer\n", err.filename, err.line, err.col);
+	if (info->get_type(size_ast) != symtab->get_int_type()) {
+		const struct SourceInfo err = get_source_info(size_ast);
+		semantic_error("%s:%d:%d: Error: Array size not an integer", err.filename, err.line, err.col);
 		return;
 	}
 	const auto type_ast = ast->get_kid(1);
-	const auto array_type = new ArrayType(type_ast->get_type(), size_ast->get_ival());
-	ast->set_type(array_type);
+	info->set_type(ast, symtab->get_types()->get_array_type(info->get_type(type_ast), info->get_ival(size_ast)));
 }
 
 void ASTVisitor::visit_record_type(struct Node* ast) {
@@ -255,16 +305,19 @@ void ASTVisitor::visit_record_type(struct Node* ast) {
 	const auto record_symtab = new SymbolTable(symtab);
 	symtab = record_symtab;
 	// increase depth by 1 and continue
-	recur_on_children(ast);
+	try {
+		recur_on_children(ast);
+	}
+	catch (const SemanticError&) {
+		symtab = outer_symtab;
+		delete record_symtab;
+		throw;
+	}
 	// lift out and fill record type
 	symtab = outer_symtab;
-	std::vector<RecordField*> fields;
-	for (const auto& sym : record_symtab->get_syms()) {
-		const auto field = new RecordField(sym->get_type(), sym->get_name());
-		fields.push_back(field);
-	}
-	const auto record_type = new RecordType(fields, record_symtab);
-	ast->set_type(record_type);
+	const auto record_type = dynamic_cast<RecordType*>(symtab->get_types()->get_record_type(record_symtab));
+	if (record_type->get_symtab() != record_symtab) delete record_symtab; // an identical record type already exists
+	info->set_type(ast, record_type);
 }
 
 void ASTVisitor::visit_var_declarations(struct Node* ast) {
@@ -276,168 +329,162 @@ void ASTVisitor::visit_var_def(struct Node* ast) {
 	const auto identifiers_ast = ast->get_kid(0);
 	const auto type_ast = ast->get_kid(1);
 	if (type_ast->get_tag() == AST_NAMED_TYPE) {
-		const auto sym = symtab->lookup(type_ast->get_str());
+		const auto sym = symtab->lookup(type_ast->get_name());
 		if (sym->get_kind() != TYPE) {
-			const struct SourceInfo err = type_ast->get_source_info();
-			err_fatal("%s:%d:%d: Error: Identifier '%s' does not refer to a type\n", err.filename, err.line, err.col,
+			const struct SourceInfo err = get_source_info(type_ast);
+			semantic_error("%s:%d:%d: Error: Identifier '%s' does not refer to a type", err.filename, err.line, err.col,
 			          type_ast->get_str().c_str());
 			return;
 		}
 	}
-	std::vector<std::string> ids;
+	std::vector<Name> ids;
 	// get all of the identifiers
 	collate_identifiers(identifiers_ast, ids);
 	// add each to the symbol table
 	for (const auto& id : ids) {
-		const auto sym = new Symbol(id, type_ast->get_type(), VAR);
+		const auto sym = new Symbol(id, info->get_type(type_ast), VAR);
 		if (!symtab->define(sym)) {
-			const struct SourceInfo err = identifiers_ast->get_source_info();
-			err_fatal("%s:%d:%d: Error: Name '%s' is already defined\n", err.filename, err.line, err.col, id.c_str());
+			delete sym;
+			const struct SourceInfo err = get_source_info(identifiers_ast);
+			semantic_error("%s:%d:%d: Error: Name '%s' is already defined", err.filename, err.line, err.col, id.c_str());
 			return;
 		}
 	}
 }
 
 void ASTVisitor::visit_add(struct Node* ast) {
-	recur_on_children(ast);
 	const auto left_ast = ast->get_kid(0);
 	const auto right_ast = ast->get_kid(1);
-	const auto result_type = check_operand_types(symtab, left_ast, right_ast);
-	const int result = left_ast->get_ival() + right_ast->get_ival();
-	ast->set_ival(result);
-	ast->set_type(result_type);
+	const auto result_type = check_operand_types(symtab, info, source_map, left_ast, right_ast);
+	const int result = info->get_ival(left_ast) + info->get_ival(right_ast);
+	info->set_ival(ast, result);
+	info->set_type(ast, result_type);
 	// if either operand is a non-constant, push that info up the tree
-	if (!check_const(symtab, left_ast)) {
-		ast->set_str(left_ast->get_str());
-		ast->set_source_info(left_ast->get_source_info());
+	if (!check_const(symtab, info, left_ast)) {
+		ast->set_name(left_ast->get_name());
+		ast->set_source_loc(left_ast->get_source_loc());
 	}
-	else if (!check_const(symtab, right_ast)) {
-		ast->set_str(right_ast->get_str());
-		ast->set_source_info(right_ast->get_source_info());
+	else if (!check_const(symtab, info, right_ast)) {
+		ast->set_name(right_ast->get_name());
+		ast->set_source_loc(right_ast->get_source_loc());
 
 	}
 }
 
 void ASTVisitor::visit_subtract(struct Node* ast) {
-	recur_on_children(ast);
 	const auto left_ast = ast->get_kid(0);
 	const auto right_ast = ast->get_kid(1);
-	const auto result_type = check_operand_types(symtab, left_ast, right_ast);
-	const int result = left_ast->get_ival() - right_ast->get_ival();
-	ast->set_ival(result);
-	ast->set_type(result_type);
+	const auto result_type = check_operand_types(symtab, info, source_map, left_ast, right_ast);
+	const int result = info->get_ival(left_ast) - info->get_ival(right_ast);
+	info->set_ival(ast, result);
+	info->set_type(ast, result_type);
 	// if either operand is a non-constant, push that info up the tree
-	if (!check_const(symtab, left_ast)) {
-		ast->set_str(left_ast->get_str());
-		ast->set_source_info(left_ast->get_source_info());
+	if (!check_const(symtab, info, left_ast)) {
+		ast->set_name(left_ast->get_name());
+		ast->set_source_loc(left_ast->get_source_loc());
 	}
-	else if (!check_const(symtab, right_ast)) {
-		ast->set_str(right_ast->get_str());
-		ast->set_source_info(right_ast->get_source_info());
+	else if (!check_const(symtab, info, right_ast)) {
+		ast->set_name(right_ast->get_name());
+		ast->set_source_loc(right_ast->get_source_loc());
 
 	}
 }
 
 void ASTVisitor::visit_multiply(struct Node* ast) {
-	recur_on_children(ast);
 	const auto left_ast = ast->get_kid(0);
 	const auto right_ast = ast->get_kid(1);
-	const auto result_type = check_operand_types(symtab, left_ast, right_ast);
-	const int result = left_ast->get_ival() * right_ast->get_ival();
-	ast->set_ival(result);
-	ast->set_type(result_type);
+	const auto result_type = check_operand_types(symtab, info, source_map, left_ast, right_ast);
+	const int result = info->get_ival(left_ast) * info->get_ival(right_ast);
+	info->set_ival(ast, result);
+	info->set_type(ast, result_type);
 	// if either operand is a non-constant, push that info up the tree
-	if (!check_const(symtab, left_ast)) {
-		ast->set_str(left_ast->get_str());
-		ast->set_source_info(left_ast->get_source_info());
+	if (!check_const(symtab, info, left_ast)) {
+		ast->set_name(left_ast->get_name());
+		ast->set_source_loc(left_ast->get_source_loc());
 	}
-	else if (!check_const(symtab, right_ast)) {
-		ast->set_str(right_ast->get_str());
-		ast->set_source_info(right_ast->get_source_info());
+	else if (!check_const(symtab, info, right_ast)) {
+		ast->set_name(right_ast->get_name());
+		ast->set_source_loc(right_ast->get_source_loc());
 
 	}
 }
 
 void ASTVisitor::visit_divide(struct Node* ast) {
-	recur_on_children(ast);
 	const auto left_ast = ast->get_kid(0);
 	const auto right_ast = ast->get_kid(1);
-	const auto result_type = check_operand_types(symtab, left_ast, right_ast);
-	if (right_ast->get_ival() == 0 && check_const(symtab, right_ast)) {
-		const struct SourceInfo err = right_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Illegal division by zero\n", err.filename, err.line, err.col);
+	const auto result_type = check_operand_types(symtab, info, source_map, left_ast, right_ast);
+	if (info->get_ival(right_ast) == 0 && check_const(symtab, info, right_ast)) {
+		const struct SourceInfo err = get_source_info(right_ast);
+		semantic_error("%s:%d:%d: Error: Illegal division by zero", err.filename, err.line, err.col);
 		return;
 	}
-	if (check_const(symtab, left_ast) && check_const(symtab, right_ast)) {
-		const int result = left_ast->get_ival() / right_ast->get_ival();
-		ast->set_ival(result);
+	if (check_const(symtab, info, left_ast) && check_const(symtab, info, right_ast)) {
+		const int result = info->get_ival(left_ast) / info->get_ival(right_ast);
+		info->set_ival(ast, result);
 	}
-	ast->set_type(result_type);
+	info->set_type(ast, result_type);
 	// if either operand is a non-constant, push that info up the tree
-	if (!check_const(symtab, left_ast)) {
-		ast->set_str(left_ast->get_str());
-		ast->set_source_info(left_ast->get_source_info());
+	if (!check_const(symtab, info, left_ast)) {
+		ast->set_name(left_ast->get_name());
+		ast->set_source_loc(left_ast->get_source_loc());
 	}
-	else if (!check_const(symtab, right_ast)) {
-		ast->set_str(right_ast->get_str());
-		ast->set_source_info(right_ast->get_source_info());
+	else if (!check_const(symtab, info, right_ast)) {
+		ast->set_name(right_ast->get_name());
+		ast->set_source_loc(right_ast->get_source_loc());
 
 	}
 }
 
 void ASTVisitor::visit_modulus(struct Node* ast) {
-	recur_on_children(ast);
 	const auto left_ast = ast->get_kid(0);
 	const auto right_ast = ast->get_kid(1);
-	const auto result_type = check_operand_types(symtab, left_ast, right_ast);
-	if (right_ast->get_ival() == 0 && check_const(symtab, right_ast)) {
-		const struct SourceInfo err = right_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Illegal mod by zero\n", err.filename, err.line, err.col);
+	const auto result_type = check_operand_types(symtab, info, source_map, left_ast, right_ast);
+	if (info->get_ival(right_ast) == 0 && check_const(symtab, info, right_ast)) {
+		const struct SourceInfo err = get_source_info(right_ast);
+		semantic_error("%s:%d:%d: Error: Illegal mod by zero", err.filename, err.line, err.col);
 		return;
 	}
-	if (check_const(symtab, left_ast) && check_const(symtab, right_ast)) {
-		const int result = left_ast->get_ival() % right_ast->get_ival();
-		ast->set_ival(result);
+	if (check_const(symtab, info, left_ast) && check_const(symtab, info, right_ast)) {
+		const int result = info->get_ival(left_ast) % info->get_ival(right_ast);
+		info->set_ival(ast, result);
 	}
-	ast->set_type(result_type);
+	info->set_type(ast, result_type);
 	// if either operand is a non-constant, push that info up the tree
-	if (!check_const(symtab, left_ast)) {
-		ast->set_str(left_ast->get_str());
-		ast->set_source_info(left_ast->get_source_info());
+	if (!check_const(symtab, info, left_ast)) {
+		ast->set_name(left_ast->get_name());
+		ast->set_source_loc(left_ast->get_source_loc());
 	}
-	else if (!check_const(symtab, right_ast)) {
-		ast->set_str(right_ast->get_str());
-		ast->set_source_info(right_ast->get_source_info());
+	else if (!check_const(symtab, info, right_ast)) {
+		ast->set_name(right_ast->get_name());
+		ast->set_source_loc(right_ast->get_source_loc());
 
 	}
 }
 
 void ASTVisitor::visit_negate(struct Node* ast) {
-	recur_on_children(ast);
 	const auto operand_ast = ast->get_kid(0);
-	if (!check_integral(symtab, operand_ast)) {
-		const struct SourceInfo err = operand_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Using a non-integral value '%s' as an operand to a unary operator\n", err.filename,
+	if (!check_integral(symtab, info, operand_ast)) {
+		const struct SourceInfo err = get_source_info(operand_ast);
+		semantic_error("%s:%d:%d: Error: Using a non-integral value '%s' as an operand to a unary operator", err.filename,
 		          err.line, err.col, operand_ast->get_str().c_str());
 		return;
 	}
-	const int result = -operand_ast->get_ival();
-	ast->set_ival(result);
-	ast->set_type(operand_ast->get_type());
+	const int result = -info->get_ival(operand_ast);
+	info->set_ival(ast, result);
+	info->set_type(ast, info->get_type(operand_ast));
 	// if the operand is a non-constant, push that info up the tree
-	if (!check_const(symtab, operand_ast)) {
-		ast->set_str(operand_ast->get_str());
-		ast->set_source_info(operand_ast->get_source_info());
+	if (!check_const(symtab, info, operand_ast)) {
+		ast->set_name(operand_ast->get_name());
+		ast->set_source_loc(operand_ast->get_source_loc());
 	}
 }
 
 void ASTVisitor::visit_int_literal(struct Node* ast) {
 	const auto tok_int_literal = ast->get_kid(0);
-	assert(symtab->lookup("INTEGER")); // we should always have INTEGER type
-	const auto type = symtab->lookup("INTEGER")->get_type();
-	ast->set_source_info(tok_int_literal->get_source_info());
-	ast->set_ival(std::stoi(tok_int_literal->get_str()));
-	ast->set_type(type);
+	const auto type = symtab->get_int_type();
+	ast->set_source_loc(tok_int_literal->get_source_loc());
+	info->set_ival(ast, std::stoi(tok_int_literal->get_str()));
+	info->set_type(ast, type);
 }
 
 void ASTVisitor::visit_instructions(struct Node* ast) {
@@ -448,16 +495,16 @@ void ASTVisitor::visit_assign(struct Node* ast) {
 	recur_on_children(ast);
 	const auto left_ast = ast->get_kid(0);
 	const auto right_ast = ast->get_kid(1);
-	if (!check_integral(symtab, right_ast)) {
-		const struct SourceInfo err = right_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Using a non-integral value '%s' as an assigned value\n", err.filename, err.line,
+	if (!check_integral(symtab, info, right_ast)) {
+		const struct SourceInfo err = get_source_info(right_ast);
+		semantic_error("%s:%d:%d: Error: Using a non-integral value '%s' as an assigned value", err.filename, err.line,
 		          err.col, right_ast->get_str().c_str());
 	}
-	if (left_ast->get_type() != right_ast->get_type()) {
-		const struct SourceInfo err = left_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: LHS of assignment is type '%s' while RHS of assignment is type '%s'\n",
-		          err.filename, err.line, err.col, left_ast->get_type()->to_string().c_str(),
-		          right_ast->get_type()->to_string().c_str());
+	if (info->get_type(left_ast) != info->get_type(right_ast)) {
+		const struct SourceInfo err = get_source_info(left_ast);
+		semantic_error("%s:%d:%d: Error: LHS of assignment is type '%s' while RHS of assignment is type '%s'",
+		          err.filename, err.line, err.col, info->get_type(left_ast)->to_string().c_str(),
+		          info->get_type(right_ast)->to_string().c_str());
 	}
 }
 
@@ -478,59 +525,53 @@ void ASTVisitor::visit_while(struct Node* ast) {
 }
 
 void ASTVisitor::visit_compare_eq(struct Node* ast) {
-	recur_on_children(ast);
 	const auto left_ast = ast->get_kid(0);
 	const auto right_ast = ast->get_kid(1);
-	check_operand_types(symtab, left_ast, right_ast);
+	check_operand_types(symtab, info, source_map, left_ast, right_ast);
 }
 
 void ASTVisitor::visit_compare_neq(struct Node* ast) {
-	recur_on_children(ast);
 	const auto left_ast = ast->get_kid(0);
 	const auto right_ast = ast->get_kid(1);
-	check_operand_types(symtab, left_ast, right_ast);
+	check_operand_types(symtab, info, source_map, left_ast, right_ast);
 }
 
 void ASTVisitor::visit_compare_lt(struct Node* ast) {
-	recur_on_children(ast);
 	const auto left_ast = ast->get_kid(0);
 	const auto right_ast = ast->get_kid(1);
-	check_operand_types(symtab, left_ast, right_ast);
+	check_operand_types(symtab, info, source_map, left_ast, right_ast);
 }
 
 void ASTVisitor::visit_compare_lte(struct Node* ast) {
-	recur_on_children(ast);
 	const auto left_ast = ast->get_kid(0);
 	const auto right_ast = ast->get_kid(1);
-	check_operand_types(symtab, left_ast, right_ast);
+	check_operand_types(symtab, info, source_map, left_ast, right_ast);
 }
 
 void ASTVisitor::visit_compare_gt(struct Node* ast) {
-	recur_on_children(ast);
 	const auto left_ast = ast->get_kid(0);
 	const auto right_ast = ast->get_kid(1);
-	check_operand_types(symtab, left_ast, right_ast);
+	check_operand_types(symtab, info, source_map, left_ast, right_ast);
 }
 
 void ASTVisitor::visit_compare_gte(struct Node* ast) {
-	recur_on_children(ast);
 	const auto left_ast = ast->get_kid(0);
 	const auto right_ast = ast->get_kid(1);
-	check_operand_types(symtab, left_ast, right_ast);
+	check_operand_types(symtab, info, source_map, left_ast, right_ast);
 }
 
 void ASTVisitor::visit_write(struct Node* ast) {
 	recur_on_children(ast);
 	const auto var_ast = ast->get_kid(0);
-	if (!check_integral(symtab, var_ast)) {
+	if (!check_integral(symtab, info, var_ast)) {
 		// not an integer or char, maybe an array of char
-		const auto char_type = symtab->lookup("CHAR")->get_type();
-		const auto array_ = dynamic_cast<ArrayType*>(var_ast->get_type());
+		const auto char_type = symtab->get_char_type();
+		const auto array_ = dynamic_cast<ArrayType*>(info->get_type(var_ast));
 		if (!array_ || array_->get_type() != char_type) {
 			// neither an integer, char, or array of char
-			const struct SourceInfo err = var_ast->get_source_info();
-			err_fatal("%s:%d:%d: Error: Inappropriate type '%s' for WRITE statement\n", err.filename, err.line, err.col,
-			          var_ast->get_type()->to_string().c_str());
+			const struct SourceInfo err = get_source_info(var_ast);
+			semantic_error("%s:%d:%d: Error: Inappropriate type '%s' for WRITE statement", err.filename, err.line, err.col,
+			          info->get_type(var_ast)->to_string().c_str());
 		}
 		// it's an array of char
 	}
@@ -539,15 +580,15 @@ void ASTVisitor::visit_write(struct Node* ast) {
 void ASTVisitor::visit_read(struct Node* ast) {
 	recur_on_children(ast);
 	const auto var_ast = ast->get_kid(0);
-	if (!check_integral(symtab, var_ast)) {
+	if (!check_integral(symtab, info, var_ast)) {
 		// not an integer or char, maybe an array of char
-		const auto char_type = symtab->lookup("CHAR")->get_type();
-		const auto array_ = dynamic_cast<ArrayType*>(var_ast->get_type());
+		const auto char_type = symtab->get_char_type();
+		const auto array_ = dynamic_cast<ArrayType*>(info->get_type(var_ast));
 		if (!array_ || array_->get_type() != char_type) {
 			// neither an integer, char, or array of char
-			const struct SourceInfo err = var_ast->get_source_info();
-			err_fatal("%s:%d:%d: Error: Inappropriate type '%s' for READ statement\n", err.filename, err.line, err.col,
-			          var_ast->get_type()->to_string().c_str());
+			const struct SourceInfo err = get_source_info(var_ast);
+			semantic_error("%s:%d:%d: Error: Inappropriate type '%s' for READ statement", err.filename, err.line, err.col,
+			          info->get_type(var_ast)->to_string().c_str());
 		}
 		// it's an array of char
 	}
@@ -555,60 +596,58 @@ void ASTVisitor::visit_read(struct Node* ast) {
 
 void ASTVisitor::visit_var_ref(struct Node* ast) {
 	const struct Node* tok_identifier = ast->get_kid(0);
-	const auto sym = symtab->lookup(tok_identifier->get_str());
+	const auto sym = symtab->lookup(tok_identifier->get_name());
 	if (!sym) {
-		const struct SourceInfo err = tok_identifier->get_source_info();
-		err_fatal("%s:%d:%d: Error: Use of an undefined variable '%s'\n", err.filename, err.line, err.col,
+		const struct SourceInfo err = get_source_info(tok_identifier);
+		semantic_error("%s:%d:%d: Error: Use of an undefined variable '%s'", err.filename, err.line, err.col,
 		          tok_identifier->get_str().c_str());
 		return;
 	}
-	ast->set_ival(sym->get_ival());
-	ast->set_source_info(tok_identifier->get_source_info());
-	ast->set_str(tok_identifier->get_str());
-	ast->set_type(sym->get_type());
+	info->set_ival(ast, sym->get_ival());
+	ast->set_source_loc(tok_identifier->get_source_loc());
+	ast->set_name(tok_identifier->get_name());
+	info->set_type(ast, sym->get_type());
 }
 
 void ASTVisitor::visit_array_element_ref(struct Node* ast) {
-	recur_on_children(ast);
 	const auto identifier_ast = ast->get_kid(0);
 	const auto index_ast = ast->get_kid(1);
 	// try to coerce into array
-	const auto array_ = dynamic_cast<ArrayType*>(identifier_ast->get_type());
+	const auto array_ = dynamic_cast<ArrayType*>(info->get_type(identifier_ast));
 	if (!array_) {
-		const struct SourceInfo err = index_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Attempt to use the array subscript operator on non-array '%s'\n", err.filename,
+		const struct SourceInfo err = get_source_info(index_ast);
+		semantic_error("%s:%d:%d: Error: Attempt to use the array subscript operator on non-array '%s'", err.filename,
 		          err.line, err.col, identifier_ast->get_str().c_str());
 	}
-	if (!check_integral(symtab, index_ast)) {
-		const struct SourceInfo err = index_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Using non-integral value '%s' as an array index\n", err.filename,
+	if (!check_integral(symtab, info, index_ast)) {
+		const struct SourceInfo err = get_source_info(index_ast);
+		semantic_error("%s:%d:%d: Error: Using non-integral value '%s' as an array index", err.filename,
 		          err.line, err.col, index_ast->get_str().c_str());
 	}
-	ast->set_str(identifier_ast->get_str());
-	ast->set_source_info(identifier_ast->get_source_info());
-	ast->set_type(array_->get_type());
+	ast->set_name(identifier_ast->get_name());
+	ast->set_source_loc(identifier_ast->get_source_loc());
+	info->set_type(ast, array_->get_type());
 }
 
 void ASTVisitor::visit_field_ref(struct Node* ast) {
-	recur_on_children(ast);
 	const auto record_ast = ast->get_kid(0);
 	const auto field_ast = ast->get_kid(1);
 	// try to coerce into record
-	const auto record = dynamic_cast<RecordType*>(record_ast->get_type());
+	const auto record = dynamic_cast<RecordType*>(info->get_type(record_ast));
 	if (!record) {
-		const struct SourceInfo err = field_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Attempt to access field on non-record '%s'\n", err.filename,
+		const struct SourceInfo err = get_source_info(field_ast);
+		semantic_error("%s:%d:%d: Error: Attempt to access field on non-record '%s'", err.filename,
 		          err.line, err.col, record_ast->get_str().c_str());
 	}
-	const auto field_type = record->get_field(field_ast->get_str());
+	const auto field_type = record->get_field(field_ast->get_name());
 	if (!field_type) {
-		const struct SourceInfo err = field_ast->get_source_info();
-		err_fatal("%s:%d:%d: Error: Attempt to access nonexistent field '%s' on record '%s'\n", err.filename,
+		const struct SourceInfo err = get_source_info(field_ast);
+		semantic_error("%s:%d:%d: Error: Attempt to access nonexistent field '%s' on record '%s'", err.filename,
 		          err.line, err.col, field_ast->get_str().c_str(), record_ast->get_str().c_str());
 	}
-	ast->set_str(field_ast->get_str());
-	ast->set_source_info(field_ast->get_source_info());
-	ast->set_type(field_type);
+	ast->set_name(field_ast->get_name());
+	ast->set_source_loc(field_ast->get_source_loc());
+	info->set_type(ast, field_type);
 }
 
 void ASTVisitor::visit_identifier_list(struct Node* ast) {
@@ -619,9 +658,9 @@ void ASTVisitor::visit_expression_list(struct Node* ast) {
 	recur_on_children(ast);
 	// just pass information up the tree
 	const auto expression_ast = ast->get_kid(0);
-	ast->set_ival(expression_ast->get_ival());
-	ast->set_type(expression_ast->get_type());
-	ast->set_source_info(expression_ast->get_source_info());
+	info->set_ival(ast, info->get_ival(expression_ast));
+	info->set_type(ast, info->get_type(expression_ast));
+	ast->set_source_loc(expression_ast->get_source_loc());
 }
 
 void ASTVisitor::visit_identifier(struct Node* ast) {
@@ -1,13 +1,42 @@
 #ifndef ASTVISITOR_H
 #define ASTVISITOR_H
+#include <stdexcept>
+#include "node.h"
+#include "symtab.h"
+
+// An error in the program being compiled, found by the semantic analysis.
+// what() is the diagnostic, "file:line:col: Error: ...".
+class SemanticError : public std::runtime_error {
+public:
+	explicit SemanticError(const std::string& msg): std::runtime_error(msg) {}
+};
+
+// Results of semantic analysis, kept for code generation: the type of
+// each expression, designator and type node, and the value of each
+// constant expression.
+class SemanticInfo {
+	NodeTable<Type*> types;
+	NodeTable<long> ivals;
+
+public:
+	Type* get_type(const Node* ast) const { return types.get(ast); }
+	void set_type(const Node* ast, Type* type) { types.set(ast, type); }
+	long get_ival(const Node* ast) const { return ivals.get(ast); }
+	void set_ival(const Node* ast, long ival) { ivals.set(ast, ival); }
+};
 
 class ASTVisitor {
 	SymbolTable* symtab = nullptr;
+	SemanticInfo* info = nullptr;
+	const SourceMap* source_map = nullptr; // for diagnostics
 
 public:
-	ASTVisitor(SymbolTable* symtab);
+	ASTVisitor(SymbolTable* symtab, SemanticInfo* info, const SourceMap* source_map);
 	virtual ~ASTVisitor();
 
+	// The visit_* method of an operator or a designator with an index
+	// (ast_is_compound_expression) is called once its kids have been
+	// visited, by visit_expression rather than by recursion.
 	void visit(struct Node* ast);
 
 	virtual void visit_program(struct Node* ast);
@@ -50,6 +79,14 @@ public:
 	virtual void visit_identifier(struct Node* ast);
 
 	virtual void recur_on_children(struct Node* ast);
+
+private:
+	void visit_expression(struct Node* ast);
+	// call the visit_* method for the node's tag
+	void dispatch(struct Node* ast);
+
+	// the file, line and column of a node, for diagnostics
+	SourceInfo get_source_info(const struct Node* ast) const;
 };
 
 #endif // ASTVISITOR_H
@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sys/stat.h>
+#include "context.h"
+#include "cpputil.h"
+#include "unit.h"
+#include "cache.h"
+#include "timereport.h"
+#include "batch.h"
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////
+// Work-stealing thread pool
+////////////////////////////////////////////////////////////////////////
+
+// A fixed set of jobs, numbered from 0, run by a pool of threads.  Each
+// worker has its own deque of jobs: it takes them from the front of its
+// own deque, and when that is empty steals from the back of the others'.
+// All of the jobs are queued before the workers start, so a worker which
+// finds every deque empty is done.
+class WorkStealingPool {
+	struct Worker {
+		std::mutex lock;
+		std::deque<size_t> jobs;
+	};
+
+	std::vector<std::unique_ptr<Worker>> m_workers;
+
+public:
+	explicit WorkStealingPool(unsigned num_threads) {
+		for (unsigned i = 0; i < num_threads; i++) m_workers.emplace_back(new Worker);
+	}
+
+	// queue job on the given worker's deque
+	void push(unsigned worker, size_t job) {
+		m_workers[worker]->jobs.push_back(job);
+	}
+
+	// Call run_job(job) for every queued job, and return once all of them
+	// have finished.
+	template<typename RunJob>
+	void run(RunJob run_job) {
+		std::vector<std::thread> threads;
+		for (unsigned i = 0; i < m_workers.size(); i++) {
+			threads.emplace_back([this, i, &run_job] {
+				size_t job;
+				while (take(i, job)) run_job(job);
+			});
+		}
+		for (auto& thread : threads) thread.join();
+	}
+
+private:
+	bool take(unsigned self, size_t& job) {
+		{
+			Worker& worker = *m_workers[self];
+			std::lock_guard<std::mutex> guard(worker.lock);
+			if (!worker.jobs.empty()) {
+				job = worker.jobs.front();
+				worker.jobs.pop_front();
+				return true;
+			}
+		}
+		for (unsigned i = 1; i < m_workers.size(); i++) {
+			Worker& victim = *m_workers[(self + i) % m_workers.size()];
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if (!victim.jobs.empty()) {
+				job = victim.jobs.back();
+				victim.jobs.pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////
+// Jobs
+////////////////////////////////////////////////////////////////////////
+
+// compile_unit, without the cache
+bool compile_uncached(Unit& unit, const CompileOptions& options, FILE* out, std::string& error) {
+	if (!unit.parse(options.hand_written_scanner)) {
+		error = unit.get_error();
+		return false;
+	}
+	struct Context* ctx = context_create(&unit);
+	if (options.optimize_flag) context_set_flag(ctx, options.optimize_flag);
+	context_set_output(ctx, out);
+	bool compiled = false;
+	try {
+		compiled = context_compile(ctx) == 0;
+		if (!compiled) error = context_get_error(ctx);
+	}
+	catch (const std::exception& ex) {
+		// an exception from a bug in the compiler only fails this unit
+		error = std::string("Internal compiler error: ") + ex.what();
+	}
+	context_destroy(ctx);
+	return compiled;
+}
+
+struct Job {
+	std::string source;
+	std::string output;
+	size_t size = 0; // of the source file, to schedule the largest first
+	bool ok = false;
+	std::string error;
+	double seconds = 0;
+};
+
+// the source file's name with its extension replaced by ".S", in
+// output_dir if there is one
+std::string get_output_filename(const std::string& source, const std::string& output_dir) {
+	const size_t slash = source.find_last_of('/');
+	const size_t base = slash == std::string::npos ? 0 : slash + 1;
+	size_t dot = source.find_last_of('.');
+	if (dot == std::string::npos || dot < base) dot = source.size();
+	const std::string stem = source.substr(base, dot - base);
+	if (output_dir.empty()) return source.substr(0, base) + stem + ".S";
+	return output_dir + "/" + stem + ".S";
+}
+
+// the file's name with its directory resolved, so that two spellings of
+// the same file's name compare equal
+std::string get_canonical_filename(const std::string& filename) {
+	const size_t slash = filename.find_last_of('/');
+	const std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : filename.substr(0, slash);
+	char* resolved = realpath(dir.c_str(), nullptr);
+	if (!resolved) return filename;
+	const std::string result = resolved + ("/" + filename.substr(slash == std::string::npos ? 0 : slash + 1));
+	free(resolved);
+	return result;
+}
+
+void compile(Job& job, const BatchOptions& options) {
+	const auto start = std::chrono::steady_clock::now();
+	// each worker reuses one Arena for all of its jobs
+	thread_local Arena arena;
+	Unit unit(job.source, &arena);
+	if (!unit.read()) {
+		job.error = "Could not open input file \"" + job.source + "\"";
+	}
+	else {
+		// Compile into memory, and only write the output file if that
+		// works.  A failed assertion still aborts the whole batch, but it
+		// leaves no partial output behind.
+		char* buf = nullptr;
+		size_t length = 0;
+		FILE* capture = open_memstream(&buf, &length);
+		if (!capture) {
+			job.error = "Out of memory";
+		}
+		else {
+			const bool compiled = compile_unit(unit, options.compile, capture, job.error);
+			fclose(capture);
+			if (compiled && !cpputil::write_file_atomically(job.output, std::string(buf, length))) {
+				job.error = "Could not write output file \"" + job.output + "\"";
+			}
+			free(buf);
+			job.ok = compiled && job.error.empty();
+			// don't leave the output of an earlier run behind
+			if (!job.ok) remove(job.output.c_str());
+		}
+	}
+	job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////
+// Batch compilation
+////////////////////////////////////////////////////////////////////////
+
+bool compile_unit(Unit& unit, const CompileOptions& options, FILE* out, std::string& error) {
+	if (!options.cache) return compile_uncached(unit, options, out, error);
+
+	const SourceFile& source = unit.get_source();
+	std::string key, output;
+	bool hit;
+	{
+		TimePhase phase("cache lookup");
+		key = options.cache->get_key(source.get_text(), source.get_length(), options);
+		hit = options.cache->lookup(key, output);
+	}
+	if (!hit) {
+		char* buf = nullptr;
+		size_t length = 0;
+		FILE* capture = open_memstream(&buf, &length);
+		if (!capture) return compile_uncached(unit, options, out, error);
+		const bool compiled = compile_uncached(unit, options, capture, error);
+		fclose(capture);
+		output.assign(buf, length);
+		free(buf);
+		if (!compiled) {
+			fwrite(output.data(), 1, output.size(), out);
+			return false;
+		}
+		TimePhase phase("cache store");
+		options.cache->store(key, output);
+	}
+	fwrite(output.data(), 1, output.size(), out);
+	return true;
+}
+
+bool batch_read_manifest(const char* manifest, std::vector<std::string>& filenames) {
+	std::ifstream in(manifest);
+	if (!in) return false;
+	std::string line;
+	while (std::getline(in, line)) {
+		const size_t begin = line.find_first_not_of(" \t\r");
+		if (begin == std::string::npos || line[begin] == '#') continue;
+		const size_t end = line.find_last_not_of(" \t\r");
+		filenames.push_back(line.substr(begin, end - begin + 1));
+	}
+	return true;
+}
+
+int batch_compile(const std::vector<std::string>& filenames, const BatchOptions& options) {
+	const auto start = std::chrono::steady_clock::now();
+
+	std::vector<Job> jobs(filenames.size());
+	for (size_t i = 0; i < jobs.size(); i++) {
+		jobs[i].source = filenames[i];
+		jobs[i].output = get_output_filename(filenames[i], options.output_dir);
+		struct stat st;
+		if (stat(filenames[i].c_str(), &st) == 0) jobs[i].size = size_t(st.st_size);
+	}
+
+	// Sources with the same name in different directories have the same
+	// output file in the -d directory (as does a source named twice).
+	// The first of them is compiled and the rest fail.  So does a job
+	// whose output file is a source (e.g. "foo.S"), its own or another's,
+	// rather than overwrite it.
+	std::map<std::string, size_t> sources;
+	for (size_t i = 0; i < jobs.size(); i++) sources.emplace(get_canonical_filename(jobs[i].source), i);
+	std::map<std::string, size_t> outputs;
+	std::vector<bool> duplicate(jobs.size());
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const std::string output = get_canonical_filename(jobs[i].output);
+		const auto source = sources.find(output);
+		if (source != sources.end()) {
+			if (output == get_canonical_filename(jobs[i].source))
+				jobs[i].error = "Output file \"" + jobs[i].output + "\" would overwrite the source file";
+			else
+				jobs[i].error = "Output file \"" + jobs[i].output + "\" is also the source file \"" +
+				                jobs[source->second].source + "\"";
+			duplicate[i] = true;
+			continue;
+		}
+		auto ins = outputs.emplace(output, i);
+		if (!ins.second) {
+			jobs[i].error = "Output file \"" + jobs[i].output + "\" is also the output file of \"" +
+			                jobs[ins.first->second].source + "\"";
+			duplicate[i] = true;
+		}
+	}
+
+	unsigned num_threads = options.num_threads ? options.num_threads : std::thread::hardware_concurrency();
+	num_threads = std::max(1u, std::min(num_threads, unsigned(jobs.size())));
+
+	// deal the jobs out largest first, so the small ones even out the load
+	std::vector<size_t> order(jobs.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&jobs](size_t a, size_t b) { return jobs[a].size > jobs[b].size; });
+	WorkStealingPool pool(num_threads);
+	order.erase(std::remove_if(order.begin(), order.end(), [&duplicate](size_t i) { return duplicate[i]; }), order.end());
+	for (size_t i = 0; i < order.size(); i++) pool.push(unsigned(i % num_threads), order[i]);
+	pool.run([&jobs, &options](size_t job) { compile(jobs[job], options); });
+
+	unsigned num_failed = 0;
+	for (const auto& job : jobs) {
+		if (job.ok) {
+			printf("ok      %s -> %s (%.1f ms)\n", job.source.c_str(), job.output.c_str(), job.seconds * 1000);
+		}
+		else {
+			printf("FAILED  %s: %s\n", job.source.c_str(), job.error.c_str());
+			num_failed++;
+		}
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%zu files: %zu compiled, %u failed in %.2f s on %u threads\n", jobs.size(), jobs.size() - num_failed,
+	       num_failed, seconds, num_threads);
+	return num_failed ? 1 : 0;
+}
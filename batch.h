@@ -0,0 +1,49 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct Unit;
+class CompileCache;
+
+// How a Unit is compiled to assembly language.
+struct CompileOptions {
+	char optimize_flag = 0;       // 'o', 'O' or 0 (see context_set_flag)
+	bool hand_written_scanner = false;
+	CompileCache* cache = nullptr; // consulted first, if there is one
+};
+
+// Parse a Unit whose source text has been read and compile it, writing
+// the assembly language to out (or copy it out of the cache).  Returns false, with a message in error,
+// if the program is ill-formed, or if the compiler throws an exception.
+// A failed assertion is not caught: it aborts the process, along with
+// every other compilation running in it.
+bool compile_unit(Unit& unit, const CompileOptions& options, FILE* out, std::string& error);
+
+// Batch compilation (compiler -b): many source files are compiled in one
+// process by a pool of worker threads, one thread per core by default.
+// Each file gets its own Unit, Context and output file, named after the
+// source file with its extension replaced by ".S", either next to it or
+// in the output directory.  If two files would have the same output
+// file (a/x.in and b/x.in with an output directory), only the first is
+// compiled and the others fail.  An output file is only written once its
+// compilation has succeeded, so if the batch is aborted, every output
+// file is either complete or untouched.  A line is reported for each file, in the
+// order they were given, followed by a summary.
+struct BatchOptions {
+	unsigned num_threads = 0;     // 0 for one per core
+	std::string output_dir;       // empty to write next to each source file
+	CompileOptions compile;
+};
+
+// Append the file names listed in a manifest, one per line, to filenames.
+// Blank lines and lines starting with '#' are ignored.  Returns false if
+// the manifest can't be read.
+bool batch_read_manifest(const char* manifest, std::vector<std::string>& filenames);
+
+// Compile the files, returning 0 if all of them compiled and 1 otherwise.
+int batch_compile(const std::vector<std::string>& filenames, const BatchOptions& options);
+
+#endif // BATCH_H
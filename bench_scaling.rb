@@ -0,0 +1,138 @@
+#! /usr/bin/env ruby
+
+# Compile-time scaling benchmark ("make bench").  For each parameter of
+# gen_program.rb it generates a series of programs of doubling size,
+# compiles each with "compiler -T", once with -o and once with -O, and
+# reports how the time of every phase grows.  The exponent printed for a
+# phase is the slope of log(time) against log(size) over the series, so a
+# phase which is linear in the size of its input has an exponent near 1,
+# and one which is quadratic has an exponent near 2.  Every series grows
+# the code to compile linearly (the text of a program with more dimensions
+# hardly grows, but the address arithmetic does), so a phase whose
+# exponent is over the limit (--max-exponent) is reported as a regression,
+# and the exit status is 1.
+
+require 'optparse'
+require 'tmpdir'
+
+options = {
+  compiler: File.join(File.dirname(__FILE__), 'compiler'),
+  flags: [],
+  runs: 3,
+  max_exponent: 1.3,
+  quick: false,
+  only: nil,
+  csv: nil,
+}
+
+OptionParser.new do |opts|
+  opts.banner = 'Usage: bench_scaling.rb [options]'
+  opts.on('--compiler PATH', 'compiler to benchmark (default: ./compiler)') { |p| options[:compiler] = p }
+  opts.on('--flags FLAGS', 'compiler flags; may be repeated (default: -o, then -O)') { |f| options[:flags] << f }
+  opts.on('--runs N', Integer, 'compile each program N times, keeping the fastest') { |n| options[:runs] = n }
+  opts.on('--max-exponent X', Float, 'largest exponent accepted (default: 1.3)') { |x| options[:max_exponent] = x }
+  opts.on('--quick', 'smaller programs, for a smoke test') { options[:quick] = true }
+  opts.on('--only AXIS', 'run only one series (statements, depth, decls, dims, expr-depth)') { |a| options[:only] = a }
+  opts.on('--csv FILE', 'also write every measurement to FILE') { |f| options[:csv] = f }
+end.parse!
+options[:flags] = ['-o', '-O'] if options[:flags].empty?
+
+GENERATOR = File.join(File.dirname(__FILE__), 'gen_program.rb')
+
+# Phases whose time is under this many milliseconds at the largest size
+# are too close to the clock's noise to fit a curve to.
+NOISE_FLOOR_MS = 2.0
+
+# Each series varies one parameter of gen_program.rb, keeping the others at
+# these values, except that the decls series grows the statements with the
+# declarations: a symbol table whose lookups get slower as it grows would
+# otherwise look linear.
+BASE = { statements: 200, depth: 2, decls: 50, dims: 2, expr_depth: 3 }
+SERIES = [
+  ['statements', :statements, [500, 1000, 2000, 4000, 8000]],
+  ['depth', :depth, [2, 4, 8, 16, 32]],
+  ['decls', :decls, [250, 500, 1000, 2000, 4000]],
+  ['dims', :dims, [1, 2, 4, 8, 16]],
+  ['expr-depth', :expr_depth, [2, 4, 8, 16, 32]],
+]
+
+def generate(params, filename)
+  args = params.map { |k, v| "--#{k.to_s.tr('_', '-')} #{v}" }.join(' ')
+  system("#{GENERATOR} #{args} > #{filename}") or abort "#{GENERATOR} failed"
+end
+
+# Compile the program, returning the wall time of each phase in the -T
+# report (in ms), with the times of a phase which runs in several places
+# added up.
+def measure(compiler, flags, filename)
+  report = `#{compiler} -T #{flags} #{filename} 2>&1 >/dev/null`
+  abort "#{compiler} failed on #{filename}:\n#{report}" unless $?.success?
+  times = Hash.new(0.0)
+  report.each_line.drop(1).each do |line|
+    # name, [calls,] wall ms, %, cpu ms, allocs, peak RSS MB
+    fields = line.split
+    times[fields[0]] += fields[-5].to_f
+  end
+  times
+end
+
+# least-squares slope of log(y) against log(x)
+def exponent(points)
+  xs = points.map { |x, _| Math.log(x) }
+  ys = points.map { |_, y| Math.log(y) }
+  n = points.size.to_f
+  mx = xs.sum / n
+  my = ys.sum / n
+  sxx = xs.map { |x| (x - mx)**2 }.sum
+  return 0.0 if sxx == 0
+  xs.zip(ys).map { |x, y| (x - mx) * (y - my) }.sum / sxx
+end
+
+csv = options[:csv] && File.open(options[:csv], 'w')
+csv&.puts 'flags,series,size,phase,ms'
+regressions = []
+
+Dir.mktmpdir('bench') do |dir|
+  options[:flags].product(SERIES).each do |flags, (name, param, sizes)|
+    next if options[:only] && options[:only] != name
+    sizes = sizes.first(3) if options[:quick]
+    results = sizes.map do |size|
+      params = BASE.merge(param => size)
+      params[:statements] = size if param == :decls
+      filename = File.join(dir, "#{name}_#{size}.in")
+      generate(params, filename) unless File.exist?(filename)
+      runs = (1..options[:runs]).map { measure(options[:compiler], flags, filename) }
+      # the fastest time of each phase
+      best = runs.first.keys.map { |phase| [phase, runs.map { |r| r[phase] }.min] }.to_h
+      best.each { |phase, ms| csv&.puts "#{flags},#{name},#{size},#{phase},#{ms}" }
+      [size, File.size(filename), best]
+    end
+
+    # the phases which take a measurable time, in the order they run
+    phases = results.last[2].keys.select { |phase| results.last[2][phase] >= NOISE_FLOOR_MS }
+    phases.delete('total')
+    phases.unshift('total')
+
+    puts "== #{name} (#{flags}) =="
+    width = [phases.map(&:size).max, 10].max
+    puts format("%-#{width}s", name) + sizes.map { |s| format('%10s', s) }.join
+    puts format("%-#{width}s", 'KB') + results.map { |_, bytes, _| format('%10.1f', bytes / 1024.0) }.join +
+         format('%10s', 'exponent')
+    phases.each do |phase|
+      points = results.map { |size, _, times| [size, times[phase]] }
+      e = points.all? { |_, ms| ms > 0 } ? exponent(points) : 0.0
+      flag = e > options[:max_exponent] ? '  <-- superlinear' : ''
+      regressions << "#{name} (#{flags}): #{phase} (exponent #{format('%.2f', e)})" unless flag.empty?
+      puts format("%-#{width}s", phase) + points.map { |_, ms| format('%10.1f', ms) }.join +
+           format('%10.2f', e) + flag
+    end
+    puts
+  end
+end
+
+csv&.close
+unless regressions.empty?
+  puts "Phases which grow faster than size^#{options[:max_exponent]}:"
+  regressions.each { |r| puts "  #{r}" }
+  exit 1
+end
@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "batch.h"
+#include "cpputil.h"
+#include "cache.h"
+
+namespace {
+
+// bumped whenever the format of the entries or the key changes
+const char CACHE_FORMAT[] = "1";
+
+////////////////////////////////////////////////////////////////////////
+// SHA-256 (FIPS 180-4)
+////////////////////////////////////////////////////////////////////////
+
+class Sha256 {
+	uint32_t m_state[8];
+	unsigned char m_block[64];
+	size_t m_block_length;
+	uint64_t m_length;
+
+public:
+	Sha256()
+		: m_state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}
+		, m_block_length(0)
+		, m_length(0) {
+	}
+
+	void update(const void* data, size_t length) {
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		m_length += length;
+		while (length > 0) {
+			const size_t n = std::min(length, sizeof(m_block) - m_block_length);
+			memcpy(m_block + m_block_length, p, n);
+			m_block_length += n;
+			p += n;
+			length -= n;
+			if (m_block_length == sizeof(m_block)) {
+				transform();
+				m_block_length = 0;
+			}
+		}
+	}
+
+	// the digest in hex
+	std::string finish() {
+		const uint64_t bits = m_length * 8;
+		const unsigned char pad = 0x80, zero = 0;
+		update(&pad, 1);
+		while (m_block_length != 56) update(&zero, 1);
+		unsigned char length[8];
+		for (int i = 0; i < 8; i++) length[i] = (unsigned char)(bits >> (56 - 8 * i));
+		update(length, 8);
+		static const char digits[] = "0123456789abcdef";
+		std::string hex;
+		for (const uint32_t word : m_state) {
+			for (int shift = 28; shift >= 0; shift -= 4) hex += digits[(word >> shift) & 0xF];
+		}
+		return hex;
+	}
+
+private:
+	static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+	void transform() {
+		static const uint32_t k[64] = {
+			0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+			0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+			0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+			0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+			0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+			0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+			0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+			0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+		};
+		uint32_t w[64];
+		for (int i = 0; i < 16; i++) {
+			w[i] = uint32_t(m_block[4 * i]) << 24 | uint32_t(m_block[4 * i + 1]) << 16 |
+			       uint32_t(m_block[4 * i + 2]) << 8 | uint32_t(m_block[4 * i + 3]);
+		}
+		for (int i = 16; i < 64; i++) {
+			const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+		uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+		uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+		for (int i = 0; i < 64; i++) {
+			const uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+			const uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		m_state[0] += a; m_state[1] += b; m_state[2] += c; m_state[3] += d;
+		m_state[4] += e; m_state[5] += f; m_state[6] += g; m_state[7] += h;
+	}
+};
+
+// Hash the source text with each run of blanks, newlines and comments
+// (which run from "--" to the end of the line) replaced by one space, the
+// way both scanners skip them.  Anything else, including characters the
+// scanners reject, is hashed as it is.
+void hash_normalized(Sha256& hash, const char* text, size_t length) {
+	const char* p = text;
+	const char* end = text + length;
+	bool separated = true; // at the start, or after a space already hashed
+	while (p < end) {
+		const char* token = p;
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\n' && !(*p == '-' && p + 1 < end && p[1] == '-')) p++;
+		if (p > token) {
+			hash.update(token, size_t(p - token));
+			separated = false;
+		}
+		bool skipped = false;
+		for (;;) {
+			if (p < end && (*p == ' ' || *p == '\t' || *p == '\n')) p++;
+			else if (p + 1 < end && p[0] == '-' && p[1] == '-') {
+				const void* newline = memchr(p, '\n', size_t(end - p));
+				p = newline ? static_cast<const char*>(newline) : end;
+			}
+			else break;
+			skipped = true;
+		}
+		if (skipped && !separated && p < end) {
+			hash.update(" ", 1);
+			separated = true;
+		}
+	}
+}
+
+// the size and modification time of the running executable, so that
+// rebuilding the compiler invalidates the cache
+std::string get_build_id() {
+	struct stat st;
+	if (stat("/proc/self/exe", &st) != 0) return __DATE__ " " __TIME__;
+	return std::to_string(st.st_size) + ":" + std::to_string(st.st_mtim.tv_sec) + "." +
+	       std::to_string(st.st_mtim.tv_nsec);
+}
+
+bool read_file(const std::string& path, std::string& contents) {
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	bool ok = fstat(fd, &st) == 0;
+	if (ok) {
+		contents.resize(size_t(st.st_size));
+		size_t length = 0;
+		while (ok && length < contents.size()) {
+			const ssize_t n = ::read(fd, &contents[length], contents.size() - length);
+			ok = n > 0;
+			if (ok) length += size_t(n);
+		}
+	}
+	close(fd);
+	return ok;
+}
+
+struct Entry {
+	std::string path;
+	uint64_t size;
+	struct timespec mtime;
+};
+
+// the files in the cache's subdirectories
+std::vector<Entry> list_entries(const std::string& dir) {
+	std::vector<Entry> entries;
+	static const char digits[] = "0123456789abcdef";
+	for (int i = 0; i < 256; i++) {
+		const std::string subdir = dir + "/" + digits[i >> 4] + digits[i & 0xF];
+		DIR* d = opendir(subdir.c_str());
+		if (!d) continue;
+		while (const dirent* ent = readdir(d)) {
+			if (ent->d_name[0] == '.') continue;
+			Entry entry;
+			entry.path = subdir + "/" + ent->d_name;
+			struct stat st;
+			if (stat(entry.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+			entry.size = uint64_t(st.st_size);
+			entry.mtime = st.st_mtim;
+			entries.push_back(entry);
+		}
+		closedir(d);
+	}
+	return entries;
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////
+// CompileCache
+////////////////////////////////////////////////////////////////////////
+
+CompileCache::CompileCache(const std::string& dir, uint64_t max_size)
+	: m_dir(dir)
+	, m_max_size(max_size)
+	, m_build_id(get_build_id()) {
+}
+
+bool CompileCache::open() {
+	return cpputil::make_directories(m_dir);
+}
+
+std::string CompileCache::get_key(const char* text, size_t length, const CompileOptions& options) const {
+	Sha256 hash;
+	std::string header = std::string(CACHE_FORMAT) + '\0' + m_build_id + '\0';
+	if (options.optimize_flag) header += options.optimize_flag;
+	if (options.hand_written_scanner) header += 'f';
+	header += '\0';
+	hash.update(header.data(), header.size());
+	hash_normalized(hash, text, length);
+	return hash.finish();
+}
+
+bool CompileCache::lookup(const std::string& key, std::string& output) {
+	const std::string path = get_entry_path(key);
+	const bool hit = read_file(path, output);
+	if (hit) utimensat(AT_FDCWD, path.c_str(), nullptr, 0); // now recently used
+	update_stats([hit](Stats& stats) {
+		if (hit) stats.hits++;
+		else stats.misses++;
+	});
+	return hit;
+}
+
+void CompileCache::store(const std::string& key, const std::string& output) {
+	const std::string path = get_entry_path(key);
+	mkdir(path.substr(0, path.find_last_of('/')).c_str(), 0755);
+	if (!cpputil::write_file_atomically(path, output)) return;
+	const uint64_t size = output.size();
+	update_stats([size](Stats& stats) { stats.size += size; });
+}
+
+void CompileCache::print_stats(FILE* out) {
+	Stats stats;
+	update_stats([&stats](Stats& current) { stats = current; });
+	uint64_t size = 0;
+	const auto entries = list_entries(m_dir);
+	for (const auto& entry : entries) size += entry.size;
+	const uint64_t lookups = stats.hits + stats.misses;
+	fprintf(out, "cache directory  %s\n", m_dir.c_str());
+	fprintf(out, "hits             %llu (%.1f%%)\n", (unsigned long long) stats.hits,
+	        lookups ? 100.0 * double(stats.hits) / double(lookups) : 0.0);
+	fprintf(out, "misses           %llu\n", (unsigned long long) stats.misses);
+	fprintf(out, "evictions        %llu\n", (unsigned long long) stats.evictions);
+	fprintf(out, "entries          %zu\n", entries.size());
+	fprintf(out, "size             %.1f MB (limit %.1f MB)\n", double(size) / (1 << 20), double(m_max_size) / (1 << 20));
+}
+
+std::string CompileCache::get_entry_path(const std::string& key) const {
+	return m_dir + "/" + key.substr(0, 2) + "/" + key.substr(2) + ".S";
+}
+
+template<typename Update>
+void CompileCache::update_stats(Update update) {
+	// each call opens the file itself, so flock also keeps this process's
+	// threads apart
+	const int fd = ::open((m_dir + "/stats").c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0) return;
+	while (flock(fd, LOCK_EX) != 0 && errno == EINTR) {}
+	Stats stats = read_stats(fd);
+	update(stats);
+	if (stats.size > m_max_size) {
+		uint64_t num_evicted = 0;
+		stats.size = evict(m_max_size / 10 * 9, num_evicted);
+		stats.evictions += num_evicted;
+	}
+	write_stats(fd, stats); // failing only loses this update
+	close(fd); // releases the lock
+}
+
+// The stats file is one line of four counts, each padded to the same
+// width, so that it can be rewritten in place.
+CompileCache::Stats CompileCache::read_stats(int fd) const {
+	Stats stats;
+	char buf[STATS_LENGTH + 1];
+	const ssize_t n = pread(fd, buf, STATS_LENGTH, 0);
+	unsigned long long hits, misses, size, evictions;
+	if (n == STATS_LENGTH) {
+		buf[n] = '\0';
+		if (sscanf(buf, "%llu %llu %llu %llu", &hits, &misses, &size, &evictions) == 4) {
+			stats.hits = hits;
+			stats.misses = misses;
+			stats.size = size;
+			stats.evictions = evictions;
+		}
+	}
+	return stats;
+}
+
+bool CompileCache::write_stats(int fd, const Stats& stats) const {
+	char buf[STATS_LENGTH + 1];
+	snprintf(buf, sizeof(buf), "%19llu %19llu %19llu %19llu\n", (unsigned long long) stats.hits,
+	         (unsigned long long) stats.misses, (unsigned long long) stats.size, (unsigned long long) stats.evictions);
+	return pwrite(fd, buf, STATS_LENGTH, 0) == STATS_LENGTH;
+}
+
+// Remove the least recently used entries until the rest take up no more
+// than target_size, returning their size.  The total is recounted from
+// the directory, which corrects any drift in the stats file (e.g. from
+// two processes storing the same entry).
+uint64_t CompileCache::evict(uint64_t target_size, uint64_t& num_evicted) const {
+	auto entries = list_entries(m_dir);
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+		return a.mtime.tv_sec != b.mtime.tv_sec ? a.mtime.tv_sec < b.mtime.tv_sec : a.mtime.tv_nsec < b.mtime.tv_nsec;
+	});
+	uint64_t size = 0;
+	for (const auto& entry : entries) size += entry.size;
+	for (const auto& entry : entries) {
+		if (size <= target_size) break;
+		if (unlink(entry.path.c_str()) == 0) {
+			size -= entry.size;
+			num_evicted++;
+		}
+	}
+	return size;
+}
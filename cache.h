@@ -0,0 +1,71 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+struct CompileOptions;
+
+// An on-disk cache of assembly language (compiler -C dir), shared by any
+// number of compiler processes and threads.
+//
+// An entry is named by the SHA-256 hash of the compiler's build id (the
+// size and modification time of its executable), the options that affect
+// code generation and the normalized source text: every run of blanks,
+// newlines and comments is replaced by one space, so an edit which only
+// touches comments or layout still hits.  (Successful compilations never
+// depend on where a token is in the file, and failed ones aren't cached.)
+// Entries live in 256 subdirectories, named by the hash's first byte, and
+// are written to a temporary file which is renamed into place, so a
+// reader never sees half an entry.
+//
+// The directory's "stats" file keeps the hit and miss counts and the
+// total size of the entries, updated while it's locked with flock.
+// Each hit touches its entry, so the entries' modification times order
+// them by last use; once a store takes the total over the size limit,
+// the least recently used entries are evicted down to 90% of it.
+class CompileCache {
+	std::string m_dir;
+	uint64_t m_max_size;
+	std::string m_build_id;
+
+public:
+	static const uint64_t DEFAULT_MAX_SIZE = 256 * 1024 * 1024;
+
+	CompileCache(const std::string& dir, uint64_t max_size);
+
+	// create the directory if need be, returning false if it can't be
+	bool open();
+
+	// the name of the entry for a source text compiled with options
+	std::string get_key(const char* text, size_t length, const CompileOptions& options) const;
+
+	// the cached output for key, if there is one (counted as a hit or a miss)
+	bool lookup(const std::string& key, std::string& output);
+
+	// add an entry (failures are ignored: the cache is only an optimization)
+	void store(const std::string& key, const std::string& output);
+
+	// print the statistics, and the size of the entries actually on disk
+	void print_stats(FILE* out);
+
+private:
+	struct Stats {
+		uint64_t hits = 0, misses = 0, size = 0, evictions = 0;
+	};
+
+	std::string get_entry_path(const std::string& key) const;
+
+	static const int STATS_LENGTH = 4 * 20;
+
+	// read the stats file, apply update, evicting entries if they're over
+	// the size limit, and write it back, all while it's locked
+	template<typename Update>
+	void update_stats(Update update);
+	Stats read_stats(int fd) const;
+	bool write_stats(int fd, const Stats& stats) const;
+	uint64_t evict(uint64_t target_size, uint64_t& num_evicted) const;
+};
+
+#endif // CACHE_H
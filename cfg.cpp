@@ -1,6 +1,7 @@
 #include <cassert>
 #include <cstdio>
 #include <algorithm>
+#include <set>
 #include "cpputil.h"
 #include "cfg.h"
 
@@ -12,6 +13,7 @@ Operand::Operand()
   : m_kind(OPERAND_NONE)
   , m_basereg(0)
   , m_indexreg(0)
+  , m_scale(1)
   , m_ival(0)
  {
 }
@@ -20,12 +22,13 @@ Operand::Operand(OperandKind kind, long ival)
   : m_kind(kind)
   , m_basereg(0)
   , m_indexreg(0)
+  , m_scale(1)
   , m_ival(0) {
   assert(kind == OPERAND_VREG || kind == OPERAND_MREG ||
          kind == OPERAND_VREG_MEMREF || kind == OPERAND_MREG_MEMREF ||
-         kind == OPERAND_INT_LITERAL);
+         kind == OPERAND_INT_LITERAL || kind == OPERAND_FRAME_MEMREF_OFFSET);
 
-  if (kind == OPERAND_INT_LITERAL) {
+  if ((kind & OPROP_HAS_INTVAL) != 0) {
     m_ival = ival;
   } else {
     m_basereg = int(ival);
@@ -36,6 +39,7 @@ Operand::Operand(OperandKind kind, int basereg, int offset_or_index)
   : m_kind(kind)
   , m_basereg(basereg)
   , m_indexreg(0)
+  , m_scale(1)
   , m_ival(0) {
   assert(kind == OPERAND_VREG_MEMREF_OFFSET || kind == OPERAND_VREG_MEMREF_INDEX ||
          kind == OPERAND_MREG_MEMREF_OFFSET || kind == OPERAND_MREG_MEMREF_INDEX);
@@ -47,19 +51,22 @@ Operand::Operand(OperandKind kind, int basereg, int offset_or_index)
   }
 }
 
-Operand::Operand(OperandKind kind, int basereg, int indexreg, int offset)
+Operand::Operand(OperandKind kind, int basereg, int indexreg, int offset, int scale)
   : m_kind(kind)
-  , m_basereg(basereg)
+  , m_basereg(kind == OPERAND_FRAME_MEMREF_OFFSET_INDEX ? 0 : basereg)
   , m_indexreg(indexreg)
+  , m_scale(scale)
   , m_ival(offset) {
-  // currently there is only one kind of reg+reg+offset operand
-  assert(m_kind == OPERAND_MREG_MEMREF_OFFSET_INDEX);
+  assert(m_kind == OPERAND_MREG_MEMREF_OFFSET_INDEX || m_kind == OPERAND_VREG_MEMREF_OFFSET_INDEX ||
+         m_kind == OPERAND_FRAME_MEMREF_OFFSET_INDEX);
+  assert(scale == 1 || scale == 2 || scale == 4 || scale == 8);
 }
 
 Operand::Operand(const std::string &target_label, bool is_immediate)
   : m_kind(is_immediate ? OPERAND_LABEL_IMMEDIATE : OPERAND_LABEL)
   , m_basereg(0)
   , m_indexreg(0)
+  , m_scale(1)
   , m_ival(0)
   , m_target_label(target_label) {
 }
@@ -82,6 +89,10 @@ int Operand::get_index_reg() const {
   return m_indexreg;
 }
 
+int Operand::get_scale() const {
+  return m_scale;
+}
+
 long Operand::get_int_value() const {
   assert(m_kind == OPERAND_INT_LITERAL);
   return m_ival;
@@ -166,6 +177,12 @@ Instruction *Instruction::duplicate() const {
 InstructionSequence::InstructionSequence() {
 }
 
+InstructionSequence::~InstructionSequence() {
+  for (auto i = m_instr_seq.begin(); i != m_instr_seq.end(); i++) {
+    delete *i;
+  }
+}
+
 void InstructionSequence::add_instruction(Instruction *ins) {
   m_labels.push_back(m_next_label);
   m_instr_seq.push_back(ins);
@@ -257,6 +274,9 @@ PrintInstructionSequence::PrintInstructionSequence(InstructionSequence *iseq)
   : m_iseq(iseq) {
 }
 
+PrintInstructionSequence::~PrintInstructionSequence() {
+}
+
 std::string PrintInstructionSequence::format_instruction(const Instruction *ins) {
   std::string formatted_ins;
   formatted_ins += get_opcode_name(ins->get_opcode());
@@ -280,20 +300,20 @@ std::string PrintInstructionSequence::format_instruction(const Instruction *ins)
   return formatted_ins;
 }
 
-void PrintInstructionSequence::print() {
+void PrintInstructionSequence::print(FILE *out) {
   for (unsigned i = 0; i < m_iseq->get_length(); i++) {
     if (m_iseq->has_label(i)) {
       std::string label = m_iseq->get_label(i);
-      printf("%s:\n", label.c_str());
+      fprintf(out, "%s:\n", label.c_str());
     }
     Instruction *ins = m_iseq->get_instruction(i);
     std::string formatted_ins = format_instruction(ins);
-    printf("\t%s\n", formatted_ins.c_str());
+    fprintf(out, "\t%s\n", formatted_ins.c_str());
   }
 
   // special case: if there is a label at the end, print it
   if (m_iseq->has_label_at_end()) {
-    printf("%s:\n", m_iseq->get_label_at_end().c_str());
+    fprintf(out, "%s:\n", m_iseq->get_label_at_end().c_str());
   }
 }
 
@@ -320,10 +340,25 @@ std::string PrintInstructionSequence::format_operand(const Operand &operand) {
                            get_mreg_name(operand.get_base_reg()).c_str(),
                            get_mreg_name(operand.get_index_reg()).c_str());
   case OPERAND_MREG_MEMREF_OFFSET_INDEX:
+    if (operand.get_scale() != 1) {
+      return cpputil::format("%d(%s, %s, %d)",
+                             operand.get_offset(),
+                             get_mreg_name(operand.get_base_reg()).c_str(),
+                             get_mreg_name(operand.get_index_reg()).c_str(),
+                             operand.get_scale());
+    }
     return cpputil::format("%d(%s, %s)",
                            operand.get_offset(),
                            get_mreg_name(operand.get_base_reg()).c_str(),
                            get_mreg_name(operand.get_index_reg()).c_str());
+  case OPERAND_VREG_MEMREF_OFFSET_INDEX:
+    return cpputil::format("%d(vr%d,vr%d,%d)", operand.get_offset(), operand.get_base_reg(),
+                           operand.get_index_reg(), operand.get_scale());
+  case OPERAND_FRAME_MEMREF_OFFSET:
+    return cpputil::format("%d(frame)", operand.get_offset());
+  case OPERAND_FRAME_MEMREF_OFFSET_INDEX:
+    return cpputil::format("%d(frame,vr%d,%d)", operand.get_offset(), operand.get_index_reg(),
+                           operand.get_scale());
   case OPERAND_INT_LITERAL:
     return cpputil::format("$%ld", operand.get_int_value());
   case OPERAND_LABEL:
@@ -393,6 +428,15 @@ ControlFlowGraph::ControlFlowGraph()
 }
 
 ControlFlowGraph::~ControlFlowGraph() {
+  // every Edge is in the outgoing list of its source
+  for (auto i = m_outgoing_edges.begin(); i != m_outgoing_edges.end(); i++) {
+    for (auto j = i->second.begin(); j != i->second.end(); j++) {
+      delete *j;
+    }
+  }
+  for (auto i = m_basic_blocks.begin(); i != m_basic_blocks.end(); i++) {
+    delete *i;
+  }
 }
 
 BasicBlock *ControlFlowGraph::get_entry_block() const {
@@ -419,8 +463,9 @@ BasicBlock *ControlFlowGraph::create_basic_block(BasicBlockKind kind, const std:
 
 Edge *ControlFlowGraph::create_edge(BasicBlock *source, BasicBlock *target, EdgeKind kind) {
   // make sure BasicBlocks belong to this ControlFlowGraph
-  assert(std::find(m_basic_blocks.begin(), m_basic_blocks.end(), source) != m_basic_blocks.end());
-  assert(std::find(m_basic_blocks.begin(), m_basic_blocks.end(), target) != m_basic_blocks.end());
+  // (a block's id is its index in m_basic_blocks, so this takes constant time)
+  assert(source->get_id() < m_basic_blocks.size() && m_basic_blocks[source->get_id()] == source);
+  assert(target->get_id() < m_basic_blocks.size() && m_basic_blocks[target->get_id()] == target);
 
   // make sure this Edge doesn't already exist
   assert(lookup_edge(source, target) == nullptr);
@@ -459,7 +504,7 @@ const ControlFlowGraph::EdgeList &ControlFlowGraph::get_incoming_edges(BasicBloc
   return i == m_incoming_edges.end() ? m_empty_edge_list : i->second;
 }
 
-InstructionSequence *ControlFlowGraph::create_instruction_sequence() const {
+InstructionSequence *ControlFlowGraph::create_instruction_sequence(BlockList *block_order) const {
   assert(m_entry != nullptr);
   assert(m_exit != nullptr);
   assert(m_outgoing_edges.size() == m_incoming_edges.size());
@@ -554,15 +599,19 @@ InstructionSequence *ControlFlowGraph::create_instruction_sequence() const {
           // mark the block as finished, but don't append its instructions yet
           finished_blocks[b->get_id()] = true;
         } else {
-          append_basic_block(result, b, finished_blocks);
+          append_basic_block(result, b, finished_blocks, block_order);
         }
 
         // Visit control successors
         visit_successors(b, work_list);
       }
     } else {
-      // This basic block is not part of a Chunk
-      append_basic_block(result, bb, finished_blocks);
+      // This basic block is not part of a Chunk.  If it's the exit block
+      // (reached only by branches), it is appended at the end.
+      if (bb == m_exit) {
+        continue;
+      }
+      append_basic_block(result, bb, finished_blocks, block_order);
 
       // Visit control successors
       visit_successors(bb, work_list);
@@ -571,13 +620,28 @@ InstructionSequence *ControlFlowGraph::create_instruction_sequence() const {
 
   // append exit chunk
   if (exit_chunk != nullptr) {
-    append_chunk(result, exit_chunk, finished_blocks);
+    append_chunk(result, exit_chunk, finished_blocks, block_order);
+  } else {
+    append_basic_block(result, m_exit, finished_blocks, block_order);
+  }
+
+  // delete the Chunks (each one is mapped to by every block it contains)
+  std::set<Chunk *> chunks;
+  for (ChunkMap::iterator i = chunk_map.begin(); i != chunk_map.end(); i++) {
+    chunks.insert(i->second);
+  }
+  for (std::set<Chunk *>::iterator i = chunks.begin(); i != chunks.end(); i++) {
+    delete *i;
   }
 
   return result;
 }
 
-void ControlFlowGraph::append_basic_block(InstructionSequence *iseq, const BasicBlock *bb, std::vector<bool> &finished_blocks) const {
+void ControlFlowGraph::append_basic_block(InstructionSequence *iseq, const BasicBlock *bb, std::vector<bool> &finished_blocks,
+                                          BlockList *block_order) const {
+  if (block_order != nullptr) {
+    block_order->push_back(const_cast<BasicBlock *>(bb));
+  }
   if (bb->has_label()) {
     iseq->define_label(bb->get_label());
   }
@@ -587,9 +651,10 @@ void ControlFlowGraph::append_basic_block(InstructionSequence *iseq, const Basic
   finished_blocks[bb->get_id()] = true;
 }
 
-void ControlFlowGraph::append_chunk(InstructionSequence *iseq, Chunk *chunk, std::vector<bool> &finished_blocks) const {
+void ControlFlowGraph::append_chunk(InstructionSequence *iseq, Chunk *chunk, std::vector<bool> &finished_blocks,
+                                    BlockList *block_order) const {
   for (auto i = chunk->blocks.begin(); i != chunk->blocks.end(); i++) {
-    append_basic_block(iseq, *i, finished_blocks);
+    append_basic_block(iseq, *i, finished_blocks, block_order);
   }
 }
 
@@ -634,7 +699,11 @@ ControlFlowGraph *ControlFlowGraphBuilder::build() {
     assert(item.ins_index <= m_iseq->get_length());
 
     // if item target is end of InstructionSequence, then it targets the exit block
+    // (which takes on the branch's label, so the label survives flattening)
     if (item.ins_index == m_iseq->get_length()) {
+      if (!item.label.empty() && !exit->has_label()) {
+        exit->set_label(item.label);
+      }
       m_cfg->create_edge(item.pred, exit, item.edge_kind);
       continue;
     }
@@ -650,7 +719,7 @@ ControlFlowGraph *ControlFlowGraphBuilder::build() {
       // Special case: if this block was originally discovered via a fall-through
       // edge, but is also reachable via a branch, then it might not be labeled
       // yet.  Set the label if necessary.
-      if (item.edge_kind == EDGE_BRANCH && !bb->has_label()) {
+      if (!item.label.empty() && !bb->has_label()) {
         bb->set_label(item.label);
       }
     } else {
@@ -665,7 +734,7 @@ ControlFlowGraph *ControlFlowGraphBuilder::build() {
     // if the edge is a branch, make sure the work item's label matches
     // the BasicBlock's label (if it doesn't, then somehow this block
     // is reachable via two different labels, which shouldn't be possible)
-    assert(item.edge_kind != EDGE_BRANCH || bb->get_label() == item.label);
+    assert(item.label.empty() || bb->get_label() == item.label);
 
     // connect to predecessor
     m_cfg->create_edge(item.pred, bb, item.edge_kind);
@@ -678,6 +747,8 @@ ControlFlowGraph *ControlFlowGraphBuilder::build() {
     // if this basic block ends in a branch, prepare to create an edge
     // to the BasicBlock for the target (creating the BasicBlock if it
     // doesn't exist yet)
+    unsigned next_index = item.ins_index + bb->get_length();
+    std::string next_label;
     if (ends_in_branch(bb)) {
       unsigned target_index = get_branch_target_index(bb);
       // Note: we assume that branch instructions have a single Operand,
@@ -687,28 +758,42 @@ ControlFlowGraph *ControlFlowGraphBuilder::build() {
       Operand operand = (*branch)[0];
       assert(operand.get_kind() == OPERAND_LABEL);
       std::string target_label = operand.get_target_label();
-      work_list.push_back({ ins_index: target_index, pred: bb, edge_kind: EDGE_BRANCH, label: target_label });
+      if (falls_through(bb) && target_index == next_index) {
+        // a conditional branch to the next instruction (e.g., around code
+        // that was optimized away): there is only one edge between two
+        // blocks, so the fall-through edge stands for both, and its target
+        // must still get the branch's label
+        next_label = target_label;
+      } else {
+        work_list.push_back({ ins_index: target_index, pred: bb, edge_kind: EDGE_BRANCH, label: target_label });
+      }
     }
 
     // if this basic block falls through, prepare to create an edge
     // to the BasicBlock for successor instruction (creating it if it doesn't
     // exist yet)
     if (falls_through(bb)) {
-      unsigned target_index = item.ins_index + bb->get_length();
+      unsigned target_index = next_index;
       assert(target_index <= m_iseq->get_length());
       if (target_index == num_instructions) {
         // this is the basic block at the end of the instruction sequence,
         // its fall-through successor should be the exit block
         last = bb;
+        if (!next_label.empty() && !exit->has_label()) {
+          exit->set_label(next_label);
+        }
       } else {
         // fall through to basic block starting at successor instruction
-        work_list.push_back({ ins_index: target_index, pred: bb, edge_kind: EDGE_FALLTHROUGH });
+        work_list.push_back({ ins_index: target_index, pred: bb, edge_kind: EDGE_FALLTHROUGH, label: next_label });
       }
     }
   }
 
-  assert(last != nullptr);
-  m_cfg->create_edge(last, exit, EDGE_FALLTHROUGH);
+  // if the last instruction is an unconditional jump (e.g., once the code
+  // after it has been optimized away), only branches reach the exit block
+  if (last != nullptr) {
+    m_cfg->create_edge(last, exit, EDGE_FALLTHROUGH);
+  }
 
   return m_cfg;
 }
@@ -2,6 +2,7 @@
 #define CFG_H
 
 #include <cassert>
+#include <cstdio>
 #include <vector>
 #include <map>
 #include <deque>
@@ -48,6 +49,14 @@ enum OperandKind {
 	OPERAND_LABEL = (OPROP_HAS_LABEL) + 12,
 	// label used as an immediate operand
 	OPERAND_LABEL_IMMEDIATE = (OPROP_HAS_LABEL | OPROP_IS_IMMEDIATE) + 13,
+	// memory reference with address specified by vreg+vreg*scale+offset
+	OPERAND_VREG_MEMREF_OFFSET_INDEX = (OPROP_HAS_BASEREG | OPROP_HAS_INDEXREG | OPROP_HAS_INTVAL | OPROP_IS_MEMREF) +
+	14,
+	// memory reference with address specified by frame+offset, i.e., a
+	// local variable at a fixed offset
+	OPERAND_FRAME_MEMREF_OFFSET = (OPROP_HAS_INTVAL | OPROP_IS_MEMREF) + 15,
+	// memory reference with address specified by frame+vreg*scale+offset
+	OPERAND_FRAME_MEMREF_OFFSET_INDEX = (OPROP_HAS_INDEXREG | OPROP_HAS_INTVAL | OPROP_IS_MEMREF) + 16,
 };
 
 struct Operand {
@@ -55,6 +64,7 @@ private:
 	enum OperandKind m_kind; // kind of operand
 	int m_basereg; // base register number
 	int m_indexreg; // index register number
+	int m_scale; // multiplier applied to the index register (1, 2, 4, or 8)
 	long m_ival; // literal integer value or offset value
 	std::string m_target_label;
 
@@ -66,7 +76,8 @@ public:
 	// (e.g., OPERAND_VREG, OPERAND_MREG, OPERAND_INT_LITERAL)
 	// Parameters:
 	//   - kind: the OperandKind
-	//   - ival: either a register number or a literal integer value
+	//   - ival: either a register number, a literal integer value,
+	//     or a frame offset (OPERAND_FRAME_MEMREF_OFFSET)
 	Operand(OperandKind kind, long ival);
 
 	// ctor for Operand with reg+integer or reg+reg
@@ -78,14 +89,16 @@ public:
 	//   - offset_or_index: either the integer offset value or index register number
 	Operand(OperandKind kind, int basereg, int offset_or_index);
 
-	// ctor for Operand with reg+reg+integer
-	// (e.g., OPERAND_MREG_MEMREF_OFFSET_INDEX)
+	// ctor for Operand with reg+reg*scale+integer
+	// (e.g., OPERAND_MREG_MEMREF_OFFSET_INDEX, OPERAND_VREG_MEMREF_OFFSET_INDEX,
+	// OPERAND_FRAME_MEMREF_OFFSET_INDEX)
 	// Parameters:
 	//   - kind: the OperandKind
-	//   - basereg: base register number
+	//   - basereg: base register number (ignored for the frame kind)
 	//   - indexreg: index register number
 	//   - offset: offset value
-	Operand(OperandKind kind, int basereg, int indexreg, int offset);
+	//   - scale: multiplier applied to the index register
+	Operand(OperandKind kind, int basereg, int indexreg, int offset, int scale = 1);
 
 	// ctor for label
 	// (e.g., OPERAND_LABEL, OPERAND_LABEL_IMMEDIATE)
@@ -117,6 +130,9 @@ public:
 	// get index register number
 	int get_index_reg() const;
 
+	// get multiplier applied to the index register
+	int get_scale() const;
+
 	// get literal integer value
 	long get_int_value() const;
 
@@ -169,8 +185,14 @@ public:
 	Instruction* duplicate() const;
 };
 
+// An InstructionSequence owns its Instructions, and deletes them when it
+// is destroyed.
 class InstructionSequence {
 private:
+	// disallow copy ctor and assignment operator
+	InstructionSequence(const InstructionSequence&);
+	InstructionSequence& operator=(const InstructionSequence&);
+
 	std::vector<Instruction*> m_instr_seq;
 
 	// vector of labels (corresponding to instruction indices)
@@ -191,6 +213,7 @@ public:
 	const_reverse_iterator crend() const { return m_instr_seq.crend(); }
 
 	InstructionSequence();
+	virtual ~InstructionSequence();
 
 	void add_instruction(Instruction* ins);
 
@@ -250,6 +273,7 @@ private:
 
 public:
 	PrintInstructionSequence(InstructionSequence* iseq);
+	virtual ~PrintInstructionSequence();
 
 	// subclasses must override the following member functions
 	virtual std::string get_opcode_name(int opcode) = 0;
@@ -257,7 +281,7 @@ public:
 
 	std::string format_instruction(const Instruction* ins);
 
-	void print();
+	void print(FILE* out = stdout);
 
 private:
 	std::string format_operand(const Operand& operand);
@@ -322,7 +346,8 @@ public:
 };
 
 // ControlFlowGraph: graph of BasicBlocks connected by Edges.
-// There are dedicated empty entry and exit blocks.
+// There are dedicated empty entry and exit blocks.  The ControlFlowGraph
+// owns its BasicBlocks and Edges.
 class ControlFlowGraph {
 public:
 	using BlockList = std::vector<BasicBlock*>;
@@ -416,12 +441,16 @@ public:
 	const EdgeList& get_incoming_edges(BasicBlock* bb) const;
 
 	// Return a "flat" InstructionSequence created from this ControlFlowGraph;
-	// this is useful for optimization passes which create a transformed ControlFlowGraph
-	InstructionSequence* create_instruction_sequence() const;
+	// this is useful for optimization passes which create a transformed ControlFlowGraph.
+	// If block_order is non-null, it is filled with the BasicBlocks in the order
+	// their instructions appear in the result.
+	InstructionSequence* create_instruction_sequence(BlockList* block_order = nullptr) const;
 
 private:
-	void append_basic_block(InstructionSequence* iseq, const BasicBlock* bb, std::vector<bool>& finished_blocks) const;
-	void append_chunk(InstructionSequence* iseq, Chunk* chunk, std::vector<bool>& finished_blocks) const;
+	void append_basic_block(InstructionSequence* iseq, const BasicBlock* bb, std::vector<bool>& finished_blocks,
+	                        BlockList* block_order) const;
+	void append_chunk(InstructionSequence* iseq, Chunk* chunk, std::vector<bool>& finished_blocks,
+	                  BlockList* block_order) const;
 	void visit_successors(BasicBlock* bb, std::deque<BasicBlock*>& work_list) const;
 };
 
@@ -4,14 +4,18 @@
 #include <iostream>
 #include <queue>
 #include <unordered_map>
+#include <cstdint>
 
 #include "highlevel.h"
 #include "x86_64.h"
 
 ControlFlowGraphTransform::ControlFlowGraphTransform(ControlFlowGraph* cfg)
-	: m_cfg(cfg) {}
+	: m_cfg(cfg)
+	  , m_live_vregs(nullptr) {}
 
-ControlFlowGraphTransform::~ControlFlowGraphTransform() {}
+ControlFlowGraphTransform::~ControlFlowGraphTransform() {
+	delete m_live_vregs;
+}
 
 ControlFlowGraph* ControlFlowGraphTransform::get_orig_cfg() {
 	return m_cfg;
@@ -60,12 +64,15 @@ ControlFlowGraph* ControlFlowGraphTransform::transform_cfg() {
 			result->create_edge(transformed_source, transformed_target, orig_edge->get_kind());
 		}
 	}
-	result = prune(result);
+	if (should_prune()) {
+		ControlFlowGraph* pruned = prune(result);
+		delete result;
+		result = pruned;
+	}
 	return result;
 }
 
 ControlFlowGraph* ControlFlowGraphTransform::prune(ControlFlowGraph* cfg) {
-	m_cfg = cfg;
 	m_live_vregs = new LiveVregs(cfg);
 	m_live_vregs->execute();
 	auto result = new ControlFlowGraph();
@@ -107,34 +114,55 @@ ControlFlowGraph* ControlFlowGraphTransform::prune(ControlFlowGraph* cfg) {
 }
 
 InstructionSequence* ControlFlowGraphTransform::prune_basic_block(BasicBlock* iseq) {
-	if (iseq->get_length() == 0) return iseq;
-	std::queue<int> mregs({
-		MREG_RAX, MREG_RBX, MREG_RCX, MREG_RDX,
-		MREG_R8, MREG_R9, MREG_R11, MREG_R12,
-		MREG_R13, MREG_R14, MREG_R15,
-	});
-	std::unordered_map<int, int> vreg_to_mreg;
-	LiveVregsControlFlowGraphPrinter printer(m_cfg, m_live_vregs);
+	// (the caller deletes the result, so it mustn't be the block itself)
+	if (iseq->get_length() == 0) return new InstructionSequence();
+	// walk the block backwards, tracking which vregs are live after each
+	// instruction, and drop defs of dead vregs that have no side effects
+	LiveVregs::LiveSet live = m_live_vregs->get_fact_at_end_of_block(iseq);
+	std::vector<Instruction*> kept;
+	for (auto i = iseq->crbegin(); i != iseq->crend(); ++i) {
+		Instruction* ins = *i;
+		if (HighLevel::is_def(ins) && is_pure(ins) && !live.test(ins->get_operand(0).get_base_reg()))
+			continue;
+		if (HighLevel::is_def(ins))
+			live.reset(ins->get_operand(0).get_base_reg());
+		for (unsigned j = 0; j < ins->get_num_operands(); j++) {
+			if (!HighLevel::is_use(ins, j)) continue;
+			const Operand op = ins->get_operand(j);
+			live.set(op.get_base_reg());
+			if (op.has_index_reg()) live.set(op.get_index_reg());
+		}
+		kept.push_back(ins);
+	}
 	auto result = new InstructionSequence();
-	for (unsigned i = 0; i < iseq->get_length(); i++) {
-		auto ins = iseq->get_instruction(i)->duplicate();
-		const auto set = m_live_vregs->get_fact_at_end_of_block(iseq);
-		if (ins->get_opcode() == HINS_LOAD_ICONST)
-			if (!set.test(ins->get_operand(0).get_base_reg()))
-				continue;
-		if (ins->get_opcode() == HINS_MOV)
-			if (!set.test(ins->get_operand(0).get_base_reg()) && ins->get_operand(1).get_kind() == OPERAND_INT_LITERAL)
-				continue;
-		result->add_instruction(ins);
+	// the block may still be labeled, so it needs an instruction
+	if (kept.empty()) {
+		result->add_instruction(new Instruction(HINS_NOP));
+		return result;
 	}
+	for (auto i = kept.rbegin(); i != kept.rend(); ++i)
+		result->add_instruction((*i)->duplicate());
 	return result;
 }
 
+// returns true if the given def can be removed when its result is unused
+bool ControlFlowGraphTransform::is_pure(const Instruction* ins) {
+	switch (ins->get_opcode()) {
+	case HINS_READ_INT: // consumes input
+	case HINS_INT_DIV: // may trap
+	case HINS_INT_MOD:
+		return false;
+	default:
+		return true;
+	}
+}
+
 ///////////////////////////////////
 // High Level CFG Transformation //
 ///////////////////////////////////
 InstructionSequence* HighLevelControlFlowGraphTransform::transform_basic_block(InstructionSequence* iseq) {
-	if (iseq->get_length() == 0) return iseq;
+	// (the caller deletes the result, so it mustn't be the block itself)
+	if (iseq->get_length() == 0) return new InstructionSequence();
 	//////////////////
 	// https://stackoverflow.com/questions/11408934/using-a-stdtuple-as-key-for-stdunordered-map
 	using key_t = std::tuple<int, int, int>;
@@ -162,6 +190,14 @@ InstructionSequence* HighLevelControlFlowGraphTransform::transform_basic_block(I
 	std::unordered_map<int, int> vreg_to_vn;
 	std::unordered_map<int, std::vector<int>> vn_to_vregs;
 	map_t op_to_vn;
+	// forget the value number held by a vreg that is about to be redefined
+	const auto forget = [&](const int vreg) {
+		const auto found = vreg_to_vn.find(vreg);
+		if (found == vreg_to_vn.end()) return;
+		std::vector<int>& vregs = vn_to_vregs[found->second];
+		vregs.erase(std::remove(vregs.begin(), vregs.end(), vreg), vregs.end());
+		vreg_to_vn.erase(found);
+	};
 	for (unsigned i = 0; i < iseq->get_length(); i++) {
 		auto ins = iseq->get_instruction(i)->duplicate();
 		const int opcode = ins->get_opcode();
@@ -237,12 +273,16 @@ InstructionSequence* HighLevelControlFlowGraphTransform::transform_basic_block(I
 			}
 		case HINS_INT_ADD:
 		case HINS_INT_MUL:
+		case HINS_INT_SUB:
+		case HINS_INT_DIV:
+		case HINS_INT_MOD:
 			{
 				const Operand dest_op = ins->get_operand(0);
 				const Operand left_op = ins->get_operand(1);
 				const Operand right_op = ins->get_operand(2);
 				int left_vn, right_vn;
 				// we have to check if the operands are ints specifically due to localaddr computations
+				// and constants propagated from other blocks
 				if (left_op.get_kind() == OPERAND_INT_LITERAL)
 					left_vn = const_to_vn.find(left_op.get_int_value()) != const_to_vn.end()
 						          ? const_to_vn[left_op.get_int_value()]
@@ -271,71 +311,42 @@ InstructionSequence* HighLevelControlFlowGraphTransform::transform_basic_block(I
 					std::vector<int>& vregs = vn_to_vregs[right_vn];
 					ins->set_operand(2, Operand(OPERAND_VREG, vregs.front()));
 				}
-				key_t op_key = std::make_tuple(ins->get_opcode(), std::min(left_vn, right_vn),
-				                               std::max(left_vn, right_vn));
-				const int dest_vn = op_to_vn.find(op_key) != op_to_vn.end() ? op_to_vn[op_key] : lvn++;
-				// if this instruction has not been seen before
-				if (op_to_vn.find(op_key) == op_to_vn.end()) op_to_vn[op_key] = dest_vn;
-				vreg_to_vn[dest_op.get_base_reg()] = dest_vn;
-				vn_to_vregs[dest_vn].push_back(dest_op.get_base_reg());
-				result->add_instruction(ins);
-				break;
-			}
-		case HINS_INT_SUB:
-		case HINS_INT_DIV:
-		case HINS_INT_MOD:
-			{
-				const Operand dest_op = ins->get_operand(0);
-				const Operand left_op = ins->get_operand(1);
-				const Operand right_op = ins->get_operand(2);
-				const int left_vn = vreg_to_vn.find(left_op.get_base_reg()) != vreg_to_vn.end()
-					                    ? vreg_to_vn[left_op.get_base_reg()]
-					                    : lvn++;
-				const int right_vn = vreg_to_vn.find(right_op.get_base_reg()) != vreg_to_vn.end()
-					                     ? vreg_to_vn[right_op.get_base_reg()]
-					                     : lvn++;
-				// if the left op has been seen before
-				if (vreg_to_vn.find(left_op.get_base_reg()) != vreg_to_vn.end()) {
-					// replace it with the first instance of the op
-					std::vector<int>& vregs = vn_to_vregs[left_vn];
-					ins->set_operand(1, Operand(OPERAND_VREG, vregs.front()));
-				}
-				// if the right op has been seen before
-				if (vreg_to_vn.find(right_op.get_base_reg()) != vreg_to_vn.end()) {
-					// replace it with the first instance of the op
-					std::vector<int>& vregs = vn_to_vregs[right_vn];
-					ins->set_operand(2, Operand(OPERAND_VREG, vregs.front()));
-				}
-				key_t op_key = std::make_tuple(ins->get_opcode(), left_vn, right_vn);
+				// only addition and multiplication are commutative
+				const bool commutative = opcode == HINS_INT_ADD || opcode == HINS_INT_MUL;
+				key_t op_key = commutative
+					               ? std::make_tuple(opcode, std::min(left_vn, right_vn), std::max(left_vn, right_vn))
+					               : std::make_tuple(opcode, left_vn, right_vn);
 				const int dest_vn = op_to_vn.find(op_key) != op_to_vn.end() ? op_to_vn[op_key] : lvn++;
 				// if this instruction has not been seen before
 				if (op_to_vn.find(op_key) == op_to_vn.end()) op_to_vn[op_key] = dest_vn;
+				forget(dest_op.get_base_reg());
 				vreg_to_vn[dest_op.get_base_reg()] = dest_vn;
 				vn_to_vregs[dest_vn].push_back(dest_op.get_base_reg());
 				result->add_instruction(ins);
 				break;
 			}
 		case HINS_INT_NEGATE:
-			{
-				break;
-			}
 		case HINS_READ_INT:
 			{
 				const Operand dest_op = ins->get_operand(0);
 				const int dest_vn = lvn++;
+				forget(dest_op.get_base_reg());
 				vreg_to_vn[dest_op.get_base_reg()] = dest_vn;
 				vn_to_vregs[dest_vn].push_back(dest_op.get_base_reg());
 				result->add_instruction(ins);
 				break;
 			}
 		default:
+			// any other def (e.g. a load) produces an unknown value
+			if (HighLevel::is_def(ins)) forget(ins->get_operand(0).get_base_reg());
 			result->add_instruction(ins);
 			break;
 		}
 		ins = result->get_last();
 		for (unsigned j = 1; j < ins->get_num_operands(); j++) {
 			auto op = ins->get_operand(j);
-			if (op.get_kind() == OPERAND_LABEL || op.get_kind() == OPERAND_INT_LITERAL) continue;
+			// only plain vregs can become literals (not memory references)
+			if (op.get_kind() != OPERAND_VREG) continue;
 			int vreg = op.get_base_reg();
 			if (vreg_to_vn.find(vreg) != vreg_to_vn.end()) {
 				int vn = vreg_to_vn[vreg];
@@ -351,6 +362,387 @@ InstructionSequence* HighLevelControlFlowGraphTransform::transform_basic_block(I
 ///////////////////////////////
 // X86_64 CFG Transformation //
 ///////////////////////////////
+namespace {
+unsigned reg_bit(int mreg) {
+	return 1u << mreg;
+}
+
+// registers the instruction templates in LowLevelCodeGen use as scratch;
+// their values never flow from one basic block into another
+const unsigned SCRATCH_REGS = reg_bit(MREG_RAX) | reg_bit(MREG_RDX) | reg_bit(MREG_RDI) | reg_bit(MREG_RSI) |
+	reg_bit(MREG_R10) | reg_bit(MREG_R11);
+const unsigned ALL_REGS = 0xFFFFu;
+// the only calls are into the I/O runtime, which just uses the scratch registers
+const unsigned CALL_CLOBBERED_REGS = SCRATCH_REGS;
+
+// how far back retarget_copy looks for the instruction that starts a chain
+const unsigned RETARGET_WINDOW = 8;
+
+bool is_jump(int opcode) {
+	return opcode >= MINS_JMP && opcode <= MINS_JGE;
+}
+}
+
 InstructionSequence* X86_64ControlFlowGraphTransform::transform_basic_block(InstructionSequence* iseq) {
-	return iseq;
+	// (the caller deletes the result, so it mustn't be the block itself)
+	if (iseq->get_length() == 0) return new InstructionSequence();
+	Code code;
+	for (auto i = iseq->cbegin(); i != iseq->cend(); ++i) code.push_back((*i)->duplicate());
+
+	// apply rules until none of them fires; rules are retried from the
+	// earliest instruction a change could have touched, since it may
+	// enable a rule there
+	std::vector<unsigned> live_after(code.size());
+	update_live_after(code, live_after, 0, unsigned(code.size()));
+	unsigned i = 0;
+	while (i < code.size()) {
+		const unsigned length = unsigned(code.size());
+		if (remove_nop(code, i) || simplify_arithmetic(code, i) || forward_store(code, i) ||
+			propagate_copy(code, i, live_after) || retarget_copy(code, i, live_after)) {
+			// a rule only changes code[i - RETARGET_WINDOW..i + 1], deleting at
+			// most one instruction, so liveness after the rest still holds
+			const unsigned removed = length - unsigned(code.size());
+			live_after.erase(live_after.begin() + i, live_after.begin() + i + removed);
+			const unsigned start = i > RETARGET_WINDOW ? i - RETARGET_WINDOW : 0;
+			update_live_after(code, live_after, start, std::min(i + 2 - removed, unsigned(code.size())));
+			i = start > 0 ? start - 1 : 0;
+		}
+		else i++;
+	}
+
+	auto result = new InstructionSequence();
+	for (const auto ins : code) result->add_instruction(ins);
+	return result;
+}
+
+InstructionSequence* X86_64ControlFlowGraphTransform::remove_jumps_to_next(InstructionSequence* iseq) {
+	auto result = new InstructionSequence();
+	const unsigned len = iseq->get_length();
+	for (unsigned i = 0; i < len; i++) {
+		Instruction* ins = iseq->get_instruction(i);
+		if (is_jump(ins->get_opcode()) && !iseq->has_label(i)) {
+			const std::string target = ins->get_operand(0).get_target_label();
+			const bool to_next = i + 1 < len
+				                     ? iseq->has_label(i + 1) && iseq->get_label(i + 1) == target
+				                     : iseq->has_label_at_end() && iseq->get_label_at_end() == target;
+			if (to_next) continue;
+		}
+		if (iseq->has_label(i)) result->define_label(iseq->get_label(i));
+		result->add_instruction(ins->duplicate());
+	}
+	if (iseq->has_label_at_end()) result->define_label(iseq->get_label_at_end());
+	return result;
+}
+
+// live_after[i] is the set of machine registers live after code[i];
+// recompute it for the instructions before code[end], given that only
+// code[start..end) changed, so it can stop once it agrees with the old
+// value before start
+void X86_64ControlFlowGraphTransform::update_live_after(const Code& code, std::vector<unsigned>& live_after,
+                                                        unsigned start, unsigned end) {
+	unsigned live = ALL_REGS & ~SCRATCH_REGS;
+	if (end < code.size()) live = (live_after[end] & ~get_writes(code[end])) | get_reads(code[end]);
+	for (unsigned i = end; i-- > 0;) {
+		if (i < start && live_after[i] == live) break;
+		live_after[i] = live;
+		live = (live & ~get_writes(code[i])) | get_reads(code[i]);
+	}
+}
+
+unsigned X86_64ControlFlowGraphTransform::get_operand_regs(const Operand& op) {
+	unsigned regs = 0;
+	if (op.get_kind() != OPERAND_MREG && !op.is_memref()) return regs;
+	regs |= reg_bit(op.get_base_reg());
+	if (op.has_index_reg()) regs |= reg_bit(op.get_index_reg());
+	return regs;
+}
+
+unsigned X86_64ControlFlowGraphTransform::get_reads(const Instruction* ins) {
+	unsigned regs = get_implicit_regs(ins);
+	switch (ins->get_opcode()) {
+	case MINS_MOVQ:
+	case MINS_LEAQ:
+	case MINS_POPQ:
+		// the destination is only read if it's a memory reference
+		for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+			const Operand op = ins->get_operand(k);
+			if (k + 1 < ins->get_num_operands() || op.is_memref()) regs |= get_operand_regs(op);
+		}
+		return regs;
+	case MINS_RET:
+		return ALL_REGS;
+	default:
+		for (unsigned k = 0; k < ins->get_num_operands(); k++) regs |= get_operand_regs(ins->get_operand(k));
+		return regs;
+	}
+}
+
+unsigned X86_64ControlFlowGraphTransform::get_writes(const Instruction* ins) {
+	switch (ins->get_opcode()) {
+	case MINS_IMULQ:
+		if (ins->get_num_operands() == 1) return reg_bit(MREG_RAX) | reg_bit(MREG_RDX);
+		// fall through
+	case MINS_MOVQ:
+	case MINS_LEAQ:
+	case MINS_ADDQ:
+	case MINS_SUBQ:
+	case MINS_NEGQ:
+	case MINS_SARQ:
+	case MINS_SHLQ:
+	case MINS_SHRQ:
+	case MINS_POPQ:
+		{
+			const Operand dest = ins->get_operand(ins->get_num_operands() - 1);
+			unsigned regs = dest.get_kind() == OPERAND_MREG ? reg_bit(dest.get_base_reg()) : 0;
+			if (ins->get_opcode() == MINS_POPQ) regs |= reg_bit(MREG_RSP);
+			return regs;
+		}
+	case MINS_PUSHQ:
+		return reg_bit(MREG_RSP);
+	case MINS_IDIVQ:
+		return reg_bit(MREG_RAX) | reg_bit(MREG_RDX);
+	case MINS_CQTO:
+		return reg_bit(MREG_RDX);
+	case MINS_CALL:
+		return CALL_CLOBBERED_REGS;
+	default:
+		return 0;
+	}
+}
+
+// registers read or written without being named by an operand
+unsigned X86_64ControlFlowGraphTransform::get_implicit_regs(const Instruction* ins) {
+	switch (ins->get_opcode()) {
+	case MINS_IDIVQ:
+	case MINS_CQTO:
+		return reg_bit(MREG_RAX) | reg_bit(MREG_RDX);
+	case MINS_IMULQ:
+		// the one operand form multiplies %rax into %rdx:%rax
+		return ins->get_num_operands() == 1 ? reg_bit(MREG_RAX) | reg_bit(MREG_RDX) : 0;
+	case MINS_PUSHQ:
+	case MINS_POPQ:
+		return reg_bit(MREG_RSP);
+	case MINS_CALL:
+		return CALL_CLOBBERED_REGS | reg_bit(MREG_RSP);
+	case MINS_RET:
+		return ALL_REGS;
+	default:
+		return 0;
+	}
+}
+
+// true if the instruction overwrites its last operand without reading it
+bool X86_64ControlFlowGraphTransform::has_write_only_dest(const Instruction* ins) {
+	const int opcode = ins->get_opcode();
+	return opcode == MINS_MOVQ || opcode == MINS_LEAQ || opcode == MINS_POPQ;
+}
+
+bool X86_64ControlFlowGraphTransform::same_operand(const Operand& a, const Operand& b) {
+	if (a.get_kind() != b.get_kind()) return false;
+	if (a.has_base_reg() && a.get_base_reg() != b.get_base_reg()) return false;
+	if (a.has_index_reg() && (a.get_index_reg() != b.get_index_reg() || a.get_scale() != b.get_scale())) return false;
+	if (a.get_kind() == OPERAND_LABEL || a.get_kind() == OPERAND_LABEL_IMMEDIATE)
+		return a.get_target_label() == b.get_target_label();
+	if (a.get_kind() == OPERAND_INT_LITERAL) return a.get_int_value() == b.get_int_value();
+	if ((a.get_kind() & OPROP_HAS_INTVAL) != 0 && a.get_offset() != b.get_offset()) return false;
+	return true;
+}
+
+// replace register from in op with to; fails if from is used as an
+// address register and to isn't a register
+bool X86_64ControlFlowGraphTransform::rename_reg(Operand& op, int from, const Operand& to) {
+	if (op.get_kind() == OPERAND_MREG) {
+		if (op.get_base_reg() == from) op = to;
+		return true;
+	}
+	if (!op.is_memref() || (get_operand_regs(op) & reg_bit(from)) == 0) return true;
+	if (to.get_kind() != OPERAND_MREG) return false;
+	const int reg = to.get_base_reg();
+	const int base = op.get_base_reg() == from ? reg : op.get_base_reg();
+	switch (op.get_kind()) {
+	case OPERAND_MREG_MEMREF:
+		op = Operand(OPERAND_MREG_MEMREF, base);
+		return true;
+	case OPERAND_MREG_MEMREF_OFFSET:
+		op = Operand(OPERAND_MREG_MEMREF_OFFSET, base, op.get_offset());
+		return true;
+	case OPERAND_MREG_MEMREF_INDEX:
+		op = Operand(OPERAND_MREG_MEMREF_INDEX, base, op.get_index_reg() == from ? reg : op.get_index_reg());
+		return true;
+	case OPERAND_MREG_MEMREF_OFFSET_INDEX:
+		op = Operand(OPERAND_MREG_MEMREF_OFFSET_INDEX, base, op.get_index_reg() == from ? reg : op.get_index_reg(),
+		             op.get_offset(), op.get_scale());
+		return true;
+	default:
+		return false;
+	}
+}
+
+// checks the operand combinations x86-64 can actually encode
+bool X86_64ControlFlowGraphTransform::is_valid(const Instruction* ins) {
+	const int opcode = ins->get_opcode();
+	const unsigned n = ins->get_num_operands();
+	unsigned memrefs = 0;
+	for (unsigned k = 0; k < n; k++) {
+		if (ins->get_operand(k).is_memref()) memrefs++;
+	}
+	if (memrefs > 1) return false;
+	if (n == 0 || opcode == MINS_CALL || is_jump(opcode)) return true;
+	const Operand src = ins->get_operand(0);
+	const Operand dest = ins->get_operand(n - 1);
+	const bool src_imm = src.get_kind() == OPERAND_INT_LITERAL || src.get_kind() == OPERAND_LABEL_IMMEDIATE;
+	if (n == 1) return !src_imm || opcode == MINS_PUSHQ;
+	if (dest.get_kind() == OPERAND_INT_LITERAL || dest.get_kind() == OPERAND_LABEL_IMMEDIATE) return false;
+	if ((opcode == MINS_IMULQ || opcode == MINS_LEAQ) && dest.get_kind() != OPERAND_MREG) return false;
+	// shift counts are only ever emitted as immediates (%cl is never used)
+	if ((opcode == MINS_SARQ || opcode == MINS_SHLQ || opcode == MINS_SHRQ) && src.get_kind() != OPERAND_INT_LITERAL)
+		return false;
+	if (opcode == MINS_LEAQ) return src.is_memref();
+	if (src.get_kind() == OPERAND_LABEL_IMMEDIATE) return opcode == MINS_MOVQ;
+	if (src.get_kind() == OPERAND_INT_LITERAL) {
+		// only movq to a register can take a 64 bit immediate
+		const long ival = src.get_int_value();
+		const bool fits = ival >= INT32_MIN && ival <= INT32_MAX;
+		return fits || (opcode == MINS_MOVQ && dest.get_kind() == OPERAND_MREG);
+	}
+	return true;
+}
+
+// delete code[index], moving its comment to the instruction taking its place
+void X86_64ControlFlowGraphTransform::erase(Code& code, unsigned index) {
+	Instruction* ins = code[index];
+	code.erase(code.begin() + index);
+	if (ins->has_comment() && index < code.size() && !code[index]->has_comment())
+		code[index]->set_comment(ins->get_comment());
+	delete ins;
+}
+
+bool X86_64ControlFlowGraphTransform::remove_nop(Code& code, unsigned i) {
+	// a block must keep at least one instruction to hold its label
+	if (code[i]->get_opcode() != MINS_NOP || code.size() == 1) return false;
+	erase(code, i);
+	return true;
+}
+
+// imulq $-1 => negq, and drop imulq $1, addq $0, subq $0
+bool X86_64ControlFlowGraphTransform::simplify_arithmetic(Code& code, unsigned i) {
+	Instruction* ins = code[i];
+	const int opcode = ins->get_opcode();
+	if (opcode != MINS_IMULQ && opcode != MINS_ADDQ && opcode != MINS_SUBQ) return false;
+	if (ins->get_operand(0).get_kind() != OPERAND_INT_LITERAL) return false;
+	const long ival = ins->get_operand(0).get_int_value();
+	if (opcode == MINS_IMULQ && ival == -1) {
+		code[i] = new Instruction(MINS_NEGQ, ins->get_operand(1));
+		code[i]->set_comment(ins->get_comment());
+		delete ins;
+		return true;
+	}
+	const bool identity = opcode == MINS_IMULQ ? ival == 1 : ival == 0;
+	if (!identity || code.size() == 1) return false;
+	erase(code, i);
+	return true;
+}
+
+// movq X, M; movq M, Y => movq X, M; movq X, Y
+bool X86_64ControlFlowGraphTransform::forward_store(Code& code, unsigned i) {
+	if (i + 1 >= code.size()) return false;
+	Instruction* store = code[i];
+	Instruction* load = code[i + 1];
+	if (store->get_opcode() != MINS_MOVQ || load->get_opcode() != MINS_MOVQ) return false;
+	const Operand mem = store->get_operand(1);
+	if (!mem.is_memref() || !same_operand(mem, load->get_operand(0))) return false;
+	const Operand src = store->get_operand(0);
+	const Operand dest = load->get_operand(1);
+	if (src.get_kind() == OPERAND_MREG && same_operand(src, dest)) {
+		erase(code, i + 1);
+		return true;
+	}
+	auto copy = new Instruction(MINS_MOVQ, src, dest);
+	if (!is_valid(copy)) {
+		delete copy;
+		return false;
+	}
+	copy->set_comment(load->get_comment());
+	code[i + 1] = copy;
+	delete load;
+	return true;
+}
+
+// movq A, %S; op ..%S.. => op ..A.. when %S is dead afterwards; this
+// also folds immediates and memory operands into the following instruction
+bool X86_64ControlFlowGraphTransform::propagate_copy(Code& code, unsigned i, const std::vector<unsigned>& live_after) {
+	if (i + 1 >= code.size()) return false;
+	Instruction* copy = code[i];
+	if (copy->get_opcode() != MINS_MOVQ || copy->get_operand(1).get_kind() != OPERAND_MREG) return false;
+	const Operand src = copy->get_operand(0);
+	const int reg = copy->get_operand(1).get_base_reg();
+	if (src.get_kind() == OPERAND_MREG && src.get_base_reg() == reg) {
+		// movq %S, %S
+		if (code.size() == 1) return false;
+		erase(code, i);
+		return true;
+	}
+
+	Instruction* user = code[i + 1];
+	const unsigned n = user->get_num_operands();
+	if ((get_reads(user) & reg_bit(reg)) == 0 || (get_implicit_regs(user) & reg_bit(reg)) != 0) return false;
+	// afterwards %S must either be dead or overwritten by user
+	const bool overwrites = has_write_only_dest(user) && n > 0 &&
+		user->get_operand(n - 1).get_kind() == OPERAND_MREG && user->get_operand(n - 1).get_base_reg() == reg;
+	if (!overwrites && (get_writes(user) & reg_bit(reg))) return false;
+	if (!overwrites && (live_after[i + 1] & reg_bit(reg))) return false;
+
+	Instruction* replacement = user->duplicate();
+	for (unsigned k = 0; k < n; k++) {
+		if (overwrites && k == n - 1) continue;
+		if (!rename_reg((*replacement)[k], reg, src)) {
+			delete replacement;
+			return false;
+		}
+	}
+	if (!is_valid(replacement)) {
+		delete replacement;
+		return false;
+	}
+	if (!replacement->has_comment()) replacement->set_comment(copy->get_comment());
+	code[i + 1] = replacement;
+	delete user;
+	code.erase(code.begin() + i);
+	delete copy;
+	return true;
+}
+
+// movq A, %S; op X, %S; ...; movq %S, %R => movq A, %R; op X, %R; ...
+// when %S is dead afterwards and the chain doesn't otherwise touch %R
+bool X86_64ControlFlowGraphTransform::retarget_copy(Code& code, unsigned i, const std::vector<unsigned>& live_after) {
+	Instruction* copy = code[i];
+	if (copy->get_opcode() != MINS_MOVQ) return false;
+	const Operand src = copy->get_operand(0), dest = copy->get_operand(1);
+	if (src.get_kind() != OPERAND_MREG || dest.get_kind() != OPERAND_MREG) return false;
+	const int s = src.get_base_reg(), r = dest.get_base_reg();
+	if (s == r || (live_after[i] & reg_bit(s))) return false;
+
+	// find the instruction that starts the chain by overwriting %S
+	const unsigned both = reg_bit(s) | reg_bit(r);
+	unsigned start = i;
+	for (unsigned k = i; k-- > 0 && i - k <= RETARGET_WINDOW;) {
+		const Instruction* ins = code[k];
+		if (get_implicit_regs(ins) & both) return false;
+		const unsigned n = ins->get_num_operands();
+		if (has_write_only_dest(ins) && n > 0 && ins->get_operand(n - 1).get_kind() == OPERAND_MREG &&
+			ins->get_operand(n - 1).get_base_reg() == s) {
+			start = k;
+			break;
+		}
+		if ((get_reads(ins) | get_writes(ins)) & reg_bit(r)) return false;
+	}
+	if (start == i) return false;
+
+	const unsigned last = code[start]->get_num_operands() - 1;
+	(*code[start])[last] = dest;
+	for (unsigned k = start + 1; k < i; k++) {
+		for (unsigned j = 0; j < code[k]->get_num_operands(); j++) rename_reg((*code[k])[j], s, dest);
+	}
+	erase(code, i);
+	return true;
 }
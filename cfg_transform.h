@@ -12,6 +12,7 @@ private:
 	LiveVregs* m_live_vregs;
 	ControlFlowGraph* prune(ControlFlowGraph* cfg);
 	InstructionSequence* prune_basic_block(BasicBlock* iseq);
+	static bool is_pure(const Instruction* ins);
 
 public:
 	ControlFlowGraphTransform(ControlFlowGraph* cfg);
@@ -21,6 +22,10 @@ public:
 	ControlFlowGraph* transform_cfg();
 
 	virtual InstructionSequence* transform_basic_block(InstructionSequence* iseq) = 0;
+
+protected:
+	// dead vreg elimination only makes sense for high-level code
+	virtual bool should_prune() const { return true; }
 };
 
 class HighLevelControlFlowGraphTransform : public ControlFlowGraphTransform {
@@ -32,12 +37,42 @@ public:
 	InstructionSequence* transform_basic_block(InstructionSequence* iseq) override;
 };
 
+// Peephole optimizer for the code LowLevelCodeGen emits.  Each rule looks
+// at one or two adjacent instructions (or a short window ending in a copy),
+// using liveness of machine registers within the block to decide whether
+// a scratch register's value is still needed.
 class X86_64ControlFlowGraphTransform : public ControlFlowGraphTransform {
 private:
 	ControlFlowGraph* m_cfg;
+	using Code = std::vector<Instruction*>;
 
 public:
 	using ControlFlowGraphTransform::ControlFlowGraphTransform;
 	InstructionSequence* transform_basic_block(InstructionSequence* iseq) override;
+
+	// delete jumps to the instruction immediately following them; this
+	// depends on block layout, so it is applied to the flattened code
+	static InstructionSequence* remove_jumps_to_next(InstructionSequence* iseq);
+
+protected:
+	bool should_prune() const override { return false; }
+
+private:
+	static void update_live_after(const Code& code, std::vector<unsigned>& live_after, unsigned start, unsigned end);
+	static unsigned get_operand_regs(const Operand& op);
+	static unsigned get_reads(const Instruction* ins);
+	static unsigned get_writes(const Instruction* ins);
+	static unsigned get_implicit_regs(const Instruction* ins);
+	static bool has_write_only_dest(const Instruction* ins);
+	static bool same_operand(const Operand& a, const Operand& b);
+	static bool rename_reg(Operand& op, int from, const Operand& to);
+	static bool is_valid(const Instruction* ins);
+	static void erase(Code& code, unsigned index);
+
+	static bool remove_nop(Code& code, unsigned i);
+	static bool simplify_arithmetic(Code& code, unsigned i);
+	static bool forward_store(Code& code, unsigned i);
+	static bool propagate_copy(Code& code, unsigned i, const std::vector<unsigned>& live_after);
+	static bool retarget_copy(Code& code, unsigned i, const std::vector<unsigned>& live_after);
 };
 #endif // CFG_TRANSFORM_H
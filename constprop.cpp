@@ -0,0 +1,410 @@
+#include <cassert>
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <utility>
+#include "highlevel.h"
+#include "dominators.h"
+#include "constprop.h"
+
+namespace {
+using Value = ConditionalConstantPropagation::Value;
+
+const Value UNDEF_VALUE = { Value::UNDEF, 0 };
+const Value VARYING_VALUE = { Value::VARYING, 0 };
+
+Value const_value(long ival) {
+	// LowLevelCodeGen can only use 32 bit immediates in most instructions
+	if (ival < INT32_MIN || ival > INT32_MAX) return VARYING_VALUE;
+	return { Value::CONST, ival };
+}
+
+int count_vregs(const ControlFlowGraph* cfg) {
+	int max_vreg = -1;
+	for (auto i = cfg->bb_begin(); i != cfg->bb_end(); ++i) {
+		for (auto j = (*i)->cbegin(); j != (*i)->cend(); ++j) {
+			const Instruction* ins = *j;
+			for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+				const Operand op = ins->get_operand(k);
+				if (op.has_base_reg()) max_vreg = std::max(max_vreg, op.get_base_reg());
+				if (op.has_index_reg()) max_vreg = std::max(max_vreg, op.get_index_reg());
+			}
+		}
+	}
+	return max_vreg + 1;
+}
+
+void meet_into(Value& mine, const Value& theirs) {
+	if (theirs.kind == Value::UNDEF || mine.kind == Value::VARYING) return;
+	if (mine.kind == Value::UNDEF) mine = theirs;
+	else if (theirs.kind == Value::VARYING || theirs.ival != mine.ival) mine = VARYING_VALUE;
+}
+}
+
+const int ConditionalConstantPropagation::NONE;
+
+ConditionalConstantPropagation::ConditionalConstantPropagation(ControlFlowGraph* cfg)
+	: m_cfg(cfg)
+	  , m_num_vregs(count_vregs(cfg)) {}
+
+ConditionalConstantPropagation::~ConditionalConstantPropagation() {}
+
+ControlFlowGraph* ConditionalConstantPropagation::transform_cfg() {
+	analyze();
+
+	auto result = new ControlFlowGraph();
+	std::map<BasicBlock*, BasicBlock*> block_map;
+	for (auto i = m_cfg->bb_begin(); i != m_cfg->bb_end(); ++i) {
+		BasicBlock* orig = *i;
+		// the exit block is kept even if the program never terminates
+		if (!m_executable[orig->get_id()] && orig->get_kind() != BASICBLOCK_EXIT) continue;
+		BasicBlock* result_bb = result->create_basic_block(orig->get_kind(), orig->get_label());
+		block_map[orig] = result_bb;
+		if (m_executable[orig->get_id()]) rewrite_block(orig, result_bb);
+	}
+
+	// only executable edges survive
+	for (auto i = m_cfg->bb_begin(); i != m_cfg->bb_end(); ++i) {
+		const ControlFlowGraph::EdgeList& outgoing_edges = m_cfg->get_outgoing_edges(*i);
+		for (const auto edge : outgoing_edges) {
+			if (m_executable_edges.count(edge) == 0) continue;
+			result->create_edge(block_map[edge->get_source()], block_map[edge->get_target()], edge->get_kind());
+		}
+	}
+	return result;
+}
+
+// Semi-pruned SSA (Briggs et al.): only vregs used before being defined in
+// some block can need phis, and they get them at the iterated dominance
+// frontier of their defs.  Names are then assigned by a walk of the
+// dominator tree.
+void ConditionalConstantPropagation::build_ssa() {
+	const unsigned num_blocks = m_cfg->get_num_blocks();
+	Dominators dominators(m_cfg);
+	dominators.execute();
+
+	m_block_start.assign(num_blocks + 1, 0);
+	m_last_compare.assign(num_blocks, NONE);
+	for (unsigned id = 0; id < num_blocks; id++) {
+		BasicBlock* bb = m_cfg->get_block(id);
+		m_block_start[id] = unsigned(m_instructions.size());
+		for (auto i = bb->cbegin(); i != bb->cend(); ++i) {
+			if ((*i)->get_opcode() == HINS_INT_COMPARE) m_last_compare[id] = int(m_instructions.size());
+			m_instructions.push_back({ *i, id, NONE, { NONE, NONE, NONE } });
+		}
+	}
+	m_block_start[num_blocks] = unsigned(m_instructions.size());
+
+	std::vector<bool> global(m_num_vregs, false);
+	std::vector<std::vector<unsigned>> def_blocks(m_num_vregs);
+	std::vector<unsigned> defined_in(m_num_vregs, Dominators::NONE);
+	for (const auto bb : dominators.get_reverse_postorder()) {
+		const unsigned id = bb->get_id();
+		for (auto i = bb->cbegin(); i != bb->cend(); ++i) {
+			const Instruction* ins = *i;
+			for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+				const Operand op = ins->get_operand(k);
+				if (op.get_kind() != OPERAND_VREG || !HighLevel::is_use(ins, k)) continue;
+				if (defined_in[op.get_base_reg()] != id) global[op.get_base_reg()] = true;
+			}
+			if (!HighLevel::is_def(ins)) continue;
+			const int vreg = ins->get_operand(0).get_base_reg();
+			if (defined_in[vreg] != id) def_blocks[vreg].push_back(id);
+			defined_in[vreg] = id;
+		}
+	}
+
+	// no phis are needed in the entry block, where every vreg is varying
+	const BasicBlock* entry = m_cfg->get_entry_block();
+	m_block_phis.assign(num_blocks, std::vector<unsigned>());
+	std::vector<unsigned> has_phi(num_blocks, Dominators::NONE), queued(num_blocks, Dominators::NONE);
+	std::vector<unsigned> work_list;
+	for (int vreg = 0; vreg < m_num_vregs; vreg++) {
+		if (!global[vreg]) continue;
+		work_list = def_blocks[vreg];
+		for (const auto id : work_list) queued[id] = unsigned(vreg);
+		while (!work_list.empty()) {
+			BasicBlock* bb = m_cfg->get_block(work_list.back());
+			work_list.pop_back();
+			for (const auto join : dominators.get_frontier(bb)) {
+				const unsigned id = join->get_id();
+				if (join == entry || has_phi[id] == unsigned(vreg)) continue;
+				has_phi[id] = unsigned(vreg);
+				m_block_phis[id].push_back(unsigned(m_phis.size()));
+				const unsigned num_args = unsigned(m_cfg->get_incoming_edges(join).size());
+				m_phis.push_back({ id, vreg, NONE, std::vector<int>(num_args, NONE) });
+				if (queued[id] == unsigned(vreg)) continue;
+				queued[id] = unsigned(vreg);
+				work_list.push_back(id);
+			}
+		}
+	}
+
+	// the dominator tree is walked with an explicit stack of
+	// (block, index of next child, size of the undo log on entry), undoing
+	// the block's changes to the current names on the way back up
+	m_values.assign(1, VARYING_VALUE);
+	m_users.assign(1, std::vector<int>());
+	std::vector<int> current(m_num_vregs, 0);
+	std::vector<std::pair<int, int>> undo; // (vreg, previous name)
+	std::vector<std::tuple<BasicBlock*, unsigned, size_t>> stack;
+	BasicBlock* bb = m_cfg->get_entry_block();
+	while (bb) {
+		const unsigned id = bb->get_id();
+		stack.emplace_back(bb, 0, undo.size());
+		for (const auto index : m_block_phis[id]) {
+			Phi& phi = m_phis[index];
+			phi.name = new_name();
+			undo.emplace_back(phi.vreg, current[phi.vreg]);
+			current[phi.vreg] = phi.name;
+		}
+		for (unsigned i = m_block_start[id]; i < m_block_start[id + 1]; i++) {
+			InstructionInfo& info = m_instructions[i];
+			const Instruction* ins = info.ins;
+			for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+				const Operand op = ins->get_operand(k);
+				if (op.get_kind() != OPERAND_VREG || !HighLevel::is_use(ins, k)) continue;
+				info.uses[k] = use_name(current[op.get_base_reg()], int(i));
+			}
+			if (!HighLevel::is_def(ins)) continue;
+			const int vreg = ins->get_operand(0).get_base_reg();
+			info.def = new_name();
+			undo.emplace_back(vreg, current[vreg]);
+			current[vreg] = info.def;
+		}
+		for (const auto edge : m_cfg->get_outgoing_edges(bb)) {
+			BasicBlock* succ = edge->get_target();
+			if (m_block_phis[succ->get_id()].empty()) continue;
+			const ControlFlowGraph::EdgeList& incoming = m_cfg->get_incoming_edges(succ);
+			const unsigned k = unsigned(std::find(incoming.begin(), incoming.end(), edge) - incoming.begin());
+			for (const auto index : m_block_phis[succ->get_id()]) {
+				Phi& phi = m_phis[index];
+				phi.args[k] = use_name(current[phi.vreg], ~int(index));
+			}
+		}
+
+		// descend to the next child, or go back up
+		bb = nullptr;
+		while (!bb && !stack.empty()) {
+			auto& top = stack.back();
+			const Dominators::BlockList& children = dominators.get_children(std::get<0>(top));
+			if (std::get<1>(top) < children.size()) {
+				bb = children[std::get<1>(top)++];
+				continue;
+			}
+			while (undo.size() > std::get<2>(top)) {
+				current[undo.back().first] = undo.back().second;
+				undo.pop_back();
+			}
+			stack.pop_back();
+		}
+	}
+}
+
+int ConditionalConstantPropagation::new_name() {
+	m_values.push_back(UNDEF_VALUE);
+	m_users.emplace_back();
+	return int(m_values.size()) - 1;
+}
+
+// the entry value never changes, so its users aren't recorded
+int ConditionalConstantPropagation::use_name(int name, int user) {
+	if (name != 0) m_users[name].push_back(user);
+	return name;
+}
+
+void ConditionalConstantPropagation::analyze() {
+	build_ssa();
+	m_executable.assign(m_cfg->get_num_blocks(), false);
+
+	const unsigned entry = m_cfg->get_entry_block()->get_id();
+	m_executable[entry] = true;
+	visit_block(entry);
+	while (!m_edge_work_list.empty() || !m_name_work_list.empty()) {
+		if (!m_edge_work_list.empty()) {
+			const Edge* edge = m_edge_work_list.back();
+			m_edge_work_list.pop_back();
+			if (!m_executable_edges.insert(edge).second) continue;
+			const unsigned id = edge->get_target()->get_id();
+			if (!m_executable[id]) {
+				m_executable[id] = true;
+				visit_block(id);
+			} else {
+				// only the phis can see the new edge
+				for (const auto index : m_block_phis[id]) evaluate_phi(index);
+			}
+			continue;
+		}
+
+		const int name = m_name_work_list.back();
+		m_name_work_list.pop_back();
+		for (const auto user : m_users[name]) {
+			if (user < 0) {
+				if (m_executable[m_phis[~user].block]) evaluate_phi(unsigned(~user));
+				continue;
+			}
+			const InstructionInfo& info = m_instructions[user];
+			if (!m_executable[info.block]) continue;
+			if (info.def != NONE) set_value(info.def, model_instruction(info));
+			if (user == m_last_compare[info.block]) add_feasible_edges(m_cfg->get_block(info.block));
+		}
+	}
+}
+
+void ConditionalConstantPropagation::visit_block(unsigned id) {
+	for (const auto index : m_block_phis[id]) evaluate_phi(index);
+	for (unsigned i = m_block_start[id]; i < m_block_start[id + 1]; i++) {
+		const InstructionInfo& info = m_instructions[i];
+		if (info.def != NONE) set_value(info.def, model_instruction(info));
+	}
+	add_feasible_edges(m_cfg->get_block(id));
+}
+
+void ConditionalConstantPropagation::evaluate_phi(unsigned index) {
+	const Phi& phi = m_phis[index];
+	const ControlFlowGraph::EdgeList& incoming = m_cfg->get_incoming_edges(m_cfg->get_block(phi.block));
+	Value value = UNDEF_VALUE;
+	for (unsigned k = 0; k < incoming.size(); k++) {
+		if (m_executable_edges.count(incoming[k])) meet_into(value, m_values[phi.args[k]]);
+	}
+	set_value(phi.name, value);
+}
+
+void ConditionalConstantPropagation::set_value(int name, const Value& value) {
+	if (m_values[name] == value) return;
+	m_values[name] = value;
+	m_name_work_list.push_back(name);
+}
+
+Value ConditionalConstantPropagation::get_value(const InstructionInfo& info, unsigned k) const {
+	const Operand op = info.ins->get_operand(k);
+	if (op.get_kind() == OPERAND_INT_LITERAL) return const_value(op.get_int_value());
+	if (op.get_kind() == OPERAND_VREG && info.uses[k] != NONE) return m_values[info.uses[k]];
+	return VARYING_VALUE;
+}
+
+// the value of the name defined by an instruction
+Value ConditionalConstantPropagation::model_instruction(const InstructionInfo& info) const {
+	switch (info.ins->get_opcode()) {
+	case HINS_LOAD_ICONST:
+	case HINS_MOV:
+		return get_value(info, 1);
+	case HINS_INT_ADD:
+	case HINS_INT_SUB:
+	case HINS_INT_MUL:
+	case HINS_INT_DIV:
+	case HINS_INT_MOD:
+		return fold(info.ins->get_opcode(), get_value(info, 1), get_value(info, 2));
+	case HINS_INT_NEGATE:
+		return fold(info.ins->get_opcode(), get_value(info, 1), const_value(0));
+	default:
+		// loads, reads and addresses are never known
+		return VARYING_VALUE;
+	}
+}
+
+ConditionalConstantPropagation::Comparison ConditionalConstantPropagation::get_comparison(unsigned id) const {
+	if (m_last_compare[id] == NONE) return { UNDEF_VALUE, UNDEF_VALUE };
+	const InstructionInfo& info = m_instructions[m_last_compare[id]];
+	return { get_value(info, 0), get_value(info, 1) };
+}
+
+int ConditionalConstantPropagation::evaluate_branch(int opcode, const Comparison& cmp) {
+	if (cmp.left.kind == Value::VARYING || cmp.right.kind == Value::VARYING) return 2;
+	if (cmp.left.kind == Value::UNDEF || cmp.right.kind == Value::UNDEF) return -1;
+	const long left = cmp.left.ival, right = cmp.right.ival;
+	switch (opcode) {
+	case HINS_JE: return left == right;
+	case HINS_JNE: return left != right;
+	case HINS_JLT: return left < right;
+	case HINS_JLTE: return left <= right;
+	case HINS_JGT: return left > right;
+	case HINS_JGTE: return left >= right;
+	default:
+		assert(false);
+		return 2;
+	}
+}
+
+void ConditionalConstantPropagation::add_feasible_edges(BasicBlock* bb) {
+	const Instruction* last = bb->get_length() > 0 ? bb->get_last() : nullptr;
+	const int outcome = last && is_conditional_jump(last->get_opcode())
+		? evaluate_branch(last->get_opcode(), get_comparison(bb->get_id()))
+		: 2;
+	for (const auto edge : m_cfg->get_outgoing_edges(bb)) {
+		const bool taken = edge->get_kind() == EDGE_BRANCH;
+		if (outcome == 2 || (outcome >= 0 && taken == bool(outcome))) m_edge_work_list.push_back(edge);
+	}
+}
+
+// append the rewritten code of bb to result
+void ConditionalConstantPropagation::rewrite_block(BasicBlock* bb, BasicBlock* result) const {
+	if (bb->get_length() == 0) return;
+	std::vector<Instruction*> code;
+	for (unsigned i = m_block_start[bb->get_id()]; i < m_block_start[bb->get_id() + 1]; i++) {
+		const InstructionInfo& info = m_instructions[i];
+		const Instruction* ins = info.ins;
+		Instruction* copy = ins->duplicate();
+		// uses of known constants become literals
+		for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+			if (ins->get_operand(k).get_kind() != OPERAND_VREG || info.uses[k] == NONE) continue;
+			const Value value = m_values[info.uses[k]];
+			if (value.kind == Value::CONST) copy->set_operand(k, Operand(OPERAND_INT_LITERAL, value.ival));
+		}
+		// and so do computations of them
+		const int opcode = ins->get_opcode();
+		if (opcode == HINS_MOV || (opcode >= HINS_INT_ADD && opcode <= HINS_INT_NEGATE)) {
+			const Operand dest = ins->get_operand(0);
+			const Value value = m_values[info.def];
+			if (value.kind == Value::CONST) {
+				Instruction* load = new Instruction(HINS_LOAD_ICONST, dest, Operand(OPERAND_INT_LITERAL, value.ival));
+				load->set_comment(copy->get_comment());
+				delete copy;
+				copy = load;
+			}
+		}
+		code.push_back(copy);
+	}
+
+	// fold a conditional jump whose outcome is known, along with its compare
+	Instruction* last = code.back();
+	const int outcome =
+		is_conditional_jump(last->get_opcode()) ? evaluate_branch(last->get_opcode(), get_comparison(bb->get_id())) : 2;
+	if (outcome == 0 || outcome == 1) {
+		const Operand target = last->get_operand(0);
+		delete last;
+		code.pop_back();
+		if (!code.empty() && code.back()->get_opcode() == HINS_INT_COMPARE) {
+			delete code.back();
+			code.pop_back();
+		}
+		if (outcome == 1) code.push_back(new Instruction(HINS_JUMP, target));
+	}
+	// the block may still be labeled, so it needs an instruction
+	if (code.empty()) code.push_back(new Instruction(HINS_NOP));
+
+	for (const auto ins : code) result->add_instruction(ins);
+}
+
+bool ConditionalConstantPropagation::is_conditional_jump(int opcode) {
+	return opcode >= HINS_JE && opcode <= HINS_JGTE;
+}
+
+Value ConditionalConstantPropagation::fold(int opcode, const Value& left, const Value& right) {
+	if (left.kind == Value::VARYING || right.kind == Value::VARYING) return VARYING_VALUE;
+	if (left.kind == Value::UNDEF || right.kind == Value::UNDEF) return UNDEF_VALUE;
+	const long l = left.ival, r = right.ival;
+	switch (opcode) {
+	case HINS_INT_ADD: return const_value(l + r);
+	case HINS_INT_SUB: return const_value(l - r);
+	case HINS_INT_MUL: return const_value(l * r);
+	// division by zero has to happen at runtime
+	case HINS_INT_DIV: return r == 0 ? VARYING_VALUE : const_value(l / r);
+	case HINS_INT_MOD: return r == 0 ? VARYING_VALUE : const_value(l % r);
+	case HINS_INT_NEGATE: return const_value(-l);
+	default:
+		assert(false);
+		return VARYING_VALUE;
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef CONSTPROP_H
+#define CONSTPROP_H
+
+#include <set>
+#include <vector>
+#include "cfg.h"
+
+// Global conditional constant propagation (Wegman & Zadeck) over a
+// high-level ControlFlowGraph.  The high-level code is not in SSA form, so
+// the analysis first puts the vregs of the reachable blocks into (semi-pruned)
+// SSA form on the side: each def and phi gets a name, and each use refers to
+// the name reaching it.  A lattice value is kept per name rather than per
+// block and vreg, and a name's users are re-evaluated only when its value
+// drops; only edges found to be executable contribute to phis.
+// The transformed CFG has
+//   - uses of constant vregs replaced by literals,
+//   - defs of constant values replaced by HINS_LOAD_ICONST,
+//   - compare/conditional jump pairs with a known outcome folded, and
+//   - blocks that can never execute removed.
+class ConditionalConstantPropagation {
+public:
+	struct Value {
+		enum Kind { UNDEF, CONST, VARYING } kind;
+		long ival;
+
+		bool operator==(const Value& other) const {
+			return kind == other.kind && (kind != CONST || ival == other.ival);
+		}
+		bool operator!=(const Value& other) const { return !(*this == other); }
+	};
+
+private:
+	// no name; name 0 is the (varying) value of every vreg on entry
+	static const int NONE = -1;
+
+	// operands of the most recent HINS_INT_COMPARE in a block
+	struct Comparison {
+		Value left, right;
+	};
+
+	// the names an instruction defines and uses (by operand), or NONE
+	struct InstructionInfo {
+		const Instruction* ins;
+		unsigned block;
+		int def;
+		int uses[3];
+	};
+
+	// a phi for vreg at the start of block, with an argument for each of
+	// the block's incoming edges
+	struct Phi {
+		unsigned block;
+		int vreg;
+		int name;
+		std::vector<int> args;
+	};
+
+	ControlFlowGraph* m_cfg;
+	int m_num_vregs;
+	// the instructions of all blocks, in block id order; those of block id are
+	// [m_block_start[id], m_block_start[id + 1])
+	std::vector<InstructionInfo> m_instructions;
+	std::vector<unsigned> m_block_start;
+	// index of the last HINS_INT_COMPARE in each block, or NONE
+	std::vector<int> m_last_compare;
+	std::vector<Phi> m_phis;
+	std::vector<std::vector<unsigned>> m_block_phis; // indexed by block id
+	// the value of each name, and the instructions (by index) and
+	// phis (by ~index) using it
+	std::vector<Value> m_values;
+	std::vector<std::vector<int>> m_users;
+	std::vector<bool> m_executable; // indexed by block id
+	std::set<const Edge*> m_executable_edges;
+	std::vector<const Edge*> m_edge_work_list;
+	std::vector<int> m_name_work_list;
+
+public:
+	ConditionalConstantPropagation(ControlFlowGraph* cfg);
+	~ConditionalConstantPropagation();
+
+	ControlFlowGraph* transform_cfg();
+
+private:
+	void build_ssa();
+	int new_name();
+	int use_name(int name, int user);
+	void analyze();
+	void visit_block(unsigned id);
+	void evaluate_phi(unsigned index);
+	void set_value(int name, const Value& value);
+	Value get_value(const InstructionInfo& info, unsigned k) const;
+	Value model_instruction(const InstructionInfo& info) const;
+	Comparison get_comparison(unsigned id) const;
+	// returns -1 if unknown yet, 0 if not taken, 1 if taken, 2 if either
+	static int evaluate_branch(int opcode, const Comparison& cmp);
+	void add_feasible_edges(BasicBlock* bb);
+	void rewrite_block(BasicBlock* bb, BasicBlock* result) const;
+
+	static bool is_conditional_jump(int opcode);
+	static Value fold(int opcode, const Value& left, const Value& right);
+};
+
+#endif // CONSTPROP_H
@@ -7,6 +7,7 @@
 #include "symtab.h"
 #include "astvisitor.h"
 #include "context.h"
+#include "unit.h"
 #include "highlevelcodegen.h"
 #include "highlevel.h"
 #include "lowlevelcodegen.h"
@@ -14,7 +15,13 @@
 #include <iostream>
 
 #include "cfg_transform.h"
+#include "constprop.h"
+#include "licm.h"
+#include "ivsr.h"
+#include "isel.h"
 #include "live_vregs.h"
+#include "regalloc.h"
+#include "timereport.h"
 
 ////////////////////////////////////////////////////////////////////////
 // Classes
@@ -25,15 +32,25 @@ private:
 	bool print_symbol_table = false;
 	bool print_high_level = false;
 	bool optimize = false;
+	bool color_registers = false;
+	Unit* unit;
 	Node* root;
-	SymbolTable* symtab;
-	InstructionSequence* high_level_iseq;
+	// the Context owns these, and every intermediate representation is
+	// deleted as soon as the next one is built from it
+	SymbolTable* symtab = nullptr;
+	SemanticInfo* semantic_info = nullptr;
+	InstructionSequence* high_level_iseq = nullptr;
 	int vregs_used = 0;
+	FILE* out = stdout;
+	std::string error;
 public:
-	Context(struct Node* ast);
+	Context(Unit* unit);
 	~Context();
 
 	void set_flag(char flag);
+	void set_output(FILE* out) { this->out = out; }
+	const std::string& get_error() const { return error; }
+	void set_error(const std::string& error) { this->error = error; }
 
 	void build_symtab();
 	void generate_hcode();
@@ -44,67 +61,176 @@ public:
 // Context class implementation
 ////////////////////////////////////////////////////////////////////////
 
-Context::Context(struct Node* ast) {
-	root = ast;
+namespace {
+
+// replace cfg with the result of a pass over it
+void replace_cfg(ControlFlowGraph*& cfg, ControlFlowGraph* result) {
+	if (result != cfg) delete cfg;
+	cfg = result;
+}
+
 }
 
-Context::~Context() {}
+Context::Context(Unit* unit) {
+	this->unit = unit;
+	root = unit->get_root();
+}
+
+Context::~Context() {
+	delete high_level_iseq;
+	delete semantic_info;
+	delete symtab;
+}
 
 void Context::set_flag(char flag) {
 	if (flag == 's') print_symbol_table = true;
 	else if (flag == 'i') print_high_level = true;
 	else if (flag == 'o') optimize = true;
+	else if (flag == 'O') optimize = color_registers = true;
 	else
 		assert(false);
 }
 
 void Context::build_symtab() {
-	const auto symtab = new SymbolTable(print_symbol_table);
-	ASTVisitor visitor(symtab);
+	TimePhase phase("build_symtab");
+	// (-s builds the symbol table, and then compiling builds it again)
+	delete semantic_info;
+	delete symtab;
+	symtab = new SymbolTable(print_symbol_table);
+	semantic_info = new SemanticInfo();
+	ASTVisitor visitor(symtab, semantic_info, &unit->get_source_map());
 	visitor.visit(root);
-	this->symtab = symtab;
 }
 
 void Context::generate_hcode() {
-	HighLevelCodeGen code_gen(symtab);
-	code_gen.visit(root);
+	TimePhase phase("generate_hcode");
+	HighLevelCodeGen code_gen(symtab, semantic_info);
+	{
+		TimePhase phase("HighLevelCodeGen");
+		code_gen.visit(root);
+	}
 	auto high_level_iseq = code_gen.get_iseq();
+	vregs_used = code_gen.get_vreg_count();
 	if (optimize) {
-		HighLevelControlFlowGraphBuilder cfg_builder(high_level_iseq);
-		ControlFlowGraph* cfg = cfg_builder.build();
-		HighLevelControlFlowGraphTransform transform(cfg);
-		ControlFlowGraph* transformed_cfg = transform.transform_cfg();
-		high_level_iseq = transformed_cfg->create_instruction_sequence();
+		ControlFlowGraph* cfg;
+		{
+			TimePhase phase("CFG build");
+			HighLevelControlFlowGraphBuilder cfg_builder(high_level_iseq);
+			cfg = cfg_builder.build();
+			delete high_level_iseq;
+		}
+		{
+			TimePhase phase("ConditionalConstantPropagation");
+			ConditionalConstantPropagation constprop(cfg);
+			replace_cfg(cfg, constprop.transform_cfg());
+		}
+		int num_vregs;
+		{
+			TimePhase phase("LoopInvariantCodeMotion");
+			LoopInvariantCodeMotion licm(cfg, vregs_used);
+			replace_cfg(cfg, licm.transform_cfg());
+			num_vregs = licm.get_num_vregs();
+		}
+		{
+			TimePhase phase("InductionVariableStrengthReduction");
+			InductionVariableStrengthReduction ivsr(cfg, num_vregs);
+			replace_cfg(cfg, ivsr.transform_cfg());
+			vregs_used = ivsr.get_num_vregs();
+		}
+		{
+			TimePhase phase("transform_cfg");
+			HighLevelControlFlowGraphTransform transform(cfg);
+			replace_cfg(cfg, transform.transform_cfg());
+			high_level_iseq = cfg->create_instruction_sequence();
+			delete cfg;
+		}
 	}
 	if (print_high_level) {
-		const auto printer = new PrintHighLevelInstructionSequence(high_level_iseq);
-		printer->print();
+		PrintHighLevelInstructionSequence printer(high_level_iseq);
+		printer.print();
 	}
+	delete this->high_level_iseq;
 	this->high_level_iseq = high_level_iseq;
-	vregs_used = code_gen.get_vreg_count();
 }
 
 void Context::generate_lcode() {
-	LowLevelCodeGen code_gen(symtab, vregs_used);
-	code_gen.generate(high_level_iseq);
-	auto low_level_iseq = code_gen.get_iseq();
-	//if (optimize) {
-	//	X86_64ControlFlowGraphBuilder cfg_builder(low_level_iseq);
-	//	ControlFlowGraph* cfg = cfg_builder.build();
-	//	X86_64ControlFlowGraphTransform transform(cfg);
-	//	ControlFlowGraph* transformed_cfg = transform.transform_cfg();
-	//	low_level_iseq = transformed_cfg->create_instruction_sequence();
-	//}
+	TimePhase phase("generate_lcode");
+	InstructionSequence* low_level_iseq;
+	if (optimize) {
+		// keep vregs in machine registers where possible
+		ControlFlowGraph* cfg;
+		{
+			TimePhase phase("CFG build");
+			HighLevelControlFlowGraphBuilder cfg_builder(high_level_iseq);
+			cfg = cfg_builder.build();
+		}
+		{
+			// cover expression trees with addressing modes, leas and immediates
+			TimePhase phase("InstructionSelector");
+			InstructionSelector isel(cfg, vregs_used + 1);
+			replace_cfg(cfg, isel.transform_cfg());
+		}
+		RegisterAllocator* allocator;
+		if (color_registers) allocator = new GraphColoringRegisterAllocator(cfg, vregs_used + 1);
+		else allocator = new LinearScanRegisterAllocator(cfg, vregs_used + 1);
+		{
+			TimePhase phase(color_registers ? "GraphColoringRegisterAllocator" : "LinearScanRegisterAllocator");
+			allocator->allocate();
+		}
+		TimePhase code_gen_phase("LowLevelCodeGen");
+		LowLevelCodeGen code_gen(symtab, vregs_used, allocator);
+		code_gen.generate(allocator->get_iseq(), out);
+		low_level_iseq = code_gen.get_iseq();
+		delete allocator;
+		delete cfg;
+	} else {
+		TimePhase phase("LowLevelCodeGen");
+		LowLevelCodeGen code_gen(symtab, vregs_used);
+		code_gen.generate(high_level_iseq, out);
+		low_level_iseq = code_gen.get_iseq();
+	}
+	if (optimize) {
+		TimePhase phase("peephole");
+		X86_64ControlFlowGraphBuilder cfg_builder(low_level_iseq);
+		ControlFlowGraph* cfg = cfg_builder.build();
+		X86_64ControlFlowGraphTransform transform(cfg);
+		replace_cfg(cfg, transform.transform_cfg());
+		InstructionSequence* flattened = cfg->create_instruction_sequence();
+		delete cfg;
+		delete low_level_iseq;
+		low_level_iseq = X86_64ControlFlowGraphTransform::remove_jumps_to_next(flattened);
+		delete flattened;
+	}
+	TimePhase print_phase("print");
 	PrintX86_64InstructionSequence printer(low_level_iseq);
-	printer.print();
+	printer.print(out);
+	delete low_level_iseq;
 }
 
 ////////////////////////////////////////////////////////////////////////
 // Context API functions
 ////////////////////////////////////////////////////////////////////////
 
-struct Context* context_create(struct Node* ast) {
-	return new Context(ast);
+namespace {
+
+// Runs some phases of the compilation.  A semantic error is recorded in the
+// Context rather than thrown back to a C caller.
+template<typename Phases>
+int run_phases(struct Context* ctx, Phases phases) {
+	try {
+		phases();
+	}
+	catch (const SemanticError& err) {
+		ctx->set_error(err.what());
+		return 1;
+	}
+	return 0;
+}
+
+}
+
+struct Context* context_create(struct Unit* unit) {
+	return new Context(unit);
 }
 
 void context_destroy(struct Context* ctx) {
@@ -115,17 +241,31 @@ void context_set_flag(struct Context* ctx, char flag) {
 	ctx->set_flag(flag);
 }
 
-void context_build_symtab(struct Context* ctx) {
-	ctx->build_symtab();
+void context_set_output(struct Context* ctx, FILE* out) {
+	ctx->set_output(out);
+}
+
+const char* context_get_error(struct Context* ctx) {
+	return ctx->get_error().c_str();
+}
+
+int context_build_symtab(struct Context* ctx) {
+	return run_phases(ctx, [ctx] {
+		ctx->build_symtab();
+	});
 }
 
-void context_generate_hl_code(struct Context* ctx) {
-	ctx->build_symtab();
-	ctx->generate_hcode();
+int context_generate_hl_code(struct Context* ctx) {
+	return run_phases(ctx, [ctx] {
+		ctx->build_symtab();
+		ctx->generate_hcode();
+	});
 }
 
-void context_compile(struct Context* ctx) {
-	ctx->build_symtab();
-	ctx->generate_hcode();
-	ctx->generate_lcode();
+int context_compile(struct Context* ctx) {
+	return run_phases(ctx, [ctx] {
+		ctx->build_symtab();
+		ctx->generate_hcode();
+		ctx->generate_lcode();
+	});
 }
@@ -1,6 +1,8 @@
 #ifndef CONTEXT_H
 #define CONTEXT_H
 
+#include <stdio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -8,20 +10,31 @@ extern "C" {
 // Context gathers all of the data structures needed for
 // semantic analysis, code generation, and code optimization.
 
-struct Node;
+struct Unit;
 struct Context;
 
-struct Context* context_create(struct Node* ast);
+// Create a Context to compile the AST of a Unit which has been parsed.
+// The Unit must outlive the Context.
+struct Context* context_create(struct Unit* unit);
 void context_destroy(struct Context* ctx);
 
 // This function can be called multiple times to configure
 // compilation options.  Flags available:
 //   's' - print symbol table info
+//   'o' - optimize, using linear scan register allocation
+//   'O' - optimize, using graph coloring register allocation
 void context_set_flag(struct Context* ctx, char flag);
 
-void context_build_symtab(struct Context* ctx);
-void context_generate_hl_code(struct Context* ctx);
-void context_compile(struct Context* ctx);
+// Write the generated assembly language to out (stdout by default).
+void context_set_output(struct Context* ctx, FILE* out);
+
+// Each of these returns 0 on success, or nonzero if the program has a
+// semantic error, whose message ("file:line:col: Error: ...")
+// context_get_error returns.
+int context_build_symtab(struct Context* ctx);
+int context_generate_hl_code(struct Context* ctx);
+int context_compile(struct Context* ctx);
+const char* context_get_error(struct Context* ctx);
 
 #ifdef __cplusplus
 }
@@ -1,20 +1,34 @@
+#include <atomic>
+#include <cerrno>
 #include <cstdarg>
 #include <cstdio>
 #if __cplusplus < 201703L
 #  include <memory>
 #endif
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "cpputil.h"
 
 // See: https://codereview.stackexchange.com/questions/187183/create-a-c-string-using-printf-style-formatting
 
 std::string cpputil::format(const char *fmt, ...)
 {
-    char buf[256];
-
     va_list args;
     va_start(args, fmt);
-    const auto r = std::vsnprintf(buf, sizeof buf, fmt, args);
+    std::string s = vformat(fmt, args);
     va_end(args);
+    return s;
+}
+
+std::string cpputil::vformat(const char *fmt, va_list args)
+{
+    char buf[256];
+
+    va_list args_copy;
+    va_copy(args_copy, args);
+    const auto r = std::vsnprintf(buf, sizeof buf, fmt, args_copy);
+    va_end(args_copy);
 
     if (r < 0)
         // conversion failed
@@ -28,18 +42,49 @@ std::string cpputil::format(const char *fmt, ...)
 #if __cplusplus >= 201703L
     // C++17: Create a string and write to its underlying array
     std::string s(len, '\0');
-    va_start(args, fmt);
     std::vsnprintf(s.data(), len+1, fmt, args);
-    va_end(args);
 
     return s;
 #else
     // C++11 or C++14: We need to allocate scratch memory
     auto vbuf = std::unique_ptr<char[]>(new char[len+1]);
-    va_start(args, fmt);
     std::vsnprintf(vbuf.get(), len+1, fmt, args);
-    va_end(args);
 
     return { vbuf.get(), len };
 #endif
 }
+
+bool cpputil::write_file_atomically(const std::string &path, const std::string &contents)
+{
+    static std::atomic<unsigned> s_num_temp_files;
+    const std::string temp = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(s_num_temp_files++);
+    const int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+        return false;
+
+    size_t length = 0;
+    bool ok = true;
+    while (ok && length < contents.size()) {
+        const ssize_t n = ::write(fd, contents.data() + length, contents.size() - length);
+        ok = n > 0;
+        if (ok)
+            length += size_t(n);
+    }
+    ok = close(fd) == 0 && ok && rename(temp.c_str(), path.c_str()) == 0;
+    if (!ok)
+        unlink(temp.c_str());
+    return ok;
+}
+
+bool cpputil::make_directories(const std::string &path)
+{
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+        const std::string prefix = path.substr(0, slash);
+        if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+        if (slash == std::string::npos)
+            break;
+    }
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && access(path.c_str(), R_OK | W_OK | X_OK) == 0;
+}
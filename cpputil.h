@@ -3,6 +3,7 @@
 
 // Utility functions for C++ code
 
+#include <cstdarg>
 #include <string>
 
 namespace cpputil {
@@ -14,6 +15,18 @@ std::string format(const char *fmt, ...)
 #endif
     ;
 
+// Like format, but taking a va_list.
+std::string vformat(const char *fmt, va_list args);
+
+// Write a file under a temporary name in the same directory and rename it
+// into place, so it's never seen half written, even if the process dies.
+// Returns false (leaving no temporary file behind) if that fails.
+bool write_file_atomically(const std::string &path, const std::string &contents);
+
+// Create a directory and any missing parents.  Returns true if the
+// directory exists and can be written to afterwards.
+bool make_directories(const std::string &path);
+
 }
 
 #endif // CPPUTIL_H
@@ -0,0 +1,171 @@
+#include <utility>
+#include "dominators.h"
+#include "timereport.h"
+
+const unsigned Dominators::NONE;
+
+Dominators::Dominators(ControlFlowGraph* cfg, bool post)
+	: m_cfg(cfg)
+	  , m_post(post) {}
+
+Dominators::~Dominators() {}
+
+void Dominators::execute() {
+	TimePhase phase("Dominators::execute");
+	compute_reverse_postorder();
+	compute_idoms();
+	build_tree();
+	compute_frontiers();
+}
+
+BasicBlock* Dominators::get_root() const {
+	return m_post ? m_cfg->get_exit_block() : m_cfg->get_entry_block();
+}
+
+bool Dominators::is_reachable(BasicBlock* bb) const {
+	return m_rpo_index[bb->get_id()] != NONE;
+}
+
+BasicBlock* Dominators::get_idom(BasicBlock* bb) const {
+	const unsigned index = m_rpo_index[bb->get_id()];
+	if (index == NONE || index == 0) return nullptr;
+	return m_rpo[m_idom[index]];
+}
+
+bool Dominators::dominates(BasicBlock* a, BasicBlock* b) const {
+	if (!is_reachable(a) || !is_reachable(b)) return false;
+	// a dominates b iff b's subtree interval nests inside a's
+	return m_tree_enter[a->get_id()] <= m_tree_enter[b->get_id()] &&
+		m_tree_exit[b->get_id()] <= m_tree_exit[a->get_id()];
+}
+
+const Dominators::BlockList& Dominators::get_children(BasicBlock* bb) const {
+	return m_children[bb->get_id()];
+}
+
+const Dominators::BlockList& Dominators::get_frontier(BasicBlock* bb) const {
+	return m_frontier[bb->get_id()];
+}
+
+const ControlFlowGraph::EdgeList& Dominators::get_preds(BasicBlock* bb) const {
+	return m_post ? m_cfg->get_outgoing_edges(bb) : m_cfg->get_incoming_edges(bb);
+}
+
+const ControlFlowGraph::EdgeList& Dominators::get_succs(BasicBlock* bb) const {
+	return m_post ? m_cfg->get_incoming_edges(bb) : m_cfg->get_outgoing_edges(bb);
+}
+
+BasicBlock* Dominators::get_pred(const Edge* e) const {
+	return m_post ? e->get_target() : e->get_source();
+}
+
+BasicBlock* Dominators::get_succ(const Edge* e) const {
+	return m_post ? e->get_source() : e->get_target();
+}
+
+// Iterative depth-first search, so that very large CFGs don't overflow the stack.
+void Dominators::compute_reverse_postorder() {
+	const unsigned num_blocks = m_cfg->get_num_blocks();
+	m_rpo.clear();
+	m_rpo_index.assign(num_blocks, NONE);
+	std::vector<bool> visited(num_blocks, false);
+	// (block, index of next successor edge to visit)
+	std::vector<std::pair<BasicBlock*, unsigned>> stack;
+	stack.emplace_back(get_root(), 0);
+	visited[get_root()->get_id()] = true;
+	BlockList postorder;
+	while (!stack.empty()) {
+		auto& top = stack.back();
+		const ControlFlowGraph::EdgeList& succs = get_succs(top.first);
+		if (top.second < succs.size()) {
+			BasicBlock* succ = get_succ(succs[top.second++]);
+			if (!visited[succ->get_id()]) {
+				visited[succ->get_id()] = true;
+				stack.emplace_back(succ, 0);
+			}
+			continue;
+		}
+		postorder.push_back(top.first);
+		stack.pop_back();
+	}
+	m_rpo.assign(postorder.rbegin(), postorder.rend());
+	for (unsigned i = 0; i < m_rpo.size(); i++) m_rpo_index[m_rpo[i]->get_id()] = i;
+}
+
+void Dominators::compute_idoms() {
+	m_idom.assign(m_rpo.size(), NONE);
+	if (m_rpo.empty()) return;
+	m_idom[0] = 0;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (unsigned i = 1; i < m_rpo.size(); i++) {
+			// intersect the dominators of all processed predecessors
+			unsigned new_idom = NONE;
+			for (const auto edge : get_preds(m_rpo[i])) {
+				const unsigned pred = m_rpo_index[get_pred(edge)->get_id()];
+				if (pred == NONE || m_idom[pred] == NONE) continue;
+				new_idom = new_idom == NONE ? pred : intersect(pred, new_idom);
+			}
+			if (new_idom != m_idom[i]) {
+				m_idom[i] = new_idom;
+				changed = true;
+			}
+		}
+	}
+}
+
+// walk up from a and b (rpo indices) to their nearest common dominator
+unsigned Dominators::intersect(unsigned a, unsigned b) const {
+	while (a != b) {
+		while (a > b) a = m_idom[a];
+		while (b > a) b = m_idom[b];
+	}
+	return a;
+}
+
+void Dominators::build_tree() {
+	const unsigned num_blocks = m_cfg->get_num_blocks();
+	m_children.assign(num_blocks, BlockList());
+	m_tree_enter.assign(num_blocks, NONE);
+	m_tree_exit.assign(num_blocks, NONE);
+	for (unsigned i = 1; i < m_rpo.size(); i++) m_children[m_rpo[m_idom[i]]->get_id()].push_back(m_rpo[i]);
+	if (m_rpo.empty()) return;
+
+	// number the tree so dominates() is a constant time interval check
+	unsigned counter = 0;
+	std::vector<std::pair<BasicBlock*, unsigned>> stack;
+	stack.emplace_back(m_rpo[0], 0);
+	m_tree_enter[m_rpo[0]->get_id()] = counter++;
+	while (!stack.empty()) {
+		auto& top = stack.back();
+		const BlockList& children = m_children[top.first->get_id()];
+		if (top.second < children.size()) {
+			BasicBlock* child = children[top.second++];
+			m_tree_enter[child->get_id()] = counter++;
+			stack.emplace_back(child, 0);
+			continue;
+		}
+		m_tree_exit[top.first->get_id()] = counter++;
+		stack.pop_back();
+	}
+}
+
+void Dominators::compute_frontiers() {
+	m_frontier.assign(m_cfg->get_num_blocks(), BlockList());
+	for (unsigned i = 0; i < m_rpo.size(); i++) {
+		BasicBlock* bb = m_rpo[i];
+		const ControlFlowGraph::EdgeList& preds = get_preds(bb);
+		if (preds.size() < 2) continue;
+		// bb is in the frontier of every block between each predecessor and bb's idom
+		for (const auto edge : preds) {
+			unsigned runner = m_rpo_index[get_pred(edge)->get_id()];
+			if (runner == NONE) continue;
+			while (runner != m_idom[i]) {
+				BlockList& frontier = m_frontier[m_rpo[runner]->get_id()];
+				if (frontier.empty() || frontier.back() != bb) frontier.push_back(bb);
+				runner = m_idom[runner];
+			}
+		}
+	}
+}
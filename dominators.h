@@ -0,0 +1,79 @@
+#ifndef DOMINATORS_H
+#define DOMINATORS_H
+
+#include <vector>
+#include "cfg.h"
+
+// Dominator tree and dominance frontiers of a ControlFlowGraph, computed with
+// the iterative algorithm of Cooper, Harvey & Kennedy ("A Simple, Fast
+// Dominance Algorithm") over block ids.  With post = true, the same is
+// computed on the reversed graph rooted at the exit block, giving
+// post-dominators and post-dominance frontiers.
+//
+// Results are computed once by execute() and cached; all queries are O(1)
+// except the ones returning lists.  Blocks which are unreachable from the
+// root (or, for post-dominators, which can't reach the exit) have no
+// immediate dominator and dominate nothing.
+class Dominators {
+public:
+	using BlockList = ControlFlowGraph::BlockList;
+
+private:
+	ControlFlowGraph* m_cfg;
+	bool m_post;
+	// reachable blocks in reverse postorder from the root
+	BlockList m_rpo;
+	// position of each block in m_rpo, or NONE if unreachable
+	std::vector<unsigned> m_rpo_index;
+	// immediate dominator of each block (by rpo index), root's is itself
+	std::vector<unsigned> m_idom;
+	// dominator tree, indexed by block id
+	std::vector<BlockList> m_children;
+	std::vector<BlockList> m_frontier;
+	// preorder entry/exit numbers in the dominator tree, for dominates()
+	std::vector<unsigned> m_tree_enter, m_tree_exit;
+
+public:
+	static const unsigned NONE = ~0u;
+
+	Dominators(ControlFlowGraph* cfg, bool post = false);
+	~Dominators();
+
+	// execute the analysis
+	void execute();
+
+	// entry block (or exit block for post-dominators)
+	BasicBlock* get_root() const;
+
+	bool is_reachable(BasicBlock* bb) const;
+
+	// immediate (post-)dominator, or nullptr for the root and unreachable blocks
+	BasicBlock* get_idom(BasicBlock* bb) const;
+
+	// does a (post-)dominate b? every reachable block dominates itself
+	bool dominates(BasicBlock* a, BasicBlock* b) const;
+
+	// blocks immediately dominated by bb
+	const BlockList& get_children(BasicBlock* bb) const;
+
+	// dominance frontier of bb
+	const BlockList& get_frontier(BasicBlock* bb) const;
+
+	// reachable blocks in reverse postorder (with respect to edge
+	// direction, so for post-dominators this starts at the exit block)
+	const BlockList& get_reverse_postorder() const { return m_rpo; }
+
+private:
+	const ControlFlowGraph::EdgeList& get_preds(BasicBlock* bb) const;
+	const ControlFlowGraph::EdgeList& get_succs(BasicBlock* bb) const;
+	BasicBlock* get_pred(const Edge* e) const;
+	BasicBlock* get_succ(const Edge* e) const;
+
+	void compute_reverse_postorder();
+	void compute_idoms();
+	unsigned intersect(unsigned a, unsigned b) const;
+	void build_tree();
+	void compute_frontiers();
+};
+
+#endif // DOMINATORS_H
@@ -0,0 +1,155 @@
+#! /usr/bin/env ruby
+
+# Generate a synthetic program for compile-time benchmarks (see
+# bench_scaling.rb), and print it to stdout.  Each parameter stresses a
+# different part of the compiler:
+#
+#   --statements N   number of assignment statements
+#   --depth N        nesting depth of the IF/WHILE statements around them
+#   --decls N        number of INTEGER variables the statements use
+#   --dims N         dimensionality of the array the statements index
+#   --expr-depth N   nesting depth of the expression each one assigns
+#   --seed N         seed for the random choices
+#
+# The programs are well-formed, initialize every variable and array element
+# they read, and terminate (every WHILE runs twice), so they can be run as
+# well as compiled, and their output doesn't depend on how they were
+# compiled.
+
+require 'optparse'
+
+params = {
+  statements: 1000,
+  depth: 2,
+  decls: 50,
+  dims: 2,
+  expr_depth: 3,
+  seed: 1,
+}
+
+OptionParser.new do |opts|
+  opts.banner = 'Usage: gen_program.rb [options] > program.in'
+  opts.on('--statements N', Integer) { |n| params[:statements] = n }
+  opts.on('--depth N', Integer) { |n| params[:depth] = n }
+  opts.on('--decls N', Integer) { |n| params[:decls] = n }
+  opts.on('--dims N', Integer) { |n| params[:dims] = n }
+  opts.on('--expr-depth N', Integer) { |n| params[:expr_depth] = n }
+  opts.on('--seed N', Integer) { |n| params[:seed] = n }
+end.parse!
+
+# statements per innermost block
+GROUP_SIZE = 8
+# the length of each of the array's dimensions
+ARRAY_LENGTH = 2
+
+class ProgramGenerator
+  def initialize(params)
+    @statements = params[:statements]
+    @depth = params[:depth]
+    @decls = [params[:decls], 1].max
+    @dims = params[:dims]
+    @expr_depth = params[:expr_depth]
+    @rng = Random.new(params[:seed])
+    @out = []
+  end
+
+  def generate
+    @out << 'PROGRAM synthetic;'
+    @out << 'VAR'
+    (0...@decls).each_slice(8) do |slice|
+      @out << '  ' + slice.map { |i| "v#{i}" }.join(', ') + ' : INTEGER;'
+    end
+    # one counter for the WHILE loops at each depth
+    @out << '  ' + (0...@depth).map { |d| "k#{d}" }.join(', ') + ' : INTEGER;' if @depth > 0
+    if @dims > 0
+      # and one for each dimension of the array, to initialize it
+      @out << '  ' + (0...@dims).map { |d| "j#{d}" }.join(', ') + ' : INTEGER;'
+      @out << "  a : #{'ARRAY %d OF ' % ARRAY_LENGTH * @dims}INTEGER;"
+    end
+    @out << 'BEGIN'
+    (0...@decls).each { |i| @out << "  v#{i} := #{i};" }
+    initialize_array if @dims > 0
+    remaining = @statements
+    while remaining > 0
+      n = [remaining, GROUP_SIZE].min
+      nest(0, n, '  ')
+      remaining -= n
+    end
+    (0...[@decls, 8].min).each { |i| @out << "  WRITE v#{i};" }
+    @out << "  WRITE #{element};" if @dims > 0
+    @out << 'END.'
+    @out.join("\n") + "\n"
+  end
+
+  private
+
+  # every element of a is set to the sum of its indices
+  def initialize_array
+    indent = '  '
+    (0...@dims).each do |d|
+      @out << "#{indent}j#{d} := 0;"
+      @out << "#{indent}WHILE j#{d} < #{ARRAY_LENGTH} DO"
+      indent += '  '
+    end
+    indices = (0...@dims).map { |d| "j#{d}" }
+    @out << "#{indent}a#{indices.map { |j| "[#{j}]" }.join} := #{indices.join(' + ')};"
+    (0...@dims).reverse_each do |d|
+      @out << "#{indent}j#{d} := j#{d} + 1;"
+      indent = indent[2..]
+      @out << "#{indent}END;"
+    end
+  end
+
+  # n assignments, wrapped in depth - level more levels of IF or WHILE
+  def nest(level, n, indent)
+    if level == @depth
+      n.times { @out << "#{indent}#{designator} := #{expression(@expr_depth)};" }
+    elsif level.even?
+      @out << "#{indent}IF #{variable} < #{variable} THEN"
+      nest(level + 1, n, indent + '  ')
+      @out << "#{indent}ELSE"
+      @out << "#{indent}  #{variable} := #{variable};"
+      @out << "#{indent}END;"
+    else
+      @out << "#{indent}k#{level} := 0;"
+      @out << "#{indent}WHILE k#{level} < 2 DO"
+      nest(level + 1, n, indent + '  ')
+      @out << "#{indent}  k#{level} := k#{level} + 1;"
+      @out << "#{indent}END;"
+    end
+  end
+
+  def variable
+    "v#{@rng.rand(@decls)}"
+  end
+
+  def element
+    'a' + (0...@dims).map { "[#{@rng.rand(ARRAY_LENGTH)}]" }.join
+  end
+
+  def designator
+    @dims > 0 && @rng.rand(4) == 0 ? element : variable
+  end
+
+  def leaf
+    case @rng.rand(5)
+    when 0 then @rng.rand(100).to_s
+    when 1 then @dims > 0 ? element : variable
+    else variable
+    end
+  end
+
+  # An expression nested depth levels deep: one operand of each operator
+  # continues the spine, and the other is a leaf or a small subexpression,
+  # so its size grows linearly with its depth.
+  def expression(depth)
+    return leaf if depth <= 0
+    op = ['+', '-', '*', '+', '-'][@rng.rand(5)]
+    spine = expression(depth - 1)
+    side = @rng.rand(3) == 0 ? "(#{leaf} #{op == '*' ? '+' : '*'} #{leaf})" : leaf
+    operands = @rng.rand(2) == 0 ? [spine, side] : [side, spine]
+    "(#{operands[0]} #{op} #{operands[1]})"
+  end
+end
+
+print ProgramGenerator.new(params).generate
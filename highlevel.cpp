@@ -122,6 +122,7 @@ bool HighLevel::is_def(const Instruction* ins) {
 	case HINS_LOAD_INT:
 	case HINS_READ_INT:
 	case HINS_LOCALADDR:
+	case HINS_LEA:
 		return ins->get_operand(0).get_kind() == OPERAND_VREG;
 	default:
 		return false;
@@ -129,5 +130,28 @@ bool HighLevel::is_def(const Instruction* ins) {
 }
 
 bool HighLevel::is_use(const Instruction* ins, unsigned operand) {
-	return ins->get_operand(operand).get_kind() == OPERAND_VREG;
+	// the destination of a def is not a use
+	if (operand == 0 && is_def(ins)) return false;
+	// a memory reference uses the vreg(s) holding its address
+	switch (ins->get_operand(operand).get_kind()) {
+	case OPERAND_VREG:
+	case OPERAND_VREG_MEMREF:
+	case OPERAND_VREG_MEMREF_OFFSET:
+	case OPERAND_VREG_MEMREF_INDEX:
+	case OPERAND_VREG_MEMREF_OFFSET_INDEX:
+	case OPERAND_FRAME_MEMREF_OFFSET_INDEX:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool HighLevel::uses_vreg(const Instruction* ins, int vreg) {
+	for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+		if (!is_use(ins, k)) continue;
+		const Operand op = ins->get_operand(k);
+		if (op.has_base_reg() && op.get_base_reg() == vreg) return true;
+		if (op.has_index_reg() && op.get_index_reg() == vreg) return true;
+	}
+	return false;
 }
@@ -6,6 +6,8 @@
 namespace HighLevel {
 	bool is_def(const Instruction* ins);
 	bool is_use(const Instruction* ins, unsigned operand);
+	// does ins use vreg (directly or as part of a memory reference)?
+	bool uses_vreg(const Instruction* ins, int vreg);
 }
 
 // "High-level" opcodes
@@ -1,16 +1,19 @@
 #include "highlevelcodegen.h"
 #include <cassert>
 #include <iostream>
+#include <utility>
+#include <vector>
 #include "node.h"
 #include "grammar_symbols.h"
 #include "ast.h"
 
-HighLevelCodeGen::HighLevelCodeGen(SymbolTable* symtab) {
+HighLevelCodeGen::HighLevelCodeGen(SymbolTable* symtab, const SemanticInfo* info) {
 	_iseq = new InstructionSequence();
 	_printer = new PrintHighLevelInstructionSequence(_iseq);
 	this->symtab = symtab;
-	const auto int_type = symtab->lookup("INTEGER")->get_type();
-	const auto char_type = symtab->lookup("CHAR")->get_type();
+	this->info = info;
+	const auto int_type = symtab->get_int_type();
+	const auto char_type = symtab->get_char_type();
 	for (const auto sym : symtab->get_syms()) {
 		if (sym->get_kind() == VAR && (sym->get_type() == int_type || sym->get_type() == char_type))
 			sym->set_vreg(next_vreg());
@@ -19,7 +22,9 @@ HighLevelCodeGen::HighLevelCodeGen(SymbolTable* symtab) {
 	}
 }
 
-HighLevelCodeGen::~HighLevelCodeGen() {}
+HighLevelCodeGen::~HighLevelCodeGen() {
+	delete _printer;
+}
 
 InstructionSequence* HighLevelCodeGen::get_iseq() {
 	return _iseq;
@@ -49,6 +54,30 @@ void HighLevelCodeGen::emit(Instruction* const ins) {
 }
 
 void HighLevelCodeGen::visit(struct Node* ast) {
+	if (ast_is_compound_expression(node_get_tag(ast))) visit_expression(ast);
+	else dispatch(ast);
+}
+
+// Visit an expression in postorder with an explicit stack, calling each
+// operator's visit_* method once its operands have been visited.  A long
+// sum is a tree as deep as it is long, so recursing on it would overflow
+// the stack.
+void HighLevelCodeGen::visit_expression(struct Node* ast) {
+	std::vector<std::pair<struct Node*, int>> stack; // a node and the next kid to visit
+	stack.emplace_back(ast, 0);
+	while (!stack.empty()) {
+		struct Node* const node = stack.back().first;
+		const int kid = stack.back().second++;
+		if (kid == node->get_num_kids()) {
+			stack.pop_back();
+			dispatch(node);
+		}
+		else if (ast_is_compound_expression(node_get_tag(node->get_kid(kid)))) stack.emplace_back(node->get_kid(kid), 0);
+		else visit(node->get_kid(kid));
+	}
+}
+
+void HighLevelCodeGen::dispatch(struct Node* ast) {
 	int tag = node_get_tag(ast);
 	switch (tag) {
 	case AST_PROGRAM:
@@ -143,7 +172,7 @@ void HighLevelCodeGen::visit(struct Node* ast) {
 // Transforms the given op if it a memory reference by adding a load instruction and returning a new op
 Operand* HighLevelCodeGen::load_op(Operand* op) {
 	if (!op->is_memref()) return op;
-	const auto destreg = new Operand(OPERAND_VREG, next_vreg());
+	const auto destreg = new_operand(OPERAND_VREG, next_vreg());
 	const auto ins = new Instruction(HINS_LOAD_INT, *destreg, *op);
 	emit(ins);
 	return destreg;
@@ -154,72 +183,65 @@ void HighLevelCodeGen::visit_program(struct Node* ast) {
 }
 
 void HighLevelCodeGen::visit_add(struct Node* ast) {
-
-	recur_on_children(ast);
-	const auto destreg = new Operand(OPERAND_VREG, next_vreg());
-	const auto leftop = load_op(ast->get_kid(0)->get_operand());
-	const auto rightop = load_op(ast->get_kid(1)->get_operand());
+	const auto destreg = new_operand(OPERAND_VREG, next_vreg());
+	const auto leftop = load_op(_operands.get(ast->get_kid(0)));
+	const auto rightop = load_op(_operands.get(ast->get_kid(1)));
 	const auto ins = new Instruction(HINS_INT_ADD, *destreg, *leftop, *rightop);
 	emit(ins);
-	ast->set_operand(destreg);
+	_operands.set(ast, destreg);
 }
 
 void HighLevelCodeGen::visit_subtract(struct Node* ast) {
-	recur_on_children(ast);
-	const auto destreg = new Operand(OPERAND_VREG, next_vreg());
-	const auto leftop = load_op(ast->get_kid(0)->get_operand());
-	const auto rightop = load_op(ast->get_kid(1)->get_operand());
+	const auto destreg = new_operand(OPERAND_VREG, next_vreg());
+	const auto leftop = load_op(_operands.get(ast->get_kid(0)));
+	const auto rightop = load_op(_operands.get(ast->get_kid(1)));
 	const auto ins = new Instruction(HINS_INT_SUB, *destreg, *leftop, *rightop);
 	emit(ins);
-	ast->set_operand(destreg);
+	_operands.set(ast, destreg);
 }
 
 void HighLevelCodeGen::visit_multiply(struct Node* ast) {
-	recur_on_children(ast);
-	const auto destreg = new Operand(OPERAND_VREG, next_vreg());
-	const auto leftop = load_op(ast->get_kid(0)->get_operand());
-	const auto rightop = load_op(ast->get_kid(1)->get_operand());
+	const auto destreg = new_operand(OPERAND_VREG, next_vreg());
+	const auto leftop = load_op(_operands.get(ast->get_kid(0)));
+	const auto rightop = load_op(_operands.get(ast->get_kid(1)));
 	const auto ins = new Instruction(HINS_INT_MUL, *destreg, *leftop, *rightop);
 	emit(ins);
-	ast->set_operand(destreg);
+	_operands.set(ast, destreg);
 }
 
 void HighLevelCodeGen::visit_divide(struct Node* ast) {
-	recur_on_children(ast);
-	const auto destreg = new Operand(OPERAND_VREG, next_vreg());
-	const auto leftop = load_op(ast->get_kid(0)->get_operand());
-	const auto rightop = load_op(ast->get_kid(1)->get_operand());
+	const auto destreg = new_operand(OPERAND_VREG, next_vreg());
+	const auto leftop = load_op(_operands.get(ast->get_kid(0)));
+	const auto rightop = load_op(_operands.get(ast->get_kid(1)));
 	const auto ins = new Instruction(HINS_INT_DIV, *destreg, *leftop, *rightop);
 	emit(ins);
-	ast->set_operand(destreg);
+	_operands.set(ast, destreg);
 }
 
 void HighLevelCodeGen::visit_modulus(struct Node* ast) {
-	recur_on_children(ast);
-	const auto destreg = new Operand(OPERAND_VREG, next_vreg());
-	const auto leftop = load_op(ast->get_kid(0)->get_operand());
-	const auto rightop = load_op(ast->get_kid(1)->get_operand());
+	const auto destreg = new_operand(OPERAND_VREG, next_vreg());
+	const auto leftop = load_op(_operands.get(ast->get_kid(0)));
+	const auto rightop = load_op(_operands.get(ast->get_kid(1)));
 	const auto ins = new Instruction(HINS_INT_MOD, *destreg, *leftop, *rightop);
 	emit(ins);
-	ast->set_operand(destreg);
+	_operands.set(ast, destreg);
 }
 
 void HighLevelCodeGen::visit_negate(struct Node* ast) {
-	recur_on_children(ast);
-	const auto destreg = new Operand(OPERAND_VREG, next_vreg());
-	const auto op = load_op(ast->get_kid(0)->get_operand());
+	const auto destreg = new_operand(OPERAND_VREG, next_vreg());
+	const auto op = load_op(_operands.get(ast->get_kid(0)));
 	const auto ins = new Instruction(HINS_INT_NEGATE, *destreg, *op);
 	emit(ins);
-	ast->set_operand(destreg);
+	_operands.set(ast, destreg);
 }
 
 void HighLevelCodeGen::visit_int_literal(struct Node* ast) {
 	// example from the assignment instructions
-	const auto destreg = new Operand(OPERAND_VREG, next_vreg());
-	const auto immval = new Operand(OPERAND_INT_LITERAL, ast->get_ival());
+	const auto destreg = new_operand(OPERAND_VREG, next_vreg());
+	const auto immval = new_operand(OPERAND_INT_LITERAL, info->get_ival(ast));
 	const auto ins = new Instruction(HINS_LOAD_ICONST, *destreg, *immval);
 	emit(ins);
-	ast->set_operand(destreg);
+	_operands.set(ast, destreg);
 }
 
 void HighLevelCodeGen::visit_instructions(struct Node* ast) {
@@ -228,14 +250,14 @@ void HighLevelCodeGen::visit_instructions(struct Node* ast) {
 
 void HighLevelCodeGen::visit_assign(struct Node* ast) {
 	recur_on_children(ast);
-	const auto leftop = ast->get_kid(0)->get_operand();
-	const auto rightop = load_op(ast->get_kid(1)->get_operand());
+	const auto leftop = _operands.get(ast->get_kid(0));
+	const auto rightop = load_op(_operands.get(ast->get_kid(1)));
 	Instruction* ins;
 	if (leftop->is_memref()) {
 		ins = new Instruction(HINS_STORE_INT, *leftop, *rightop);
 		// free the vregs used to calculate the memref
 		// also free the RHS vreg since it's in memory now
-		for (int i = 0; i < ast->get_kid(0)->get_num_vregs_used() + 1; ++i) free_vreg();
+		for (int i = 0; i < _vregs_used.get(ast->get_kid(0)) + 1; ++i) free_vreg();
 	}
 	else ins = new Instruction(HINS_MOV, *leftop, *rightop);
 	emit(ins);
@@ -246,10 +268,13 @@ void HighLevelCodeGen::visit_if(struct Node* ast) {
 	const auto condition_ast = ast->get_kid(0);
 	const auto then_ast = ast->get_kid(1);
 	const auto out_label = next_label();
-	condition_ast->set_inverted(true);
-	condition_ast->set_operand(new Operand(out_label));
+	_inverted.set(condition_ast, true);
+	_operands.set(condition_ast, new_operand(out_label));
 	visit(condition_ast);
 	visit(then_ast);
+	// in case we're in a nested control block
+	if (_iseq->has_label_at_end())
+		emit(new Instruction(HINS_NOP));
 	_iseq->define_label(out_label);
 }
 
@@ -266,8 +291,8 @@ void HighLevelCodeGen::visit_if_else(struct Node* ast) {
 	const auto else_ast = ast->get_kid(2);
 	const auto else_label = next_label();
 	const auto out_label = next_label();
-	condition_ast->set_inverted(true);
-	condition_ast->set_operand(new Operand(else_label));
+	_inverted.set(condition_ast, true);
+	_operands.set(condition_ast, new_operand(else_label));
 	visit(condition_ast);
 	visit(then_ast);
 	const auto ins = new Instruction(HINS_JUMP, Operand(out_label));
@@ -286,8 +311,8 @@ void HighLevelCodeGen::visit_repeat(struct Node* ast) {
 	const auto instructions_label = next_label();
 	_iseq->define_label(instructions_label);
 	visit(instructions_ast);
-	condition_ast->set_operand(new Operand(instructions_label));
-	condition_ast->set_inverted(true); // we want to jump when the comparison is false
+	_operands.set(condition_ast, new_operand(instructions_label));
+	_inverted.set(condition_ast, true); // we want to jump when the comparison is false
 	visit(condition_ast);
 }
 
@@ -297,7 +322,7 @@ void HighLevelCodeGen::visit_while(struct Node* ast) {
 	const auto condition_label = next_label();
 	const auto instructions_label = next_label();
 	// condition needs to know where to jump to if successful
-	condition_ast->set_operand(new Operand(instructions_label));
+	_operands.set(condition_ast, new_operand(instructions_label));
 	const auto ins = new Instruction(HINS_JUMP, Operand(condition_label));
 	emit(ins);
 	_iseq->define_label(instructions_label);
@@ -310,88 +335,82 @@ void HighLevelCodeGen::visit_while(struct Node* ast) {
 }
 
 void HighLevelCodeGen::visit_compare_eq(struct Node* ast) {
-	recur_on_children(ast);
-	const auto leftop = load_op(ast->get_kid(0)->get_operand());
-	const auto rightop = load_op(ast->get_kid(1)->get_operand());
+	const auto leftop = load_op(_operands.get(ast->get_kid(0)));
+	const auto rightop = load_op(_operands.get(ast->get_kid(1)));
 	auto ins = new Instruction(HINS_INT_COMPARE, *leftop, *rightop);
 	emit(ins);
-	ins = ast->is_inverted()
-		      ? new Instruction(HINS_JNE, *ast->get_operand())
-		      : new Instruction(HINS_JE, *ast->get_operand());
+	ins = _inverted.get(ast)
+		      ? new Instruction(HINS_JNE, *_operands.get(ast))
+		      : new Instruction(HINS_JE, *_operands.get(ast));
 	emit(ins);
 }
 
 void HighLevelCodeGen::visit_compare_neq(struct Node* ast) {
-	recur_on_children(ast);
-	const auto leftop = load_op(ast->get_kid(0)->get_operand());
-	const auto rightop = load_op(ast->get_kid(1)->get_operand());
+	const auto leftop = load_op(_operands.get(ast->get_kid(0)));
+	const auto rightop = load_op(_operands.get(ast->get_kid(1)));
 	auto ins = new Instruction(HINS_INT_COMPARE, *leftop, *rightop);
 	emit(ins);
-	ins = ast->is_inverted()
-		      ? new Instruction(HINS_JE, *ast->get_operand())
-		      : new Instruction(HINS_JNE, *ast->get_operand());
+	ins = _inverted.get(ast)
+		      ? new Instruction(HINS_JE, *_operands.get(ast))
+		      : new Instruction(HINS_JNE, *_operands.get(ast));
 	emit(ins);
 }
 
 void HighLevelCodeGen::visit_compare_lt(struct Node* ast) {
-	recur_on_children(ast);
-	const auto leftop = load_op(ast->get_kid(0)->get_operand());
-	const auto rightop = load_op(ast->get_kid(1)->get_operand());
+	const auto leftop = load_op(_operands.get(ast->get_kid(0)));
+	const auto rightop = load_op(_operands.get(ast->get_kid(1)));
 	auto ins = new Instruction(HINS_INT_COMPARE, *leftop, *rightop);
 	emit(ins);
-	ins = ast->is_inverted()
-		      ? new Instruction(HINS_JGTE, *ast->get_operand())
-		      : new Instruction(HINS_JLT, *ast->get_operand());
+	ins = _inverted.get(ast)
+		      ? new Instruction(HINS_JGTE, *_operands.get(ast))
+		      : new Instruction(HINS_JLT, *_operands.get(ast));
 	emit(ins);
 }
 
 void HighLevelCodeGen::visit_compare_lte(struct Node* ast) {
-	recur_on_children(ast);
-	const auto leftop = load_op(ast->get_kid(0)->get_operand());
-	const auto rightop = load_op(ast->get_kid(1)->get_operand());
+	const auto leftop = load_op(_operands.get(ast->get_kid(0)));
+	const auto rightop = load_op(_operands.get(ast->get_kid(1)));
 	auto ins = new Instruction(HINS_INT_COMPARE, *leftop, *rightop);
 	emit(ins);
-	ins = ast->is_inverted()
-		      ? new Instruction(HINS_JGT, *ast->get_operand())
-		      : new Instruction(HINS_JLTE, *ast->get_operand());
+	ins = _inverted.get(ast)
+		      ? new Instruction(HINS_JGT, *_operands.get(ast))
+		      : new Instruction(HINS_JLTE, *_operands.get(ast));
 	emit(ins);
 }
 
 void HighLevelCodeGen::visit_compare_gt(struct Node* ast) {
-	recur_on_children(ast);
-	const auto leftop = load_op(ast->get_kid(0)->get_operand());
-	const auto rightop = load_op(ast->get_kid(1)->get_operand());
+	const auto leftop = load_op(_operands.get(ast->get_kid(0)));
+	const auto rightop = load_op(_operands.get(ast->get_kid(1)));
 	auto ins = new Instruction(HINS_INT_COMPARE, *leftop, *rightop);
 	emit(ins);
-	ins = ast->is_inverted()
-		      ? new Instruction(HINS_JLTE, *ast->get_operand())
-		      : new Instruction(HINS_JGT, *ast->get_operand());
+	ins = _inverted.get(ast)
+		      ? new Instruction(HINS_JLTE, *_operands.get(ast))
+		      : new Instruction(HINS_JGT, *_operands.get(ast));
 	emit(ins);
 }
 
 void HighLevelCodeGen::visit_compare_gte(struct Node* ast) {
-	recur_on_children(ast);
-	const auto leftop = load_op(ast->get_kid(0)->get_operand());
-	const auto rightop = load_op(ast->get_kid(1)->get_operand());
+	const auto leftop = load_op(_operands.get(ast->get_kid(0)));
+	const auto rightop = load_op(_operands.get(ast->get_kid(1)));
 	auto ins = new Instruction(HINS_INT_COMPARE, *leftop, *rightop);
 	emit(ins);
-	ins = ast->is_inverted()
-		      ? new Instruction(HINS_JLT, *ast->get_operand())
-		      : new Instruction(HINS_JGTE, *ast->get_operand());
+	ins = _inverted.get(ast)
+		      ? new Instruction(HINS_JLT, *_operands.get(ast))
+		      : new Instruction(HINS_JGTE, *_operands.get(ast));
 	emit(ins);
 }
 
 void HighLevelCodeGen::visit_write(struct Node* ast) {
 	recur_on_children(ast);
-	auto op = ast->get_kid(0)->get_operand();
+	auto op = _operands.get(ast->get_kid(0));
 	Instruction* ins;
 	if (op->is_memref()) {
-		const auto writereg = new Operand(OPERAND_VREG, next_vreg());
+		const auto writereg = new_operand(OPERAND_VREG, next_vreg());
 		ins = new Instruction(HINS_LOAD_INT, *writereg, *op);
 		emit(ins);
 		// free the vregs used to calculate the memref
 		// also free the temporary writereg
-		for (int i = 0; i < ast->get_kid(0)->get_num_vregs_used() + 1; ++i) free_vreg();
+		for (int i = 0; i < _vregs_used.get(ast->get_kid(0)) + 1; ++i) free_vreg();
 		// change the write op to the new writereg
 		op = writereg;
 	}
@@ -401,14 +420,14 @@ void HighLevelCodeGen::visit_write(struct Node* ast) {
 
 void HighLevelCodeGen::visit_read(struct Node* ast) {
 	recur_on_children(ast);
-	auto op = ast->get_kid(0)->get_operand();
-	const auto readreg = new Operand(OPERAND_VREG, next_vreg());
+	auto op = _operands.get(ast->get_kid(0));
+	const auto readreg = new_operand(OPERAND_VREG, next_vreg());
 	auto ins = new Instruction(HINS_READ_INT, *readreg);
 	emit(ins);
 	if (op->is_memref()) {
 		ins = new Instruction(HINS_STORE_INT, *op, *readreg);
 		// free the vregs used to calculate the memref
-		for (int i = 0; i < ast->get_kid(0)->get_num_vregs_used(); ++i) free_vreg();
+		for (int i = 0; i < _vregs_used.get(ast->get_kid(0)); ++i) free_vreg();
 	}
 	else ins = new Instruction(HINS_MOV, *op, *readreg);
 	emit(ins);
@@ -417,58 +436,62 @@ void HighLevelCodeGen::visit_read(struct Node* ast) {
 
 void HighLevelCodeGen::visit_var_ref(struct Node* ast) {
 	const struct Node* tok_identifier = ast->get_kid(0);
-	const auto sym = symtab->lookup(tok_identifier->get_str());
+	const auto sym = symtab->lookup(tok_identifier->get_name());
 	// symbol is a local variable
 	if (sym->get_vreg() >= 0) {
-		const auto destreg = new Operand(OPERAND_VREG, sym->get_vreg());
-		ast->set_operand(destreg);
+		const auto destreg = new_operand(OPERAND_VREG, sym->get_vreg());
+		_operands.set(ast, destreg);
+		return;
+	}
+	auto destreg = new_operand(OPERAND_VREG, next_vreg());
+	// constants are known at compile time, so there's no need to load them
+	if (sym->get_kind() == CONST) {
+		emit(new Instruction(HINS_LOAD_ICONST, *destreg, Operand(OPERAND_INT_LITERAL, sym->get_ival())));
+		_operands.set(ast, destreg);
+		_vregs_used.set(ast, 1);
 		return;
 	}
 	// get the base address
-	auto destreg = new Operand(OPERAND_VREG, next_vreg());
 	const int base_addr = sym->get_offset();
 	auto ins = new Instruction(HINS_LOCALADDR, *destreg, Operand(OPERAND_INT_LITERAL, base_addr));
 	emit(ins);
-	if (sym->get_kind() == CONST) *destreg = destreg->to_memref();
-	ast->set_operand(destreg);
-	ast->set_vregs_used(1); // base addr
+	_operands.set(ast, destreg);
+	_vregs_used.set(ast, 1); // base addr
 }
 
 void HighLevelCodeGen::visit_array_element_ref(struct Node* ast) {
-	recur_on_children(ast);
 	const auto identifier_ast = ast->get_kid(0);
 	const auto index_ast = ast->get_kid(1);
 	// calculate the offset
-	const int elem_size = dynamic_cast<ArrayType*>(identifier_ast->get_type())->get_type()->get_size();
+	const int elem_size = dynamic_cast<ArrayType*>(info->get_type(identifier_ast))->get_type()->get_size();
 	const auto offsetreg = Operand(OPERAND_VREG, next_vreg());
-	auto ins = new Instruction(HINS_INT_MUL, offsetreg, *index_ast->get_operand(),
+	auto ins = new Instruction(HINS_INT_MUL, offsetreg, *_operands.get(index_ast),
 	                           Operand(OPERAND_INT_LITERAL, elem_size));
 	emit(ins);
 	// add the offset to base
-	auto destreg = new Operand(OPERAND_VREG, next_vreg());
-	ins = new Instruction(HINS_INT_ADD, *destreg, *identifier_ast->get_operand(), offsetreg);
+	auto destreg = new_operand(OPERAND_VREG, next_vreg());
+	ins = new Instruction(HINS_INT_ADD, *destreg, *_operands.get(identifier_ast), offsetreg);
 	emit(ins);
 	// set the memref for this node
 	*destreg = destreg->to_memref();
-	ast->set_operand(destreg);
-	ast->set_vregs_used(identifier_ast->get_num_vregs_used() + 2); // offset and base+offset
+	_operands.set(ast, destreg);
+	_vregs_used.set(ast, _vregs_used.get(identifier_ast) + 2); // offset and base+offset
 }
 
 void HighLevelCodeGen::visit_field_ref(struct Node* ast) {
-	recur_on_children(ast);
 	const auto identifier_ast = ast->get_kid(0);
 	const auto field_ast = ast->get_kid(1);
-	const auto record_symtab = dynamic_cast<RecordType*>(identifier_ast->get_type())->get_symtab();
-	const int offset = record_symtab->lookup(field_ast->get_str())->get_offset();
+	const auto record_symtab = dynamic_cast<RecordType*>(info->get_type(identifier_ast))->get_symtab();
+	const int offset = record_symtab->lookup(field_ast->get_name())->get_offset();
 	// add offset to base
-	const auto destreg = new Operand(OPERAND_VREG, next_vreg());
-	const auto ins = new Instruction(HINS_INT_ADD, *destreg, *identifier_ast->get_operand(),
+	const auto destreg = new_operand(OPERAND_VREG, next_vreg());
+	const auto ins = new Instruction(HINS_INT_ADD, *destreg, *_operands.get(identifier_ast),
 	                                 Operand(OPERAND_INT_LITERAL, offset));
 	emit(ins);
 	// set the memref for this node
 	*destreg = destreg->to_memref();
-	ast->set_operand(destreg);
-	ast->set_vregs_used(identifier_ast->get_num_vregs_used() + 1); // base+offset
+	_operands.set(ast, destreg);
+	_vregs_used.set(ast, _vregs_used.get(identifier_ast) + 1); // base+offset
 }
 
 void HighLevelCodeGen::visit_identifier_list(struct Node* ast) {
@@ -478,7 +501,7 @@ void HighLevelCodeGen::visit_identifier_list(struct Node* ast) {
 void HighLevelCodeGen::visit_expression_list(struct Node* ast) {
 	recur_on_children(ast);
 	// pass info up the tree
-	ast->set_operand(ast->get_kid(0)->get_operand());
+	_operands.set(ast, _operands.get(ast->get_kid(0)));
 }
 
 void HighLevelCodeGen::visit_identifier(Node* ast) {
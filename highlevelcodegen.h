@@ -2,18 +2,26 @@
 #define HIGHLEVELCODEGEN_H
 #include "cfg.h"
 #include "symtab.h"
+#include <deque>
 #include <string>
 #include "highlevel.h"
+#include "astvisitor.h"
 
 class HighLevelCodeGen {
 	PrintHighLevelInstructionSequence* _printer;
 	InstructionSequence* _iseq;
 	SymbolTable* symtab;
+	const SemanticInfo* info;
+	// results for each node, allocated by new_operand
+	NodeTable<Operand*> _operands;
+	std::deque<Operand> _operand_pool;
+	NodeTable<bool> _inverted; // whether to compile an inverted comparison
+	NodeTable<int> _vregs_used; // how many vregs were used during address calculation
 	int _vreg_count = 0; // vregs in use
 	int _max_vreg_count = 0; // how many vregs we used at once
 	int _label_count = 0;
 public:
-	HighLevelCodeGen(SymbolTable* symtab);
+	HighLevelCodeGen(SymbolTable* symtab, const SemanticInfo* info);
 	virtual ~HighLevelCodeGen();
 
 	InstructionSequence* get_iseq();
@@ -23,8 +31,17 @@ public:
 	std::string next_label();
 
 	void emit(Instruction* ins);
+	// The visit_* method of an operator or a designator with an index
+	// (ast_is_compound_expression) is called once its kids have been
+	// visited, by visit_expression rather than by recursion.
 	void visit(struct Node* ast);
 
+	// an Operand which lives as long as the code generator
+	template<typename... Args>
+	Operand* new_operand(Args... args) {
+		_operand_pool.emplace_back(args...);
+		return &_operand_pool.back();
+	}
 	Operand* load_op(Operand* op);
 	virtual void visit_program(struct Node* ast);
 	virtual void visit_add(struct Node* ast);
@@ -56,6 +73,11 @@ public:
 	virtual void visit_identifier(struct Node* ast);
 
 	virtual void recur_on_children(struct Node* ast);
+
+private:
+	void visit_expression(struct Node* ast);
+	// call the visit_* method for the node's tag
+	void dispatch(struct Node* ast);
 };
 
 #endif // HIGHLEVELCODEGEN_H
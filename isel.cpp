@@ -0,0 +1,448 @@
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include "highlevel.h"
+#include "isel.h"
+
+const int InstructionSelector::NONE;
+const int InstructionSelector::FRAME;
+
+InstructionSelector::InstructionSelector(ControlFlowGraph* cfg, int num_vregs)
+	: m_cfg(cfg)
+	  , m_num_vregs(num_vregs)
+	  , m_live_vregs(nullptr) {}
+
+InstructionSelector::~InstructionSelector() {
+	delete m_live_vregs;
+}
+
+ControlFlowGraph* InstructionSelector::transform_cfg() {
+	// liveness is needed to tell whether a vreg has a single use
+	m_live_vregs = new LiveVregs(m_cfg);
+	m_live_vregs->execute();
+
+	m_code.resize(m_cfg->get_num_blocks());
+	for (auto i = m_cfg->bb_begin(); i != m_cfg->bb_end(); ++i) select_block(*i);
+	return build_result();
+}
+
+void InstructionSelector::select_block(BasicBlock* bb) {
+	m_block.clear();
+	for (auto i = bb->cbegin(); i != bb->cend(); ++i) m_block.push_back((*i)->duplicate());
+	index_vregs(bb);
+	find_users(bb);
+	m_match.assign(m_block.size(), Match{ NONE, false, {}, 0, { NONE, NONE } });
+	m_covered.assign(m_block.size(), false);
+
+	// an instruction is covered by the tile of a later root, if at all, so
+	// roots are visited from the end of the block
+	for (unsigned i = unsigned(m_block.size()); i-- > 0;) {
+		if (!m_covered[i]) select(i);
+	}
+
+	Code& code = m_code[bb->get_id()];
+	for (unsigned i = 0; i < m_block.size(); i++) {
+		if (m_covered[i]) delete m_block[i];
+		else code.push_back(m_block[i]);
+	}
+}
+
+// set up m_defs and m_next for the vregs of the block
+void InstructionSelector::index_vregs(BasicBlock* bb) {
+	const unsigned stamp = bb->get_id() + 1;
+	for (unsigned i = 0; i < m_block.size(); i++) {
+		const Instruction* ins = m_block[i];
+		for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+			const Operand op = ins->get_operand(k);
+			if (op.has_base_reg()) add_block_vreg(op.get_base_reg(), stamp);
+			if (op.has_index_reg()) add_block_vreg(op.get_index_reg(), stamp);
+		}
+		if (HighLevel::is_def(ins)) m_defs[ins->get_operand(0).get_base_reg()].push_back(i);
+	}
+}
+
+void InstructionSelector::add_block_vreg(int vreg, unsigned stamp) {
+	if (unsigned(vreg) >= m_block_stamp.size()) {
+		m_defs.resize(vreg + 1);
+		m_next.resize(vreg + 1);
+		m_block_stamp.resize(vreg + 1, 0);
+	}
+	if (m_block_stamp[vreg] != stamp) {
+		m_block_stamp[vreg] = stamp;
+		m_defs[vreg].clear();
+		m_next[vreg] = NONE;
+	}
+}
+
+// m_user[i] is the index of the instruction which consumes the value
+// defined by a pure instruction i, if that is its only use
+void InstructionSelector::find_users(BasicBlock* bb) {
+	const unsigned n = unsigned(m_block.size());
+	m_user.assign(n, NONE);
+	// bit 2k (2k+1) of dies[i] is set if the base (index) register of
+	// operand k of instruction i isn't live after it
+	std::vector<unsigned> dies(n, 0);
+	LiveVregs::LiveSet live = m_live_vregs->get_fact_at_end_of_block(bb);
+	for (unsigned i = n; i-- > 0;) {
+		const Instruction* ins = m_block[i];
+
+		// the value of a pure instruction goes to the next instruction
+		// which mentions its vreg, if that uses it (once, for the last time)
+		if (is_pure(ins)) {
+			const int vreg = ins->get_operand(0).get_base_reg();
+			const int j = m_next[vreg];
+			if (!HighLevel::uses_vreg(ins, vreg) && j != NONE) {
+				const Instruction* user = m_block[j];
+				unsigned uses = 0, dead = 0;
+				for (unsigned k = 0; k < user->get_num_operands(); k++) {
+					if (!HighLevel::is_use(user, k)) continue;
+					const Operand op = user->get_operand(k);
+					if (op.has_base_reg() && op.get_base_reg() == vreg) {
+						uses++;
+						dead |= dies[j] & (1u << (2 * k));
+					}
+					if (op.has_index_reg() && op.get_index_reg() == vreg) {
+						uses++;
+						dead |= dies[j] & (1u << (2 * k + 1));
+					}
+				}
+				if (uses == 1 && dead) m_user[i] = j;
+			}
+		}
+
+		for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+			if (!HighLevel::is_use(ins, k)) continue;
+			const Operand op = ins->get_operand(k);
+			if (op.has_base_reg() && !live.test(op.get_base_reg())) dies[i] |= 1u << (2 * k);
+			if (op.has_index_reg() && !live.test(op.get_index_reg())) dies[i] |= 1u << (2 * k + 1);
+		}
+		if (HighLevel::is_def(ins)) {
+			live.reset(ins->get_operand(0).get_base_reg());
+			m_next[ins->get_operand(0).get_base_reg()] = int(i);
+		}
+		for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+			if (!HighLevel::is_use(ins, k)) continue;
+			const Operand op = ins->get_operand(k);
+			if (op.has_base_reg()) {
+				live.set(op.get_base_reg());
+				m_next[op.get_base_reg()] = int(i);
+			}
+			if (op.has_index_reg()) {
+				live.set(op.get_index_reg());
+				m_next[op.get_index_reg()] = int(i);
+			}
+		}
+	}
+}
+
+void InstructionSelector::select(unsigned root) {
+	switch (m_block[root]->get_opcode()) {
+	case HINS_LOAD_INT:
+		select_address(root, 1);
+		break;
+	case HINS_STORE_INT:
+		select_address(root, 0);
+		select_immediates(root);
+		break;
+	case HINS_INT_ADD:
+	case HINS_INT_SUB:
+	case HINS_INT_MUL:
+		if (!select_lea(root)) select_immediates(root);
+		break;
+	default:
+		select_immediates(root);
+		break;
+	}
+}
+
+// fold the computation of a load or store address into an addressing mode
+bool InstructionSelector::select_address(unsigned root, unsigned operand) {
+	Instruction* ins = m_block[root];
+	const Operand op = ins->get_operand(operand);
+	if (op.get_kind() != OPERAND_VREG_MEMREF && op.get_kind() != OPERAND_VREG_MEMREF_OFFSET) return false;
+
+	Option options[2];
+	const unsigned n = match_operand(Operand(OPERAND_VREG, op.get_base_reg()), root, root, options);
+	for (unsigned k = 0; k < n; k++) {
+		if (options[k].def == NONE) continue;
+		Address addr = options[k].addr;
+		if (op.get_kind() == OPERAND_VREG_MEMREF_OFFSET) addr.offset += op.get_offset();
+		Operand memref;
+		if (!to_memref(addr, memref)) continue;
+		(*ins)[operand] = memref;
+		cover(options[k].def);
+		return true;
+	}
+	return false;
+}
+
+// turn an add, sub or mul (and whatever it covers) into a lea, where
+// that saves instructions
+bool InstructionSelector::select_lea(unsigned root) {
+	Instruction* ins = m_block[root];
+	if (!HighLevel::is_def(ins)) return false;
+	const int dest = ins->get_operand(0).get_base_reg();
+	const Match& match = match_def(root, root);
+	if (!match.matched) return false;
+	const Address& addr = match.addr;
+	const bool covers = match.size > 1;
+
+	Instruction* selected;
+	Operand memref;
+	if (is_constant(addr)) {
+		selected = new Instruction(HINS_LOAD_ICONST, ins->get_operand(0), Operand(OPERAND_INT_LITERAL, addr.offset));
+	} else if (addr.base >= 0 && addr.index == NONE && addr.offset == 0) {
+		// e.g., adding a product which is zero
+		if (!covers) return false;
+		selected = new Instruction(HINS_MOV, ins->get_operand(0), Operand(OPERAND_VREG, addr.base));
+	} else if (to_memref(addr, memref) && (covers || (addr.base != dest && addr.index != dest))) {
+		// without anything covered, a lea only helps when it avoids
+		// copying an operand into the destination first
+		selected = new Instruction(HINS_LEA, ins->get_operand(0), memref);
+	} else {
+		return false;
+	}
+	selected->set_comment(ins->get_comment());
+	delete ins;
+	m_block[root] = selected;
+	for (const int child : match.children) cover(child);
+	return true;
+}
+
+// replace operands which are single-use constants with immediates
+void InstructionSelector::select_immediates(unsigned root) {
+	Instruction* ins = m_block[root];
+	for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+		if (!HighLevel::is_use(ins, k) || ins->get_operand(k).get_kind() != OPERAND_VREG) continue;
+		Option options[2];
+		const unsigned n = match_operand(ins->get_operand(k), root, root, options);
+		if (n > 0 && options[0].def != NONE && is_constant(options[0].addr)) {
+			(*ins)[k] = Operand(OPERAND_INT_LITERAL, options[0].addr.offset);
+			cover(options[0].def);
+		}
+	}
+}
+
+// Finds the ways to cover an operand of the instruction at index user,
+// whose tile is part of the tree for root: by the best tile of the
+// operand's def, if it has no other use, and/or as a leaf.  A leaf must
+// still hold the same value at the root as it did at user.
+unsigned InstructionSelector::match_operand(const Operand& op, unsigned user, unsigned root, Option options[2]) {
+	switch (op.get_kind()) {
+	case OPERAND_INT_LITERAL:
+		if (!fits_int32(op.get_int_value())) return 0;
+		options[0] = { { NONE, NONE, 1, op.get_int_value() }, 0, NONE };
+		return 1;
+	case OPERAND_VREG:
+	case OPERAND_VREG_MEMREF: // an address used as a value
+		break;
+	default:
+		return 0;
+	}
+
+	unsigned n = 0;
+	const int vreg = op.get_base_reg();
+	const int def = find_def(vreg, user);
+	if (def != NONE && m_user[def] == int(user)) {
+		const Match& match = match_def(unsigned(def), root);
+		if (match.matched) options[n++] = { match.addr, match.size, def };
+	}
+	if (!is_redefined(vreg, user, root)) options[n++] = { { vreg, NONE, 1, 0 }, 0, NONE };
+	return n;
+}
+
+// The tile covering the most instructions for the value defined at
+// index, preferring tiles which form a complete addressing mode.  Each
+// def belongs to a single tree, so trying every combination of its
+// operands' options is linear in the size of the tree.
+const InstructionSelector::Match& InstructionSelector::match_def(unsigned index, unsigned root) {
+	Match& match = m_match[index];
+	if (match.root == int(root)) return match;
+	match = Match{ int(root), false, {}, 0, { NONE, NONE } };
+
+	const Instruction* ins = m_block[index];
+	const int opcode = ins->get_opcode();
+	if (opcode == HINS_LOCALADDR) {
+		match = Match{ int(root), true, { FRAME, NONE, 1, ins->get_operand(1).get_int_value() }, 1, { NONE, NONE } };
+		return match;
+	}
+	if (opcode == HINS_LOAD_ICONST) {
+		const Operand value = ins->get_operand(1);
+		if (fits_int32(value.get_int_value()))
+			match = Match{ int(root), true, { NONE, NONE, 1, value.get_int_value() }, 1, { NONE, NONE } };
+		return match;
+	}
+	if (opcode != HINS_INT_ADD && opcode != HINS_INT_SUB && opcode != HINS_INT_MUL) return match;
+
+	Option left[2], right[2];
+	const unsigned num_left = match_operand(ins->get_operand(1), index, root, left);
+	const unsigned num_right = match_operand(ins->get_operand(2), index, root, right);
+	for (unsigned l = 0; l < num_left; l++) {
+		for (unsigned r = 0; r < num_right; r++) {
+			Address addr;
+			if (!apply(opcode, left[l].addr, right[r].addr, addr) || !fits_int32(addr.offset)) continue;
+			const unsigned size = 1 + left[l].size + right[r].size;
+			if (match.matched && (is_memref(match.addr) > is_memref(addr) ||
+			                      (is_memref(match.addr) == is_memref(addr) && match.size >= size)))
+				continue;
+			match = Match{ int(root), true, addr, size, { left[l].def, right[r].def } };
+		}
+	}
+	return match;
+}
+
+// index of the last def of vreg before user in the block, or NONE
+int InstructionSelector::find_def(int vreg, unsigned user) const {
+	const std::vector<unsigned>& defs = m_defs[vreg];
+	const auto i = std::lower_bound(defs.begin(), defs.end(), user);
+	return i == defs.begin() ? NONE : int(*(i - 1));
+}
+
+bool InstructionSelector::is_redefined(int vreg, unsigned after, unsigned root) const {
+	const std::vector<unsigned>& defs = m_defs[vreg];
+	const auto i = std::upper_bound(defs.begin(), defs.end(), after);
+	return i != defs.end() && *i < root;
+}
+
+// mark the def at index, and the defs its tile covers, as covered
+void InstructionSelector::cover(int index) {
+	if (index == NONE) return;
+	m_covered[index] = true;
+	for (const int child : m_match[index].children) cover(child);
+}
+
+ControlFlowGraph* InstructionSelector::build_result() const {
+	auto result = new ControlFlowGraph();
+	for (auto i = m_cfg->bb_begin(); i != m_cfg->bb_end(); ++i) {
+		BasicBlock* orig = *i;
+		BasicBlock* result_bb = result->create_basic_block(orig->get_kind(), orig->get_label());
+		const Code& code = m_code[orig->get_id()];
+		for (const auto ins : code) result_bb->add_instruction(ins);
+		// a labeled block needs an instruction
+		if (code.empty() && orig->has_label() && orig->get_kind() == BASICBLOCK_INTERIOR)
+			result_bb->add_instruction(new Instruction(HINS_NOP));
+	}
+	// blocks were created in the same order, so they have the same ids
+	for (auto i = m_cfg->bb_begin(); i != m_cfg->bb_end(); ++i) {
+		for (const auto edge : m_cfg->get_outgoing_edges(*i)) {
+			result->create_edge(result->get_block(edge->get_source()->get_id()),
+			                    result->get_block(edge->get_target()->get_id()), edge->get_kind());
+		}
+	}
+	return result;
+}
+
+bool InstructionSelector::is_pure(const Instruction* ins) {
+	switch (ins->get_opcode()) {
+	case HINS_LOCALADDR:
+	case HINS_LOAD_ICONST:
+	case HINS_INT_ADD:
+	case HINS_INT_SUB:
+	case HINS_INT_MUL:
+		return HighLevel::is_def(ins);
+	default:
+		return false;
+	}
+}
+
+bool InstructionSelector::is_constant(const Address& addr) {
+	return addr.base == NONE && addr.index == NONE;
+}
+
+// can addr be used as a memory reference?
+bool InstructionSelector::is_memref(const Address& addr) {
+	return addr.base != NONE || (addr.index != NONE && addr.scale == 1);
+}
+
+bool InstructionSelector::apply(int opcode, const Address& left, const Address& right, Address& result) {
+	switch (opcode) {
+	case HINS_INT_ADD:
+		return combine(left, right, result);
+	case HINS_INT_SUB:
+		if (!is_constant(right)) return false;
+		result = left;
+		result.offset -= right.offset;
+		return true;
+	case HINS_INT_MUL:
+		if (is_constant(right)) return scale(left, right.offset, result);
+		return is_constant(left) && scale(right, left.offset, result);
+	default:
+		return false;
+	}
+}
+
+// a + b, if it fits in one addressing mode
+bool InstructionSelector::combine(const Address& a, const Address& b, Address& sum) {
+	int regs[4], scales[4];
+	unsigned n = 0;
+	for (const Address* x : { &a, &b }) {
+		if (x->base != NONE) {
+			regs[n] = x->base;
+			scales[n++] = 1;
+		}
+		if (x->index != NONE) {
+			regs[n] = x->index;
+			scales[n++] = x->scale;
+		}
+	}
+	if (n > 2) return false;
+
+	sum = { NONE, NONE, 1, a.offset + b.offset };
+	// the frame can only be the base
+	for (unsigned k = 0; k < n; k++) {
+		if (regs[k] != FRAME) continue;
+		if (sum.base != NONE) return false;
+		sum.base = FRAME;
+	}
+	for (unsigned k = 0; k < n; k++) {
+		if (regs[k] == FRAME) continue;
+		if (scales[k] == 1 && sum.base == NONE) {
+			sum.base = regs[k];
+		} else if (sum.index == NONE) {
+			sum.index = regs[k];
+			sum.scale = scales[k];
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+// a * factor, if it fits in one addressing mode
+bool InstructionSelector::scale(const Address& a, long factor, Address& product) {
+	if (is_constant(a)) {
+		product = { NONE, NONE, 1, a.offset * factor };
+		return true;
+	}
+	if (a.base == FRAME || (a.base != NONE && a.index != NONE)) return false;
+	// a lone register is scaled as the index
+	const int index = a.index != NONE ? a.index : a.base;
+	const long new_scale = (a.index != NONE ? a.scale : 1) * factor;
+	if (new_scale != 1 && new_scale != 2 && new_scale != 4 && new_scale != 8) return false;
+	product = { NONE, index, int(new_scale), a.offset * factor };
+	return true;
+}
+
+bool InstructionSelector::to_memref(Address addr, Operand& op) {
+	if (!is_memref(addr) || !fits_int32(addr.offset)) return false;
+	if (addr.base == NONE) {
+		addr.base = addr.index;
+		addr.index = NONE;
+	}
+	const int offset = int(addr.offset);
+	if (addr.base == FRAME) {
+		if (addr.index == NONE) op = Operand(OPERAND_FRAME_MEMREF_OFFSET, long(offset));
+		else op = Operand(OPERAND_FRAME_MEMREF_OFFSET_INDEX, 0, addr.index, offset, addr.scale);
+	} else if (addr.index != NONE) {
+		op = Operand(OPERAND_VREG_MEMREF_OFFSET_INDEX, addr.base, addr.index, offset, addr.scale);
+	} else if (offset != 0) {
+		op = Operand(OPERAND_VREG_MEMREF_OFFSET, addr.base, offset);
+	} else {
+		op = Operand(OPERAND_VREG_MEMREF, addr.base);
+	}
+	return true;
+}
+
+bool InstructionSelector::fits_int32(long ival) {
+	return ival >= INT_MIN && ival <= INT_MAX;
+}
@@ -0,0 +1,106 @@
+#ifndef ISEL_H
+#define ISEL_H
+
+#include <vector>
+#include "cfg.h"
+#include "live_vregs.h"
+
+// Tree-pattern instruction selection over a high-level ControlFlowGraph,
+// run just before register allocation.
+//
+// Within a block, a vreg defined by a pure instruction (localaddr, ldci,
+// add, sub, mul) and used exactly once later in the same block is an
+// interior node of an expression tree rooted at its user.  Starting from
+// the last instruction of the block, each root is covered top-down with
+// the largest x86-64 tile that matches (maximal munch):
+//   - the address of a load or store becomes an addressing mode, one of
+//     off(base), off(base,index,scale), off(%rsp) or off(%rsp,index,scale),
+//     so e.g. localaddr+muli+addi+ldi is a single movq,
+//   - an add or sub computing such an address becomes a lea, and
+//   - a constant operand becomes an immediate.
+// The covered instructions are deleted.  The root refers to their
+// operands directly, so the register allocator sees the live ranges of
+// the code which will actually be emitted.
+class InstructionSelector {
+public:
+	using Code = std::vector<Instruction*>;
+
+private:
+	// a value of the form base + index*scale + offset
+	struct Address {
+		int base;  // vreg, FRAME, or NONE
+		int index; // vreg or NONE
+		int scale;
+		long offset;
+	};
+
+	// one way of covering an operand: as a leaf, or by the tile of its def
+	struct Option {
+		Address addr;
+		unsigned size; // number of instructions covered
+		int def;       // covered def, or NONE for a leaf
+	};
+
+	// the best tile found for a def, within the tree of a given root
+	struct Match {
+		int root; // NONE if not computed yet
+		bool matched;
+		Address addr;
+		unsigned size;
+		int children[2]; // covered defs of the operands, or NONE
+	};
+
+	static const int NONE = -1;
+	static const int FRAME = -2; // %rsp, the base of local storage
+
+	ControlFlowGraph* m_cfg;
+	int m_num_vregs;
+	LiveVregs* m_live_vregs;
+	std::vector<Code> m_code; // selected code of each block
+
+	// state for the block being selected
+	Code m_block;
+	std::vector<int> m_user; // index of the only user of each def, or NONE
+	std::vector<Match> m_match;
+	std::vector<bool> m_covered;
+	// indexed by vreg: the indices of its defs in the block, in order, and
+	// the index of the next instruction which uses or defines it (while
+	// find_users scans the block backwards).  The entries are only valid
+	// for a vreg whose m_block_stamp is the block's id + 1.
+	std::vector<std::vector<unsigned>> m_defs;
+	std::vector<int> m_next;
+	std::vector<unsigned> m_block_stamp;
+
+public:
+	InstructionSelector(ControlFlowGraph* cfg, int num_vregs);
+	~InstructionSelector();
+
+	ControlFlowGraph* transform_cfg();
+
+private:
+	void select_block(BasicBlock* bb);
+	void index_vregs(BasicBlock* bb);
+	void add_block_vreg(int vreg, unsigned stamp);
+	void find_users(BasicBlock* bb);
+	void select(unsigned root);
+	bool select_address(unsigned root, unsigned operand);
+	bool select_lea(unsigned root);
+	void select_immediates(unsigned root);
+	unsigned match_operand(const Operand& op, unsigned user, unsigned root, Option options[2]);
+	const Match& match_def(unsigned index, unsigned root);
+	int find_def(int vreg, unsigned user) const;
+	bool is_redefined(int vreg, unsigned after, unsigned root) const;
+	void cover(int index);
+	ControlFlowGraph* build_result() const;
+
+	static bool is_pure(const Instruction* ins);
+	static bool is_constant(const Address& addr);
+	static bool is_memref(const Address& addr);
+	static bool apply(int opcode, const Address& left, const Address& right, Address& result);
+	static bool combine(const Address& a, const Address& b, Address& sum);
+	static bool scale(const Address& a, long factor, Address& product);
+	static bool to_memref(Address addr, Operand& op);
+	static bool fits_int32(long ival);
+};
+
+#endif // ISEL_H
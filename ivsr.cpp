@@ -0,0 +1,351 @@
+#include <cassert>
+#include <algorithm>
+#include <cstdint>
+#include "highlevel.h"
+#include "dominators.h"
+#include "loops.h"
+#include "ivsr.h"
+
+InductionVariableStrengthReduction::InductionVariableStrengthReduction(ControlFlowGraph* cfg, int num_vregs)
+	: m_cfg(cfg)
+	  , m_num_vregs(num_vregs)
+	  , m_first_new_vreg(num_vregs)
+	  , m_live_vregs(nullptr)
+	  , m_dom(nullptr)
+	  , m_loops(nullptr) {}
+
+InductionVariableStrengthReduction::~InductionVariableStrengthReduction() {
+	delete m_loops;
+	delete m_dom;
+	delete m_live_vregs;
+}
+
+ControlFlowGraph* InductionVariableStrengthReduction::transform_cfg() {
+	m_live_vregs = new LiveVregs(m_cfg);
+	m_live_vregs->execute();
+	m_dom = new Dominators(m_cfg);
+	m_dom->execute();
+	m_loops = new LoopForest(m_cfg, m_dom);
+	m_loops->execute();
+
+	m_code.resize(m_cfg->get_num_blocks());
+	for (auto i = m_cfg->bb_begin(); i != m_cfg->bb_end(); ++i) {
+		for (auto j = (*i)->cbegin(); j != (*i)->cend(); ++j) m_code[(*i)->get_id()].push_back((*j)->duplicate());
+	}
+	for (const auto loop : m_loops->get_loops()) reduce(loop);
+	return build_result();
+}
+
+void InductionVariableStrengthReduction::reduce(Loop* loop) {
+	if (!loop->preheader || loop->preheader->get_kind() != BASICBLOCK_INTERIOR) return;
+	m_deleted.clear();
+	m_insert_after.clear();
+	m_preheader_code.clear();
+
+	// number of defs of each vreg in the loop; m_defs is all zero between
+	// loops, so its cost is proportional to the loop, not to the vregs
+	m_defs.resize(m_num_vregs, 0);
+	for (const auto bb : loop->blocks) {
+		for (const auto ins : m_code[bb->get_id()]) {
+			if (HighLevel::is_def(ins)) m_defs[ins->get_operand(0).get_base_reg()]++;
+		}
+	}
+	const bool edited = plan_edits(loop, m_defs);
+	// clear the counts while the code is still what they counted
+	for (const auto bb : loop->blocks) {
+		for (const auto ins : m_code[bb->get_id()]) {
+			if (HighLevel::is_def(ins)) m_defs[ins->get_operand(0).get_base_reg()] = 0;
+		}
+	}
+	if (edited) apply_edits(loop);
+}
+
+// Find the loop's basic induction variables and plan the reductions of
+// the multiplications by them, returning false if there are none.
+bool InductionVariableStrengthReduction::plan_edits(Loop* loop, const std::vector<unsigned>& defs) {
+	const std::vector<BasicIV> ivs = find_basic_ivs(loop, defs);
+	if (ivs.empty()) return false;
+
+	std::vector<std::vector<DerivedIV>> derived(ivs.size());
+	for (const auto bb : loop->blocks) {
+		const Code& code = m_code[bb->get_id()];
+		for (unsigned i = 0; i < code.size(); i++) {
+			const Instruction* ins = code[i];
+			if (ins->get_opcode() != HINS_INT_MUL || !HighLevel::is_def(ins) || m_deleted.count(code[i])) continue;
+			for (unsigned n = 0; n < ivs.size(); n++) {
+				DerivedIV iv;
+				if (!HighLevel::uses_vreg(ins, ivs[n].vreg)) continue;
+				if (reduce_multiply(loop, bb, i, ivs[n], defs, iv)) derived[n].push_back(iv);
+				break;
+			}
+		}
+	}
+	for (unsigned n = 0; n < ivs.size(); n++) {
+		// scaling by a negative number would reverse the comparison
+		const auto best = std::find_if(derived[n].begin(), derived[n].end(),
+		                               [](const DerivedIV& iv) { return iv.scale > 0; });
+		if (best != derived[n].end()) replace_test(loop, ivs[n], *best, defs);
+	}
+	return true;
+}
+
+// A basic induction variable's update must happen exactly once per
+// iteration, so it has to be in a block of this loop (not of an inner loop)
+// which dominates every latch.
+std::vector<InductionVariableStrengthReduction::BasicIV> InductionVariableStrengthReduction::find_basic_ivs(
+	Loop* loop, const std::vector<unsigned>& defs) const {
+	std::vector<BasicIV> ivs;
+	for (const auto bb : loop->blocks) {
+		if (m_loops->get_loop(bb) != loop) continue;
+		if (!std::all_of(loop->latches.begin(), loop->latches.end(),
+		                 [this, bb](BasicBlock* latch) { return m_dom->dominates(bb, latch); }))
+			continue;
+		const Code& code = m_code[bb->get_id()];
+		for (unsigned i = 0; i < code.size(); i++) {
+			Instruction* ins = code[i];
+			if (!HighLevel::is_def(ins)) continue;
+			const int vreg = ins->get_operand(0).get_base_reg();
+			if (vreg >= m_first_new_vreg || defs[vreg] != 1) continue;
+			long step;
+			if (match_step(ins, vreg, step)) {
+				ivs.push_back({ vreg, step, ins, nullptr, bb });
+				continue;
+			}
+			// HighLevelCodeGen's i := i + 1 is an addi to a temporary and a mov
+			if (ins->get_opcode() != HINS_MOV || ins->get_operand(1).get_kind() != OPERAND_VREG) continue;
+			const int temp = ins->get_operand(1).get_base_reg();
+			for (unsigned j = i; j-- > 0;) {
+				if (!HighLevel::is_def(code[j]) || code[j]->get_operand(0).get_base_reg() != temp) continue;
+				if (match_step(code[j], vreg, step)) ivs.push_back({ vreg, step, ins, code[j], bb });
+				break;
+			}
+		}
+	}
+	return ivs;
+}
+
+// is ins vreg + constant or vreg - constant?
+bool InductionVariableStrengthReduction::match_step(const Instruction* ins, int vreg, long& step) const {
+	const int opcode = ins->get_opcode();
+	if (opcode != HINS_INT_ADD && opcode != HINS_INT_SUB) return false;
+	const Operand left = ins->get_operand(1), right = ins->get_operand(2);
+	const auto is_vreg = [vreg](const Operand& op) {
+		return op.get_kind() == OPERAND_VREG && op.get_base_reg() == vreg;
+	};
+	if (is_vreg(left) && right.get_kind() == OPERAND_INT_LITERAL) step = right.get_int_value();
+	else if (opcode == HINS_INT_ADD && left.get_kind() == OPERAND_INT_LITERAL && is_vreg(right)) step = left.get_int_value();
+	else return false;
+	if (opcode == HINS_INT_SUB) step = -step;
+	return step != 0;
+}
+
+bool InductionVariableStrengthReduction::reduce_multiply(Loop* loop, BasicBlock* bb, unsigned index, const BasicIV& iv,
+                                                         const std::vector<unsigned>& defs, DerivedIV& derived) {
+	Code& code = m_code[bb->get_id()];
+	Instruction* mul = code[index];
+	const int dest = mul->get_operand(0).get_base_reg();
+	const Operand left = mul->get_operand(1), right = mul->get_operand(2);
+	long scale;
+	if (left.get_kind() == OPERAND_VREG && left.get_base_reg() == iv.vreg && right.get_kind() == OPERAND_INT_LITERAL)
+		scale = right.get_int_value();
+	else if (right.get_kind() == OPERAND_VREG && right.get_base_reg() == iv.vreg &&
+		left.get_kind() == OPERAND_INT_LITERAL)
+		scale = left.get_int_value();
+	else return false;
+	if (dest >= m_first_new_vreg || scale == 0 || !fits_int32(scale * iv.step)) return false;
+
+	// fold in the invariant added to the product, if that is its only use
+	unsigned user;
+	Operand base;
+	if (is_local(bb, index, dest, user) && code[user]->get_opcode() == HINS_INT_ADD) {
+		const Instruction* add = code[user];
+		// i must not be updated in between
+		const auto def = std::find(code.begin() + index, code.begin() + user, iv.def);
+		const Operand other = add->get_operand(1).get_kind() == OPERAND_VREG &&
+			add->get_operand(1).get_base_reg() == dest ? add->get_operand(2) : add->get_operand(1);
+		if (def == code.begin() + user) find_base(code, user, other, defs, base);
+	}
+
+	const int vreg = new_vreg();
+	const Operand ivreg(OPERAND_VREG, iv.vreg), pointer(OPERAND_VREG, vreg);
+	if (base.get_kind() != OPERAND_NONE) {
+		const Operand product(OPERAND_VREG, new_vreg());
+		m_preheader_code.push_back(new Instruction(HINS_INT_MUL, product, ivreg, Operand(OPERAND_INT_LITERAL, scale)));
+		m_preheader_code.push_back(new Instruction(HINS_INT_ADD, pointer, base, product));
+		auto mov = new Instruction(HINS_MOV, code[user]->get_operand(0), pointer);
+		mov->set_comment(code[user]->get_comment());
+		delete code[user];
+		code[user] = mov;
+		m_deleted.insert(mul);
+	} else {
+		m_preheader_code.push_back(new Instruction(HINS_INT_MUL, pointer, ivreg, Operand(OPERAND_INT_LITERAL, scale)));
+		auto mov = new Instruction(HINS_MOV, mul->get_operand(0), pointer);
+		mov->set_comment(mul->get_comment());
+		delete mul;
+		code[index] = mov;
+	}
+	m_insert_after[iv.def].push_back(
+		new Instruction(HINS_INT_ADD, pointer, pointer, Operand(OPERAND_INT_LITERAL, scale * iv.step)));
+	derived = { vreg, scale, base };
+	return true;
+}
+
+// Find an operand with the value of op (used at index) in the preheader:
+// either op itself, if it is invariant, or a recomputed local address.
+bool InductionVariableStrengthReduction::find_base(const Code& code, unsigned index, const Operand& op,
+                                                   const std::vector<unsigned>& defs, Operand& base) {
+	if (op.get_kind() == OPERAND_INT_LITERAL) {
+		base = op;
+		return true;
+	}
+	if (op.get_kind() != OPERAND_VREG && op.get_kind() != OPERAND_VREG_MEMREF) return false;
+	if (defs[op.get_base_reg()] == 0) {
+		base = op;
+		return true;
+	}
+	for (unsigned j = index; j-- > 0;) {
+		const Instruction* ins = code[j];
+		if (!HighLevel::is_def(ins) || ins->get_operand(0).get_base_reg() != op.get_base_reg()) continue;
+		if (ins->get_opcode() != HINS_LOCALADDR || m_deleted.count(code[j])) return false;
+		base = Operand(op.get_kind(), new_vreg());
+		m_preheader_code.push_back(new Instruction(HINS_LOCALADDR, Operand(OPERAND_VREG, base.get_base_reg()),
+		                                           ins->get_operand(1)));
+		return true;
+	}
+	return false;
+}
+
+// Linear function test replacement: compare the derived induction variable
+// against the limit scaled the same way, so the basic one can be deleted.
+void InductionVariableStrengthReduction::replace_test(Loop* loop, const BasicIV& iv, const DerivedIV& derived,
+                                                      const std::vector<unsigned>& defs) {
+	Instruction* cmp = nullptr;
+	BasicBlock* cmp_block = nullptr;
+	unsigned cmp_index = 0;
+	for (const auto bb : loop->blocks) {
+		const Code& code = m_code[bb->get_id()];
+		for (unsigned i = 0; i < code.size(); i++) {
+			Instruction* ins = code[i];
+			if (ins == iv.def || ins == iv.add || m_deleted.count(ins) || !HighLevel::uses_vreg(ins, iv.vreg)) continue;
+			if (cmp || ins->get_opcode() != HINS_INT_COMPARE) return;
+			cmp = ins;
+			cmp_block = bb;
+			cmp_index = i;
+		}
+	}
+	if (!cmp) return;
+	const bool iv_left = cmp->get_operand(0).get_kind() == OPERAND_VREG && cmp->get_operand(0).get_base_reg() == iv.vreg;
+	const Operand limit = cmp->get_operand(iv_left ? 1 : 0);
+	if (!iv_left && (cmp->get_operand(1).get_kind() != OPERAND_VREG || cmp->get_operand(1).get_base_reg() != iv.vreg))
+		return;
+	if (limit.get_kind() == OPERAND_VREG ? defs[limit.get_base_reg()] > 0 : limit.get_kind() != OPERAND_INT_LITERAL)
+		return;
+
+	// i must be dead once the loop exits
+	for (const auto bb : loop->blocks) {
+		for (const auto edge : m_cfg->get_outgoing_edges(bb)) {
+			BasicBlock* target = edge->get_target();
+			if (loop->contains(m_loops->get_loop(target))) continue;
+			if (m_live_vregs->get_fact_at_beginning_of_block(target).test(iv.vreg)) return;
+		}
+	}
+	// and so must the temporary holding i + step
+	if (iv.add) {
+		const Code& code = m_code[iv.block->get_id()];
+		unsigned user;
+		const unsigned index = std::find(code.begin(), code.end(), iv.add) - code.begin();
+		if (!is_local(iv.block, index, iv.add->get_operand(0).get_base_reg(), user) || code[user] != iv.def) return;
+	}
+
+	// scale the limit in the preheader
+	Operand new_limit;
+	const bool has_base = derived.base.get_kind() != OPERAND_NONE;
+	if (limit.get_kind() == OPERAND_INT_LITERAL) {
+		const long scaled = limit.get_int_value() * derived.scale;
+		if (!fits_int32(scaled)) return;
+		new_limit = Operand(OPERAND_INT_LITERAL, scaled);
+	} else {
+		new_limit = Operand(OPERAND_VREG, new_vreg());
+		m_preheader_code.push_back(
+			new Instruction(HINS_INT_MUL, new_limit, limit, Operand(OPERAND_INT_LITERAL, derived.scale)));
+	}
+	if (has_base) {
+		const Operand sum(OPERAND_VREG, new_vreg());
+		m_preheader_code.push_back(new Instruction(HINS_INT_ADD, sum, derived.base, new_limit));
+		new_limit = sum;
+	}
+
+	const Operand pointer(OPERAND_VREG, derived.vreg);
+	auto new_cmp = new Instruction(HINS_INT_COMPARE, iv_left ? pointer : new_limit, iv_left ? new_limit : pointer);
+	new_cmp->set_comment(cmp->get_comment());
+	delete cmp;
+	m_code[cmp_block->get_id()][cmp_index] = new_cmp;
+	m_deleted.insert(iv.def);
+	if (iv.add) m_deleted.insert(iv.add);
+}
+
+// Is the value defined at index used exactly once, later in the same block,
+// and dead after that?
+bool InductionVariableStrengthReduction::is_local(BasicBlock* bb, unsigned index, int vreg, unsigned& only_user) const {
+	if (vreg >= m_first_new_vreg) return false;
+	const Code& code = m_code[bb->get_id()];
+	unsigned uses = 0;
+	bool killed = false;
+	for (unsigned j = index + 1; j < code.size() && !killed; j++) {
+		if (m_deleted.count(code[j])) continue;
+		if (HighLevel::uses_vreg(code[j], vreg)) {
+			uses++;
+			only_user = j;
+		}
+		killed = HighLevel::is_def(code[j]) && code[j]->get_operand(0).get_base_reg() == vreg;
+	}
+	return uses == 1 && (killed || !m_live_vregs->get_fact_at_end_of_block(bb).test(vreg));
+}
+
+void InductionVariableStrengthReduction::apply_edits(Loop* loop) {
+	for (const auto bb : loop->blocks) {
+		Code& code = m_code[bb->get_id()];
+		Code result;
+		for (const auto ins : code) {
+			const auto inserted = m_insert_after.find(ins);
+			if (m_deleted.count(ins)) delete ins;
+			else result.push_back(ins);
+			if (inserted != m_insert_after.end()) result.insert(result.end(), inserted->second.begin(), inserted->second.end());
+		}
+		code = result;
+	}
+	Code& preheader = m_code[loop->preheader->get_id()];
+	const bool ends_in_jump = !preheader.empty() && preheader.back()->get_opcode() >= HINS_JUMP &&
+		preheader.back()->get_opcode() <= HINS_JGTE;
+	preheader.insert(ends_in_jump ? preheader.end() - 1 : preheader.end(), m_preheader_code.begin(),
+	                 m_preheader_code.end());
+}
+
+int InductionVariableStrengthReduction::new_vreg() {
+	m_defs.resize(m_num_vregs + 1, 0);
+	return m_num_vregs++;
+}
+
+ControlFlowGraph* InductionVariableStrengthReduction::build_result() const {
+	auto result = new ControlFlowGraph();
+	for (auto i = m_cfg->bb_begin(); i != m_cfg->bb_end(); ++i) {
+		BasicBlock* orig = *i;
+		BasicBlock* result_bb = result->create_basic_block(orig->get_kind(), orig->get_label());
+		const Code& code = m_code[orig->get_id()];
+		for (const auto ins : code) result_bb->add_instruction(ins);
+		// a labeled block needs an instruction
+		if (code.empty() && orig->has_label() && orig->get_kind() == BASICBLOCK_INTERIOR)
+			result_bb->add_instruction(new Instruction(HINS_NOP));
+	}
+	for (auto i = m_cfg->bb_begin(); i != m_cfg->bb_end(); ++i) {
+		for (const auto edge : m_cfg->get_outgoing_edges(*i)) {
+			result->create_edge(result->get_block(edge->get_source()->get_id()),
+			                    result->get_block(edge->get_target()->get_id()), edge->get_kind());
+		}
+	}
+	return result;
+}
+
+bool InductionVariableStrengthReduction::fits_int32(long ival) {
+	return ival >= INT32_MIN && ival <= INT32_MAX;
+}
@@ -0,0 +1,91 @@
+#ifndef IVSR_H
+#define IVSR_H
+
+#include <map>
+#include <set>
+#include <vector>
+#include "cfg.h"
+#include "live_vregs.h"
+
+class Dominators;
+struct Loop;
+class LoopForest;
+
+// Induction variable strength reduction over a high-level ControlFlowGraph
+// whose loops have preheaders (see LoopInvariantCodeMotion).
+//
+// A basic induction variable is a vreg whose only def in the loop adds a
+// constant step to it, once per iteration.  Each
+//     muli t, i, c
+// of a basic induction variable i is replaced by a new vreg p, initialized
+// to c*i in the preheader and incremented by c*step right after i is.  When
+// t's only use is an
+//     addi u, x, t
+// with x invariant (as emitted for an array element reference), p is
+// initialized to x + c*i instead, so the address itself is bumped through
+// the array.
+//
+// If afterwards i is only used by its own increment and a compare against
+// an invariant limit, and isn't live after the loop, the compare is
+// rewritten in terms of p (linear function test replacement) and the
+// increment of i is deleted.
+class InductionVariableStrengthReduction {
+public:
+	using Code = std::vector<Instruction*>;
+
+private:
+	struct BasicIV {
+		int vreg;
+		long step;
+		Instruction* def;  // the instruction updating the vreg
+		Instruction* add;  // addi/subi feeding def if it is a mov, else nullptr
+		BasicBlock* block; // containing def
+	};
+
+	struct DerivedIV {
+		int vreg;     // p
+		long scale;   // c
+		Operand base; // x, or OPERAND_NONE if there is none
+	};
+
+	ControlFlowGraph* m_cfg;
+	int m_num_vregs, m_first_new_vreg;
+	LiveVregs* m_live_vregs;
+	Dominators* m_dom;
+	LoopForest* m_loops;
+	std::vector<Code> m_code; // current code of each block
+	std::vector<unsigned> m_defs; // scratch counts of defs of each vreg, for reduce
+
+	// edits to the loop being reduced
+	std::set<Instruction*> m_deleted;
+	std::map<Instruction*, Code> m_insert_after;
+	Code m_preheader_code;
+
+public:
+	InductionVariableStrengthReduction(ControlFlowGraph* cfg, int num_vregs);
+	~InductionVariableStrengthReduction();
+
+	ControlFlowGraph* transform_cfg();
+
+	// number of vregs, including the new induction variables
+	int get_num_vregs() const { return m_num_vregs; }
+
+private:
+	void reduce(Loop* loop);
+	bool plan_edits(Loop* loop, const std::vector<unsigned>& defs);
+	std::vector<BasicIV> find_basic_ivs(Loop* loop, const std::vector<unsigned>& defs) const;
+	bool match_step(const Instruction* ins, int vreg, long& step) const;
+	bool reduce_multiply(Loop* loop, BasicBlock* bb, unsigned index, const BasicIV& iv,
+	                     const std::vector<unsigned>& defs, DerivedIV& derived);
+	bool find_base(const Code& code, unsigned index, const Operand& op, const std::vector<unsigned>& defs,
+	               Operand& base);
+	void replace_test(Loop* loop, const BasicIV& iv, const DerivedIV& derived, const std::vector<unsigned>& defs);
+	bool is_local(BasicBlock* bb, unsigned index, int vreg, unsigned& only_user) const;
+	void apply_edits(Loop* loop);
+	int new_vreg();
+	ControlFlowGraph* build_result() const;
+
+	static bool fits_int32(long ival);
+};
+
+#endif // IVSR_H
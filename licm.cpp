@@ -0,0 +1,314 @@
+#include <cassert>
+#include <algorithm>
+#include <cctype>
+#include "highlevel.h"
+#include "dominators.h"
+#include "loops.h"
+#include "licm.h"
+
+namespace {
+Operand rename_vreg(const Operand& op, int from, int to) {
+	const int base = op.get_base_reg() == from ? to : op.get_base_reg();
+	switch (op.get_kind()) {
+	case OPERAND_VREG:
+	case OPERAND_VREG_MEMREF:
+		return Operand(op.get_kind(), base);
+	case OPERAND_VREG_MEMREF_OFFSET:
+		return Operand(op.get_kind(), base, op.get_offset());
+	case OPERAND_VREG_MEMREF_INDEX:
+		return Operand(op.get_kind(), base, op.get_index_reg() == from ? to : op.get_index_reg());
+	default:
+		return op;
+	}
+}
+}
+
+LoopInvariantCodeMotion::LoopInvariantCodeMotion(ControlFlowGraph* cfg, int num_vregs)
+	: m_cfg(cfg)
+	  , m_num_vregs(num_vregs)
+	  , m_first_new_vreg(num_vregs)
+	  , m_next_label(0)
+	  , m_loop_cfg(nullptr)
+	  , m_live_vregs(nullptr) {}
+
+LoopInvariantCodeMotion::~LoopInvariantCodeMotion() {
+	delete m_live_vregs;
+	delete m_loop_cfg;
+}
+
+ControlFlowGraph* LoopInvariantCodeMotion::transform_cfg() {
+	m_next_label = find_max_label(m_cfg) + 1;
+	m_loop_cfg = insert_preheaders();
+	// liveness is needed to tell whether a vreg is local to its block
+	m_live_vregs = new LiveVregs(m_loop_cfg);
+	m_live_vregs->execute();
+
+	m_code.resize(m_loop_cfg->get_num_blocks());
+	for (auto i = m_loop_cfg->bb_begin(); i != m_loop_cfg->bb_end(); ++i) {
+		for (auto j = (*i)->cbegin(); j != (*i)->cend(); ++j) m_code[(*i)->get_id()].push_back((*j)->duplicate());
+	}
+
+	Dominators dom(m_loop_cfg);
+	dom.execute();
+	LoopForest loops(m_loop_cfg, &dom);
+	loops.execute();
+	std::vector<unsigned> rpo_index(m_loop_cfg->get_num_blocks(), Dominators::NONE);
+	const ControlFlowGraph::BlockList& rpo = dom.get_reverse_postorder();
+	for (unsigned i = 0; i < rpo.size(); i++) rpo_index[rpo[i]->get_id()] = i;
+
+	// inner loops come first, so values can move out through several levels
+	for (const auto loop : loops.get_loops()) hoist(loop, rpo_index);
+	return build_result();
+}
+
+// Give each loop without a suitable preheader a new block between the header
+// and the predecessors outside the loop.
+ControlFlowGraph* LoopInvariantCodeMotion::insert_preheaders() {
+	Dominators dom(m_cfg);
+	dom.execute();
+	LoopForest loops(m_cfg, &dom);
+	loops.execute();
+	const unsigned num_blocks = m_cfg->get_num_blocks();
+	std::vector<Loop*> needs_preheader(num_blocks, nullptr); // indexed by header id
+	for (const auto loop : loops.get_loops()) {
+		if (!loop->preheader || loop->preheader->get_kind() != BASICBLOCK_INTERIOR)
+			needs_preheader[loop->header->get_id()] = loop;
+	}
+
+	auto result = new ControlFlowGraph();
+	std::vector<BasicBlock*> block_map(num_blocks, nullptr);
+	for (auto i = m_cfg->bb_begin(); i != m_cfg->bb_end(); ++i) {
+		BasicBlock* orig = *i;
+		BasicBlock* copy = result->create_basic_block(orig->get_kind(), orig->get_label());
+		for (auto j = orig->cbegin(); j != orig->cend(); ++j) copy->add_instruction((*j)->duplicate());
+		block_map[orig->get_id()] = copy;
+	}
+
+	// the preheader needs a label if it is branched to, and must branch to the
+	// header if a block in the loop falls through into it
+	std::vector<BasicBlock*> preheaders(num_blocks, nullptr);
+	std::vector<bool> jumps_to_header(num_blocks, false);
+	for (unsigned id = 0; id < num_blocks; id++) {
+		const Loop* loop = needs_preheader[id];
+		if (!loop) continue;
+		bool branched_to = false;
+		for (const auto edge : m_cfg->get_incoming_edges(loop->header)) {
+			const bool inside = loop->contains(loops.get_loop(edge->get_source()));
+			if (inside && edge->get_kind() == EDGE_FALLTHROUGH) jumps_to_header[id] = true;
+			if (!inside && edge->get_kind() == EDGE_BRANCH) branched_to = true;
+		}
+		const std::string label = branched_to ? ".L" + std::to_string(m_next_label++) : "";
+		BasicBlock* preheader = result->create_basic_block(BASICBLOCK_INTERIOR, label);
+		if (jumps_to_header[id]) preheader->add_instruction(new Instruction(HINS_JUMP, Operand(loop->header->get_label())));
+		preheaders[id] = preheader;
+	}
+
+	for (auto i = m_cfg->bb_begin(); i != m_cfg->bb_end(); ++i) {
+		for (const auto edge : m_cfg->get_outgoing_edges(*i)) {
+			BasicBlock* source = block_map[edge->get_source()->get_id()];
+			const unsigned target_id = edge->get_target()->get_id();
+			const Loop* loop = needs_preheader[target_id];
+			if (!loop || loop->contains(loops.get_loop(edge->get_source()))) {
+				result->create_edge(source, block_map[target_id], edge->get_kind());
+				continue;
+			}
+			// entering the loop: go through the preheader instead
+			BasicBlock* preheader = preheaders[target_id];
+			result->create_edge(source, preheader, edge->get_kind());
+			if (edge->get_kind() == EDGE_BRANCH) {
+				Instruction* jump = source->get_last();
+				assert(jump->get_operand(0).get_target_label() == loop->header->get_label());
+				jump->set_operand(0, Operand(preheader->get_label()));
+			}
+		}
+	}
+	for (unsigned id = 0; id < num_blocks; id++) {
+		if (!preheaders[id]) continue;
+		result->create_edge(preheaders[id], block_map[id], jumps_to_header[id] ? EDGE_BRANCH : EDGE_FALLTHROUGH);
+	}
+	return result;
+}
+
+void LoopInvariantCodeMotion::hoist(Loop* loop, const std::vector<unsigned>& rpo_index) {
+	if (!loop->preheader || loop->preheader->get_kind() != BASICBLOCK_INTERIOR) return;
+
+	// number of defs of each vreg in the loop; a vreg with none is invariant
+	std::vector<unsigned>& defs = m_defs;
+	defs.resize(m_num_vregs, 0);
+	for (const auto bb : loop->blocks) {
+		for (const auto ins : m_code[bb->get_id()]) {
+			if (HighLevel::is_def(ins)) defs[ins->get_operand(0).get_base_reg()]++;
+		}
+	}
+
+	// visit blocks in reverse postorder so defs are hoisted before their uses
+	ControlFlowGraph::BlockList blocks(loop->blocks);
+	std::sort(blocks.begin(), blocks.end(), [&rpo_index](BasicBlock* a, BasicBlock* b) {
+		return rpo_index[a->get_id()] < rpo_index[b->get_id()];
+	});
+	// hoisting one instruction can make others invariant, so repeat until
+	// nothing more moves
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (const auto bb : blocks) {
+			Code& code = m_code[bb->get_id()];
+			find_uses(code);
+			// a hoisted instruction leaves a null behind, so the indices in
+			// m_uses stay valid until the block has been scanned
+			bool hoisted = false;
+			for (unsigned i = 0; i < code.size(); i++) {
+				const Instruction* ins = code[i];
+				const int dest = is_hoistable(ins) ? ins->get_operand(0).get_base_reg() : -1;
+				// a constant or address is as cheap to recompute as to keep in a
+				// register, so it only moves along with a value computed from it
+				bool hoist = dest >= 0 && is_invariant(ins, defs);
+				if (hoist && is_rematerializable(ins)) hoist = feeds_invariant(code, i, dest, defs);
+				// vregs created here are already defined only once
+				if (hoist && (dest >= m_first_new_vreg || rename_local(bb, i, dest))) {
+					defs[dest]--;
+					move_to_preheader(loop, code[i]);
+					code[i] = nullptr;
+					hoisted = changed = true;
+				}
+			}
+			if (hoisted) code.erase(std::remove(code.begin(), code.end(), nullptr), code.end());
+		}
+	}
+
+	// the counts of the hoisted defs are already back to zero, so this
+	// leaves defs all zero for the next loop
+	for (const auto bb : loop->blocks) {
+		for (const auto ins : m_code[bb->get_id()]) {
+			if (HighLevel::is_def(ins)) defs[ins->get_operand(0).get_base_reg()] = 0;
+		}
+	}
+}
+
+// are none of the vregs ins uses (other than ignore) defined in the loop?
+bool LoopInvariantCodeMotion::is_invariant(const Instruction* ins, const std::vector<unsigned>& defs, int ignore) {
+	for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+		if (!HighLevel::is_use(ins, k)) continue;
+		const Operand op = ins->get_operand(k);
+		if (op.get_base_reg() != ignore && defs[op.get_base_reg()] > 0) return false;
+		if (op.has_index_reg() && op.get_index_reg() != ignore && defs[op.get_index_reg()] > 0) return false;
+	}
+	return true;
+}
+
+// Set up m_uses and m_killed for the block's code.
+void LoopInvariantCodeMotion::find_uses(const Code& code) {
+	m_uses.resize(code.size());
+	for (unsigned i = 0; i < code.size(); i++) m_uses[i].clear();
+	m_killed.assign(code.size(), false);
+	m_last_def.resize(m_num_vregs, -1);
+	for (unsigned j = 0; j < code.size(); j++) {
+		const Instruction* ins = code[j];
+		for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+			if (!HighLevel::is_use(ins, k)) continue;
+			const Operand op = ins->get_operand(k);
+			for (const int vreg : { op.get_base_reg(), op.has_index_reg() ? op.get_index_reg() : -1 }) {
+				if (vreg < 0 || m_last_def[vreg] < 0) continue;
+				std::vector<unsigned>& uses = m_uses[m_last_def[vreg]];
+				if (uses.empty() || uses.back() != j) uses.push_back(j);
+			}
+		}
+		if (!HighLevel::is_def(ins)) continue;
+		const int dest = ins->get_operand(0).get_base_reg();
+		if (m_last_def[dest] >= 0) m_killed[m_last_def[dest]] = true;
+		m_last_def[dest] = int(j);
+	}
+	for (const auto ins : code) {
+		if (HighLevel::is_def(ins)) m_last_def[ins->get_operand(0).get_base_reg()] = -1;
+	}
+}
+
+// is the value defined at index used later in the block, and only by
+// instructions that would be invariant along with it?
+bool LoopInvariantCodeMotion::feeds_invariant(const Code& code, unsigned index, int vreg,
+                                              const std::vector<unsigned>& defs) const {
+	for (const unsigned j : m_uses[index]) {
+		if (!is_hoistable(code[j]) || !is_invariant(code[j], defs, vreg)) return false;
+	}
+	return !m_uses[index].empty();
+}
+
+// Rename the vreg defined by the instruction at index, and its uses up to
+// the next def, to a fresh vreg.  Fails if the value is used outside the
+// block or isn't used at all.
+bool LoopInvariantCodeMotion::rename_local(BasicBlock* bb, unsigned index, int vreg) {
+	Code& code = m_code[bb->get_id()];
+	const std::vector<unsigned>& uses = m_uses[index];
+	if (uses.empty() || (!m_killed[index] && m_live_vregs->get_fact_at_end_of_block(bb).test(vreg))) return false;
+	const int fresh = m_num_vregs++;
+	m_defs.resize(m_num_vregs, 0);
+	code[index]->set_operand(0, Operand(OPERAND_VREG, fresh));
+	for (const unsigned j : uses) {
+		Instruction* ins = code[j];
+		for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+			if (HighLevel::is_use(ins, k)) ins->set_operand(k, rename_vreg(ins->get_operand(k), vreg, fresh));
+		}
+	}
+	return true;
+}
+
+void LoopInvariantCodeMotion::move_to_preheader(Loop* loop, Instruction* ins) {
+	Code& preheader = m_code[loop->preheader->get_id()];
+	preheader.insert(!preheader.empty() && is_jump(preheader.back()) ? preheader.end() - 1 : preheader.end(), ins);
+}
+
+ControlFlowGraph* LoopInvariantCodeMotion::build_result() const {
+	auto result = new ControlFlowGraph();
+	for (auto i = m_loop_cfg->bb_begin(); i != m_loop_cfg->bb_end(); ++i) {
+		BasicBlock* orig = *i;
+		BasicBlock* result_bb = result->create_basic_block(orig->get_kind(), orig->get_label());
+		const Code& code = m_code[orig->get_id()];
+		for (const auto ins : code) result_bb->add_instruction(ins);
+		// a labeled block needs an instruction
+		if (code.empty() && orig->has_label() && orig->get_kind() == BASICBLOCK_INTERIOR)
+			result_bb->add_instruction(new Instruction(HINS_NOP));
+	}
+	// blocks were created in the same order, so they have the same ids
+	for (auto i = m_loop_cfg->bb_begin(); i != m_loop_cfg->bb_end(); ++i) {
+		for (const auto edge : m_loop_cfg->get_outgoing_edges(*i)) {
+			result->create_edge(result->get_block(edge->get_source()->get_id()),
+			                    result->get_block(edge->get_target()->get_id()), edge->get_kind());
+		}
+	}
+	return result;
+}
+
+bool LoopInvariantCodeMotion::is_hoistable(const Instruction* ins) {
+	switch (ins->get_opcode()) {
+	case HINS_LOCALADDR:
+	case HINS_LOAD_ICONST:
+	case HINS_INT_ADD:
+	case HINS_INT_SUB:
+	case HINS_INT_MUL:
+	case HINS_INT_NEGATE:
+	case HINS_MOV:
+		return HighLevel::is_def(ins);
+	default:
+		// division can trap, and loads, stores and I/O aren't invariant
+		return false;
+	}
+}
+
+bool LoopInvariantCodeMotion::is_rematerializable(const Instruction* ins) {
+	return ins->get_opcode() == HINS_LOCALADDR || ins->get_opcode() == HINS_LOAD_ICONST;
+}
+
+bool LoopInvariantCodeMotion::is_jump(const Instruction* ins) {
+	return ins->get_opcode() >= HINS_JUMP && ins->get_opcode() <= HINS_JGTE;
+}
+
+int LoopInvariantCodeMotion::find_max_label(const ControlFlowGraph* cfg) {
+	int max_label = -1;
+	for (auto i = cfg->bb_begin(); i != cfg->bb_end(); ++i) {
+		const std::string label = (*i)->get_label();
+		if (label.size() < 3 || label.compare(0, 2, ".L") != 0) continue;
+		if (!std::all_of(label.begin() + 2, label.end(), [](char c) { return std::isdigit(c); })) continue;
+		max_label = std::max(max_label, std::stoi(label.substr(2)));
+	}
+	return max_label;
+}
@@ -0,0 +1,67 @@
+#ifndef LICM_H
+#define LICM_H
+
+#include <vector>
+#include "cfg.h"
+#include "live_vregs.h"
+
+struct Loop;
+
+// Loop-invariant code motion over a high-level ControlFlowGraph.  Every
+// loop is first given a preheader (a block outside the loop whose only
+// successor is the header) if it doesn't have one.  Then, innermost loops
+// first, instructions which
+//   - can't trap or touch memory (localaddr, ldci, add/sub/mul/neg, mov),
+//   - have operands which aren't defined anywhere in the loop, and
+//   - define a vreg used only later in the same block
+// are moved to the preheader.  Constants and local addresses only move along
+// with an instruction using them, rather than occupying a register for the
+// whole loop.  HighLevelCodeGen reuses vregs from one
+// statement to the next, so each hoisted value is given a fresh vreg, which
+// is then defined exactly once and may be hoisted again out of an enclosing
+// loop.
+class LoopInvariantCodeMotion {
+public:
+	using Code = std::vector<Instruction*>;
+
+private:
+	ControlFlowGraph* m_cfg;
+	int m_num_vregs, m_first_new_vreg;
+	int m_next_label;
+	ControlFlowGraph* m_loop_cfg; // m_cfg with preheaders
+	LiveVregs* m_live_vregs;
+	std::vector<Code> m_code; // current code of each block of m_loop_cfg
+	std::vector<unsigned> m_defs; // scratch counts of defs of each vreg, for hoist
+	// for the block being hoisted from: the instructions which use the
+	// value defined by each instruction, up to the next def of its vreg,
+	// and whether there is a next def in the block
+	std::vector<std::vector<unsigned>> m_uses;
+	std::vector<bool> m_killed;
+	std::vector<int> m_last_def; // scratch, indexed by vreg, for find_uses
+
+public:
+	LoopInvariantCodeMotion(ControlFlowGraph* cfg, int num_vregs);
+	~LoopInvariantCodeMotion();
+
+	ControlFlowGraph* transform_cfg();
+
+	// number of vregs, including the ones created for hoisted values
+	int get_num_vregs() const { return m_num_vregs; }
+
+private:
+	ControlFlowGraph* insert_preheaders();
+	void hoist(Loop* loop, const std::vector<unsigned>& rpo_index);
+	static bool is_invariant(const Instruction* ins, const std::vector<unsigned>& defs, int ignore = -1);
+	void find_uses(const Code& code);
+	bool feeds_invariant(const Code& code, unsigned index, int vreg, const std::vector<unsigned>& defs) const;
+	bool rename_local(BasicBlock* bb, unsigned index, int vreg);
+	void move_to_preheader(Loop* loop, Instruction* ins);
+	ControlFlowGraph* build_result() const;
+
+	static bool is_hoistable(const Instruction* ins);
+	static bool is_rematerializable(const Instruction* ins);
+	static bool is_jump(const Instruction* ins);
+	static int find_max_label(const ControlFlowGraph* cfg);
+};
+
+#endif // LICM_H
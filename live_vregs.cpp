@@ -1,12 +1,74 @@
 #include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #include "cfg.h"
 #include "highlevel.h"
 #include "live_vregs.h"
+#include "timereport.h"
 
 namespace {
 	bool DEBUG_LIVE_VREGS = false;
+
+	inline unsigned count_trailing_zeros(uint64_t word) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, word);
+		return index;
+#else
+		return __builtin_ctzll(word);
+#endif
+	}
+}
+
+////////////////////////////////////////////////////////////////////////
+// LiveVregs::LiveSet implementation
+////////////////////////////////////////////////////////////////////////
+
+LiveVregs::LiveSet& LiveVregs::LiveSet::operator|=(const LiveSet& other) {
+	if (other.m_words.empty()) return *this;
+	if (m_words.empty()) {
+		m_words = other.m_words;
+		return *this;
+	}
+	// merge the two lists of words
+	std::vector<Word> merged;
+	merged.reserve(m_words.size() + other.m_words.size());
+	auto i = m_words.cbegin(), j = other.m_words.cbegin();
+	while (i != m_words.cend() || j != other.m_words.cend()) {
+		if (j == other.m_words.cend() || (i != m_words.cend() && i->index < j->index)) merged.push_back(*i++);
+		else if (i == m_words.cend() || j->index < i->index) merged.push_back(*j++);
+		else merged.push_back(Word{ i->index, (i++)->bits | (j++)->bits });
+	}
+	m_words.swap(merged);
+	return *this;
 }
 
+LiveVregs::LiveSet LiveVregs::LiveSet::operator-(const LiveSet& other) const {
+	LiveSet result;
+	auto j = other.m_words.cbegin();
+	for (const auto& word : m_words) {
+		while (j != other.m_words.cend() && j->index < word.index) ++j;
+		const uint64_t bits = j != other.m_words.cend() && j->index == word.index ? word.bits & ~j->bits : word.bits;
+		if (bits != 0) result.m_words.push_back(Word{ word.index, bits });
+	}
+	return result;
+}
+
+int LiveVregs::LiveSet::find_next(unsigned vreg) const {
+	auto i = find_word(vreg / 64);
+	if (i == m_words.end()) return -1;
+	// ignore the bits below vreg in its word
+	const uint64_t bits = i->index == vreg / 64 ? i->bits & (~uint64_t(0) << (vreg % 64)) : i->bits;
+	if (bits != 0) return int(i->index * 64 + count_trailing_zeros(bits));
+	// the stored words are nonzero
+	return ++i == m_words.end() ? -1 : int(i->index * 64 + count_trailing_zeros(i->bits));
+}
+
+////////////////////////////////////////////////////////////////////////
+// LiveVregs implementation
+////////////////////////////////////////////////////////////////////////
+
 LiveVregs::LiveVregs(ControlFlowGraph* cfg)
 	: m_cfg(cfg)
 	  , m_endfacts(cfg->get_num_blocks(), LiveSet())
@@ -15,6 +77,7 @@ LiveVregs::LiveVregs(ControlFlowGraph* cfg)
 LiveVregs::~LiveVregs() {}
 
 void LiveVregs::execute() {
+	TimePhase phase("LiveVregs::execute");
 	compute_iter_order();
 
 	if (DEBUG_LIVE_VREGS) {
@@ -121,29 +184,32 @@ void LiveVregs::compute_iter_order() {
 	// since this is a backwards problem,
 	// desired iteration order is reverse postorder on
 	// reversed CFG
-	std::bitset<MAX_BLOCKS> visited;
-	postorder_on_rcfg(visited, m_cfg->get_exit_block());
-	std::reverse(m_iter_order.begin(), m_iter_order.end());
-}
-
-void LiveVregs::postorder_on_rcfg(std::bitset<MAX_BLOCKS>& visited, BasicBlock* bb) {
-	// already arrived at this block?
-	if (visited.test(bb->get_id())) {
-		return;
-	}
-
-	// this block is now guaranteed to be visited
-	visited.set(bb->get_id());
-
-	// recursively visit predecessors
-	const ControlFlowGraph::EdgeList& incoming_edges = m_cfg->get_incoming_edges(bb);
-	for (auto i = incoming_edges.begin(); i != incoming_edges.end(); ++i) {
-		Edge* e = *i;
-		postorder_on_rcfg(visited, e->get_source());
+	//
+	// The depth first search keeps its own stack of blocks, each with the
+	// index of the next predecessor to visit, since a long program's CFG
+	// can be too deep to recurse on.
+	std::vector<bool> visited(m_cfg->get_num_blocks(), false);
+	std::vector<std::pair<BasicBlock*, unsigned>> stack;
+	BasicBlock* exit = m_cfg->get_exit_block();
+	visited[exit->get_id()] = true;
+	stack.push_back(std::make_pair(exit, 0u));
+	while (!stack.empty()) {
+		BasicBlock* bb = stack.back().first;
+		const ControlFlowGraph::EdgeList& incoming_edges = m_cfg->get_incoming_edges(bb);
+		if (stack.back().second < incoming_edges.size()) {
+			// visit the next predecessor, unless we already arrived at it
+			BasicBlock* pred = incoming_edges[stack.back().second++]->get_source();
+			if (!visited[pred->get_id()]) {
+				visited[pred->get_id()] = true;
+				stack.push_back(std::make_pair(pred, 0u));
+			}
+			continue;
+		}
+		// all predecessors are done, so add this block to the order
+		m_iter_order.push_back(bb->get_id());
+		stack.pop_back();
 	}
-
-	// add this block to the order
-	m_iter_order.push_back(bb->get_id());
+	std::reverse(m_iter_order.begin(), m_iter_order.end());
 }
 
 void LiveVregs::model_instruction(Instruction* ins, LiveSet& fact) const {
@@ -161,8 +227,10 @@ void LiveVregs::model_instruction(Instruction* ins, LiveSet& fact) const {
 		if (HighLevel::is_use(ins, i)) {
 			Operand operand = ins->get_operand(i);
 
-			assert(operand.has_base_reg());
-			fact.set(operand.get_base_reg());
+			assert(operand.has_base_reg() || operand.has_index_reg());
+			if (operand.has_base_reg()) {
+				fact.set(operand.get_base_reg());
+			}
 
 			if (operand.has_index_reg()) {
 				fact.set(operand.get_index_reg());
@@ -196,11 +264,9 @@ std::string LiveVregsControlFlowGraphPrinter::format_instruction(BasicBlock* bb,
 
 std::string LiveVregsControlFlowGraphPrinter::format_set(const LiveVregs::LiveSet& live_set) {
 	std::string s;
-	for (unsigned i = 0; i < LiveVregs::MAX_VREGS; i++) {
-		if (live_set.test(i)) {
-			if (!s.empty()) { s += ","; }
-			s += std::to_string(i);
-		}
+	for (int i = live_set.find_next(0); i >= 0; i = live_set.find_next(i + 1)) {
+		if (!s.empty()) { s += ","; }
+		s += std::to_string(i);
 	}
 	return s;
 }
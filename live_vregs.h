@@ -1,23 +1,66 @@
 #ifndef LIVE_VREGS_H
 #define LIVE_VREGS_H
 
-#include <bitset>
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include "cfg.h"
 #include "highlevel.h"
 
 class LiveVregs {
 public:
-	// we assume that there are never more than this many vregs used
-	static const unsigned MAX_VREGS = 256;
-
 	// We use a bitset to represent the set of live vregs.
 	// To check whether a vreg is live, check the bit indexed by
-	// its register number.
-	using LiveSet = std::bitset<MAX_VREGS>;
-
-	// we assume there are never more than this many basic blocks
-	static const unsigned MAX_BLOCKS = 1024;
+	// its register number.  Only the nonzero 64-bit words of the
+	// bitset are stored, in order of their index, so there is no
+	// limit on the number of vregs, and a set of a few vregs stays
+	// small however high their numbers are.  (The vregs live at a
+	// point are usually the program's variables, which have the
+	// lowest numbers, and a few temporaries, which can have any.)
+	class LiveSet {
+		struct Word {
+			unsigned index;
+			uint64_t bits;
+			bool operator==(const Word& other) const { return index == other.index && bits == other.bits; }
+		};
+		std::vector<Word> m_words;
+
+		// the first stored word whose index is at least index
+		std::vector<Word>::const_iterator find_word(unsigned index) const {
+			return std::lower_bound(m_words.begin(), m_words.end(), index,
+			                        [](const Word& word, unsigned i) { return word.index < i; });
+		}
+
+	public:
+		bool test(unsigned vreg) const {
+			const auto i = find_word(vreg / 64);
+			return i != m_words.end() && i->index == vreg / 64 && ((i->bits >> (vreg % 64)) & 1);
+		}
+
+		void set(unsigned vreg) {
+			const auto i = m_words.begin() + (find_word(vreg / 64) - m_words.cbegin());
+			if (i != m_words.end() && i->index == vreg / 64) i->bits |= uint64_t(1) << (vreg % 64);
+			else m_words.insert(i, Word{ vreg / 64, uint64_t(1) << (vreg % 64) });
+		}
+
+		void reset(unsigned vreg) {
+			const auto i = m_words.begin() + (find_word(vreg / 64) - m_words.cbegin());
+			if (i == m_words.end() || i->index != vreg / 64) return;
+			i->bits &= ~(uint64_t(1) << (vreg % 64));
+			if (i->bits == 0) m_words.erase(i);
+		}
+
+		LiveSet& operator|=(const LiveSet& other);
+		// the members of this set which are not in other
+		LiveSet operator-(const LiveSet& other) const;
+		bool operator==(const LiveSet& other) const { return m_words == other.m_words; }
+		bool operator!=(const LiveSet& other) const { return !(*this == other); }
+
+		// the smallest vreg in the set which is at least vreg, or -1,
+		// so the members can be visited with
+		//   for (int v = set.find_next(0); v >= 0; v = set.find_next(v + 1))
+		int find_next(unsigned vreg) const;
+	};
 
 private:
 	// the control flow graph
@@ -48,7 +91,6 @@ public:
 
 private:
 	void compute_iter_order();
-	void postorder_on_rcfg(std::bitset<MAX_BLOCKS>& visited, BasicBlock* bb);
 	void model_instruction(Instruction* ins, LiveSet& fact) const;
 };
 
@@ -0,0 +1,92 @@
+#include "dominators.h"
+#include "loops.h"
+#include "timereport.h"
+
+bool Loop::contains(const Loop* other) const {
+	for (; other != nullptr; other = other->parent) {
+		if (other == this) return true;
+	}
+	return false;
+}
+
+LoopForest::LoopForest(ControlFlowGraph* cfg, Dominators* dom)
+	: m_cfg(cfg)
+	  , m_dom(dom) {}
+
+LoopForest::~LoopForest() {
+	for (const auto loop : m_loops) delete loop;
+}
+
+void LoopForest::execute() {
+	TimePhase phase("LoopForest::execute");
+	m_innermost.assign(m_cfg->get_num_blocks(), nullptr);
+
+	// a loop's header is dominated by the headers of the loops containing it,
+	// so visiting headers in reverse of reverse postorder finds inner loops first
+	const ControlFlowGraph::BlockList& rpo = m_dom->get_reverse_postorder();
+	for (auto i = rpo.rbegin(); i != rpo.rend(); ++i) find_loop(*i);
+
+	// outer loops come after their children, so walk backwards to set depths
+	for (auto i = m_loops.rbegin(); i != m_loops.rend(); ++i) {
+		Loop* loop = *i;
+		loop->depth = loop->parent ? loop->parent->depth + 1 : 1;
+		if (!loop->parent) m_top_level.push_back(loop);
+		find_preheader(loop);
+	}
+}
+
+Loop* LoopForest::get_loop(BasicBlock* bb) const {
+	return m_innermost[bb->get_id()];
+}
+
+unsigned LoopForest::get_depth(BasicBlock* bb) const {
+	const Loop* loop = get_loop(bb);
+	return loop ? loop->depth : 0;
+}
+
+void LoopForest::find_loop(BasicBlock* header) {
+	ControlFlowGraph::BlockList latches;
+	for (const auto edge : m_cfg->get_incoming_edges(header)) {
+		if (m_dom->dominates(header, edge->get_source())) latches.push_back(edge->get_source());
+	}
+	if (latches.empty()) return;
+
+	auto loop = new Loop{ header, nullptr, nullptr, {}, { header }, latches, 0 };
+	if (!m_innermost[header->get_id()]) m_innermost[header->get_id()] = loop;
+
+	// walk backwards from the latches; blocks already claimed by an inner loop
+	// are skipped over by continuing from that loop's header
+	ControlFlowGraph::BlockList work_list(latches);
+	while (!work_list.empty()) {
+		BasicBlock* bb = work_list.back();
+		work_list.pop_back();
+		if (bb == header || !m_dom->is_reachable(bb)) continue;
+		Loop* inner = m_innermost[bb->get_id()];
+		if (!inner) {
+			m_innermost[bb->get_id()] = loop;
+			loop->blocks.push_back(bb);
+		} else {
+			while (inner->parent) inner = inner->parent;
+			if (inner == loop) continue;
+			inner->parent = loop;
+			loop->children.push_back(inner);
+			bb = inner->header;
+		}
+		for (const auto edge : m_cfg->get_incoming_edges(bb)) work_list.push_back(edge->get_source());
+	}
+	for (const auto child : loop->children) {
+		loop->blocks.insert(loop->blocks.end(), child->blocks.begin(), child->blocks.end());
+	}
+	m_loops.push_back(loop);
+}
+
+void LoopForest::find_preheader(Loop* loop) const {
+	BasicBlock* outside = nullptr;
+	for (const auto edge : m_cfg->get_incoming_edges(loop->header)) {
+		BasicBlock* pred = edge->get_source();
+		if (loop->contains(get_loop(pred))) continue;
+		if (outside) return;
+		outside = pred;
+	}
+	if (outside && m_cfg->get_outgoing_edges(outside).size() == 1) loop->preheader = outside;
+}
@@ -0,0 +1,64 @@
+#ifndef LOOPS_H
+#define LOOPS_H
+
+#include <vector>
+#include "cfg.h"
+
+class Dominators;
+
+// A natural loop: the header plus every block that can reach a latch (the
+// source of a back edge to the header) without passing through the header.
+struct Loop {
+	BasicBlock* header;
+	// the unique predecessor of the header from outside the loop, if it has
+	// no other successor, otherwise nullptr
+	BasicBlock* preheader;
+	Loop* parent;
+	std::vector<Loop*> children;
+	// every block in the loop, including those of nested loops; header first
+	ControlFlowGraph::BlockList blocks;
+	ControlFlowGraph::BlockList latches;
+	// 1 for outermost loops
+	unsigned depth;
+
+	bool contains(const Loop* other) const;
+};
+
+// Loop-nest forest of a ControlFlowGraph, built from the back edges found by
+// a (forward) Dominators analysis.  Loops sharing a header are merged.
+// Irreducible cycles have no back edge and so aren't reported as loops.
+class LoopForest {
+public:
+	using LoopList = std::vector<Loop*>;
+
+private:
+	ControlFlowGraph* m_cfg;
+	Dominators* m_dom;
+	LoopList m_loops;         // innermost loops first
+	LoopList m_top_level;
+	std::vector<Loop*> m_innermost; // indexed by block id
+
+public:
+	LoopForest(ControlFlowGraph* cfg, Dominators* dom);
+	~LoopForest();
+
+	// execute the analysis; the Dominators must already have been executed
+	void execute();
+
+	// innermost loop containing bb, or nullptr
+	Loop* get_loop(BasicBlock* bb) const;
+
+	// loop nesting depth of bb, 0 outside of all loops
+	unsigned get_depth(BasicBlock* bb) const;
+
+	// all loops, ordered so that inner loops precede the loops containing them
+	const LoopList& get_loops() const { return m_loops; }
+
+	const LoopList& get_top_level_loops() const { return m_top_level; }
+
+private:
+	void find_loop(BasicBlock* header);
+	void find_preheader(Loop* loop) const;
+};
+
+#endif // LOOPS_H
@@ -1,10 +1,13 @@
 #include "lowlevelcodegen.h"
-#include <iostream>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
 #include "highlevel.h"
+#include "runtime.h"
 #include "x86_64.h"
 
-LowLevelCodeGen::LowLevelCodeGen(SymbolTable* symtab, int vregs): vregs_used(vregs), _iseq(new InstructionSequence),
-                                                                  symtab(symtab) {}
+LowLevelCodeGen::LowLevelCodeGen(SymbolTable* symtab, int vregs, RegisterAllocator* regalloc): vregs_used(vregs),
+	_iseq(new InstructionSequence), symtab(symtab), regalloc(regalloc) {}
 
 LowLevelCodeGen::~LowLevelCodeGen() {}
 
@@ -14,30 +17,71 @@ InstructionSequence* LowLevelCodeGen::get_iseq() const {
 
 Operand LowLevelCodeGen::vreg_ref(Operand op) {
 	if (!op.has_base_reg()) return op; // op is actually a literal
+	if (regalloc) {
+		const int mreg = regalloc->get_mreg(op.get_base_reg());
+		if (mreg >= 0) return Operand(OPERAND_MREG, mreg);
+	}
 	const int offset = vreg_refs.at(op.get_base_reg());
 	return Operand(OPERAND_MREG_MEMREF_OFFSET, MREG_RSP, offset);
 }
 
-void LowLevelCodeGen::generate(InstructionSequence* hl_iseq) {
+// Translates the memory reference operand of a load, store or lea into an
+// x86-64 addressing mode.  Address vregs which aren't in machine registers
+// are first loaded into the given scratch registers.
+Operand LowLevelCodeGen::memref_ref(Operand op, int base_scratch, int index_scratch) {
+	switch (op.get_kind()) {
+	case OPERAND_VREG_MEMREF:
+		return Operand(OPERAND_MREG_MEMREF, address_reg(op.get_base_reg(), base_scratch).get_base_reg());
+	case OPERAND_VREG_MEMREF_OFFSET:
+		return Operand(OPERAND_MREG_MEMREF_OFFSET, address_reg(op.get_base_reg(), base_scratch).get_base_reg(),
+		               op.get_offset());
+	case OPERAND_VREG_MEMREF_OFFSET_INDEX:
+		return Operand(OPERAND_MREG_MEMREF_OFFSET_INDEX, address_reg(op.get_base_reg(), base_scratch).get_base_reg(),
+		               address_reg(op.get_index_reg(), index_scratch).get_base_reg(), op.get_offset(),
+		               op.get_scale());
+	case OPERAND_FRAME_MEMREF_OFFSET:
+		return Operand(OPERAND_MREG_MEMREF_OFFSET, MREG_RSP, op.get_offset());
+	case OPERAND_FRAME_MEMREF_OFFSET_INDEX:
+		return Operand(OPERAND_MREG_MEMREF_OFFSET_INDEX, MREG_RSP,
+		               address_reg(op.get_index_reg(), index_scratch).get_base_reg(), op.get_offset(),
+		               op.get_scale());
+	default:
+		assert(false); // not a memory reference
+		return op;
+	}
+}
+
+// machine register holding vreg, loading it into scratch if necessary
+Operand LowLevelCodeGen::address_reg(int vreg, int scratch) {
+	const Operand ref = vreg_ref(Operand(OPERAND_VREG, vreg));
+	if (ref.get_kind() == OPERAND_MREG) return ref;
+	_iseq->add_instruction(new Instruction(MINS_MOVQ, ref, Operand(OPERAND_MREG, scratch)));
+	return Operand(OPERAND_MREG, scratch);
+}
+
+void LowLevelCodeGen::generate(InstructionSequence* hl_iseq, FILE* out) {
 	// generate the boilerplate
-	std::cout << "/* " << vregs_used << " vregs with storage allocated */" << '\n';
-	std::cout << "\t.section .rodata" << '\n';
-	std::cout << R"(s_readint_fmt: .string "%ld")" << '\n';
-	std::cout << R"(s_writeint_fmt: .string "%ld\n")" << '\n';
-	std::cout << "\t.section .bss" << '\n';
-	std::cout << "\t.align 8" << '\n';
-	std::cout << "s_readbuf: .space 8" << '\n';
-	std::cout << "\t.section .text" << '\n';
-	std::cout << "\t.globl main" << '\n';
-	std::cout << "main:" << '\n';
+	fprintf(out, "/* %d vregs with storage allocated */\n", vregs_used);
+	if (regalloc) fprintf(out, "/* %d vregs allocated to machine registers */\n", regalloc->get_num_allocated());
+	fprintf(out, "%s\n", IO_RUNTIME);
+	fprintf(out, "\t.globl main\n");
+	fprintf(out, "main:\n");
 	// calculate vreg memory locations
 	int offset = symtab->get_offset(); // from start of vreg memory
 	for (int i = 0; i <= vregs_used; i++) {
 		vreg_refs[i] = offset;
 		offset += 8;
 	}
-	// align to 16 byte boundary
-	offset += offset % 16;
+	// callee-saved registers we use are pushed on entry
+	const std::vector<int> no_pushes;
+	const auto& pushed = regalloc ? regalloc->get_callee_saved_used() : no_pushes;
+	for (const int mreg : pushed) {
+		_iseq->add_instruction(new Instruction(MINS_PUSHQ, Operand(OPERAND_MREG, mreg)));
+	}
+	// keep %rsp 16 byte aligned at calls: on entry it is 8 bytes past
+	// an aligned address because of the return address
+	offset = (offset + 7) & ~7;
+	if ((8 + 8 * int(pushed.size()) + offset) % 16 != 0) offset += 8;
 	auto ins = new Instruction(MINS_SUBQ, Operand(OPERAND_INT_LITERAL, offset), Operand(OPERAND_MREG, MREG_RSP));
 	//_iseq->define_label("main");
 	_iseq->add_instruction(ins);
@@ -56,6 +100,7 @@ void LowLevelCodeGen::generate(InstructionSequence* hl_iseq) {
 	// generate instructions
 	for (unsigned int i = 0; i < hl_iseq->get_length(); i++) {
 		if (hl_iseq->has_label(i)) _iseq->define_label(hl_iseq->get_label(i));
+		const unsigned length_before = _iseq->get_length();
 		const auto hlins = hl_iseq->get_instruction(i);
 		int opcode = hlins->get_opcode();
 		switch (opcode) {
@@ -122,16 +167,26 @@ void LowLevelCodeGen::generate(InstructionSequence* hl_iseq) {
 		case HINS_INT_COMPARE:
 			generate_compare(hlins);
 			break;
+		case HINS_LEA:
+			generate_lea(hlins);
+			break;
 		case HINS_MOV:
 			generate_mov(hlins);
 			break;
 		default:
 			assert(false); // unknown opcode
 		}
+		// a coalesced copy needs no code, but its label needs an instruction
+		if (hl_iseq->has_label(i) && _iseq->get_length() == length_before) generate_nop(hlins);
 	}
 	if (hl_iseq->has_label_at_end()) _iseq->define_label(hl_iseq->get_label_at_end());
 	ins = new Instruction(MINS_ADDQ, Operand(OPERAND_INT_LITERAL, offset), Operand(OPERAND_MREG, MREG_RSP));
 	_iseq->add_instruction(ins);
+	for (auto it = pushed.rbegin(); it != pushed.rend(); ++it) {
+		_iseq->add_instruction(new Instruction(MINS_POPQ, Operand(OPERAND_MREG, *it)));
+	}
+	ins = new Instruction(MINS_CALL, Operand("rt_flush"));
+	_iseq->add_instruction(ins);
 	ins = new Instruction(MINS_MOVQ, Operand(OPERAND_INT_LITERAL, 0), Operand(OPERAND_MREG, MREG_RAX));
 	_iseq->add_instruction(ins);
 	ins = new Instruction(MINS_RET);
@@ -178,9 +233,12 @@ void LowLevelCodeGen::generate_sub(Instruction* hlins) {
 }
 
 void LowLevelCodeGen::generate_mul(Instruction* hlins) {
+	if (generate_mul_by_constant(hlins)) return;
 	const auto destreg = vreg_ref((*hlins)[0]);
-	const auto leftreg = vreg_ref((*hlins)[1]);
-	const auto rightreg = vreg_ref((*hlins)[2]);
+	auto leftreg = vreg_ref((*hlins)[1]);
+	auto rightreg = vreg_ref((*hlins)[2]);
+	// a constant factor can be an immediate operand of imulq
+	if (leftreg.get_kind() == OPERAND_INT_LITERAL) std::swap(leftreg, rightreg);
 	auto ins = new Instruction(MINS_MOVQ, leftreg, Operand(OPERAND_MREG, MREG_RAX));
 	ins->set_comment(hlins->get_comment());
 	_iseq->add_instruction(ins);
@@ -191,12 +249,19 @@ void LowLevelCodeGen::generate_mul(Instruction* hlins) {
 }
 
 void LowLevelCodeGen::generate_div(Instruction* hlins) {
+	if (generate_div_by_constant(hlins, false)) return;
 	const auto destreg = vreg_ref((*hlins)[0]);
 	const auto leftreg = vreg_ref((*hlins)[1]);
-	const auto rightreg = vreg_ref((*hlins)[2]);
+	auto rightreg = vreg_ref((*hlins)[2]);
 	auto ins = new Instruction(MINS_MOVQ, leftreg, Operand(OPERAND_MREG, MREG_RAX));
 	ins->set_comment(hlins->get_comment());
 	_iseq->add_instruction(ins);
+	if (rightreg.get_kind() == OPERAND_INT_LITERAL) {
+		// idivq has no immediate form
+		ins = new Instruction(MINS_MOVQ, rightreg, Operand(OPERAND_MREG, MREG_R10));
+		_iseq->add_instruction(ins);
+		rightreg = Operand(OPERAND_MREG, MREG_R10);
+	}
 	ins = new Instruction(MINS_CQTO);
 	_iseq->add_instruction(ins);
 	ins = new Instruction(MINS_IDIVQ, rightreg);
@@ -206,12 +271,19 @@ void LowLevelCodeGen::generate_div(Instruction* hlins) {
 }
 
 void LowLevelCodeGen::generate_mod(Instruction* hlins) {
+	if (generate_div_by_constant(hlins, true)) return;
 	const auto destreg = vreg_ref((*hlins)[0]);
 	const auto leftreg = vreg_ref((*hlins)[1]);
-	const auto rightreg = vreg_ref((*hlins)[2]);
+	auto rightreg = vreg_ref((*hlins)[2]);
 	auto ins = new Instruction(MINS_MOVQ, leftreg, Operand(OPERAND_MREG, MREG_RAX));
 	ins->set_comment(hlins->get_comment());
 	_iseq->add_instruction(ins);
+	if (rightreg.get_kind() == OPERAND_INT_LITERAL) {
+		// idivq has no immediate form
+		ins = new Instruction(MINS_MOVQ, rightreg, Operand(OPERAND_MREG, MREG_R10));
+		_iseq->add_instruction(ins);
+		rightreg = Operand(OPERAND_MREG, MREG_R10);
+	}
 	ins = new Instruction(MINS_CQTO);
 	_iseq->add_instruction(ins);
 	ins = new Instruction(MINS_IDIVQ, rightreg);
@@ -220,6 +292,171 @@ void LowLevelCodeGen::generate_mod(Instruction* hlins) {
 	_iseq->add_instruction(ins);
 }
 
+// Multiplication by a constant c >= 0 using at most two shifts and leas on
+// %rax, e.g. x*12 = ((x + x*2) << 2) and x*45 = (x + x*4) + (x + x*4)*8.
+// Returns false if neither operand is such a constant.
+bool LowLevelCodeGen::generate_mul_by_constant(Instruction* hlins) {
+	const auto destreg = vreg_ref((*hlins)[0]);
+	auto leftreg = vreg_ref((*hlins)[1]);
+	auto rightreg = vreg_ref((*hlins)[2]);
+	if (rightreg.get_kind() != OPERAND_INT_LITERAL) std::swap(leftreg, rightreg);
+	if (rightreg.get_kind() != OPERAND_INT_LITERAL) return false;
+	const long c = rightreg.get_int_value();
+	if (c < 0) return false;
+
+	// split c into factor * 2^shift, and factor into at most two of 3, 5, 9
+	int shift = 0;
+	long factor = c;
+	while (factor != 0 && factor % 2 == 0) {
+		factor /= 2;
+		shift++;
+	}
+	int leas[2], num_leas = 0;
+	for (const int m : { 9, 5, 3 }) {
+		while (num_leas < 2 && factor % m == 0) {
+			factor /= m;
+			leas[num_leas++] = m;
+		}
+	}
+	if (c != 0 && (factor != 1 || num_leas + (shift != 0) > 2)) return false;
+
+	const unsigned start = _iseq->get_length();
+	if (c == 0) {
+		_iseq->add_instruction(new Instruction(MINS_MOVQ, Operand(OPERAND_INT_LITERAL, 0), destreg));
+	} else {
+		emit(MINS_MOVQ, leftreg, MREG_RAX);
+		for (int k = 0; k < num_leas; k++) {
+			const auto memref = Operand(OPERAND_MREG_MEMREF_OFFSET_INDEX, MREG_RAX, MREG_RAX, 0, leas[k] - 1);
+			emit(MINS_LEAQ, memref, MREG_RAX);
+		}
+		if (shift != 0) emit(MINS_SHLQ, Operand(OPERAND_INT_LITERAL, shift), MREG_RAX);
+		_iseq->add_instruction(new Instruction(MINS_MOVQ, Operand(OPERAND_MREG, MREG_RAX), destreg));
+	}
+	_iseq->get_instruction(start)->set_comment(hlins->get_comment());
+	return true;
+}
+
+// Signed division or remainder by a constant d without idivq.  For
+// d = 2^k or -2^k, the dividend n is biased by 2^k-1 when it is negative,
+// so that an arithmetic shift rounds toward zero.  For other d, the
+// quotient is the high half of n*M for a magic multiplier M (see
+// find_magic), shifted right and rounded toward zero.  The remainder is
+// n - q*d in both cases.  Returns false if the divisor isn't a constant
+// that can be handled this way.
+bool LowLevelCodeGen::generate_div_by_constant(Instruction* hlins, bool remainder) {
+	const auto destreg = vreg_ref((*hlins)[0]);
+	const auto leftreg = vreg_ref((*hlins)[1]);
+	const auto rightreg = vreg_ref((*hlins)[2]);
+	if (rightreg.get_kind() != OPERAND_INT_LITERAL) return false;
+	const long d = rightreg.get_int_value();
+	if (d == 0 || d == LONG_MIN) return false;
+	const unsigned long ad = d < 0 ? -(unsigned long)d : d;
+
+	const unsigned start = _iseq->get_length();
+	int result = MREG_RDX;
+	// the dividend can stay where it is if it is already in a register
+	int n = MREG_R10;
+	if (leftreg.get_kind() == OPERAND_MREG) n = leftreg.get_base_reg();
+	else if (ad != 1) emit(MINS_MOVQ, leftreg, MREG_R10);
+	if (ad == 1) {
+		if (remainder) {
+			_iseq->add_instruction(new Instruction(MINS_MOVQ, Operand(OPERAND_INT_LITERAL, 0), destreg));
+			_iseq->get_instruction(start)->set_comment(hlins->get_comment());
+			return true;
+		}
+		emit(MINS_MOVQ, leftreg, MREG_RDX);
+		if (d < 0) _iseq->add_instruction(new Instruction(MINS_NEGQ, Operand(OPERAND_MREG, MREG_RDX)));
+	} else if ((ad & (ad - 1)) == 0) {
+		int k = 0;
+		while ((1UL << k) != ad) k++;
+		emit(MINS_MOVQ, n, MREG_RDX);
+		if (k > 1) emit(MINS_SARQ, Operand(OPERAND_INT_LITERAL, 63), MREG_RDX);
+		emit(MINS_SHRQ, Operand(OPERAND_INT_LITERAL, 64 - k), MREG_RDX);
+		emit(MINS_ADDQ, n, MREG_RDX);
+		if (remainder) {
+			// n - (biased n rounded down to a multiple of 2^k)
+			emit(MINS_SARQ, Operand(OPERAND_INT_LITERAL, k), MREG_RDX);
+			emit(MINS_SHLQ, Operand(OPERAND_INT_LITERAL, k), MREG_RDX);
+			emit(MINS_MOVQ, n, MREG_RAX);
+			emit(MINS_SUBQ, MREG_RDX, MREG_RAX);
+			result = MREG_RAX;
+		} else {
+			emit(MINS_SARQ, Operand(OPERAND_INT_LITERAL, k), MREG_RDX);
+			if (d < 0) _iseq->add_instruction(new Instruction(MINS_NEGQ, Operand(OPERAND_MREG, MREG_RDX)));
+		}
+	} else {
+		long multiplier;
+		int shift;
+		find_magic(d, multiplier, shift);
+		emit(MINS_MOVQ, Operand(OPERAND_INT_LITERAL, multiplier), MREG_RAX);
+		_iseq->add_instruction(new Instruction(MINS_IMULQ, Operand(OPERAND_MREG, n)));
+		// correct for the sign of the multiplier having wrapped around
+		if (d > 0 && multiplier < 0) emit(MINS_ADDQ, n, MREG_RDX);
+		if (d < 0 && multiplier > 0) emit(MINS_SUBQ, n, MREG_RDX);
+		if (shift > 0) emit(MINS_SARQ, Operand(OPERAND_INT_LITERAL, shift), MREG_RDX);
+		// add one if the quotient is negative, to round toward zero
+		emit(MINS_MOVQ, MREG_RDX, MREG_RAX);
+		emit(MINS_SHRQ, Operand(OPERAND_INT_LITERAL, 63), MREG_RAX);
+		emit(MINS_ADDQ, MREG_RAX, MREG_RDX);
+		if (remainder) {
+			if (d >= INT32_MIN && d <= INT32_MAX) {
+				emit(MINS_IMULQ, rightreg, MREG_RDX);
+			} else {
+				emit(MINS_MOVQ, rightreg, MREG_R11);
+				emit(MINS_IMULQ, MREG_R11, MREG_RDX);
+			}
+			emit(MINS_MOVQ, n, MREG_RAX);
+			emit(MINS_SUBQ, MREG_RDX, MREG_RAX);
+			result = MREG_RAX;
+		}
+	}
+	_iseq->add_instruction(new Instruction(MINS_MOVQ, Operand(OPERAND_MREG, result), destreg));
+	_iseq->get_instruction(start)->set_comment(hlins->get_comment());
+	return true;
+}
+
+void LowLevelCodeGen::emit(int opcode, const Operand& src, int mreg) {
+	_iseq->add_instruction(new Instruction(opcode, src, Operand(OPERAND_MREG, mreg)));
+}
+
+void LowLevelCodeGen::emit(int opcode, int src_mreg, int mreg) {
+	emit(opcode, Operand(OPERAND_MREG, src_mreg), mreg);
+}
+
+// Computes the magic multiplier M and shift s for signed division by d,
+// |d| >= 2, such that n/d = hi64(n*M) (+n if d > 0 > M, -n if d < 0 < M)
+// arithmetically shifted right by s, plus one if that is negative.  This is
+// the algorithm of Warren, Hacker's Delight, chapter 10, for 64-bit words.
+void LowLevelCodeGen::find_magic(long divisor, long& multiplier, int& shift) {
+	const unsigned long two63 = 1UL << 63;
+	const unsigned long ad = divisor < 0 ? -(unsigned long)divisor : divisor;
+	const unsigned long t = two63 + ((unsigned long)divisor >> 63);
+	const unsigned long anc = t - 1 - t % ad; // absolute value of nc
+	unsigned long q1 = two63 / anc, r1 = two63 - q1 * anc;
+	unsigned long q2 = two63 / ad, r2 = two63 - q2 * ad;
+	unsigned long delta;
+	int p = 63;
+	do {
+		p++;
+		q1 *= 2;
+		r1 *= 2;
+		if (r1 >= anc) {
+			q1++;
+			r1 -= anc;
+		}
+		q2 *= 2;
+		r2 *= 2;
+		if (r2 >= ad) {
+			q2++;
+			r2 -= ad;
+		}
+		delta = ad - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+	multiplier = long(q2 + 1);
+	if (divisor < 0) multiplier = -multiplier;
+	shift = p - 64;
+}
+
 void LowLevelCodeGen::generate_negate(Instruction* hlins) {
 	const auto destreg = vreg_ref((*hlins)[0]);
 	const auto sourcereg = vreg_ref((*hlins)[1]);
@@ -245,6 +482,15 @@ void LowLevelCodeGen::generate_localaddr(Instruction* hlins) {
 
 void LowLevelCodeGen::generate_load_int(Instruction* hlins) {
 	const auto destreg = vreg_ref((*hlins)[0]);
+	if ((*hlins)[1].get_kind() != OPERAND_VREG_MEMREF) {
+		// an addressing mode chosen by InstructionSelector
+		const unsigned start = _iseq->get_length();
+		const auto memref = memref_ref((*hlins)[1], MREG_R10, MREG_R11);
+		_iseq->add_instruction(new Instruction(MINS_MOVQ, memref, Operand(OPERAND_MREG, MREG_R10)));
+		_iseq->get_instruction(start)->set_comment(hlins->get_comment());
+		_iseq->add_instruction(new Instruction(MINS_MOVQ, Operand(OPERAND_MREG, MREG_R10), destreg));
+		return;
+	}
 	const auto sourcereg = vreg_ref((*hlins)[1]);
 	auto ins = new Instruction(MINS_MOVQ, sourcereg, Operand(OPERAND_MREG, MREG_R10));
 	ins->set_comment(hlins->get_comment());
@@ -256,6 +502,15 @@ void LowLevelCodeGen::generate_load_int(Instruction* hlins) {
 }
 
 void LowLevelCodeGen::generate_store_int(Instruction* hlins) {
+	if ((*hlins)[0].get_kind() != OPERAND_VREG_MEMREF) {
+		// an addressing mode chosen by InstructionSelector
+		auto ins = new Instruction(MINS_MOVQ, vreg_ref((*hlins)[1]), Operand(OPERAND_MREG, MREG_R10));
+		ins->set_comment(hlins->get_comment());
+		_iseq->add_instruction(ins);
+		const auto memref = memref_ref((*hlins)[0], MREG_R11, MREG_RAX);
+		_iseq->add_instruction(new Instruction(MINS_MOVQ, Operand(OPERAND_MREG, MREG_R10), memref));
+		return;
+	}
 	const auto destreg = vreg_ref((*hlins)[0]);
 	const auto sourcereg = vreg_ref((*hlins)[1]);
 	auto ins = new Instruction(MINS_MOVQ, destreg, Operand(OPERAND_MREG, MREG_R11));
@@ -269,35 +524,19 @@ void LowLevelCodeGen::generate_store_int(Instruction* hlins) {
 
 void LowLevelCodeGen::generate_read_int(Instruction* hlins) {
 	const auto destreg = vreg_ref((*hlins)[0]);
-	auto ins = new Instruction(MINS_MOVQ, Operand("s_readint_fmt", true), Operand(OPERAND_MREG, MREG_RDI));
+	auto ins = new Instruction(MINS_CALL, Operand("rt_read_int"));
 	ins->set_comment(hlins->get_comment());
 	_iseq->add_instruction(ins);
-	ins = new Instruction(MINS_LEAQ, destreg, Operand(OPERAND_MREG, MREG_RSI));
-	_iseq->add_instruction(ins);
-	// zero out %rax
-	ins = new Instruction(MINS_MOVQ, Operand(OPERAND_INT_LITERAL, 0), Operand(OPERAND_MREG, MREG_RAX));
-	_iseq->add_instruction(ins);
-	// stack alignment
-	ins = new Instruction(MINS_SUBQ, Operand(OPERAND_INT_LITERAL, 8), Operand(OPERAND_MREG, MREG_RSP));
-	_iseq->add_instruction(ins);
-	ins = new Instruction(MINS_CALL, Operand("scanf"));
-	_iseq->add_instruction(ins);
-	// stack alignment
-	ins = new Instruction(MINS_ADDQ, Operand(OPERAND_INT_LITERAL, 8), Operand(OPERAND_MREG, MREG_RSP));
+	ins = new Instruction(MINS_MOVQ, Operand(OPERAND_MREG, MREG_RAX), destreg);
 	_iseq->add_instruction(ins);
 }
 
 void LowLevelCodeGen::generate_write_int(Instruction* hlins) {
 	const auto sourcereg = vreg_ref((*hlins)[0]);
-	auto ins = new Instruction(MINS_MOVQ, Operand("s_writeint_fmt", true), Operand(OPERAND_MREG, MREG_RDI));
+	auto ins = new Instruction(MINS_MOVQ, sourcereg, Operand(OPERAND_MREG, MREG_RDI));
 	ins->set_comment(hlins->get_comment());
 	_iseq->add_instruction(ins);
-	ins = new Instruction(MINS_MOVQ, sourcereg, Operand(OPERAND_MREG, MREG_RSI));
-	_iseq->add_instruction(ins);
-	// zero out %rax
-	ins = new Instruction(MINS_MOVQ, Operand(OPERAND_INT_LITERAL, 0), Operand(OPERAND_MREG, MREG_RAX));
-	_iseq->add_instruction(ins);
-	ins = new Instruction(MINS_CALL, Operand("printf"));
+	ins = new Instruction(MINS_CALL, Operand("rt_write_int"));
 	_iseq->add_instruction(ins);
 }
 
@@ -360,9 +599,50 @@ void LowLevelCodeGen::generate_compare(Instruction* hlins) {
 	_iseq->add_instruction(ins);
 }
 
+void LowLevelCodeGen::generate_lea(Instruction* hlins) {
+	const auto destreg = vreg_ref((*hlins)[0]);
+	const unsigned start = _iseq->get_length();
+	const auto memref = memref_ref((*hlins)[1], MREG_R10, MREG_R11);
+	if (memref.get_kind() == OPERAND_MREG_MEMREF) {
+		// a lone base register is just a copy
+		const auto source = Operand(OPERAND_MREG, memref.get_base_reg());
+		if (destreg.get_kind() == OPERAND_MREG && destreg.get_base_reg() == source.get_base_reg()) return;
+		_iseq->add_instruction(new Instruction(MINS_MOVQ, source, destreg));
+		_iseq->get_instruction(start)->set_comment(hlins->get_comment());
+		return;
+	}
+	if (destreg.get_kind() != OPERAND_MREG) {
+		_iseq->add_instruction(new Instruction(MINS_LEAQ, memref, Operand(OPERAND_MREG, MREG_R10)));
+		_iseq->add_instruction(new Instruction(MINS_MOVQ, Operand(OPERAND_MREG, MREG_R10), destreg));
+		_iseq->get_instruction(start)->set_comment(hlins->get_comment());
+		return;
+	}
+	// when the destination was coalesced with one of the terms, an add is shorter
+	const int dest = destreg.get_base_reg();
+	Operand addend;
+	if (memref.get_kind() == OPERAND_MREG_MEMREF_OFFSET && memref.get_base_reg() == dest) {
+		addend = Operand(OPERAND_INT_LITERAL, memref.get_offset());
+	} else if (memref.get_kind() == OPERAND_MREG_MEMREF_OFFSET_INDEX && memref.get_offset() == 0 &&
+	           memref.get_scale() == 1) {
+		if (memref.get_base_reg() == dest) addend = Operand(OPERAND_MREG, memref.get_index_reg());
+		else if (memref.get_index_reg() == dest) addend = Operand(OPERAND_MREG, memref.get_base_reg());
+	}
+	if (addend.get_kind() != OPERAND_NONE) _iseq->add_instruction(new Instruction(MINS_ADDQ, addend, destreg));
+	else _iseq->add_instruction(new Instruction(MINS_LEAQ, memref, destreg));
+	_iseq->get_instruction(start)->set_comment(hlins->get_comment());
+}
+
 void LowLevelCodeGen::generate_mov(Instruction* hlins) {
 	const auto destreg = vreg_ref((*hlins)[0]);
 	const auto sourcereg = vreg_ref((*hlins)[1]);
+	if (destreg.get_kind() == OPERAND_MREG || sourcereg.get_kind() == OPERAND_MREG) {
+		// a coalesced copy needs no instruction at all
+		if (destreg.get_kind() == sourcereg.get_kind() && destreg.get_base_reg() == sourcereg.get_base_reg()) return;
+		const auto ins = new Instruction(MINS_MOVQ, sourcereg, destreg);
+		ins->set_comment(hlins->get_comment());
+		_iseq->add_instruction(ins);
+		return;
+	}
 	auto ins = new Instruction(MINS_MOVQ, sourcereg, Operand(OPERAND_MREG, MREG_R10));
 	ins->set_comment(hlins->get_comment());
 	_iseq->add_instruction(ins);
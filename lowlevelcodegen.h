@@ -2,6 +2,7 @@
 #define LOWLEVELCODEGEN_H
 #include "cfg.h"
 #include "symtab.h"
+#include "regalloc.h"
 #include <map>
 
 class LowLevelCodeGen {
@@ -9,15 +10,19 @@ class LowLevelCodeGen {
 	InstructionSequence* _iseq;
 	SymbolTable* symtab;
 	std::map<int, int> vreg_refs;
+	// optional; when present, hl_iseq must be regalloc->get_iseq()
+	RegisterAllocator* regalloc;
 
 public:
-	LowLevelCodeGen(SymbolTable* symtab, int vregs);
+	LowLevelCodeGen(SymbolTable* symtab, int vregs, RegisterAllocator* regalloc = nullptr);
 	virtual ~LowLevelCodeGen();
 
 	InstructionSequence* get_iseq() const;
 
 	Operand vreg_ref(Operand op);
-	void generate(InstructionSequence* hl_iseq);
+	Operand memref_ref(Operand op, int base_scratch, int index_scratch);
+	// generates code for hl_iseq, writing the boilerplate ahead of it to out
+	void generate(InstructionSequence* hl_iseq, FILE* out);
 	void generate_nop(Instruction* hlins);
 	void generate_load_int_literal(Instruction* hlins);
 	void generate_add(Instruction* hlins);
@@ -39,7 +44,17 @@ public:
 	void generate_jgt(Instruction* hlins);
 	void generate_jgte(Instruction* hlins);
 	void generate_compare(Instruction* hlins);
+	void generate_lea(Instruction* hlins);
 	void generate_mov(Instruction* hlins);
+
+private:
+	Operand address_reg(int vreg, int scratch);
+	bool generate_mul_by_constant(Instruction* hlins);
+	bool generate_div_by_constant(Instruction* hlins, bool remainder);
+	void emit(int opcode, const Operand& src, int mreg);
+	void emit(int opcode, int src_mreg, int mreg);
+
+	static void find_magic(long divisor, long& multiplier, int& shift);
 };
 
 #endif // LOWLEVELCODEGEN_H
@@ -1,5 +1,9 @@
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
 #include <unistd.h> // for getopt
 #include "node.h"
 #include "util.h"
@@ -7,41 +11,86 @@
 #include "ast.h"
 #include "treeprint.h"
 #include "context.h"
-
-extern "C" {
-int yyparse(void);
-void lexer_set_source_file(const char* filename);
-}
+#include "unit.h"
+#include "batch.h"
+#include "server.h"
+#include "cache.h"
+#include "timereport.h"
+#include "cpputil.h"
 
 void print_usage(void) {
 	err_fatal(
 		"Usage: compiler [options] <filename>\n"
+		"       compiler -b [-j threads] [-d dir] [-m manifest] [-o|-O] [-f] [filename...]\n"
+		"       compiler -L socket [-j workers]\n"
+		"       compiler -c socket [-o|-O] [-f] <filename>\n"
+		"       compiler -C dir -Z\n"
 		"Options:\n"
 		"   -p    print AST\n"
 		"   -g    print AST as graph (DOT/graphviz)\n"
 		"   -s    print symbol table information\n"
 		"   -i    print high level code gen information\n"
 		"   -o    optimize before emitting target assembly language\n"
+		"   -O    like -o, but spend more time on register allocation\n"
+		"   -f    use the hand-written scanner rather than the flex scanner\n"
+		"   -b    batch mode: compile each file (and each file listed in the\n"
+		"         manifest) to a .S file on a pool of threads\n"
+		"   -j    number of threads for -b, or of worker processes for -L\n"
+		"         (default: one per core)\n"
+		"   -d    directory for the .S files of -b (default: next to the sources)\n"
+		"   -m    manifest for -b, listing source files one per line\n"
+		"   -L    run a compile server listening on the socket\n"
+		"   -c    have the compile server listening on the socket compile the\n"
+		"         file (compiles it directly if there is no server)\n"
+		"   -C    cache the assembly language of each program compiled in dir\n"
+		"   -M    size limit of the -C cache in megabytes (default: 256)\n"
+		"   -Z    print the -C cache's statistics\n"
+		"   -T    report the time and memory each phase of the compiler takes\n"
+		"         (to stderr)\n"
+		"   -J    write the phases to a Chrome trace (JSON) file\n"
 	);
 }
 
+// -T and -J: the report is written when the process exits, so that it
+// covers a compilation which fails as well
+TimeReport* time_report;
+bool print_time_report;
+const char* trace_filename;
+
+void write_time_report(void) {
+	TimeReport::set_current(nullptr);
+	if (print_time_report) {
+		time_report->print(stderr);
+	}
+	if (trace_filename && !time_report->write_trace(trace_filename)) {
+		fprintf(stderr, "Could not write trace file \"%s\"\n", trace_filename);
+	}
+}
+
 enum Mode {
 	PRINT_AST,
 	PRINT_AST_GRAPH,
 	PRINT_SYMBOL_TABLE,
 	PRINT_HIGH_LEVEL,
 	COMPILE,
-	COMPILE_OPTIMIZED
+	COMPILE_OPTIMIZED,
+	COMPILE_OPTIMIZED_MORE
 };
 
 int main(int argc, char** argv) {
-	extern FILE* yyin;
-	extern struct Node* g_program;
-
 	int mode = COMPILE;
+	bool fast_scanner = false;
+	bool batch = false;
+	BatchOptions batch_options;
+	const char* server_socket = nullptr;
+	const char* client_socket = nullptr;
+	const char* cache_dir = nullptr;
+	uint64_t cache_max_size = CompileCache::DEFAULT_MAX_SIZE;
+	bool print_cache_stats = false;
+	std::vector<std::string> filenames;
 	int opt;
 
-	while ((opt = getopt(argc, argv, "pgsio")) != -1) {
+	while ((opt = getopt(argc, argv, "pgsioOfbj:d:m:L:c:C:M:ZTJ:")) != -1) {
 		switch (opt) {
 		case 'p':
 			mode = PRINT_AST;
@@ -63,45 +112,166 @@ int main(int argc, char** argv) {
 			mode = COMPILE_OPTIMIZED;
 			break;
 
+		case 'O':
+			mode = COMPILE_OPTIMIZED_MORE;
+			break;
+
+		case 'f':
+			fast_scanner = true;
+			break;
+
+		case 'b':
+			batch = true;
+			break;
+
+		case 'j':
+			batch_options.num_threads = unsigned(atoi(optarg));
+			break;
+
+		case 'd':
+			batch_options.output_dir = optarg;
+			break;
+
+		case 'm':
+			if (!batch_read_manifest(optarg, filenames)) {
+				err_fatal("Could not read manifest \"%s\"\n", optarg);
+			}
+			break;
+
+		case 'L':
+			server_socket = optarg;
+			break;
+
+		case 'c':
+			client_socket = optarg;
+			break;
+
+		case 'C':
+			cache_dir = optarg;
+			break;
+
+		case 'M':
+			cache_max_size = uint64_t(atoll(optarg)) << 20;
+			break;
+
+		case 'Z':
+			print_cache_stats = true;
+			break;
+
+		case 'T':
+			print_time_report = true;
+			break;
+
+		case 'J':
+			trace_filename = optarg;
+			break;
+
 		case '?':
 			print_usage();
 		}
 	}
 
+	// batch mode and the compile server only generate code
+	CompileOptions& compile_options = batch_options.compile;
+
+	std::unique_ptr<CompileCache> cache;
+	if (cache_dir) {
+		cache.reset(new CompileCache(cache_dir, cache_max_size));
+		if (!cache->open()) {
+			err_fatal("Could not create cache directory \"%s\"\n", cache_dir);
+		}
+		if (print_cache_stats) {
+			cache->print_stats(stdout);
+			return 0;
+		}
+		compile_options.cache = cache.get();
+	}
+	else if (print_cache_stats) {
+		print_usage();
+	}
+
+	if (server_socket) {
+		return server_run(server_socket, batch_options.num_threads, compile_options.cache);
+	}
+
+	if (mode == COMPILE_OPTIMIZED) compile_options.optimize_flag = 'o';
+	if (mode == COMPILE_OPTIMIZED_MORE) compile_options.optimize_flag = 'O';
+	compile_options.hand_written_scanner = fast_scanner;
+	const bool compile_only = mode == COMPILE || mode == COMPILE_OPTIMIZED || mode == COMPILE_OPTIMIZED_MORE;
+
+	if (batch) {
+		if (!compile_only) {
+			print_usage();
+		}
+		filenames.insert(filenames.end(), argv + optind, argv + argc);
+		if (!batch_options.output_dir.empty() && !cpputil::make_directories(batch_options.output_dir)) {
+			err_fatal("Could not create output directory \"%s\"\n", batch_options.output_dir.c_str());
+		}
+		return batch_compile(filenames, batch_options);
+	}
+
 	if (optind >= argc) {
 		print_usage();
 	}
 
 	const char* filename = argv[optind];
 
-	yyin = fopen(filename, "r");
-	if (!yyin) {
-		err_fatal("Could not open input file \"%s\"\n", filename);
+	if (print_time_report || trace_filename) {
+		time_report = new TimeReport;
+		TimeReport::set_current(time_report);
+		atexit(write_time_report);
 	}
-	lexer_set_source_file(filename);
 
-	yyparse();
+	if (client_socket && compile_only) {
+		const int status = server_compile(client_socket, filename, compile_options);
+		if (status >= 0) return status;
+	}
+
+	Unit unit(filename);
+	if (!unit.read()) {
+		err_fatal("Could not open input file \"%s\"\n", filename);
+	}
+	if (compile_options.cache && compile_only) {
+		std::string error;
+		if (!compile_unit(unit, compile_options, stdout, error)) {
+			err_fatal("%s\n", error.c_str());
+		}
+		return 0;
+	}
+	if (!unit.parse(fast_scanner)) {
+		err_fatal("%s\n", unit.get_error().c_str());
+	}
 
 	if (mode == PRINT_AST) {
-		treeprint(g_program, ast_get_tag_name);
+		treeprint(unit.get_root(), ast_get_tag_name);
 	}
 	else if (mode == PRINT_AST_GRAPH) {
-		ast_print_graph(g_program);
+		ast_print_graph(unit.get_root());
 	}
 	else {
-		struct Context* ctx = context_create(g_program);
+		struct Context* ctx = context_create(&unit);
+		int failed = 0;
 		if (mode == PRINT_SYMBOL_TABLE) {
 			context_set_flag(ctx, 's'); // tell Context to print symbol table info
-			context_build_symtab(ctx);
+			failed = context_build_symtab(ctx);
 		}
 		else if (mode == PRINT_HIGH_LEVEL) {
 			context_set_flag(ctx, 'i');
-			context_generate_hl_code(ctx);
+			failed = context_generate_hl_code(ctx);
 		}
 		else if (mode == COMPILE_OPTIMIZED) {
 			context_set_flag(ctx, 'o');
 		}
-		context_compile(ctx);
+		else if (mode == COMPILE_OPTIMIZED_MORE) {
+			context_set_flag(ctx, 'O');
+		}
+		if (!failed) {
+			failed = context_compile(ctx);
+		}
+		if (failed) {
+			err_fatal("%s\n", context_get_error(ctx));
+		}
+		context_destroy(ctx);
 	}
 
 	return 0;
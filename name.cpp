@@ -0,0 +1,71 @@
+#include <cassert>
+#include <cstring>
+#include "name.h"
+
+thread_local Name::Pool* Name::s_pool = nullptr;
+
+// The pool is an open-addressing hash table of interned entries with
+// linear probing, kept at most half full.
+Name::Pool::Pool(Arena& arena)
+	: m_arena(arena)
+	, m_slots(1024, nullptr)
+	, m_count(0) {
+}
+
+namespace {
+// FNV-1a
+size_t hash_str(const char* str, size_t length) {
+	size_t h = 14695981039346656037UL;
+	for (size_t i = 0; i < length; i++) {
+		h ^= (unsigned char) str[i];
+		h *= 1099511628211UL;
+	}
+	return h;
+}
+}
+
+Name::Name(const char* str): Name(str, std::strlen(str)) {}
+
+Name::Name(const char* str, size_t length): m_entry(intern(str, length)) {}
+
+Name::Name(const std::string& str): Name(str.data(), str.size()) {}
+
+void Name::set_pool(Pool* pool) {
+	s_pool = pool;
+}
+
+Name::Pool* Name::get_pool() {
+	return s_pool;
+}
+
+const Name::Entry* Name::intern(const char* str, size_t length) {
+	if (length == 0) return nullptr;
+	assert(s_pool);
+	Pool& pool = *s_pool;
+	const size_t hash = hash_str(str, length);
+	size_t mask = pool.m_slots.size() - 1;
+	size_t i = hash & mask;
+	for (; pool.m_slots[i]; i = (i + 1) & mask) {
+		const Entry* entry = pool.m_slots[i];
+		if (entry->hash == hash && entry->length == length && std::memcmp(entry->str, str, length) == 0) return entry;
+	}
+
+	const auto entry = static_cast<Entry*>(pool.m_arena.allocate(sizeof(Entry), alignof(Entry)));
+	entry->hash = hash;
+	entry->length = length;
+	entry->str = pool.m_arena.copy_str(str, length);
+	pool.m_slots[i] = entry;
+	if (++pool.m_count * 2 > pool.m_slots.size()) {
+		// rehash into a table twice the size
+		std::vector<const Entry*> slots(pool.m_slots.size() * 2, nullptr);
+		mask = slots.size() - 1;
+		for (const auto slot : pool.m_slots) {
+			if (!slot) continue;
+			size_t j = slot->hash & mask;
+			while (slots[j]) j = (j + 1) & mask;
+			slots[j] = slot;
+		}
+		pool.m_slots.swap(slots);
+	}
+	return entry;
+}
@@ -0,0 +1,79 @@
+#ifndef NAME_H
+#define NAME_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "arena.h"
+
+// A Name is a handle to an interned string: every distinct string is
+// stored exactly once, in a Pool, so two Names from the same Pool are
+// equal exactly when they refer to the same string and comparing them is
+// a pointer compare.  Identifiers are interned by the lexers (see
+// create_value_token), and Nodes, Symbols and RecordFields carry Names
+// rather than strings.  Each Unit has its own Pool, whose strings are
+// allocated from the Unit's Arena, so they are released along with the
+// AST, and a thread compiling one Unit after another doesn't grow.
+class Name {
+	struct Entry {
+		size_t hash;
+		size_t length;
+		const char* str; // NUL-terminated
+	};
+
+public:
+	// An open-addressing hash table of interned strings.  It is only used
+	// by one thread at a time, so it has no lock.
+	class Pool {
+		friend class Name;
+
+		Arena& m_arena;
+		std::vector<const Entry*> m_slots;
+		size_t m_count;
+
+		// copy ctor and assignment operator disallowed
+		Pool(const Pool&);
+		Pool& operator=(const Pool&);
+
+	public:
+		// entries and their characters are allocated from arena
+		explicit Pool(Arena& arena);
+
+		// number of distinct strings interned so far
+		size_t get_count() const { return m_count; }
+	};
+
+private:
+	static thread_local Pool* s_pool;
+
+	const Entry* m_entry; // nullptr for the empty string
+
+	explicit Name(const Entry* entry): m_entry(entry) {}
+
+public:
+	Name(): m_entry(nullptr) {}
+	Name(const char* str);
+	Name(const char* str, size_t length);
+	explicit Name(const std::string& str);
+
+	bool operator==(const Name& other) const { return m_entry == other.m_entry; }
+	bool operator!=(const Name& other) const { return m_entry != other.m_entry; }
+
+	bool empty() const { return !m_entry; }
+	size_t length() const { return m_entry ? m_entry->length : 0; }
+	const char* c_str() const { return m_entry ? m_entry->str : ""; }
+	std::string str() const { return std::string(c_str(), length()); }
+
+	// hash of the string, computed once when it was interned
+	size_t hash() const { return m_entry ? m_entry->hash : 0; }
+
+	// Strings are interned in the pool passed to the thread's last call of
+	// set_pool.  Names from different Pools must not be compared.
+	static void set_pool(Pool* pool);
+	static Pool* get_pool();
+
+private:
+	static const Entry* intern(const char* str, size_t length);
+};
+
+#endif // NAME_H
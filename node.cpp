@@ -1,6 +1,8 @@
 #include <cstdio>
 #include <cstdarg>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
 #include "util.h"
 /*
 #include "symbol.h"
@@ -14,142 +16,126 @@
 // C++ Node data type implementation
 ////////////////////////////////////////////////////////////////////////
 
+thread_local Arena *Node::s_arena = nullptr;
+thread_local unsigned Node::s_num_nodes = 0;
+
 Node::Node(int tag)
   : m_tag(tag)
-  , m_source_info { .filename = "<unknown file>", .line = -1, .col = -1 }
-  , m_ival(0L)
-  , m_symtab(nullptr)
-  , m_index(0)
-  , m_operand(nullptr)
-  , m_inverted(false)
+  , m_num_kids(0)
+  , m_kids(nullptr)
+  , m_id(s_num_nodes++)
+  , m_max_kids(0)
+  , m_loc(SOURCE_LOC_NONE)
  {
 }
 
 Node::~Node() {
 }
 
-int Node::get_tag() const {
-  return m_tag;
-}
-
-int Node::get_num_kids() const {
-  return int(m_kids.size());
-}
-
-void Node::add_kid(Node *kid) {
-  m_kids.push_back(kid);
-
-  // If the parent node doesn't yet have source info set,
-  // and the child has source info, copy the child's source info
-  if (m_source_info.line < 0 && kid->m_source_info.line > 0) {
-    m_source_info = kid->m_source_info;
-  }
-}
-
-void Node::prepend_kid(Node *kid) {
-  m_kids.insert(m_kids.begin(), kid);
-
-  // Copy child's source info, if it has valid source info
-  if (kid->m_source_info.line > 0) {
-    m_source_info = kid->m_source_info;
-  }
+void *Node::operator new(size_t size) {
+  assert(s_arena);
+  return s_arena->allocate(size, alignof(Node));
 }
 
-Node *Node::get_kid(int index) {
-  assert(index >= 0);
-  return m_kids.at(unsigned(index));
+void Node::set_arena(Arena *arena) {
+  s_arena = arena;
+  s_num_nodes = 0;
 }
 
-void Node::set_str(const std::string &s) {
-  m_strval = s;
+Arena *Node::get_arena() {
+  return s_arena;
 }
 
-const std::string &Node::get_str() const {
-  return m_strval;
+unsigned Node::get_num_nodes() {
+  return s_num_nodes;
 }
 
-SourceInfo Node::get_source_info() const {
-  return m_source_info;
+int Node::get_tag() const {
+  return m_tag;
 }
 
-void Node::set_source_info(const SourceInfo &source_info) {
-  m_source_info = source_info;
+unsigned Node::get_id() const {
+  return m_id;
 }
 
-long Node::get_ival() const {
-  return m_ival;
+int Node::get_num_kids() const {
+  return m_num_kids;
 }
 
-void Node::set_ival(long ival) {
-  m_ival = ival;
+// Make room for count kids in all.  A kid array that is outgrown is
+// abandoned in the arena, so it grows geometrically.
+void Node::reserve_kids(int count) {
+  if (count <= m_max_kids) {
+    return;
+  }
+  Node **kids = s_arena->allocate_array<Node *>(unsigned(count));
+  std::copy(m_kids, m_kids + m_num_kids, kids);
+  m_kids = kids;
+  m_max_kids = count;
 }
 
+void Node::add_kid(Node *kid) {
+  if (m_num_kids == m_max_kids) {
+    reserve_kids(std::max(4, 2 * m_max_kids));
+  }
+  m_kids[m_num_kids++] = kid;
 
-void Node::set_symtab(SymbolTable *symtab) {
-  m_symtab = symtab;
-}
-
-SymbolTable *Node::get_symtab() {
-  return m_symtab;
+  // If the parent node doesn't yet have a source location set,
+  // and the child has one, copy the child's source location
+  if (m_loc == SOURCE_LOC_NONE) {
+    m_loc = kid->m_loc;
+  }
 }
 
-void Node::set_index(unsigned index) {
-  m_index = index;
-}
+void Node::prepend_kid(Node *kid) {
+  if (m_num_kids == m_max_kids) {
+    reserve_kids(std::max(4, 2 * m_max_kids));
+  }
+  std::copy_backward(m_kids, m_kids + m_num_kids, m_kids + m_num_kids + 1);
+  m_kids[0] = kid;
+  m_num_kids++;
 
-unsigned Node::get_index() const {
-  return m_index;
+  // Copy child's source location, if it has one
+  if (kid->m_loc != SOURCE_LOC_NONE) {
+    m_loc = kid->m_loc;
+  }
 }
 
-void Node::set_symbol(SymbolTable *symtab, unsigned index) {
-  m_symtab = symtab;
-  m_index = index;
+Node *Node::get_kid(int index) {
+  assert(index >= 0 && index < m_num_kids);
+  return m_kids[index];
 }
 
-void Node::set_type(Type *type) {
-  m_type = type;
+void Node::set_str(const std::string &s) {
+  m_strval = Name(s);
 }
 
-Type *Node::get_type() {
-  // If the Node is directly annotated with a Type,
-  // return it
-  if (m_type) {
-    return m_type;
-  }
-
-  /*// If there is a symbol table entry, then return its type
-  Symbol *sym = node_get_symbol(this);
-  if (sym) {
-    return sym->get_type();
-  }*/
-
-  // no type is associated with this node
-  return nullptr;
+void Node::set_str(const char *s, size_t len) {
+  m_strval = Name(s, len);
 }
 
-void Node::set_operand(Operand* operand) {
-	m_operand = operand;
+std::string Node::get_str() const {
+  return m_strval.str();
 }
 
-Operand* Node::get_operand() {
-	return m_operand;
+const char *Node::get_cstr() const {
+  return m_strval.c_str();
 }
 
-void Node::set_inverted(bool inverted) {
-    m_inverted = inverted;
+void Node::set_name(Name name) {
+  m_strval = name;
 }
 
-bool Node::is_inverted()
-{
-    return m_inverted;
+Name Node::get_name() const {
+  return m_strval;
 }
 
-void Node::set_vregs_used(int vregs_used) {
-    m_vregs_used = vregs_used;
+SourceLoc Node::get_source_loc() const {
+  return m_loc;
 }
 
-int Node::get_num_vregs_used() {
-    return m_vregs_used;
+void Node::set_source_loc(SourceLoc loc) {
+  m_loc = loc;
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -162,20 +148,20 @@ struct Node *node_alloc(int tag) {
 
 struct Node *node_alloc_str_copy(int tag, const char *str_to_copy) {
   Node *n = new Node(tag);
-  n->set_str(str_to_copy);
+  n->set_str(str_to_copy, strlen(str_to_copy));
   return n;
 }
 
-struct Node *node_alloc_str_adopt(int tag, char *str_to_adopt) {
+struct Node *node_alloc_str_slice(int tag, const char *str, size_t length) {
   Node *n = new Node(tag);
-  n->set_str(str_to_adopt);
-  free(str_to_adopt);
+  n->set_str(str, length);
   return n;
 }
 
-struct Node *node_alloc_ival(int tag, long ival) {
+struct Node *node_alloc_str_adopt(int tag, char *str_to_adopt) {
   Node *n = new Node(tag);
-  n->set_ival(ival);
+  n->set_str(str_to_adopt, strlen(str_to_adopt));
+  free(str_to_adopt);
   return n;
 }
 
@@ -238,8 +224,18 @@ struct Node *node_build8(int tag,
 
 struct Node *node_buildn(int tag, ...) {
   va_list args;
-  va_start(args, tag);
   struct Node *n = node_alloc(tag);
+
+  // size the kid array exactly
+  int count = 0;
+  va_start(args, tag);
+  while (va_arg(args, struct Node *)) {
+    count++;
+  }
+  va_end(args);
+  n->reserve_kids(count);
+
+  va_start(args, tag);
   int done = 0;
   while (!done) {
     struct Node *child = (struct Node *) va_arg(args, struct Node *);
@@ -292,24 +288,12 @@ int node_first_kid_has_tag(struct Node *n, int tag) {
   return n->get_num_kids() > 0 && n->get_kid(0)->get_tag() == tag;
 }
 
-void node_set_source_info(struct Node *n, struct SourceInfo source_info) {
-  n->set_source_info(source_info);
-}
-
-struct SourceInfo node_get_source_info(struct Node *n) {
-  return n->get_source_info();
+void node_set_source_loc(struct Node *n, SourceLoc loc) {
+  n->set_source_loc(loc);
 }
 
 const char *node_get_str(struct Node *n) {
-  return n->get_str().c_str();
-}
-
-long node_get_ival(struct Node *n) {
-  return n->get_ival();
-}
-
-void node_set_ival(struct Node *n, long ival) {
-  n->set_ival(ival);
+  return n->get_cstr();
 }
 
 /*
@@ -3,20 +3,22 @@
 
 #ifdef __cplusplus
 
+#include <cstddef>
 #include <string>
 #include <vector>
-#include "symtab.h"
-#include "cfg.h"
+#include <algorithm>
+#include "arena.h"
+#include "name.h"
+
+#else
+
+#include <stddef.h>
 
 #endif // __cplusplus
 
 // Node datatype and functions
 
-// Source information structure.
-struct SourceInfo {
-	const char* filename;
-	int line, col;
-};
+#include "srcloc.h"
 
 struct Node;
 
@@ -25,57 +27,92 @@ struct Node;
 // Node data type exposed as a full C++ class.
 // The C functions from previous assignments still work,
 // and are retained for backwards compatibility.
+//
+// Nodes and their arrays of kids are allocated from the current thread's
+// Arena (see set_arena), so a whole tree is freed at once along with its
+// Arena, and threads can build trees independently.
+// Deleting a Node does nothing.  A Node's string value is an interned Name.
+//
+// A Node only holds what the parser builds: its tag, its kids, its source
+// position and its string value.  Each Node is numbered when it is
+// created, and the results of later phases (types, constant values,
+// operands, ...) are kept in NodeTables indexed by that number, owned by
+// the phases that produce them.
 struct Node {
 private:
+	static thread_local Arena* s_arena;
+	static thread_local unsigned s_num_nodes;
+
 	int m_tag;
-	std::vector<Node*> m_kids;
-	SourceInfo m_source_info;
-	long m_ival;
-	std::string m_strval;
-	SymbolTable* m_symtab;
-	unsigned m_index; // index of symbol table entry
-	Type* m_type;
-	Operand* m_operand;
-	bool m_inverted; // whether to compile an inverted comparison
-	int m_vregs_used; // how many vregs were used during address calculation
+	int m_num_kids;
+	Node** m_kids;
+	unsigned m_id;
+	int m_max_kids;
+	SourceLoc m_loc;
+	Name m_strval;
 
 	// copy ctor and assignment operator disallowed
 	Node(const Node&);
 	Node& operator=(const Node&);
 
 public:
-	using iterator = std::vector<Node*>::iterator;
+	using iterator = Node**;
 
 	Node(int tag);
 	~Node();
 
-	iterator begin() { return m_kids.begin(); }
-	iterator end() { return m_kids.end(); }
+	// Nodes are allocated from the arena passed to the thread's last call of
+	// set_arena, which also numbers the following Nodes from 0 again
+	static void* operator new(size_t size);
+	static void operator delete(void*) {}
+	static void set_arena(Arena* arena);
+	static Arena* get_arena();
+	// the number of Nodes created by this thread since set_arena, which is
+	// one more than the largest id
+	static unsigned get_num_nodes();
+
+	iterator begin() { return m_kids; }
+	iterator end() { return m_kids + m_num_kids; }
 
 	int get_tag() const;
+	unsigned get_id() const;
 	int get_num_kids() const;
+	void reserve_kids(int count);
 	void add_kid(Node* kid);
 	void prepend_kid(Node* kid);
 	Node* get_kid(int index);
 	void set_str(const std::string& s);
-	const std::string& get_str() const;
-	SourceInfo get_source_info() const;
-	void set_source_info(const SourceInfo& source_info);
-	long get_ival() const;
-	void set_ival(long ival);
-	void set_symtab(SymbolTable* symtab);
-	SymbolTable* get_symtab();
-	void set_index(unsigned index);
-	unsigned get_index() const;
-	void set_symbol(SymbolTable* symtab, unsigned index);
-	void set_type(Type* type);
-	Type* get_type();
-	void set_operand(Operand* operand);
-	Operand* get_operand();
-	void set_inverted(bool inverted);
-	bool is_inverted();
-	void set_vregs_used(int vregs_used);
-	int get_num_vregs_used();
+	void set_str(const char* s, size_t len);
+	std::string get_str() const;
+	const char* get_cstr() const;
+	void set_name(Name name);
+	Name get_name() const;
+	SourceLoc get_source_loc() const;
+	void set_source_loc(SourceLoc loc);
+};
+
+// A value of type T for each Node, indexed by Node id.  The table is
+// allocated for all Nodes the first time a value is set, so a phase only
+// pays for the annotations it actually records; Nodes without a value
+// read as the default value.
+template<typename T>
+class NodeTable {
+	std::vector<T> m_values;
+	T m_default;
+
+public:
+	explicit NodeTable(T default_value = T()): m_default(default_value) {}
+
+	T get(const Node* n) const {
+		const unsigned id = n->get_id();
+		return id < m_values.size() ? m_values[id] : m_default;
+	}
+
+	void set(const Node* n, T value) {
+		const unsigned id = n->get_id();
+		if (id >= m_values.size()) m_values.resize(std::max(id + 1, Node::get_num_nodes()), m_default);
+		m_values[id] = value;
+	}
 };
 
 extern "C" {
@@ -90,13 +127,14 @@ struct Node* node_alloc(int tag);
 // Create a node with a string value by copying a specified string.
 struct Node* node_alloc_str_copy(int tag, const char* str_to_copy);
 
+// Create a node whose string value is the first length characters of
+// str, which need not be NUL-terminated.
+struct Node* node_alloc_str_slice(int tag, const char* str, size_t length);
+
 // Create a node with a string value by adopting specific string,
 // which will be freed when the Node is destroyed.
 struct Node* node_alloc_str_adopt(int tag, char* str_to_adopt);
 
-// Create a node with a given integer value.
-struct Node* node_alloc_ival(int tag, long ival);
-
 // Convenience functions to create a Node with specified tag value
 // and pointers to children.
 struct Node* node_build0(int tag);
@@ -125,7 +163,7 @@ struct Node* node_build8(int tag,
 // The sequence of child pointers should be terminated with a null pointer.
 struct Node* node_buildn(int tag, ...);
 
-// Destroy a Node.
+// Destroy a Node.  Its memory is only released along with its Arena.
 void node_destroy(struct Node* n);
 
 // Recursively destroy a tree of Nodes.
@@ -147,21 +185,12 @@ void node_prepend_kid(struct Node* n, struct Node* kid);
 struct Node* node_get_kid(struct Node* n, int index);
 int node_first_kid_has_tag(struct Node* n, int tag);
 
-// Set the SourceInfo for a Node.
-void node_set_source_info(struct Node* n, struct SourceInfo source_info);
-
-// Get the SourceInfo for a Node.
-struct SourceInfo node_get_source_info(struct Node* n);
+// Set the source location of a Node.
+void node_set_source_loc(struct Node* n, SourceLoc loc);
 
 // Get the string value of a Node.
 const char* node_get_str(struct Node* n);
 
-// Get integer value of a Node.
-long node_get_ival(struct Node* n);
-
-// Set integer value of a Node.
-void node_set_ival(struct Node* n, long ival);
-
 /*
 // Set symbol table, entry
 void node_set_symbol(struct Node *n, struct SymbolTable *symtab, unsigned index);
@@ -1,18 +1,24 @@
 %{
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdarg.h>
 #include "grammar_symbols.h"
 #include "util.h"
 #include "ast.h"
 #include "node.h"
+#include "unit.h"
+%}
 
-struct Node *g_program;
+%code requires {
+struct Unit;
+}
 
-void yyerror(const char *fmt, ...);
+%code {
+int yylex(YYSTYPE *lvalp, struct Unit *unit);
+void yyerror(struct Unit *unit, const char *msg);
+}
 
-int yylex(void);
-%}
+%define api.pure full
+%param {struct Unit *unit}
 
 %error-verbose
 
@@ -43,7 +49,7 @@ int yylex(void);
 
 program
   : TOK_PROGRAM TOK_IDENT TOK_SEMICOLON opt_declarations TOK_BEGIN opt_instructions TOK_END TOK_DOT
-  { g_program = $$ = node_build3(AST_PROGRAM, $2, $4, $6); }
+  { $$ = node_build3(AST_PROGRAM, $2, $4, $6); unit_set_root(unit, $$); }
   ;
 
 opt_declarations
@@ -53,7 +59,7 @@ opt_declarations
   
 declarations
   : declaration { $$ = node_build1(AST_DECLARATIONS, $1); }
-  | declaration declarations { $$ = node_build2(AST_DECLARATIONS, $1, $2); }
+  | declarations declaration { $$ = $1; node_add_kid($$, $2); }
   ;
   
 declaration
@@ -68,7 +74,7 @@ constdecl
   
 constdefn_list
   : constdefn { $$ = node_build1(AST_CONSTANT_DECLARATIONS, $1); }
-  | constdefn constdefn_list { $$ = node_build2(AST_CONSTANT_DECLARATIONS, $1, $2); }
+  | constdefn_list constdefn { $$ = $1; node_add_kid($$, $2); }
   ;
   
 constdefn
@@ -81,7 +87,7 @@ vardecl
   
 vardefn_list
   : vardefn { $$ = node_build1(AST_VAR_DECLARATIONS, $1); }
-  | vardefn vardefn_list { $$ = node_build2(AST_VAR_DECLARATIONS, $1, $2); }
+  | vardefn_list vardefn { $$ = $1; node_add_kid($$, $2); }
   ;
   
 vardefn
@@ -90,7 +96,7 @@ vardefn
 
 identifier_list
   : TOK_IDENT { $$ = node_build1(AST_IDENTIFIER_LIST, $1); }
-  | TOK_IDENT TOK_COMMA identifier_list { $$ = node_build2(AST_IDENTIFIER_LIST, $1, $3); }
+  | identifier_list TOK_COMMA TOK_IDENT { $$ = $1; node_add_kid($$, $3); }
   ;
 
 typedecl
@@ -99,7 +105,7 @@ typedecl
   
 typedefn_list
   : typedefn { $$ = node_build1(AST_TYPE_DECLARATIONS, $1); }
-  | typedefn typedefn_list { $$ = node_build2(AST_TYPE_DECLARATIONS, $1, $2); }
+  | typedefn_list typedefn { $$ = $1; node_add_kid($$, $2); }
   ;
   
 typedefn 
@@ -114,7 +120,7 @@ type
   
 expression_list
   : expression { $$ = node_build1(AST_EXPRESSION_LIST, $1); }
-  | expression TOK_COMMA expression_list { $$ = node_build2(AST_EXPRESSION_LIST, $1, $3); }
+  | expression_list TOK_COMMA expression { $$ = $1; node_add_kid($$, $3); }
   ;
   
 expression
@@ -148,8 +154,8 @@ opt_instructions
   ;
   
 instructions
-  : instruction { $$ = $1; }
-  | instruction instructions { $$ = node_build2(AST_INSTRUCTIONS, $1, $2); } // TODO: reduce by 1
+  : instruction { $$ = node_build1(AST_INSTRUCTIONS, $1); }
+  | instructions instruction { $$ = $1; node_add_kid($$, $2); }
   ;
   
 instruction
@@ -202,17 +208,7 @@ designator
   ;
 %%
 
-void yyerror(const char *fmt, ...) {
-  extern char *g_srcfile;
-  extern int yylineno, g_col;
-
-  va_list args;
-
-  va_start(args, fmt);
-  fprintf(stderr, "%s:%d:%d: Error: ", g_srcfile, yylineno, g_col);
-  vfprintf(stderr, fmt, args);
-  fprintf(stderr, "\n");
-  va_end(args);
-
-  exit(1);
+void yyerror(struct Unit *unit, const char *msg) {
+  // report the end of the text scanned so far
+  unit_error(unit, "%s", msg);
 }
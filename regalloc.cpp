@@ -0,0 +1,610 @@
+#include <cassert>
+#include <algorithm>
+#include <cmath>
+#include "highlevel.h"
+#include "dominators.h"
+#include "loops.h"
+#include "x86_64.h"
+#include "regalloc.h"
+
+////////////////////////////////////////////////////////////////////////
+// RegisterAllocator implementation
+////////////////////////////////////////////////////////////////////////
+
+RegisterAllocator::RegisterAllocator(ControlFlowGraph* cfg, int num_vregs)
+	: m_cfg(cfg)
+	  , m_iseq(nullptr)
+	  , m_live_vregs(nullptr)
+	  , m_num_vregs(num_vregs) {}
+
+RegisterAllocator::~RegisterAllocator() {
+	delete m_live_vregs;
+	delete m_iseq;
+}
+
+void RegisterAllocator::allocate() {
+	m_iseq = m_cfg->create_instruction_sequence(&m_block_order);
+	for (int i = 0; i < m_num_vregs; i++)
+		m_intervals.push_back({ i, -1, -1, -1 });
+	m_live_vregs = new LiveVregs(m_cfg);
+	m_live_vregs->execute();
+	build_intervals();
+	assign_registers();
+}
+
+InstructionSequence* RegisterAllocator::get_iseq() const {
+	return m_iseq;
+}
+
+int RegisterAllocator::get_mreg(int vreg) const {
+	if (vreg < 0 || vreg >= int(m_intervals.size())) return -1;
+	return m_intervals[vreg].mreg;
+}
+
+const std::vector<int>& RegisterAllocator::get_callee_saved_used() const {
+	return m_callee_saved_used;
+}
+
+int RegisterAllocator::get_num_allocated() const {
+	return int(std::count_if(m_intervals.begin(), m_intervals.end(),
+	                         [](const LiveInterval& interval) { return interval.mreg >= 0; }));
+}
+
+bool RegisterAllocator::is_callee_saved(int mreg) {
+	const auto& regs = get_callee_saved_regs();
+	return std::find(regs.begin(), regs.end(), mreg) != regs.end();
+}
+
+const std::vector<int>& RegisterAllocator::get_caller_saved_regs() {
+	// %rax, %rdx, %rdi, %rsi, %r10 and %r11 are used by the code templates
+	static const std::vector<int> regs = { MREG_RCX, MREG_R8, MREG_R9 };
+	return regs;
+}
+
+const std::vector<int>& RegisterAllocator::get_callee_saved_regs() {
+	static const std::vector<int> regs = { MREG_RBX, MREG_R12, MREG_R13, MREG_R14, MREG_R15, MREG_RBP };
+	return regs;
+}
+
+void RegisterAllocator::mark_used(int mreg) {
+	if (is_callee_saved(mreg) &&
+		std::find(m_callee_saved_used.begin(), m_callee_saved_used.end(), mreg) == m_callee_saved_used.end())
+		m_callee_saved_used.push_back(mreg);
+}
+
+void RegisterAllocator::build_intervals() {
+	// Values flowing into or out of a block are live at its boundaries.
+	// The boundaries come in increasing order of position, so only the
+	// first and last boundary at which a vreg is live can extend its
+	// interval; those are where it enters and leaves the live set, and
+	// visiting just the differences between consecutive boundaries avoids
+	// touching every live vreg (usually every variable) at every block.
+	const LiveVregs::LiveSet none;
+	const LiveVregs::LiveSet* prev = &none;
+	int prev_pos = -1;
+	const auto boundary = [&](const LiveVregs::LiveSet& live, int pos) {
+		const LiveVregs::LiveSet entered = live - *prev, left = *prev - live;
+		for (int v = entered.find_next(0); v >= 0; v = entered.find_next(v + 1)) extend(v, pos);
+		for (int v = left.find_next(0); v >= 0; v = left.find_next(v + 1)) extend(v, prev_pos);
+		prev = &live;
+		prev_pos = pos;
+	};
+	unsigned base = 0; // index of the first instruction of the current block
+	for (const auto bb : m_block_order) {
+		const unsigned len = bb->get_length();
+		if (len == 0) continue;
+		boundary(m_live_vregs->get_fact_at_beginning_of_block(bb), int(2 * base));
+		boundary(m_live_vregs->get_fact_at_end_of_block(bb), int(2 * (base + len) - 1));
+		// within the block, intervals are bounded by defs and uses
+		for (unsigned j = 0; j < len; j++) {
+			const Instruction* ins = bb->get_instruction(j);
+			const unsigned index = base + j;
+			if (HighLevel::is_def(ins)) extend(ins->get_operand(0).get_base_reg(), int(2 * index + 1));
+			for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+				if (!HighLevel::is_use(ins, k)) continue;
+				const Operand op = ins->get_operand(k);
+				if (op.has_base_reg()) extend(op.get_base_reg(), int(2 * index));
+				if (op.has_index_reg()) extend(op.get_index_reg(), int(2 * index));
+			}
+		}
+		base += len;
+	}
+	boundary(none, -1);
+	assert(base == m_iseq->get_length());
+}
+
+void RegisterAllocator::extend(int vreg, int pos) {
+	assert(vreg >= 0 && vreg < m_num_vregs);
+	LiveInterval& interval = m_intervals[vreg];
+	if (interval.start < 0) {
+		interval.start = interval.end = pos;
+		return;
+	}
+	interval.start = std::min(interval.start, pos);
+	interval.end = std::max(interval.end, pos);
+}
+
+////////////////////////////////////////////////////////////////////////
+// LinearScanRegisterAllocator implementation
+////////////////////////////////////////////////////////////////////////
+
+void LinearScanRegisterAllocator::assign_registers() {
+	std::vector<LiveInterval*> order;
+	for (auto& interval : m_intervals) {
+		if (interval.start >= 0) order.push_back(&interval);
+	}
+	std::stable_sort(order.begin(), order.end(),
+	                 [](const LiveInterval* a, const LiveInterval* b) { return a->start < b->start; });
+
+	std::vector<int> free_regs(get_caller_saved_regs());
+	free_regs.insert(free_regs.end(), get_callee_saved_regs().begin(), get_callee_saved_regs().end());
+	// intervals currently holding a register, sorted by increasing end
+	std::vector<LiveInterval*> active;
+	const auto by_end = [](const LiveInterval* a, const LiveInterval* b) { return a->end < b->end; };
+
+	for (const auto current : order) {
+		// expire intervals that ended before this one starts
+		while (!active.empty() && active.front()->end < current->start) {
+			free_regs.push_back(active.front()->mreg);
+			active.erase(active.begin());
+		}
+		int mreg = take_free_reg(free_regs);
+		if (mreg < 0) {
+			// no register is free: spill whichever interval ends last
+			LiveInterval* victim = active.back();
+			if (victim->end <= current->end) continue; // current stays in memory
+			mreg = victim->mreg;
+			victim->mreg = -1;
+			active.pop_back();
+		}
+		current->mreg = mreg;
+		mark_used(mreg);
+		active.insert(std::upper_bound(active.begin(), active.end(), current, by_end), current);
+	}
+}
+
+// Caller-saved registers are preferred, since the callee-saved ones cost a
+// push and a pop.  (READ and WRITE call into the I/O runtime, which
+// preserves every allocatable register.)
+int LinearScanRegisterAllocator::take_free_reg(std::vector<int>& free_regs) {
+	for (const auto candidates : { &get_caller_saved_regs(), &get_callee_saved_regs() }) {
+		for (const int mreg : *candidates) {
+			const auto found = std::find(free_regs.begin(), free_regs.end(), mreg);
+			if (found != free_regs.end()) {
+				free_regs.erase(found);
+				return mreg;
+			}
+		}
+	}
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////
+// GraphColoringRegisterAllocator implementation
+////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const unsigned NUM_REGS = 9; // caller-saved and callee-saved registers
+const unsigned INITIAL_EDGE_TABLE_SIZE = 1024; // must be a power of 2
+const unsigned MAX_PRESSURE = 128; // vregs in the graph live at once
+
+// heap order for the spill worklist: the smallest cost / degree on top
+bool spill_heap_order(const std::pair<double, int>& a, const std::pair<double, int>& b) {
+	return a > b;
+}
+
+}
+
+int GraphColoringRegisterAllocator::get_num_coalesced() const {
+	return int(std::count(m_state.begin(), m_state.end(), NODE_COALESCED));
+}
+
+void GraphColoringRegisterAllocator::assign_registers() {
+	assert(NUM_REGS == get_caller_saved_regs().size() + get_callee_saved_regs().size());
+	m_edges.assign(INITIAL_EDGE_TABLE_SIZE, 0);
+	m_num_edges = 0;
+	m_adj.assign(m_num_vregs, std::vector<int>());
+	m_degree.assign(m_num_vregs, 0);
+	m_state.assign(m_num_vregs, NODE_UNUSED);
+	m_alias.resize(m_num_vregs);
+	for (int v = 0; v < m_num_vregs; v++) m_alias[v] = v;
+	m_spill_cost.assign(m_num_vregs, 0.0);
+	m_move_list.assign(m_num_vregs, std::vector<int>());
+	m_prespilled = LiveVregs::LiveSet();
+
+	compute_spill_costs();
+	limit_pressure();
+	build_graph();
+	make_worklists();
+	for (;;) {
+		if (!m_simplify_worklist.empty()) simplify();
+		else if (!m_move_worklist.empty()) coalesce();
+		else if (!m_freeze_worklist.empty()) freeze();
+		else if (!m_spill_worklist.empty()) select_spill();
+		else break;
+	}
+	assign_colors();
+}
+
+// Spill weights use the depth of each block in the loop-nest forest, so
+// a vreg used in an inner loop costs more to spill than one used outside.
+std::vector<unsigned> GraphColoringRegisterAllocator::compute_loop_depths() const {
+	Dominators dom(m_cfg);
+	dom.execute();
+	LoopForest loops(m_cfg, &dom);
+	loops.execute();
+	std::vector<unsigned> depths;
+	depths.reserve(m_iseq->get_length());
+	for (const auto bb : m_block_order) depths.insert(depths.end(), bb->get_length(), loops.get_depth(bb));
+	return depths;
+}
+
+// the uses and defs of each vreg, weighted by 10^loop depth
+void GraphColoringRegisterAllocator::compute_spill_costs() {
+	const std::vector<unsigned> depths = compute_loop_depths();
+	for (unsigned i = 0; i < m_iseq->get_length(); i++) {
+		const Instruction* ins = m_iseq->get_instruction(i);
+		const double weight = std::pow(10.0, std::min(depths[i], 8u));
+		if (HighLevel::is_def(ins)) m_spill_cost[ins->get_operand(0).get_base_reg()] += weight;
+		for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+			if (!HighLevel::is_use(ins, k)) continue;
+			const Operand op = ins->get_operand(k);
+			if (op.has_base_reg()) m_spill_cost[op.get_base_reg()] += weight;
+			if (op.has_index_reg()) m_spill_cost[op.get_index_reg()] += weight;
+		}
+	}
+}
+
+// The graph has an edge between every pair of vregs live at once, so where
+// many more vregs are live than there are registers, it grows with the
+// square of their number.  Sweeping the live intervals like linear scan,
+// whenever more than MAX_PRESSURE of them overlap, the one with the lowest
+// spill cost per position is spilled up front and left out of the graph.
+// Most of the vregs live at such a point spill anyway, and the graph then
+// has at most MAX_PRESSURE edges per def.
+void GraphColoringRegisterAllocator::limit_pressure() {
+	std::vector<LiveInterval*> order;
+	for (auto& interval : m_intervals) {
+		if (interval.start >= 0) order.push_back(&interval);
+	}
+	std::stable_sort(order.begin(), order.end(),
+	                 [](const LiveInterval* a, const LiveInterval* b) { return a->start < b->start; });
+	const auto density = [this](const LiveInterval* interval) {
+		return m_spill_cost[interval->vreg] / (interval->end - interval->start + 1);
+	};
+	// overlapping intervals, sorted by increasing end
+	std::vector<LiveInterval*> active;
+	const auto by_end = [](const LiveInterval* a, const LiveInterval* b) { return a->end < b->end; };
+	for (const auto current : order) {
+		const auto expired = std::find_if(active.begin(), active.end(),
+		                                  [current](const LiveInterval* a) { return a->end >= current->start; });
+		active.erase(active.begin(), expired);
+		active.insert(std::upper_bound(active.begin(), active.end(), current, by_end), current);
+		if (active.size() <= MAX_PRESSURE) continue;
+		const auto victim = std::min_element(active.begin(), active.end(),
+		                                     [&density](const LiveInterval* a, const LiveInterval* b) {
+			                                     return density(a) < density(b);
+		                                     });
+		m_state[(*victim)->vreg] = NODE_PRESPILLED;
+		m_prespilled.set((*victim)->vreg);
+		active.erase(victim);
+	}
+}
+
+void GraphColoringRegisterAllocator::build_graph() {
+	for (const auto bb : m_block_order) {
+		if (bb->get_length() == 0) continue;
+		// walk backwards through the block, keeping track of the live vregs
+		// which are in the graph
+		LiveVregs::LiveSet live = m_live_vregs->get_fact_at_end_of_block(bb) - m_prespilled;
+		for (unsigned j = bb->get_length(); j-- > 0;) {
+			const Instruction* ins = bb->get_instruction(j);
+			if (HighLevel::is_def(ins) && m_state[ins->get_operand(0).get_base_reg()] != NODE_PRESPILLED) {
+				const int dest = ins->get_operand(0).get_base_reg();
+				// the source of a copy doesn't interfere with its destination
+				int src = -1;
+				if (ins->get_opcode() == HINS_MOV && ins->get_operand(1).get_kind() == OPERAND_VREG &&
+				    m_state[ins->get_operand(1).get_base_reg()] != NODE_PRESPILLED) {
+					src = ins->get_operand(1).get_base_reg();
+					if (src != dest) {
+						const int move = int(m_moves.size());
+						m_moves.push_back({ dest, src, MOVE_WORKLIST });
+						m_move_list[dest].push_back(move);
+						m_move_list[src].push_back(move);
+					}
+				}
+				for (int v = live.find_next(0); v >= 0; v = live.find_next(v + 1)) {
+					if (v != dest && v != src) add_edge(dest, v);
+				}
+				live.reset(dest);
+			}
+			for (unsigned k = 0; k < ins->get_num_operands(); k++) {
+				if (!HighLevel::is_use(ins, k)) continue;
+				const Operand op = ins->get_operand(k);
+				if (op.has_base_reg() && m_state[op.get_base_reg()] != NODE_PRESPILLED) live.set(op.get_base_reg());
+				if (op.has_index_reg() && m_state[op.get_index_reg()] != NODE_PRESPILLED) live.set(op.get_index_reg());
+			}
+		}
+	}
+}
+
+// returns the slot holding key, or the empty slot where it would be inserted
+unsigned GraphColoringRegisterAllocator::find_edge_slot(uint64_t key) const {
+	const unsigned mask = m_edges.size() - 1;
+	unsigned slot = unsigned((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+	while (m_edges[slot] != 0 && m_edges[slot] != key) slot = (slot + 1) & mask;
+	return slot;
+}
+
+void GraphColoringRegisterAllocator::grow_edges() {
+	std::vector<uint64_t> old(m_edges.size() * 2, 0);
+	old.swap(m_edges);
+	for (const uint64_t key : old) {
+		if (key != 0) m_edges[find_edge_slot(key)] = key;
+	}
+}
+
+// returns false if the edge was already there
+bool GraphColoringRegisterAllocator::add_edge(int a, int b) {
+	if (a == b) return false;
+	const uint64_t key = uint64_t(std::min(a, b)) << 32 | uint64_t(std::max(a, b));
+	const unsigned slot = find_edge_slot(key);
+	if (m_edges[slot] == key) return false;
+	m_edges[slot] = key;
+	// keep the load factor at or below 1/2
+	if (++m_num_edges * 2 > m_edges.size()) grow_edges();
+	m_adj[a].push_back(b);
+	m_adj[b].push_back(a);
+	m_degree[a]++;
+	m_degree[b]++;
+	// a higher degree makes a node a cheaper spill
+	if (m_state[a] == NODE_SPILL) push_spill(a);
+	if (m_state[b] == NODE_SPILL) push_spill(b);
+	return true;
+}
+
+bool GraphColoringRegisterAllocator::interferes(int a, int b) const {
+	const uint64_t key = uint64_t(std::min(a, b)) << 32 | uint64_t(std::max(a, b));
+	return m_edges[find_edge_slot(key)] == key;
+}
+
+void GraphColoringRegisterAllocator::make_worklists() {
+	for (int v = 0; v < m_num_vregs; v++) {
+		if (m_intervals[v].start < 0 || m_state[v] == NODE_PRESPILLED) continue;
+		if (m_degree[v] >= NUM_REGS) {
+			m_state[v] = NODE_SPILL;
+			push_spill(v);
+		}
+		else if (is_move_related(v)) {
+			m_state[v] = NODE_FREEZE;
+			m_freeze_worklist.push_back(v);
+		}
+		else {
+			push_simplify(v);
+		}
+	}
+	for (int i = int(m_moves.size()); i-- > 0;) m_move_worklist.push_back(i);
+	m_significant.assign(m_num_vregs, 0);
+	for (int v = 0; v < m_num_vregs; v++) {
+		if (m_degree[v] >= NUM_REGS) count_significant(v, 1);
+	}
+}
+
+// adds delta to the number of significant neighbors of each neighbor of
+// node which is still in the graph, when node becomes significant (+1) or
+// stops being significant or leaves the graph (-1)
+void GraphColoringRegisterAllocator::count_significant(int node, int delta) {
+	for (const int n : m_adj[node]) {
+		if (m_state[n] != NODE_SELECTED && m_state[n] != NODE_COALESCED) m_significant[n] += delta;
+	}
+}
+
+// true if the node has a move which might still be coalesced
+bool GraphColoringRegisterAllocator::is_move_related(int node) const {
+	return std::any_of(m_move_list[node].begin(), m_move_list[node].end(), [this](int move) {
+		return m_moves[move].state == MOVE_WORKLIST || m_moves[move].state == MOVE_ACTIVE;
+	});
+}
+
+void GraphColoringRegisterAllocator::push_simplify(int node) {
+	m_state[node] = NODE_SIMPLIFY;
+	m_simplify_worklist.push_back(node);
+}
+
+// A node is pushed again when its degree goes up, since that lowers its
+// priority.  Other changes only raise it, and select_spill pushes an entry
+// whose priority is out of date back with the current one.
+void GraphColoringRegisterAllocator::push_spill(int node) {
+	m_spill_worklist.emplace_back(m_spill_cost[node] / m_degree[node], node);
+	std::push_heap(m_spill_worklist.begin(), m_spill_worklist.end(), spill_heap_order);
+}
+
+void GraphColoringRegisterAllocator::push_move(int move) {
+	m_moves[move].state = MOVE_WORKLIST;
+	m_move_worklist.push_back(move);
+}
+
+void GraphColoringRegisterAllocator::simplify() {
+	const int node = m_simplify_worklist.back();
+	m_simplify_worklist.pop_back();
+	if (m_state[node] != NODE_SIMPLIFY) return;
+	m_state[node] = NODE_SELECTED;
+	m_select_stack.push_back(node);
+	if (m_degree[node] >= NUM_REGS) count_significant(node, -1);
+	for (const int n : m_adj[node]) {
+		if (m_state[n] != NODE_SELECTED && m_state[n] != NODE_COALESCED) decrement_degree(n);
+	}
+}
+
+void GraphColoringRegisterAllocator::decrement_degree(int node) {
+	const unsigned degree = m_degree[node]--;
+	if (degree != NUM_REGS) return;
+	count_significant(node, -1);
+	if (m_state[node] != NODE_SPILL) return;
+	// the node and its neighbors' copies may now be coalesced safely
+	enable_moves(node);
+	for (const int n : m_adj[node]) {
+		if (m_state[n] != NODE_SELECTED && m_state[n] != NODE_COALESCED) enable_moves(n);
+	}
+	if (is_move_related(node)) {
+		m_state[node] = NODE_FREEZE;
+		m_freeze_worklist.push_back(node);
+	}
+	else {
+		push_simplify(node);
+	}
+}
+
+void GraphColoringRegisterAllocator::enable_moves(int node) {
+	for (const int move : m_move_list[node]) {
+		if (m_moves[move].state == MOVE_ACTIVE) push_move(move);
+	}
+}
+
+void GraphColoringRegisterAllocator::coalesce() {
+	const int move = m_move_worklist.back();
+	m_move_worklist.pop_back();
+	if (m_moves[move].state != MOVE_WORKLIST) return;
+	int a = get_alias(m_moves[move].dest), b = get_alias(m_moves[move].src);
+	// merge the node with fewer neighbors into the one with more
+	if (m_adj[a].size() < m_adj[b].size()) std::swap(a, b);
+	if (a == b) {
+		m_moves[move].state = MOVE_COALESCED;
+		add_worklist(a);
+	}
+	else if (interferes(a, b)) {
+		m_moves[move].state = MOVE_CONSTRAINED;
+		add_worklist(a);
+		add_worklist(b);
+	}
+	else if (briggs_test(a, b)) {
+		m_moves[move].state = MOVE_COALESCED;
+		combine(a, b);
+		add_worklist(a);
+	}
+	else {
+		m_moves[move].state = MOVE_ACTIVE;
+	}
+}
+
+// the node a vreg was coalesced into, halving the path to it
+int GraphColoringRegisterAllocator::get_alias(int node) {
+	while (m_alias[node] != node) {
+		m_alias[node] = m_alias[m_alias[node]];
+		node = m_alias[node];
+	}
+	return node;
+}
+
+// a node with no more copies to coalesce can be simplified, if its degree
+// is low enough
+void GraphColoringRegisterAllocator::add_worklist(int node) {
+	if (m_state[node] == NODE_FREEZE && !is_move_related(node)) push_simplify(node);
+}
+
+// Briggs' test: merging a and b is safe if the merged node has fewer than
+// K neighbors of significant degree, since it will then still simplify.
+// A neighbor of both is only counted once, so the neighbors only have to
+// be visited when a and b have fewer than K each but not in total.  (A
+// copy of a long-lived vreg is retried whenever any of the vreg's many
+// neighbors drops below K, so the test has to be cheap.)
+bool GraphColoringRegisterAllocator::briggs_test(int a, int b) const {
+	if (m_significant[a] >= NUM_REGS || m_significant[b] >= NUM_REGS) return false;
+	if (m_significant[a] + m_significant[b] < NUM_REGS) return true;
+	unsigned significant = m_significant[a];
+	for (const int n : m_adj[b]) {
+		if (m_state[n] == NODE_SELECTED || m_state[n] == NODE_COALESCED || m_degree[n] < NUM_REGS) continue;
+		if (interferes(n, a)) continue;
+		if (++significant >= NUM_REGS) return false;
+	}
+	return true;
+}
+
+void GraphColoringRegisterAllocator::combine(int a, int b) {
+	m_state[b] = NODE_COALESCED;
+	m_alias[b] = a;
+	// (the union is symmetric, so append the shorter list to the longer)
+	if (m_move_list[a].size() < m_move_list[b].size()) std::swap(m_move_list[a], m_move_list[b]);
+	m_move_list[a].insert(m_move_list[a].end(), m_move_list[b].begin(), m_move_list[b].end());
+	std::vector<int>().swap(m_move_list[b]);
+	enable_moves(b);
+	m_spill_cost[a] += m_spill_cost[b];
+	if (m_degree[b] >= NUM_REGS) count_significant(b, -1);
+	for (const int n : m_adj[b]) {
+		if (m_state[n] == NODE_SELECTED || m_state[n] == NODE_COALESCED) continue;
+		const bool a_significant = m_degree[a] >= NUM_REGS, n_significant = m_degree[n] >= NUM_REGS;
+		if (add_edge(n, a)) {
+			if (a_significant) m_significant[n]++;
+			else if (m_degree[a] == NUM_REGS) count_significant(a, 1);
+			if (n_significant) m_significant[a]++;
+			else if (m_degree[n] == NUM_REGS) count_significant(n, 1);
+		}
+		decrement_degree(n);
+	}
+	if (m_degree[a] >= NUM_REGS && m_state[a] == NODE_FREEZE) {
+		m_state[a] = NODE_SPILL;
+		push_spill(a);
+	}
+}
+
+void GraphColoringRegisterAllocator::freeze() {
+	const int node = m_freeze_worklist.back();
+	m_freeze_worklist.pop_back();
+	if (m_state[node] != NODE_FREEZE) return;
+	push_simplify(node);
+	freeze_moves(node);
+}
+
+// give up on coalescing the node's copies
+void GraphColoringRegisterAllocator::freeze_moves(int node) {
+	for (const int move : m_move_list[node]) {
+		Move& m = m_moves[move];
+		if (m.state != MOVE_WORKLIST && m.state != MOVE_ACTIVE) continue;
+		m.state = MOVE_FROZEN;
+		const int dest = get_alias(m.dest), src = get_alias(m.src);
+		const int other = dest == get_alias(node) ? src : dest;
+		if (m_state[other] == NODE_FREEZE && m_degree[other] < NUM_REGS && !is_move_related(other))
+			push_simplify(other);
+	}
+}
+
+void GraphColoringRegisterAllocator::select_spill() {
+	std::pop_heap(m_spill_worklist.begin(), m_spill_worklist.end(), spill_heap_order);
+	const std::pair<double, int> top = m_spill_worklist.back();
+	m_spill_worklist.pop_back();
+	const int node = top.second;
+	if (m_state[node] != NODE_SPILL) return;
+	if (top.first != m_spill_cost[node] / m_degree[node]) {
+		push_spill(node);
+		return;
+	}
+	push_simplify(node);
+	freeze_moves(node);
+}
+
+void GraphColoringRegisterAllocator::assign_colors() {
+	// select: nodes pushed as potential spills may still find a color
+	while (!m_select_stack.empty()) {
+		const int node = m_select_stack.back();
+		m_select_stack.pop_back();
+		bool taken[MREG_R15 + 1] = { };
+		for (const int n : m_adj[node]) {
+			const int mreg = m_intervals[get_alias(n)].mreg;
+			if (mreg >= 0) taken[mreg] = true;
+		}
+		m_intervals[node].mreg = -1;
+		for (const auto candidates : { &get_caller_saved_regs(), &get_callee_saved_regs() }) {
+			const auto free = std::find_if(candidates->begin(), candidates->end(), [&](int mreg) { return !taken[mreg]; });
+			if (free != candidates->end()) {
+				m_intervals[node].mreg = *free;
+				break;
+			}
+		}
+	}
+	for (int v = 0; v < m_num_vregs; v++) {
+		if (m_intervals[v].start < 0) continue;
+		m_intervals[v].mreg = m_intervals[get_alias(v)].mreg;
+		if (m_intervals[v].mreg >= 0) mark_used(m_intervals[v].mreg);
+	}
+}
@@ -0,0 +1,183 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include <cstdint>
+#include <vector>
+#include "cfg.h"
+#include "live_vregs.h"
+
+// A LiveInterval is the range of positions in the flattened high-level
+// InstructionSequence over which a vreg holds a value.  The instruction at
+// index i uses its operands at position 2*i and defines its destination at
+// position 2*i+1, so a vreg whose last use is at i can share a machine
+// register with a vreg defined by i.
+struct LiveInterval {
+	int vreg;
+	int start, end; // start is -1 if the vreg never appears
+	int mreg; // assigned machine register, or -1 if spilled to its stack slot
+
+	bool overlaps(const LiveInterval& other) const {
+		return start <= other.end && other.start <= end;
+	}
+};
+
+// Assigns machine registers to the vregs of a high-level ControlFlowGraph.
+// Subclasses implement the actual assignment policy; this class builds the
+// live intervals from LiveVregs and answers the questions LowLevelCodeGen
+// has about the result.
+class RegisterAllocator {
+protected:
+	ControlFlowGraph* m_cfg;
+	InstructionSequence* m_iseq; // flattened cfg, indices are instruction positions
+	ControlFlowGraph::BlockList m_block_order;
+	LiveVregs* m_live_vregs;
+	int m_num_vregs;
+	std::vector<LiveInterval> m_intervals; // indexed by vreg
+	std::vector<int> m_callee_saved_used;
+
+public:
+	RegisterAllocator(ControlFlowGraph* cfg, int num_vregs);
+	virtual ~RegisterAllocator();
+
+	// build live intervals and assign registers
+	void allocate();
+
+	// the flattened high-level code; LowLevelCodeGen must generate code
+	// from this sequence so that instruction indices match positions
+	InstructionSequence* get_iseq() const;
+
+	// machine register assigned to vreg, or -1 if the vreg lives in memory
+	int get_mreg(int vreg) const;
+
+	// callee-saved registers that must be preserved by the prologue/epilogue
+	const std::vector<int>& get_callee_saved_used() const;
+
+	// number of vregs which were assigned a machine register
+	int get_num_allocated() const;
+
+	static bool is_callee_saved(int mreg);
+
+	// machine registers available for allocation (the rest are scratch
+	// registers used by LowLevelCodeGen's instruction templates)
+	static const std::vector<int>& get_caller_saved_regs();
+	static const std::vector<int>& get_callee_saved_regs();
+
+protected:
+	virtual void assign_registers() = 0;
+	void mark_used(int mreg);
+
+private:
+	void build_intervals();
+	void extend(int vreg, int pos);
+};
+
+// Linear scan allocation (Poletto & Sarkar): intervals are visited in order
+// of increasing start, and when no register is free, the interval which
+// ends furthest away is spilled.
+class LinearScanRegisterAllocator : public RegisterAllocator {
+public:
+	using RegisterAllocator::RegisterAllocator;
+
+protected:
+	void assign_registers() override;
+
+private:
+	int take_free_reg(std::vector<int>& free_regs);
+};
+
+// Graph coloring with iterated register coalescing (George & Appel): the
+// interference graph is built from per-instruction liveness, and nodes are
+// simplified, the copies made by HINS_MOV coalesced conservatively
+// (Briggs' test) and move-related nodes frozen from worklists, so each
+// step takes time proportional to the nodes and edges it touches.  Nodes
+// are colored optimistically.  When the graph can't be simplified, the
+// node with the lowest ratio of spill cost (uses and defs weighted by
+// 10^loop depth) to degree is pushed as a potential spill.  Where too many
+// vregs are live at once, some are spilled before the graph is built, to
+// keep its size linear in the code's.  Slower than linear scan, but leaves
+// fewer copies and spills.
+class GraphColoringRegisterAllocator : public RegisterAllocator {
+private:
+	enum NodeState {
+		NODE_UNUSED,     // the vreg never appears
+		NODE_SIMPLIFY,   // low degree and not move related
+		NODE_FREEZE,     // low degree and move related
+		NODE_SPILL,      // high degree
+		NODE_SELECTED,   // removed from the graph and pushed for coloring
+		NODE_COALESCED,  // merged into its alias
+		NODE_PRESPILLED, // left out of the graph (see limit_pressure)
+	};
+	enum MoveState {
+		MOVE_WORKLIST,    // might be coalesced
+		MOVE_ACTIVE,      // not ready to be coalesced yet
+		MOVE_COALESCED,
+		MOVE_CONSTRAINED, // its source and destination interfere
+		MOVE_FROZEN,      // given up on
+	};
+	struct Move {
+		int dest, src;
+		MoveState state;
+	};
+
+	// interference graph: each edge (a, b) is keyed min(a, b) << 32 | max(a, b)
+	// in m_edges, an open-addressing hash table where 0 marks an empty slot
+	// (a != b, so no key is 0), and b is in m_adj[a] and a in m_adj[b]
+	std::vector<uint64_t> m_edges;
+	unsigned m_num_edges;
+	std::vector<std::vector<int>> m_adj;
+	std::vector<unsigned> m_degree;
+	std::vector<unsigned> m_significant; // neighbors in the graph of degree >= K
+	std::vector<NodeState> m_state;
+	std::vector<int> m_alias; // vreg each vreg was coalesced into
+	std::vector<double> m_spill_cost;
+	std::vector<Move> m_moves;
+	std::vector<std::vector<int>> m_move_list; // indices of each node's moves
+	LiveVregs::LiveSet m_prespilled;
+
+	// worklists; nodes and moves are only removed when they're taken, so
+	// an entry whose node or move is no longer in that state is skipped
+	std::vector<int> m_simplify_worklist;
+	std::vector<int> m_freeze_worklist;
+	std::vector<std::pair<double, int>> m_spill_worklist; // heap of (cost / degree, node)
+	std::vector<int> m_move_worklist;
+	std::vector<int> m_select_stack;
+
+public:
+	using RegisterAllocator::RegisterAllocator;
+
+	// number of vregs merged into another vreg by coalescing
+	int get_num_coalesced() const;
+
+protected:
+	void assign_registers() override;
+
+private:
+	std::vector<unsigned> compute_loop_depths() const;
+	void compute_spill_costs();
+	void limit_pressure();
+	void build_graph();
+	unsigned find_edge_slot(uint64_t key) const;
+	void grow_edges();
+	bool add_edge(int a, int b);
+	bool interferes(int a, int b) const;
+	void make_worklists();
+	void count_significant(int node, int delta);
+	bool is_move_related(int node) const;
+	void push_simplify(int node);
+	void push_spill(int node);
+	void push_move(int move);
+	void simplify();
+	void decrement_degree(int node);
+	void enable_moves(int node);
+	void coalesce();
+	int get_alias(int node);
+	void add_worklist(int node);
+	bool briggs_test(int a, int b) const;
+	void combine(int a, int b);
+	void freeze();
+	void freeze_moves(int node);
+	void select_spill();
+	void assign_colors();
+};
+
+#endif // REGALLOC_H
@@ -0,0 +1,51 @@
+#! /usr/bin/env ruby
+
+# Regression tests ("make check").  Every tests/NAME.in is compiled with no
+# options, with -o and with -O, assembled, and run with tests/NAME.txt (if
+# there is one) as its input.  Its output has to be the same as
+# tests/NAME.exp each time.  The exit status is 1 if any test fails.
+
+require 'optparse'
+require 'tmpdir'
+
+options = {
+  compiler: File.join(File.dirname(__FILE__), 'compiler'),
+  flags: [],
+}
+
+OptionParser.new do |opts|
+  opts.banner = 'Usage: run_tests.rb [options] [tests/NAME.in...]'
+  opts.on('--compiler PATH', 'compiler to test (default: ./compiler)') { |p| options[:compiler] = p }
+  opts.on('--flags FLAGS', 'compiler flags; may be repeated (default: none, then -o, then -O)') { |f| options[:flags] << f }
+end.parse!
+options[:flags] = ['', '-o', '-O'] if options[:flags].empty?
+
+tests = ARGV.empty? ? Dir.glob(File.join(File.dirname(__FILE__), 'tests', '*.in')).sort : ARGV
+
+failures = 0
+Dir.mktmpdir('check') do |dir|
+  tests.each do |source|
+    base = source.sub(/\.in\z/, '')
+    expected = File.read("#{base}.exp")
+    input = File.exist?("#{base}.txt") ? "#{base}.txt" : '/dev/null'
+    options[:flags].each do |flags|
+      asm = File.join(dir, 'out.S')
+      exe = File.join(dir, 'out')
+      error =
+        if !system("#{options[:compiler]} #{flags} #{source} > #{asm} 2> #{dir}/err")
+          "compiler failed: #{File.read("#{dir}/err").lines.last}"
+        elsif !system("gcc -no-pie -o #{exe} #{asm} 2> /dev/null")
+          'assembler failed'
+        else
+          actual = `#{exe} < #{input}`
+          "wrong output:\n#{actual}" if actual != expected
+        end
+      next unless error
+      puts "FAIL #{source} #{flags}: #{error}"
+      failures += 1
+    end
+  end
+end
+
+puts "#{tests.size} tests, #{tests.size * options[:flags].size} runs, #{failures} failures"
+exit(failures == 0 ? 0 : 1)
@@ -0,0 +1,180 @@
+#include "runtime.h"
+
+const char* const IO_RUNTIME = R"(	.section .bss
+	.align 8
+s_outlen: .space 8
+s_inpos: .space 8
+s_inlen: .space 8
+s_outbuf: .space 65536
+s_inbuf: .space 65536
+	.section .rodata
+s_digits: .ascii "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899"
+	.section .text
+
+/* rt_write_int: print %rdi and a newline */
+rt_write_int:
+	movq s_outlen, %r10
+	/* room for a sign, the 24 bytes copied below and the newline */
+	cmpq $65536-32, %r10
+	jbe .Lrt_write_room
+	pushq %rdi
+	call rt_flush
+	popq %rdi
+	xorl %r10d, %r10d
+.Lrt_write_room:
+	testq %rdi, %rdi
+	jns .Lrt_write_digits
+	movb $45, s_outbuf(%r10)
+	incq %r10
+	negq %rdi
+.Lrt_write_digits:
+	/* convert the magnitude (unsigned from here on) backwards into the
+	   red zone, two digits per division by 100, which is a multiply by
+	   the magic number for (n/4)/25 */
+	movq %rsp, %rsi
+	cmpq $100, %rdi
+	jb .Lrt_write_last
+.Lrt_write_pair:
+	movq %rdi, %rax
+	shrq $2, %rax
+	movabsq $0x28F5C28F5C28F5C3, %rdx
+	mulq %rdx
+	shrq $2, %rdx
+	imulq $100, %rdx, %rax
+	subq %rax, %rdi
+	movzwl s_digits(,%rdi,2), %eax
+	subq $2, %rsi
+	movw %ax, (%rsi)
+	movq %rdx, %rdi
+	cmpq $100, %rdi
+	jae .Lrt_write_pair
+.Lrt_write_last:
+	cmpq $10, %rdi
+	jb .Lrt_write_one
+	movzwl s_digits(,%rdi,2), %eax
+	subq $2, %rsi
+	movw %ax, (%rsi)
+	jmp .Lrt_write_copy
+.Lrt_write_one:
+	addl $48, %edi
+	decq %rsi
+	movb %dil, (%rsi)
+.Lrt_write_copy:
+	/* there are at most 19 digits: copy 24 bytes, but only count the digits */
+	movq (%rsi), %rax
+	movq %rax, s_outbuf(%r10)
+	movq 8(%rsi), %rax
+	movq %rax, s_outbuf+8(%r10)
+	movq 16(%rsi), %rax
+	movq %rax, s_outbuf+16(%r10)
+	movq %rsp, %rax
+	subq %rsi, %rax
+	addq %rax, %r10
+	movb $10, s_outbuf(%r10)
+	incq %r10
+	movq %r10, s_outlen
+	ret
+
+/* rt_flush: write the output buffer to stdout */
+rt_flush:
+	pushq %rcx
+	movq $s_outbuf, %rsi
+	movq s_outlen, %rdx
+.Lrt_flush_loop:
+	testq %rdx, %rdx
+	jle .Lrt_flush_done
+	movl $1, %eax /* write */
+	movl $1, %edi /* stdout */
+	syscall
+	cmpq $-4, %rax /* EINTR */
+	je .Lrt_flush_loop
+	testq %rax, %rax
+	jle .Lrt_flush_done /* the output is lost */
+	addq %rax, %rsi
+	subq %rax, %rdx
+	jmp .Lrt_flush_loop
+.Lrt_flush_done:
+	movq $0, s_outlen
+	popq %rcx
+	ret
+
+/* rt_fill: refill the input buffer, returning 0 in %rsi and the number
+   of bytes read (0 at the end of the input) in %rdi */
+rt_fill:
+	pushq %rcx
+	pushq %r11
+	/* output written so far should be visible before blocking on input */
+	call rt_flush
+.Lrt_fill_read:
+	xorl %eax, %eax /* read */
+	xorl %edi, %edi /* stdin */
+	movq $s_inbuf, %rsi
+	movl $65536, %edx
+	syscall
+	cmpq $-4, %rax /* EINTR */
+	je .Lrt_fill_read
+	testq %rax, %rax
+	jns .Lrt_fill_done
+	xorl %eax, %eax
+.Lrt_fill_done:
+	movq %rax, s_inlen
+	movq %rax, %rdi
+	xorl %esi, %esi
+	popq %r11
+	popq %rcx
+	ret
+
+/* rt_read_int: return the next integer on stdin in %rax; the position
+   is kept in %rsi, the buffer length in %rdi, the value in %r10 and the
+   sign in %r11 */
+rt_read_int:
+	movq s_inpos, %rsi
+	movq s_inlen, %rdi
+	xorl %r10d, %r10d
+	xorl %r11d, %r11d
+.Lrt_read_space:
+	cmpq %rdi, %rsi
+	jb .Lrt_read_space_char
+	call rt_fill
+	testq %rdi, %rdi
+	jz .Lrt_read_done
+.Lrt_read_space_char:
+	movzbl s_inbuf(%rsi), %eax
+	cmpl $32, %eax
+	ja .Lrt_read_sign
+	incq %rsi
+	jmp .Lrt_read_space
+.Lrt_read_sign:
+	cmpl $45, %eax /* '-' */
+	jne .Lrt_read_plus
+	movl $1, %r11d
+	incq %rsi
+	jmp .Lrt_read_digit
+.Lrt_read_plus:
+	cmpl $43, %eax /* '+' */
+	jne .Lrt_read_digit
+	incq %rsi
+.Lrt_read_digit:
+	cmpq %rdi, %rsi
+	jb .Lrt_read_digit_char
+	call rt_fill
+	testq %rdi, %rdi
+	jz .Lrt_read_done
+.Lrt_read_digit_char:
+	movzbl s_inbuf(%rsi), %eax
+	subl $48, %eax
+	cmpl $9, %eax
+	ja .Lrt_read_done
+	leaq (%r10,%r10,4), %r10
+	leaq (%rax,%r10,2), %r10
+	incq %rsi
+	jmp .Lrt_read_digit
+.Lrt_read_done:
+	movq %rsi, s_inpos
+	movq %r10, %rax
+	testq %r11, %r11
+	jz .Lrt_read_return
+	negq %rax
+.Lrt_read_return:
+	ret
+)";
@@ -0,0 +1,23 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+// x86-64 assembly source of the I/O runtime, which LowLevelCodeGen emits
+// into every compiled program in place of calls to printf and scanf.
+//
+// Output is formatted into a 64 KiB buffer which is written to stdout
+// when it fills up, before input is read and when main returns.  Input
+// is read from stdin in 64 KiB blocks.  Both talk to the kernel with the
+// Linux read and write system calls, so no libc formatting, locking or
+// allocation is involved.
+//
+// The entry points use a lean calling convention: they only clobber the
+// scratch registers of LowLevelCodeGen's templates (%rax, %rdx, %rdi,
+// %rsi, %r10 and %r11), so no allocatable register has to be saved
+// around a call, and they don't need %rsp to be aligned.
+//   rt_write_int  prints %rdi in decimal, followed by a newline
+//   rt_read_int   skips white space and returns the next integer in %rax,
+//                 or 0 at the end of the input
+//   rt_flush      writes out any buffered output
+extern const char* const IO_RUNTIME;
+
+#endif // RUNTIME_H
@@ -0,0 +1,254 @@
+#include <array>
+#include <cassert>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SCANNER_SSE2
+#endif
+#include "node.h"
+#include "unit.h"
+#include "scanner.h"
+
+extern "C" {
+#include "parse.tab.h"
+}
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////
+// Character classes
+////////////////////////////////////////////////////////////////////////
+
+enum CharClass : unsigned char {
+	CC_OTHER,   // not allowed outside comments
+	CC_BLANK,   // space or tab
+	CC_NEWLINE,
+	CC_LETTER,  // A-Z, a-z or _
+	CC_DIGIT,
+	CC_PUNCT,   // starts a punctuation token or a comment
+};
+
+constexpr std::array<CharClass, 256> make_char_classes() {
+	std::array<CharClass, 256> classes{};
+	classes[' '] = classes['\t'] = CC_BLANK;
+	classes['\n'] = CC_NEWLINE;
+	for (int c = 'A'; c <= 'Z'; c++) classes[c] = CC_LETTER;
+	for (int c = 'a'; c <= 'z'; c++) classes[c] = CC_LETTER;
+	classes['_'] = CC_LETTER;
+	for (int c = '0'; c <= '9'; c++) classes[c] = CC_DIGIT;
+	for (const char* p = ":;,.+-*<>=#[]()"; *p; p++) classes[static_cast<unsigned char>(*p)] = CC_PUNCT;
+	return classes;
+}
+
+constexpr std::array<CharClass, 256> s_char_class = make_char_classes();
+
+inline CharClass char_class(char c) {
+	return s_char_class[static_cast<unsigned char>(c)];
+}
+
+inline bool is_ident_char(char c) {
+	const CharClass cc = char_class(c);
+	return cc == CC_LETTER || cc == CC_DIGIT;
+}
+
+// tags of the single-character punctuation tokens
+constexpr std::array<short, 256> make_punct_tags() {
+	std::array<short, 256> tags{};
+	tags[';'] = TOK_SEMICOLON;
+	tags[':'] = TOK_COLON;
+	tags[','] = TOK_COMMA;
+	tags['.'] = TOK_DOT;
+	tags['+'] = TOK_PLUS;
+	tags['-'] = TOK_MINUS;
+	tags['*'] = TOK_TIMES;
+	tags['<'] = TOK_LT;
+	tags['>'] = TOK_GT;
+	tags['='] = TOK_EQUALS;
+	tags['#'] = TOK_HASH;
+	tags['['] = TOK_LBRACKET;
+	tags[']'] = TOK_RBRACKET;
+	tags['('] = TOK_LPAREN;
+	tags[')'] = TOK_RPAREN;
+	return tags;
+}
+
+constexpr std::array<short, 256> s_punct_tag = make_punct_tags();
+
+////////////////////////////////////////////////////////////////////////
+// Keywords
+////////////////////////////////////////////////////////////////////////
+
+struct Keyword {
+	const char* text;
+	unsigned length;
+	int tag;
+};
+
+const Keyword KEYWORDS[] = {
+	{"PROGRAM", 7, TOK_PROGRAM}, {"BEGIN", 5, TOK_BEGIN}, {"END", 3, TOK_END},
+	{"CONST", 5, TOK_CONST}, {"TYPE", 4, TOK_TYPE}, {"VAR", 3, TOK_VAR},
+	{"ARRAY", 5, TOK_ARRAY}, {"OF", 2, TOK_OF}, {"RECORD", 6, TOK_RECORD},
+	{"DIV", 3, TOK_DIV}, {"MOD", 3, TOK_MOD}, {"IF", 2, TOK_IF},
+	{"THEN", 4, TOK_THEN}, {"ELSE", 4, TOK_ELSE}, {"REPEAT", 6, TOK_REPEAT},
+	{"UNTIL", 5, TOK_UNTIL}, {"WHILE", 5, TOK_WHILE}, {"DO", 2, TOK_DO},
+	{"READ", 4, TOK_READ}, {"WRITE", 5, TOK_WRITE},
+};
+
+const unsigned MIN_KEYWORD_LENGTH = 2;
+const unsigned MAX_KEYWORD_LENGTH = 7;
+const unsigned KEYWORD_TABLE_SIZE = 64;
+
+// a hash of the first, second and last characters and the length which
+// is different for every keyword
+inline unsigned keyword_hash(const char* s, unsigned length) {
+	const auto c = reinterpret_cast<const unsigned char*>(s);
+	return (c[0] + (c[1] << 3) + c[length - 1] + (length << 2)) & (KEYWORD_TABLE_SIZE - 1);
+}
+
+class KeywordTable {
+	const Keyword* m_slots[KEYWORD_TABLE_SIZE] = {};
+
+public:
+	KeywordTable() {
+		for (const auto& keyword : KEYWORDS) {
+			const Keyword*& slot = m_slots[keyword_hash(keyword.text, keyword.length)];
+			assert(!slot); // the hash must be perfect
+			slot = &keyword;
+		}
+	}
+
+	// returns the tag of the keyword s, or TOK_IDENT if s isn't a keyword
+	int lookup(const char* s, unsigned length) const {
+		if (length < MIN_KEYWORD_LENGTH || length > MAX_KEYWORD_LENGTH) return TOK_IDENT;
+		const Keyword* keyword = m_slots[keyword_hash(s, length)];
+		if (keyword && keyword->length == length && memcmp(keyword->text, s, length) == 0) return keyword->tag;
+		return TOK_IDENT;
+	}
+};
+
+const KeywordTable s_keywords;
+
+inline unsigned count_trailing_zeros(unsigned mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////
+// Scanner class implementation
+////////////////////////////////////////////////////////////////////////
+
+Scanner::Scanner(Unit* unit, SourceMap* source_map, const char* text, size_t length)
+	: m_unit(unit)
+	, m_source_map(source_map)
+	, m_text(text)
+	, m_pos(text)
+	, m_end(text + length) {
+}
+
+Scanner::~Scanner() = default;
+
+SourceLoc Scanner::offset_of(const char* p) const {
+	return SourceLoc(p - m_text);
+}
+
+SourceLoc Scanner::get_offset() const {
+	return offset_of(m_pos);
+}
+
+int Scanner::next_token(YYSTYPE* lvalp) {
+	for (;;) {
+		skip_blanks();
+		if (m_pos == m_end) return 0;
+		switch (char_class(*m_pos)) {
+		case CC_LETTER:
+			return scan_identifier(lvalp);
+		case CC_DIGIT:
+			return scan_number(lvalp);
+		case CC_PUNCT:
+			if (m_pos[0] == '-' && m_pos + 1 < m_end && m_pos[1] == '-') {
+				// a comment runs up to the end of the line
+				const auto newline = static_cast<const char*>(memchr(m_pos, '\n', m_end - m_pos));
+				m_pos = newline ? newline : m_end;
+				continue;
+			}
+			return scan_punctuation(lvalp);
+		default:
+			unit_error(m_unit, "Illegal character '%c' in input", *m_pos);
+			return 0;
+		}
+	}
+}
+
+// Skips spaces, tabs and newlines, recording where each line starts.
+void Scanner::skip_blanks() {
+#ifdef SCANNER_SSE2
+	const __m128i spaces = _mm_set1_epi8(' ');
+	const __m128i tabs = _mm_set1_epi8('\t');
+	const __m128i newlines = _mm_set1_epi8('\n');
+	while (m_end - m_pos >= 16) {
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_pos));
+		const __m128i is_newline = _mm_cmpeq_epi8(chunk, newlines);
+		const __m128i is_blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, spaces), _mm_cmpeq_epi8(chunk, tabs)),
+		                                      is_newline);
+		const unsigned other_mask = ~unsigned(_mm_movemask_epi8(is_blank)) & 0xFFFF;
+		const unsigned length = other_mask ? count_trailing_zeros(other_mask) : 16;
+		unsigned newline_mask = unsigned(_mm_movemask_epi8(is_newline)) & ((1u << length) - 1);
+		while (newline_mask) {
+			m_source_map->add_line(offset_of(m_pos) + count_trailing_zeros(newline_mask) + 1);
+			newline_mask &= newline_mask - 1;
+		}
+		m_pos += length;
+		if (length < 16) return;
+	}
+#endif
+	for (; m_pos < m_end; m_pos++) {
+		const CharClass cc = char_class(*m_pos);
+		if (cc == CC_NEWLINE) m_source_map->add_line(offset_of(m_pos) + 1);
+		else if (cc != CC_BLANK) return;
+	}
+}
+
+int Scanner::scan_identifier(YYSTYPE* lvalp) {
+	const char* start = m_pos;
+	do m_pos++;
+	while (m_pos < m_end && is_ident_char(*m_pos));
+	const unsigned length = unsigned(m_pos - start);
+	const int tag = s_keywords.lookup(start, length);
+	if (tag != TOK_IDENT) {
+		lvalp->node = nullptr;
+		return tag;
+	}
+	Node* tok = new Node(TOK_IDENT);
+	tok->set_str(start, length);
+	tok->set_source_loc(offset_of(start));
+	lvalp->node = tok;
+	return TOK_IDENT;
+}
+
+int Scanner::scan_number(YYSTYPE* lvalp) {
+	const char* start = m_pos;
+	do m_pos++;
+	while (m_pos < m_end && char_class(*m_pos) == CC_DIGIT);
+	Node* tok = new Node(TOK_INT_LITERAL);
+	tok->set_str(start, size_t(m_pos - start));
+	tok->set_source_loc(offset_of(start));
+	lvalp->node = tok;
+	return TOK_INT_LITERAL;
+}
+
+int Scanner::scan_punctuation(YYSTYPE* lvalp) {
+	const char c = *m_pos++;
+	lvalp->node = nullptr;
+	if (m_pos < m_end && *m_pos == '=' && (c == ':' || c == '<' || c == '>')) {
+		m_pos++;
+		return c == ':' ? TOK_ASSIGN : c == '<' ? TOK_LTE : TOK_GTE;
+	}
+	return s_punct_tag[static_cast<unsigned char>(c)];
+}
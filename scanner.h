@@ -0,0 +1,52 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <cstddef>
+#include "srcloc.h"
+
+struct Unit;
+union YYSTYPE;
+
+// A hand-written scanner, the alternative to the flex scanner in lex.l
+// (compiler -f).  It scans a SourceFile's text in place, without writing
+// to it, and returns the same tokens, with the same tags, as the flex
+// scanner:
+//   - characters are classified with a 256-entry table,
+//   - identifiers are checked for keywords with one probe of a perfect
+//     hash table,
+//   - runs of blanks are skipped 16 bytes at a time with SSE2, recording
+//     the start of each line crossed, and comments are skipped with memchr.
+// Only identifiers and integer literals get a Node as their semantic
+// value; the parser never looks at the value of a keyword or punctuation
+// token, so theirs is null.
+class Scanner {
+	Unit* m_unit;
+	SourceMap* m_source_map;
+	const char* m_text;
+	const char* m_pos;
+	const char* m_end;
+
+public:
+	// scans the length characters at text, which must outlive the Scanner,
+	// recording its lines in source_map and reporting errors to unit
+	Scanner(Unit* unit, SourceMap* source_map, const char* text, size_t length);
+	~Scanner();
+
+	Scanner(const Scanner&) = delete;
+	Scanner& operator=(const Scanner&) = delete;
+
+	// returns the tag of the next token and sets *lvalp, or returns 0 at
+	// the end of the input or after an error
+	int next_token(YYSTYPE* lvalp);
+	// the offset of the end of the text scanned so far
+	SourceLoc get_offset() const;
+
+private:
+	void skip_blanks();
+	int scan_identifier(YYSTYPE* lvalp);
+	int scan_number(YYSTYPE* lvalp);
+	int scan_punctuation(YYSTYPE* lvalp);
+	SourceLoc offset_of(const char* p) const;
+};
+
+#endif // SCANNER_H
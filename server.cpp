@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+#include "server.h"
+
+#ifdef _WIN32
+
+int server_run(const char*, unsigned, CompileCache*) {
+	fprintf(stderr, "The compile server isn't supported on this system\n");
+	return 1;
+}
+
+int server_compile(const char*, const char*, const CompileOptions&) {
+	return -1;
+}
+
+#else
+
+#include <csignal>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "arena.h"
+#include "sourcefile.h"
+#include "unit.h"
+
+namespace {
+
+// no message (in particular, no source file) is allowed to be larger
+const uint32_t MAX_STRING_LENGTH = 1u << 30;
+
+////////////////////////////////////////////////////////////////////////
+// Messages
+////////////////////////////////////////////////////////////////////////
+
+bool send_all(int fd, const void* data, size_t length) {
+	const char* p = static_cast<const char*>(data);
+	while (length > 0) {
+		// MSG_NOSIGNAL: a peer which goes away is an error, not a SIGPIPE
+		const ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		length -= size_t(n);
+	}
+	return true;
+}
+
+bool recv_all(int fd, void* data, size_t length) {
+	char* p = static_cast<char*>(data);
+	while (length > 0) {
+		const ssize_t n = recv(fd, p, length, 0);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		p += n;
+		length -= size_t(n);
+	}
+	return true;
+}
+
+bool send_string(int fd, const char* str, size_t length) {
+	const uint32_t n = uint32_t(length);
+	return send_all(fd, &n, sizeof(n)) && send_all(fd, str, length);
+}
+
+bool send_string(int fd, const std::string& str) {
+	return send_string(fd, str.data(), str.size());
+}
+
+bool recv_length(int fd, uint32_t& length) {
+	return recv_all(fd, &length, sizeof(length)) && length <= MAX_STRING_LENGTH;
+}
+
+bool recv_string(int fd, std::string& str) {
+	uint32_t length;
+	if (!recv_length(fd, length)) return false;
+	str.resize(length);
+	return recv_all(fd, &str[0], length);
+}
+
+int connect_to(const char* socket_path) {
+	sockaddr_un addr;
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path);
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Server
+////////////////////////////////////////////////////////////////////////
+
+volatile sig_atomic_t s_terminate;
+
+extern "C" void on_terminate(int) {
+	s_terminate = 1;
+}
+
+// Read a request and send its response, returning false once the client
+// has closed the connection (or broken the protocol).  The source text is
+// received straight into the Unit's buffer.
+bool serve_request(int fd, Arena& arena, CompileCache* cache) {
+	std::string flags, filename;
+	if (!recv_string(fd, flags) || !recv_string(fd, filename)) return false;
+
+	CompileOptions options;
+	options.cache = cache;
+	for (const char flag : flags) {
+		if (flag == 'o' || flag == 'O') options.optimize_flag = flag;
+		else if (flag == 'f') options.hand_written_scanner = true;
+	}
+
+	Unit unit(filename, &arena);
+	uint32_t length;
+	if (!recv_length(fd, length)) return false;
+	if (!recv_all(fd, unit.get_source().allocate(length), length)) return false;
+
+	char* output = nullptr;
+	size_t output_length = 0;
+	FILE* out = open_memstream(&output, &output_length);
+	if (!out) return false;
+	std::string error;
+	const bool compiled = compile_unit(unit, options, out, error);
+	fclose(out);
+
+	const bool sent = send_string(fd, compiled ? "0" : "1") &&
+	                  send_string(fd, output, output_length) &&
+	                  send_string(fd, error);
+	free(output);
+	return sent;
+}
+
+// a worker process: serve connections until it's killed
+void serve(int listener, CompileCache* cache) {
+	Arena arena;
+	for (;;) {
+		const int fd = accept(listener, nullptr, nullptr);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			perror("accept");
+			_exit(1);
+		}
+		try {
+			while (serve_request(fd, arena, cache)) {}
+		}
+		catch (const std::exception& ex) {
+			// e.g. bad_alloc for an absurd source length; drop the client
+			fprintf(stderr, "Compile server error: %s\n", ex.what());
+		}
+		close(fd);
+	}
+}
+
+pid_t start_worker(int listener, CompileCache* cache) {
+	const pid_t pid = fork();
+	if (pid == 0) {
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		serve(listener, cache);
+	}
+	else if (pid < 0) {
+		perror("fork");
+	}
+	return pid;
+}
+
+}
+
+int server_run(const char* socket_path, unsigned num_workers, CompileCache* cache) {
+	sockaddr_un addr;
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path \"%s\" is too long\n", socket_path);
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path);
+
+	// a socket left behind by a server that was killed is replaced, but
+	// not one with a live server behind it
+	const int existing = connect_to(socket_path);
+	if (existing >= 0) {
+		close(existing);
+		fprintf(stderr, "A compile server is already listening on \"%s\"\n", socket_path);
+		return 1;
+	}
+	unlink(socket_path);
+
+	const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 ||
+	    bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+	    listen(listener, SOMAXCONN) != 0) {
+		perror(socket_path);
+		return 1;
+	}
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_terminate; // no SA_RESTART, so waitpid is interrupted
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+
+	// The workers all accept connections on the listening socket.  This
+	// process only keeps their number up, replacing each one that dies
+	// (a failed assertion kills only the worker, and the client
+	// whose program it was compiling compiles it itself).
+	if (num_workers == 0) num_workers = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<pid_t> workers;
+	for (unsigned i = 0; i < num_workers; i++) {
+		const pid_t pid = start_worker(listener, cache);
+		if (pid > 0) workers.push_back(pid);
+	}
+	int status = workers.empty() ? 1 : 0;
+	while (!s_terminate && !workers.empty()) {
+		int wstatus;
+		const pid_t pid = waitpid(-1, &wstatus, 0);
+		if (pid < 0) {
+			if (errno == EINTR) continue;
+			perror("waitpid");
+			status = 1;
+			break;
+		}
+		workers.erase(std::remove(workers.begin(), workers.end(), pid), workers.end());
+		if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) != 0) {
+			status = 1; // it can't accept connections, and neither would a replacement
+			continue;
+		}
+		if (WIFSIGNALED(wstatus)) {
+			fprintf(stderr, "Compile server worker %d died (signal %d)\n", int(pid), WTERMSIG(wstatus));
+		}
+		const pid_t replacement = start_worker(listener, cache);
+		if (replacement > 0) workers.push_back(replacement);
+	}
+
+	for (const pid_t pid : workers) kill(pid, SIGTERM);
+	for (const pid_t pid : workers) waitpid(pid, nullptr, 0);
+	close(listener);
+	unlink(socket_path);
+	return status;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Client
+////////////////////////////////////////////////////////////////////////
+
+int server_compile(const char* socket_path, const char* filename, const CompileOptions& options) {
+	SourceFile source;
+	if (!source.open(filename)) {
+		fprintf(stderr, "Could not open input file \"%s\"\n", filename);
+		return 1;
+	}
+
+	const int fd = connect_to(socket_path);
+	if (fd < 0) return -1;
+
+	std::string flags;
+	if (options.optimize_flag) flags += options.optimize_flag;
+	if (options.hand_written_scanner) flags += 'f';
+	std::string status, output, error;
+	const bool ok = send_string(fd, flags) &&
+	                send_string(fd, filename, strlen(filename)) &&
+	                send_string(fd, source.get_text(), source.get_length()) &&
+	                recv_string(fd, status) && recv_string(fd, output) && recv_string(fd, error);
+	close(fd);
+	// the server died, most likely on a failed assertion compiling this
+	// very file, which compiling it here will report
+	if (!ok) return -1;
+
+	fwrite(output.data(), 1, output.size(), stdout);
+	if (!error.empty()) fprintf(stderr, "%s\n", error.c_str());
+	return atoi(status.c_str());
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "batch.h"
+
+// Compile server (compiler -L socket): a long-running process listening
+// on a Unix domain socket, so that a program can be compiled without
+// paying for a new process each time.  Its worker processes accept
+// connections and compile the programs sent over them, one at a time,
+// through the same pipeline as batch mode, allocating each AST from the
+// worker's own Arena, which keeps its blocks from one program to the next.
+// A worker is replaced when it dies, so a failed assertion only costs
+// the server one process.
+//
+// The client (compiler -c socket) reads the source file itself and sends
+// its text, so file names are relative to the client's directory, and
+// writes the assembly language and any error message to its own stdout
+// and stderr, so it can be used exactly like a compiler run on its own.
+//
+// Every message is a sequence of strings, each sent as a 32-bit length in
+// the host's byte order followed by its bytes.  A request is the flags
+// (any of "oOf", as on the command line), the file name and the source
+// text; the response is the exit status (as a string of digits), the
+// assembly language and the error message, if any.  A connection can
+// carry any number of requests, each answered before the next is read.
+
+// Listen on socket_path (replacing a stale socket left there) and serve
+// requests with num_workers worker processes (0 for one per core) until
+// the server gets SIGINT or SIGTERM.  The workers look programs up in
+// cache, if there is one.  Returns 1 if the socket can't be set up.
+int server_run(const char* socket_path, unsigned num_workers, CompileCache* cache);
+
+// Have the server on socket_path compile a file, returning the exit
+// status the compiler would have, or -1 if there's no server to connect
+// to (or it goes away before answering), so the caller can compile the
+// file itself.
+int server_compile(const char* socket_path, const char* filename, const CompileOptions& options);
+
+#endif // SERVER_H
@@ -0,0 +1,104 @@
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "sourcefile.h"
+#include "util.h"
+
+SourceFile::SourceFile(): m_text(nullptr), m_length(0), m_mapping_length(0) {}
+
+SourceFile::~SourceFile() {
+	close();
+}
+
+bool SourceFile::open(const char* filename) {
+	close();
+	const int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	bool ok = fstat(fd, &st) == 0;
+	if (ok) ok = (S_ISREG(st.st_mode) && map(fd, size_t(st.st_size))) || read(fd);
+	::close(fd);
+	return ok;
+}
+
+#ifdef _WIN32
+
+bool SourceFile::map(int, size_t) {
+	return false;
+}
+
+#else
+
+// Maps the file into the start of an anonymous, zero-filled region that
+// has room for the two NUL bytes.  The file's last page is zero-filled
+// beyond the end of the file, and if the file ends on a page boundary the
+// NULs are in the anonymous pages, so there's no need to touch them.
+bool SourceFile::map(int fd, size_t length) {
+	const size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+	const size_t mapping_length = (length + 2 + page_size - 1) / page_size * page_size;
+	void* region = mmap(nullptr, mapping_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) return false;
+	if (length > 0 &&
+	    mmap(region, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(region, mapping_length);
+		return false;
+	}
+	madvise(region, mapping_length, MADV_SEQUENTIAL);
+	m_text = static_cast<char*>(region);
+	m_length = length;
+	m_mapping_length = mapping_length;
+	return true;
+}
+
+#endif
+
+bool SourceFile::read(int fd) {
+	size_t capacity = 65536;
+	char* text = static_cast<char*>(xmalloc(capacity));
+	size_t length = 0;
+	for (;;) {
+		if (capacity - length <= 2) {
+			capacity *= 2;
+			text = static_cast<char*>(xrealloc(text, capacity));
+		}
+		const auto n = ::read(fd, text + length, unsigned(capacity - length - 2));
+		if (n < 0) {
+			free(text);
+			return false;
+		}
+		if (n == 0) break;
+		length += size_t(n);
+	}
+	text[length] = text[length + 1] = '\0';
+	m_text = text;
+	m_length = length;
+	m_mapping_length = 0;
+	return true;
+}
+
+char* SourceFile::allocate(size_t length) {
+	close();
+	m_text = static_cast<char*>(xmalloc(length + 2));
+	m_text[length] = m_text[length + 1] = '\0';
+	m_length = length;
+	return m_text;
+}
+
+void SourceFile::close() {
+#ifndef _WIN32
+	if (m_mapping_length) {
+		munmap(m_text, m_mapping_length);
+		m_text = nullptr;
+	}
+#endif
+	free(m_text);
+	m_text = nullptr;
+	m_length = m_mapping_length = 0;
+}
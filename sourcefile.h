@@ -0,0 +1,48 @@
+#ifndef SOURCEFILE_H
+#define SOURCEFILE_H
+
+#include <cstddef>
+
+// The text of a source file, which the scanners read in place.
+//
+// A regular file is mapped into memory rather than read, so its text
+// isn't copied through stdio and the lexers' buffers; anything else (a
+// pipe, or a system without mmap) is read into a heap buffer.  Either
+// way the text is followed by two NUL bytes, as flex's yy_scan_buffer
+// requires, and is writable, because flex temporarily overwrites the
+// character after each token.  The mapping is private, so those writes
+// never reach the file.
+class SourceFile {
+	char* m_text;
+	size_t m_length;
+	size_t m_mapping_length; // 0 if the text is in a heap buffer
+
+public:
+	SourceFile();
+	~SourceFile();
+
+	SourceFile(const SourceFile&) = delete;
+	SourceFile& operator=(const SourceFile&) = delete;
+
+	// map or read the named file, returning false if it can't be read
+	bool open(const char* filename);
+
+	// Make room for length bytes of text which didn't come from a file
+	// (the compile server receives it over a socket), returning the
+	// buffer for the caller to fill in.
+	char* allocate(size_t length);
+
+	const char* get_text() const { return m_text; }
+	size_t get_length() const { return m_length; }
+
+	// the text and the two NUL bytes after it
+	char* get_buffer() { return m_text; }
+	size_t get_buffer_size() const { return m_length + 2; }
+
+private:
+	bool map(int fd, size_t length);
+	bool read(int fd);
+	void close();
+};
+
+#endif // SOURCEFILE_H
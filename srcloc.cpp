@@ -0,0 +1,18 @@
+#include <algorithm>
+#include "srcloc.h"
+
+SourceMap::SourceMap(const std::string& filename)
+	: m_filename(filename)
+	, m_line_starts(1, 0) {
+}
+
+SourceInfo SourceMap::get_info(SourceLoc loc) const {
+	if (loc == SOURCE_LOC_NONE) return SourceInfo{"<unknown file>", -1, -1};
+	// the line is the last one starting at or before loc
+	const auto line = std::upper_bound(m_line_starts.begin(), m_line_starts.end(), loc) - 1;
+	return SourceInfo{m_filename.c_str(), int(line - m_line_starts.begin()) + 1, int(loc - *line) + 1};
+}
+
+void srcloc_add_line(struct SourceMap* map, SourceLoc line_start) {
+	map->add_line(line_start);
+}
@@ -0,0 +1,63 @@
+#ifndef SRCLOC_H
+#define SRCLOC_H
+
+// Source locations.
+//
+// Nodes record where they came from as a SourceLoc, the byte offset of
+// their first character in the source file.  While scanning, the lexer
+// records where each line starts in the file's SourceMap, and an offset is
+// converted to a file name, line and column with a binary search of that
+// table only when a diagnostic is printed.
+
+#ifdef __cplusplus
+#include <string>
+#include <vector>
+#endif // __cplusplus
+
+typedef unsigned SourceLoc;
+
+// The location of a Node that doesn't correspond to any source text.
+#define SOURCE_LOC_NONE 0xFFFFFFFFu
+
+// Source information structure.
+struct SourceInfo {
+	const char* filename;
+	int line, col;
+};
+
+#ifdef __cplusplus
+
+// The name of a source file and the offset at which each of its lines
+// starts.  Each compilation has its own (see Unit).
+struct SourceMap {
+private:
+	std::string m_filename;
+	std::vector<SourceLoc> m_line_starts;
+
+public:
+	// the first line starts at offset 0
+	explicit SourceMap(const std::string& filename);
+
+	const std::string& get_filename() const { return m_filename; }
+
+	// Record that a line starts at the given offset, which must be greater
+	// than that of the previous line.
+	void add_line(SourceLoc line_start) { m_line_starts.push_back(line_start); }
+
+	// Convert an offset into a file name, line and column (counting from 1,
+	// with a tab counting as one column).
+	SourceInfo get_info(SourceLoc loc) const;
+};
+
+extern "C" {
+#endif // __cplusplus
+
+// C interface for the flex scanner.
+struct SourceMap;
+void srcloc_add_line(struct SourceMap* map, SourceLoc line_start);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SRCLOC_H
@@ -1,10 +1,10 @@
 #include "symbol.h"
 
-Symbol::Symbol(const std::string& name, Type* type, SymbolKind kind): name(name), type(type), kind(kind) {}
+Symbol::Symbol(Name name, Type* type, SymbolKind kind): name(name), type(type), kind(kind) {}
 
 Symbol::~Symbol() = default;
 
-std::string Symbol::get_name() const {
+Name Symbol::get_name() const {
 	return name;
 }
 
@@ -2,6 +2,7 @@
 #define SYMBOL_H
 #include "type.h"
 #include "string"
+#include "name.h"
 
 class Type;
 
@@ -12,7 +13,7 @@ enum SymbolKind {
 };
 
 class Symbol {
-	std::string name;
+	Name name;
 	Type* type;
 	SymbolKind kind;
 	int ival;
@@ -20,9 +21,9 @@ class Symbol {
 	int offset; // offset within the current symbol table
 
 public:
-	Symbol(const std::string& name, Type* type, SymbolKind kind);
+	Symbol(Name name, Type* type, SymbolKind kind);
 	~Symbol();
-	std::string get_name() const;
+	Name get_name() const;
 	Type* get_type() const;
 	std::string get_kind_name() const;
 	SymbolKind get_kind() const;
@@ -1,51 +1,68 @@
 #include "symtab.h"
 #include <iostream>
 
-void SymbolTable::get_depth(int& counter) {
-	if (parent) {
-		counter++;
-		parent->get_depth(counter);
-	}
+namespace {
+
+const unsigned INITIAL_INDEX_SIZE = 16; // must be a power of 2
+
 }
 
 // Constructor for nested scopes
 SymbolTable::SymbolTable(SymbolTable* symtab): parent(symtab), print_symbols(symtab->print_symbols),
-                                               current_offset(0) {}
+                                               current_offset(0), depth(symtab->depth + 1),
+                                               types(symtab->types) {}
 
-SymbolTable::SymbolTable(bool print_symbols): print_symbols(print_symbols), current_offset(0) {
+SymbolTable::SymbolTable(bool print_symbols): print_symbols(print_symbols), current_offset(0), depth(0),
+                                              types(new TypeContext()) {
 	// Define INTEGER primitive
-	const auto int_type = new PrimitiveType("INTEGER", 8);
-	const auto int_sym = new Symbol("INTEGER", int_type, TYPE);
-	syms.push_back(int_sym);
+	insert(new Symbol("INTEGER", types->get_int_type(), TYPE));
 	// Define CHAR primitive
-	const auto char_type = new PrimitiveType("CHAR", 1);
-	const auto char_sym = new Symbol("CHAR", char_type, TYPE);
-	syms.push_back(char_sym);
+	insert(new Symbol("CHAR", types->get_char_type(), TYPE));
+}
+
+SymbolTable::~SymbolTable() {
+	for (const auto sym : syms) delete sym;
+	if (!parent) delete types;
 }
 
-SymbolTable::~SymbolTable() = default;
+// returns the slot holding name, or the empty slot where it would be inserted
+int SymbolTable::find_slot(Name name) const {
+	const unsigned mask = index.size() - 1;
+	unsigned slot = name.hash() & mask;
+	while (index[slot] >= 0 && syms[index[slot]]->get_name() != name)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+void SymbolTable::insert(Symbol* sym) {
+	// keep the load factor at or below 1/2
+	if ((syms.size() + 1) * 2 > index.size()) grow_index();
+	index[find_slot(sym->get_name())] = syms.size();
+	syms.push_back(sym);
+}
 
-Symbol* SymbolTable::lookup(const std::string& name) const {
-	Symbol* sym_ptr = nullptr;
-	for (const auto sym : syms) {
-		if (sym->get_name() == name) sym_ptr = sym;
+void SymbolTable::grow_index() {
+	index.assign(index.empty() ? INITIAL_INDEX_SIZE : index.size() * 2, -1);
+	for (unsigned i = 0; i < syms.size(); i++)
+		index[find_slot(syms[i]->get_name())] = i;
+}
+
+Symbol* SymbolTable::lookup(Name name) const {
+	for (auto scope = this; scope; scope = scope->parent) {
+		if (scope->syms.empty()) continue;
+		const int pos = scope->index[scope->find_slot(name)];
+		if (pos >= 0) return scope->syms[pos];
 	}
-	if (!sym_ptr && parent) sym_ptr = parent->lookup(name);
-	return sym_ptr;
+	return nullptr;
 }
 
 bool SymbolTable::define(Symbol* sym) {
-	for (const auto defined_sym : syms) {
-		if (sym->get_name() == defined_sym->get_name()) return false; // symbol is already defined in this scope
-	}
+	if (!syms.empty() && index[find_slot(sym->get_name())] >= 0)
+		return false; // symbol is already defined in this scope
 	// calculate offset in memory for arrays and records
-	const auto int_type = lookup("INTEGER")->get_type();
-	const auto char_type = lookup("CHAR")->get_type();
 	if (sym->get_kind() == VAR) {
-		int depth = 0;
-		get_depth(depth);
 		// the var should either be nested (in a record) or a non-primitive local variable
-		if (depth || (sym->get_type() != int_type && sym->get_type() != char_type)) {
+		if (depth || (sym->get_type() != get_int_type() && sym->get_type() != get_char_type())) {
 			sym->set_offset(current_offset);
 			current_offset += sym->get_type()->get_size();
 		}
@@ -57,17 +74,23 @@ bool SymbolTable::define(Symbol* sym) {
 		current_offset += sym->get_type()->get_size();
 	}
 	// add symbol
-	syms.push_back(sym);
+	insert(sym);
 	if (print_symbols) {
-		int depth = 0;
-		get_depth(depth);
-		std::cout << std::to_string(depth) + "," + sym->get_kind_name() + "," + sym->get_name() + "," + sym->get_type()
+		std::cout << std::to_string(depth) + "," + sym->get_kind_name() + "," + sym->get_name().str() + "," + sym->get_type()
 			->to_string() << '\n';
 	}
 	return true;
 }
 
-std::vector<Symbol*> SymbolTable::get_syms() const {
+Type* SymbolTable::get_int_type() const {
+	return types->get_int_type();
+}
+
+Type* SymbolTable::get_char_type() const {
+	return types->get_char_type();
+}
+
+const std::vector<Symbol*>& SymbolTable::get_syms() const {
 	return syms;
 }
 
@@ -5,23 +5,37 @@
 #include <string>
 
 class Symbol;
+class Type;
+class TypeContext;
 
+// A scope of symbols.  Each scope indexes its own symbols in an
+// open-addressing hash table keyed by interned Name, so define and lookup
+// take constant time per scope, while syms keeps the insertion order used
+// for record layouts and code generation.
 class SymbolTable {
 	std::vector<Symbol*> syms;
+	std::vector<int> index; // slot -> position in syms, or -1 if the slot is empty
 	SymbolTable* parent = nullptr;
 	bool print_symbols;
 	int current_offset;
+	int depth;
+	TypeContext* types; // owned by the root scope, shared by all nested scopes
 
-	void get_depth(int& counter);
+	int find_slot(Name name) const;
+	void insert(Symbol* sym);
+	void grow_index();
 
 public:
 	SymbolTable(SymbolTable* symtab);
 	SymbolTable(bool print_symbols);
 	~SymbolTable();
-	Symbol* lookup(const std::string& name) const;
+	Symbol* lookup(Name name) const;
 	bool define(Symbol* sym);
-	std::vector<Symbol*> get_syms() const;
+	const std::vector<Symbol*>& get_syms() const;
 	int get_offset() const;
+	TypeContext* get_types() const { return types; }
+	Type* get_int_type() const;
+	Type* get_char_type() const;
 };
 
 #endif // SYMTAB_H
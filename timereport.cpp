@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "timereport.h"
+
+namespace {
+
+thread_local TimeReport* t_current_report;
+thread_local uint64_t t_num_allocations;
+
+double wall_clock_us() {
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double thread_cpu_us() {
+	timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+	return double(ts.tv_sec) * 1e6 + double(ts.tv_nsec) / 1e3;
+}
+
+long peak_rss_kb() {
+	rusage usage;
+	return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+// a JSON string literal, for the names of phases
+std::string quote(const char* str) {
+	std::string quoted = "\"";
+	for (const char* p = str; *p; p++) {
+		if (*p == '"' || *p == '\\') quoted += '\\';
+		quoted += *p;
+	}
+	return quoted + "\"";
+}
+
+}
+
+////////////////////////////////////////////////////////////////////////
+// Allocation counting
+////////////////////////////////////////////////////////////////////////
+
+// The other forms of new and delete (arrays, nothrow) are implemented in
+// terms of these.
+
+// Like the standard operator new, this calls the new-handler (which may
+// free some memory) until malloc succeeds, and only throws if there is
+// none.
+void* operator new(size_t size) {
+	t_num_allocations++;
+	for (;;) {
+		if (void* p = std::malloc(size ? size : 1)) return p;
+		const std::new_handler handler = std::get_new_handler();
+		if (!handler) throw std::bad_alloc();
+		handler();
+	}
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	std::free(p);
+}
+
+uint64_t get_num_allocations() {
+	return t_num_allocations;
+}
+
+////////////////////////////////////////////////////////////////////////
+// TimeReport
+////////////////////////////////////////////////////////////////////////
+
+TimeReport::TimeReport(): m_origin_us(wall_clock_us()) {}
+
+TimeReport::~TimeReport() {
+	if (t_current_report == this) t_current_report = nullptr;
+}
+
+TimeReport* TimeReport::get_current() {
+	return t_current_report;
+}
+
+void TimeReport::set_current(TimeReport* report) {
+	t_current_report = report;
+}
+
+int TimeReport::begin(const char* name) {
+	Event event;
+	event.name = name;
+	event.parent = m_open.empty() ? -1 : m_open.back();
+	event.depth = int(m_open.size());
+	event.start_us = wall_clock_us() - m_origin_us;
+	event.wall_us = event.cpu_us = 0;
+	event.allocations = 0;
+	event.peak_rss_kb = 0;
+	m_events.push_back(event);
+	m_open.push_back(int(m_events.size()) - 1);
+	return m_open.back();
+}
+
+void TimeReport::end(int index, double cpu_start_us, uint64_t allocations_at_start) {
+	Event& event = m_events[index];
+	event.wall_us = wall_clock_us() - m_origin_us - event.start_us;
+	event.cpu_us = thread_cpu_us() - cpu_start_us;
+	event.allocations = t_num_allocations - allocations_at_start;
+	event.peak_rss_kb = peak_rss_kb();
+	m_open.pop_back();
+}
+
+void TimeReport::print(FILE* out) const {
+	// add up the events of each phase, keyed by the phase it ran in
+	struct Line {
+		const Event* first;
+		unsigned calls = 0;
+		double wall_us = 0, cpu_us = 0;
+		uint64_t allocations = 0;
+		long peak_rss_kb = 0;
+		std::vector<size_t> children;
+	};
+	std::vector<Line> lines;
+	std::vector<size_t> line_of_event(m_events.size());
+	std::map<std::pair<long, std::string>, size_t> line_index; // (parent line, name) -> line
+	std::vector<size_t> roots;
+	for (size_t i = 0; i < m_events.size(); i++) {
+		const Event& event = m_events[i];
+		const long parent_line = event.parent < 0 ? -1 : long(line_of_event[event.parent]);
+		const auto key = std::make_pair(parent_line, std::string(event.name));
+		auto it = line_index.find(key);
+		if (it == line_index.end()) {
+			it = line_index.insert(std::make_pair(key, lines.size())).first;
+			lines.emplace_back();
+			lines.back().first = &event;
+			if (parent_line < 0) roots.push_back(lines.size() - 1);
+			else lines[parent_line].children.push_back(lines.size() - 1);
+		}
+		Line& line = lines[it->second];
+		line.calls++;
+		line.wall_us += event.wall_us;
+		line.cpu_us += event.cpu_us;
+		line.allocations += event.allocations;
+		line.peak_rss_kb = std::max(line.peak_rss_kb, event.peak_rss_kb);
+		line_of_event[i] = it->second;
+	}
+
+	double total_wall_us = 0, total_cpu_us = 0;
+	uint64_t total_allocations = 0;
+	for (const size_t root : roots) {
+		total_wall_us += lines[root].wall_us;
+		total_cpu_us += lines[root].cpu_us;
+		total_allocations += lines[root].allocations;
+	}
+
+	fprintf(out, "%-36s %6s %11s %6s %11s %11s %12s\n", "phase", "calls", "wall ms", "%", "cpu ms", "allocs",
+	        "peak RSS MB");
+	// print a line and the lines under it, depth first
+	std::vector<std::pair<size_t, int>> stack;
+	for (auto it = roots.rbegin(); it != roots.rend(); ++it) stack.push_back(std::make_pair(*it, 0));
+	while (!stack.empty()) {
+		const size_t index = stack.back().first;
+		const int depth = stack.back().second;
+		stack.pop_back();
+		const Line& line = lines[index];
+		const std::string name = std::string(2 * depth, ' ') + line.first->name;
+		fprintf(out, "%-36s %6u %11.2f %6.1f %11.2f %11llu %12.1f\n", name.c_str(), line.calls, line.wall_us / 1000,
+		        total_wall_us > 0 ? 100 * line.wall_us / total_wall_us : 0.0, line.cpu_us / 1000,
+		        (unsigned long long) line.allocations, double(line.peak_rss_kb) / 1024);
+		for (auto it = line.children.rbegin(); it != line.children.rend(); ++it) {
+			stack.push_back(std::make_pair(*it, depth + 1));
+		}
+	}
+	fprintf(out, "%-36s %6s %11.2f %6.1f %11.2f %11llu %12.1f\n", "total", "", total_wall_us / 1000, 100.0,
+	        total_cpu_us / 1000, (unsigned long long) total_allocations, double(peak_rss_kb()) / 1024);
+}
+
+bool TimeReport::write_trace(const char* filename) const {
+	FILE* out = fopen(filename, "w");
+	if (!out) return false;
+	const long pid = long(getpid());
+	fprintf(out, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i < m_events.size(); i++) {
+		const Event& event = m_events[i];
+		fprintf(out, "{\"name\":%s,\"cat\":\"compile\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":1,"
+		        "\"args\":{\"cpu_ms\":%.3f,\"allocations\":%llu,\"peak_rss_kb\":%ld}}%s\n",
+		        quote(event.name).c_str(), event.start_us, event.wall_us, pid, event.cpu_us / 1000,
+		        (unsigned long long) event.allocations, event.peak_rss_kb, i + 1 < m_events.size() ? "," : "");
+	}
+	fprintf(out, "],\"displayTimeUnit\":\"ms\"}\n");
+	return fclose(out) == 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+// TimePhase
+////////////////////////////////////////////////////////////////////////
+
+TimePhase::TimePhase(const char* name): m_report(t_current_report), m_event(-1) {
+	if (!m_report) return;
+	m_event = m_report->begin(name);
+	m_allocations_at_start = t_num_allocations;
+	m_cpu_start_us = thread_cpu_us();
+}
+
+TimePhase::~TimePhase() {
+	if (m_report) m_report->end(m_event, m_cpu_start_us, m_allocations_at_start);
+}
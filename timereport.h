@@ -0,0 +1,81 @@
+#ifndef TIMEREPORT_H
+#define TIMEREPORT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// A record of where a compilation spends its time and memory (compiler
+// -T and -J).  Each phase of the compiler, and each optimization pass,
+// marks itself with a TimePhase, which records its wall and CPU time, the
+// number of heap allocations made with new during it, and the process's
+// peak resident set size when it ends into the thread's current
+// TimeReport, if it has one.  Phases nest, and a pass which runs many
+// times (LiveVregs, for example) gets an event each time it runs.
+class TimeReport {
+public:
+	struct Event {
+		const char* name;
+		int parent;          // index of the enclosing event, or -1
+		int depth;
+		double start_us;     // since the report was created
+		double wall_us;
+		double cpu_us;       // this thread's CPU time
+		uint64_t allocations;
+		long peak_rss_kb;
+	};
+
+private:
+	std::vector<Event> m_events;
+	std::vector<int> m_open; // the events which haven't ended, innermost last
+	double m_origin_us;
+
+	// copy ctor and assignment operator disallowed
+	TimeReport(const TimeReport&);
+	TimeReport& operator=(const TimeReport&);
+
+public:
+	TimeReport();
+	~TimeReport();
+
+	// the report the calling thread's phases are recorded in (or null)
+	static TimeReport* get_current();
+	static void set_current(TimeReport* report);
+
+	int begin(const char* name);
+	void end(int event, double cpu_start_us, uint64_t allocations_at_start);
+
+	const std::vector<Event>& get_events() const { return m_events; }
+
+	// Print a table with a line for each phase, indented under the phase
+	// it ran in; the events of a phase which ran more than once in the
+	// same place are added up on one line.
+	void print(FILE* out) const;
+
+	// Write the events as a Chrome trace (for chrome://tracing or
+	// Perfetto), returning false if the file can't be written.
+	bool write_trace(const char* filename) const;
+};
+
+// Marks a scope as a phase of the current TimeReport.  The name must be a
+// string literal (or otherwise outlive the report).
+class TimePhase {
+	TimeReport* m_report;
+	int m_event;
+	double m_cpu_start_us;
+	uint64_t m_allocations_at_start;
+
+	// copy ctor and assignment operator disallowed
+	TimePhase(const TimePhase&);
+	TimePhase& operator=(const TimePhase&);
+
+public:
+	explicit TimePhase(const char* name);
+	~TimePhase();
+};
+
+// the number of allocations the calling thread has made with new
+uint64_t get_num_allocations();
+
+#endif // TIMEREPORT_H
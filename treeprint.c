@@ -1,19 +1,30 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include "util.h"
 #include "node.h"
 #include "treeprint.h"
 
-#define MAX_DEPTH 4096
-
+// The tree is printed in preorder with an explicit stack, one level per
+// level of the tree, so arbitrarily deep trees can be printed.
 struct TreePrintContext {
   int stack_depth;
-  int index[MAX_DEPTH];
-  int nsibs[MAX_DEPTH];
+  int capacity;
+  int *index;
+  int *nsibs;
+  struct Node **parent;
 };
 
-static void pushctx(struct TreePrintContext *ctx, int nsibs) {
+static void pushctx(struct TreePrintContext *ctx, struct Node *parent, int nsibs) {
   int level = ctx->stack_depth;
+  if (level == ctx->capacity) {
+    ctx->capacity = ctx->capacity ? ctx->capacity * 2 : 64;
+    ctx->index = xrealloc(ctx->index, ctx->capacity * sizeof(int));
+    ctx->nsibs = xrealloc(ctx->nsibs, ctx->capacity * sizeof(int));
+    ctx->parent = xrealloc(ctx->parent, ctx->capacity * sizeof(struct Node *));
+  }
   ctx->index[level] = 0;
   ctx->nsibs[level] = nsibs;
+  ctx->parent[level] = parent;
   ctx->stack_depth++;
 }
 
@@ -47,17 +58,22 @@ static void print_node(struct Node *n, struct TreePrintContext *ctx, const char
   printf("\n");
   ctx->index[depth-1]++;
 
-  int nkids = node_get_num_kids(n);
-  pushctx(ctx, nkids);
-  for (int i = 0; i < nkids; i++) {
-    print_node(node_get_kid(n, i), ctx, node_tag_to_str_fn);
-  }
-  popctx(ctx);
+  pushctx(ctx, n, node_get_num_kids(n));
 }
 
 void treeprint(struct Node *root, const char *(*node_tag_to_str_fn)(int)) {
-  struct TreePrintContext ctx;
-  ctx.stack_depth = 0;
-  pushctx(&ctx, 1);
+  struct TreePrintContext ctx = { 0, 0, NULL, NULL, NULL };
+  pushctx(&ctx, NULL, 1);
   print_node(root, &ctx, node_tag_to_str_fn);
+  while (ctx.stack_depth > 1) {
+    int level = ctx.stack_depth - 1;
+    if (ctx.index[level] < ctx.nsibs[level]) {
+      print_node(node_get_kid(ctx.parent[level], ctx.index[level]), &ctx, node_tag_to_str_fn);
+    } else {
+      popctx(&ctx);
+    }
+  }
+  free(ctx.index);
+  free(ctx.nsibs);
+  free(ctx.parent);
 }
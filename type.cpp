@@ -6,7 +6,7 @@
 // PrimitiveType //
 ///////////////////
 
-PrimitiveType::PrimitiveType(const std::string& name, int size): name(name), size(size) {}
+PrimitiveType::PrimitiveType(const std::string& name, int size): Type(size), name(name) {}
 
 PrimitiveType::~PrimitiveType() = default;
 
@@ -14,16 +14,12 @@ std::string PrimitiveType::to_string() {
 	return name;
 }
 
-int PrimitiveType::get_size() {
-	return size;
-}
-
 ///////////////
 // ArrayType //
 ///////////////
 
-ArrayType::ArrayType(Type* type, int num_elements): type(type), num_elements(num_elements),
-                                                    size(type->get_size() * num_elements) {}
+ArrayType::ArrayType(Type* type, int num_elements): Type(type->get_size() * num_elements), type(type),
+                                                    num_elements(num_elements) {}
 
 ArrayType::~ArrayType() = default;
 
@@ -35,22 +31,25 @@ std::string ArrayType::to_string() {
 	return "ARRAY " + std::to_string(num_elements) + " OF " + type->to_string();
 }
 
-int ArrayType::get_size() {
-	return size;
+int ArrayType::get_num_elements() const {
+	return num_elements;
 }
 
 ////////////////
 // RecordType //
 ////////////////
 
-RecordField::RecordField(Type* type, const std::string& name): type(type), name(name) {}
+RecordField::RecordField(Type* type, Name name): type(type), name(name) {}
 
-RecordType::RecordType(const std::vector<RecordField*>& fields, SymbolTable* symtab): fields(fields),
-	size(symtab->get_offset()), symtab(symtab) {}
+RecordType::RecordType(const std::vector<RecordField*>& fields, SymbolTable* symtab): Type(symtab->get_offset()),
+	fields(fields), symtab(symtab) {}
 
-RecordType::~RecordType() = default;
+RecordType::~RecordType() {
+	for (const auto field : fields) delete field;
+	delete symtab;
+}
 
-Type* RecordType::get_field(const std::string& name) {
+Type* RecordType::get_field(Name name) {
 	for (const auto field : fields) {
 		if (name == field->name) return field->type;
 	}
@@ -67,10 +66,69 @@ std::string RecordType::to_string() {
 	return out;
 }
 
-int RecordType::get_size() {
-	return size;
-}
-
 SymbolTable* RecordType::get_symtab() {
 	return symtab;
 }
+
+/////////////////
+// TypeContext //
+/////////////////
+
+namespace {
+
+size_t hash_combine(size_t seed, size_t value) {
+	return seed ^ (value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+}
+
+}
+
+bool TypeContext::ArrayKey::operator==(const ArrayKey& other) const {
+	return type == other.type && num_elements == other.num_elements;
+}
+
+bool TypeContext::RecordKey::operator==(const RecordKey& other) const {
+	return fields == other.fields;
+}
+
+size_t TypeContext::KeyHash::operator()(const ArrayKey& key) const {
+	return hash_combine(std::hash<Type*>()(key.type), key.num_elements);
+}
+
+size_t TypeContext::KeyHash::operator()(const RecordKey& key) const {
+	size_t seed = key.fields.size();
+	for (const auto& field : key.fields) {
+		seed = hash_combine(seed, field.first.hash());
+		seed = hash_combine(seed, std::hash<Type*>()(field.second));
+	}
+	return seed;
+}
+
+TypeContext::TypeContext(): int_type(new PrimitiveType("INTEGER", 8)), char_type(new PrimitiveType("CHAR", 1)) {}
+
+TypeContext::~TypeContext() {
+	for (const auto& entry : arrays) delete entry.second;
+	for (const auto& entry : records) delete entry.second;
+	delete int_type;
+	delete char_type;
+}
+
+Type* TypeContext::get_array_type(Type* type, int num_elements) {
+	auto& array_type = arrays[ArrayKey{type, num_elements}];
+	if (!array_type) array_type = new ArrayType(type, num_elements);
+	return array_type;
+}
+
+Type* TypeContext::get_record_type(SymbolTable* record_symtab) {
+	RecordKey key;
+	const auto& syms = record_symtab->get_syms();
+	key.fields.reserve(syms.size());
+	for (const auto sym : syms) key.fields.emplace_back(sym->get_name(), sym->get_type());
+	auto& record_type = records[key];
+	if (!record_type) {
+		std::vector<RecordField*> fields;
+		fields.reserve(syms.size());
+		for (const auto sym : syms) fields.push_back(new RecordField(sym->get_type(), sym->get_name()));
+		record_type = new RecordType(fields, record_symtab);
+	}
+	return record_type;
+}
@@ -2,14 +2,24 @@
 #define TYPE_H
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include "name.h"
 #include "symtab.h"
 
 class SymbolTable;
 
+// Types are created by a TypeContext, which interns them, so two types
+// are the same exactly when they are the same object.
 class Type {
+protected:
+	int size; // in bytes
+
+	Type(int size): size(size) {}
+
 public:
+	virtual ~Type() = default;
 	virtual std::string to_string() = 0;
-	virtual int get_size() = 0;
+	int get_size() const { return size; }
 };
 
 ///////////////////
@@ -18,13 +28,11 @@ public:
 
 class PrimitiveType : public Type {
 	std::string name;
-	int size; // in bytes
 
 public:
 	PrimitiveType(const std::string& name, int size);
 	~PrimitiveType();
 	std::string to_string() override;
-	int get_size() override;
 };
 
 ///////////////
@@ -34,14 +42,13 @@ public:
 class ArrayType : public Type {
 	Type* type;
 	int num_elements;
-	int size; // in bytes
 
 public:
 	ArrayType(Type* type, int num_elements);
 	~ArrayType();
 	Type* get_type();
+	int get_num_elements() const;
 	std::string to_string() override;
-	int get_size() override;
 };
 
 ////////////////
@@ -50,23 +57,70 @@ public:
 
 struct RecordField {
 	Type* type;
-	std::string name;
+	Name name;
 
-	RecordField(Type* type, const std::string& name);
+	RecordField(Type* type, Name name);
 };
 
 class RecordType : public Type {
 	std::vector<RecordField*> fields;
-	int size; // in bytes
-	SymbolTable* symtab;
+	SymbolTable* symtab; // owned: the scope of the fields
 
 public:
 	RecordType(const std::vector<RecordField*>& fields, SymbolTable* symtab);
 	~RecordType();
-	Type* get_field(const std::string& name);
+	Type* get_field(Name name);
 	std::string to_string() override;
-	int get_size() override;
 	SymbolTable* get_symtab();
 };
 
+/////////////////
+// TypeContext //
+/////////////////
+
+// Owns the types of a program and hash-conses the composite ones: an
+// array type is identified by its element type and number of elements,
+// and a record type by the names and types of its fields, in order.
+// Structurally identical types are therefore one object, so comparing
+// types stays a pointer compare, and their sizes are computed once.
+class TypeContext {
+	struct ArrayKey {
+		Type* type;
+		int num_elements;
+
+		bool operator==(const ArrayKey& other) const;
+	};
+
+	struct RecordKey {
+		std::vector<std::pair<Name, Type*>> fields;
+
+		bool operator==(const RecordKey& other) const;
+	};
+
+	struct KeyHash {
+		size_t operator()(const ArrayKey& key) const;
+		size_t operator()(const RecordKey& key) const;
+	};
+
+	PrimitiveType* int_type;
+	PrimitiveType* char_type;
+	std::unordered_map<ArrayKey, ArrayType*, KeyHash> arrays;
+	std::unordered_map<RecordKey, RecordType*, KeyHash> records;
+
+public:
+	TypeContext();
+	~TypeContext();
+
+	TypeContext(const TypeContext&) = delete;
+	TypeContext& operator=(const TypeContext&) = delete;
+
+	Type* get_int_type() const { return int_type; }
+	Type* get_char_type() const { return char_type; }
+	// returns the array type ARRAY num_elements OF type
+	Type* get_array_type(Type* type, int num_elements);
+	// returns the record type whose fields are the symbols of record_symtab;
+	// if an identical record type exists, record_symtab is left unused
+	Type* get_record_type(SymbolTable* record_symtab);
+};
+
 #endif // TYPE_H
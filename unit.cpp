@@ -0,0 +1,98 @@
+#include <cstdarg>
+#include "cpputil.h"
+#include "node.h"
+#include "scanner.h"
+#include "timereport.h"
+#include "unit.h"
+
+extern "C" {
+#include "parse.tab.h"
+
+// the flex scanner (lex.l)
+void* lexer_create(struct Unit* unit, struct SourceMap* source_map, char* buffer, size_t size);
+void lexer_destroy(void* lexer);
+int flex_yylex(YYSTYPE* lvalp, void* lexer);
+SourceLoc lexer_get_offset(void* lexer);
+}
+
+Unit::Unit(const std::string& filename)
+	: m_source_map(filename)
+	, m_arena(new Arena)
+	, m_owns_arena(true)
+	, m_names(*m_arena)
+	, m_root(nullptr)
+	, m_scanner(nullptr)
+	, m_lexer(nullptr) {
+}
+
+Unit::Unit(const std::string& filename, Arena* arena)
+	: m_source_map(filename)
+	, m_arena(arena)
+	, m_owns_arena(false)
+	, m_names(*m_arena)
+	, m_root(nullptr)
+	, m_scanner(nullptr)
+	, m_lexer(nullptr) {
+	m_arena->reset();
+}
+
+Unit::~Unit() {
+	if (m_owns_arena) delete m_arena;
+}
+
+bool Unit::read() {
+	TimePhase phase("read");
+	return m_source.open(m_source_map.get_filename().c_str());
+}
+
+bool Unit::parse(bool hand_written_scanner) {
+	TimePhase phase("parse");
+	Node::set_arena(m_arena);
+	Name::set_pool(&m_names);
+	if (hand_written_scanner) {
+		Scanner scanner(this, &m_source_map, m_source.get_text(), m_source.get_length());
+		m_scanner = &scanner;
+		yyparse(this);
+		m_scanner = nullptr;
+	}
+	else {
+		m_lexer = lexer_create(this, &m_source_map, m_source.get_buffer(), m_source.get_buffer_size());
+		yyparse(this);
+		lexer_destroy(m_lexer);
+		m_lexer = nullptr;
+	}
+	return !has_error();
+}
+
+void Unit::error(SourceLoc loc, const char* fmt, va_list args) {
+	if (has_error()) return;
+	const SourceInfo info = m_source_map.get_info(loc);
+	m_error = cpputil::format("%s:%d:%d: Error: ", info.filename, info.line, info.col) + cpputil::vformat(fmt, args);
+}
+
+int Unit::next_token(YYSTYPE* lvalp) {
+	return m_scanner ? m_scanner->next_token(lvalp) : flex_yylex(lvalp, m_lexer);
+}
+
+SourceLoc Unit::get_offset() const {
+	return m_scanner ? m_scanner->get_offset() : lexer_get_offset(m_lexer);
+}
+
+////////////////////////////////////////////////////////////////////////
+// C interface
+////////////////////////////////////////////////////////////////////////
+
+void unit_set_root(struct Unit* unit, struct Node* root) {
+	unit->set_root(root);
+}
+
+void unit_error(struct Unit* unit, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	unit->error(unit->get_offset(), fmt, args);
+	va_end(args);
+}
+
+extern "C" int yylex(YYSTYPE* lvalp, struct Unit* unit) {
+	return unit->next_token(lvalp);
+}
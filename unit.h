@@ -0,0 +1,98 @@
+#ifndef UNIT_H
+#define UNIT_H
+
+#include "srcloc.h"
+
+#ifdef __cplusplus
+
+#include <cstdarg>
+#include <string>
+#include "arena.h"
+#include "name.h"
+#include "sourcefile.h"
+
+struct Node;
+class Scanner;
+union YYSTYPE;
+
+// The front end's state for the compilation of one source file: its text,
+// its SourceMap, the Arena the AST is allocated from, the Name::Pool its
+// identifiers are interned in, the root of the AST and the first error
+// found.  The parser and both scanners keep all of
+// their state in a Unit (or in scanner state it owns), so any number of
+// Units can be parsed at once, each on its own thread.
+struct Unit {
+private:
+	SourceFile m_source;
+	SourceMap m_source_map;
+	Arena* m_arena;
+	bool m_owns_arena;
+	Name::Pool m_names;
+	Node* m_root;
+	std::string m_error;
+	// the scanner yylex reads from while parsing: either a Scanner or a
+	// flex scanner (a yyscan_t)
+	Scanner* m_scanner;
+	void* m_lexer;
+
+	// copy ctor and assignment operator disallowed
+	Unit(const Unit&);
+	Unit& operator=(const Unit&);
+
+public:
+	explicit Unit(const std::string& filename);
+	// a Unit whose AST is allocated from an existing Arena, which is reset
+	// first: a thread compiling one Unit after another can keep reusing
+	// the same warm blocks
+	Unit(const std::string& filename, Arena* arena);
+	~Unit();
+
+	// map or read the source file, returning false if it can't be read
+	bool read();
+
+	// the source text, for a Unit whose text isn't read from the file
+	// named by its filename (see SourceFile::allocate)
+	SourceFile& get_source() { return m_source; }
+
+	// Parse the source text with the hand-written scanner or the flex
+	// scanner, returning false (with an error message) if it isn't a
+	// well-formed program.  The AST is allocated from the Unit's Arena,
+	// which is installed as the calling thread's Node arena, and its
+	// identifiers are interned in the Unit's Name::Pool, which is
+	// installed as the thread's Name pool.
+	bool parse(bool hand_written_scanner);
+
+	Node* get_root() const { return m_root; }
+	void set_root(Node* root) { m_root = root; }
+	Arena* get_arena() const { return m_arena; }
+	const SourceMap& get_source_map() const { return m_source_map; }
+
+	bool has_error() const { return !m_error.empty(); }
+	// "file:line:col: Error: message"
+	const std::string& get_error() const { return m_error; }
+	// record an error at the given location, unless there already is one
+	void error(SourceLoc loc, const char* fmt, va_list args);
+
+	// the next token, for yylex
+	int next_token(YYSTYPE* lvalp);
+	// the offset of the end of the text scanned so far
+	SourceLoc get_offset() const;
+};
+
+extern "C" {
+#endif // __cplusplus
+
+// C interface for the parser and the flex scanner.
+
+struct Unit;
+
+void unit_set_root(struct Unit* unit, struct Node* root);
+
+// Record an error at the end of the text scanned so far.
+void unit_error(struct Unit* unit, const char* fmt, ...);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UNIT_H
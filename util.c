@@ -12,6 +12,14 @@ void *xmalloc(size_t n) {
   return buf;
 }
 
+void *xrealloc(void *p, size_t n) {
+  void *buf = realloc(p, n);
+  if (!buf) {
+    err_fatal("Allocation of %lu bytes failed", (unsigned long) n);
+  }
+  return buf;
+}
+
 char *xstrdup(const char *s) {
   size_t slen = strlen(s);
   char *buf = xmalloc(slen + 1);
@@ -19,6 +19,7 @@ extern "C" {
 /* Memory allocation (fatal error if allocation fails) */
 
 void *xmalloc(size_t n);
+void *xrealloc(void *p, size_t n);
 char *xstrdup(const char *s);
 
 /* Error handling */
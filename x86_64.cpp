@@ -24,7 +24,13 @@ std::string PrintX86_64InstructionSequence::get_opcode_name(int opcode) {
 	case MINS_IMULQ: return "imulq";
 	case MINS_IDIVQ: return "idivq";
 	case MINS_CQTO: return "cqto";
+	case MINS_NEGQ: return "negq";
+	case MINS_PUSHQ: return "pushq";
+	case MINS_POPQ: return "popq";
 	case MINS_RET: return "ret";
+	case MINS_SARQ: return "sarq";
+	case MINS_SHLQ: return "shlq";
+	case MINS_SHRQ: return "shrq";
 	default:
 		assert(false);
 		s = "<invalid>";
@@ -40,7 +40,13 @@ enum X86_64Instruction {
 	MINS_IMULQ,
 	MINS_IDIVQ,
 	MINS_CQTO,
-	MINS_RET
+	MINS_NEGQ,
+	MINS_PUSHQ,
+	MINS_POPQ,
+	MINS_RET,
+	MINS_SARQ,
+	MINS_SHLQ,
+	MINS_SHRQ
 };
 
 class PrintX86_64InstructionSequence : public PrintInstructionSequence {